@@ -0,0 +1,143 @@
+/*
+ * back_projection_benchmark.cpp
+ *
+ *     Authors: Gregory Kramida
+ *     License: Apache v. 2
+ *   Copyright: (c) Gregory Kramida 2015
+ *
+ *  Compares the per-pixel Eigen back-projection of Kinect v2 depth images (cvDepth32F2pclCloudColor)
+ *  to the ray-table-based utils::depth_back_projector.
+ */
+
+//standard
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+//opencv
+#include <opencv2/core/core.hpp>
+
+//pcl
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+
+//local
+#include <reco/alex/pcl_cv_conversions.hpp>
+#include <reco/utils/depth_back_projector.h>
+
+#define DEPTH_WIDTH 512
+#define DEPTH_HEIGHT 424
+#define NUM_ITERATIONS 200
+//fraction of pixels with no depth reading, roughly what the Kinect v2 produces indoors
+#define INVALID_FRACTION 0.15
+
+typedef std::chrono::high_resolution_clock benchmark_clock;
+
+/**
+ * Generate a depth image with a smooth surface, in mm, with randomly-scattered invalid pixels
+ */
+cv::Mat generate_depth_image() {
+	cv::Mat depth(DEPTH_HEIGHT, DEPTH_WIDTH, CV_32F);
+	std::mt19937 generator(42);
+	std::uniform_real_distribution<float> distribution(0.0F, 1.0F);
+	for (int row = 0; row < depth.rows; row++) {
+		float* depth_row = depth.ptr<float>(row);
+		for (int col = 0; col < depth.cols; col++) {
+			depth_row[col] = distribution(generator) < INVALID_FRACTION ?
+					0.0F : 1500.0F + 500.0F * std::sin(col * 0.01F) * std::cos(row * 0.01F);
+		}
+	}
+	return depth;
+}
+
+int main(int argc, char* argv[]) {
+	cv::Mat depth = generate_depth_image();
+	cv::Mat K = cv::Mat::eye(3, 3, CV_32F);
+	K.at<float>(0, 0) = 365.0F;
+	K.at<float>(1, 1) = 365.0F;
+	K.at<float>(0, 2) = DEPTH_WIDTH / 2.0F - 0.5F;
+	K.at<float>(1, 2) = DEPTH_HEIGHT / 2.0F - 0.5F;
+	Eigen::Matrix<float, 3, 3> R(Eigen::AngleAxisf(0.3F, Eigen::Vector3f(0.2F, 1.0F, 0.1F).normalized()));
+	Eigen::Vector3f T(0.5F, -0.1F, 0.2F);
+	uint32_t rgb = 0x00ff0000;
+
+	//----------------------------------------------------------------------------
+	// Per-pixel Eigen path
+	//----------------------------------------------------------------------------
+	pcl::PointCloud<pcl::PointXYZRGB> cloud_reference;
+	benchmark_clock::time_point start = benchmark_clock::now();
+	for (int i_iteration = 0; i_iteration < NUM_ITERATIONS; i_iteration++) {
+		cloud_reference.clear();
+		pcl::cvDepth32F2pclCloudColor(depth, K, R, T, cloud_reference, rgb);
+	}
+	double reference_ms = std::chrono::duration<double, std::milli>(benchmark_clock::now() - start).count()
+			/ NUM_ITERATIONS;
+
+	//----------------------------------------------------------------------------
+	// Ray table path
+	//----------------------------------------------------------------------------
+	start = benchmark_clock::now();
+	Eigen::Matrix<float, 3, 3, Eigen::RowMajor> rotation = R;
+	reco::utils::depth_back_projector back_projector(DEPTH_WIDTH, DEPTH_HEIGHT,
+			K.at<float>(0, 0), K.at<float>(1, 1), K.at<float>(0, 2), K.at<float>(1, 2),
+			rotation.data(), T.data());
+	double table_ms = std::chrono::duration<double, std::milli>(benchmark_clock::now() - start).count();
+
+	std::vector<float> x(depth.total()), y(depth.total()), z(depth.total());
+	size_t num_points = 0;
+	start = benchmark_clock::now();
+	for (int i_iteration = 0; i_iteration < NUM_ITERATIONS; i_iteration++) {
+		num_points = back_projector.back_project(depth.ptr<float>(0), depth.step1(), x.data(), y.data(),
+				z.data());
+	}
+	double kernel_ms = std::chrono::duration<double, std::milli>(benchmark_clock::now() - start).count()
+			/ NUM_ITERATIONS;
+
+	pcl::PointCloud<pcl::PointXYZRGB> cloud;
+	const float rgb_f = *reinterpret_cast<float*>(&rgb);
+	start = benchmark_clock::now();
+	for (int i_iteration = 0; i_iteration < NUM_ITERATIONS; i_iteration++) {
+		num_points = back_projector.back_project(depth.ptr<float>(0), depth.step1(), x.data(), y.data(),
+				z.data());
+		cloud.resize(num_points);
+		for (size_t i_point = 0; i_point < num_points; i_point++) {
+			pcl::PointXYZRGB& point = cloud.points[i_point];
+			point.x = x[i_point];
+			point.y = y[i_point];
+			point.z = z[i_point];
+			point.rgb = rgb_f;
+		}
+	}
+	double cloud_ms = std::chrono::duration<double, std::milli>(benchmark_clock::now() - start).count()
+			/ NUM_ITERATIONS;
+
+	//----------------------------------------------------------------------------
+	// Check results agree on valid pixels
+	//----------------------------------------------------------------------------
+	float max_error = 0.0F;
+	size_t i_point = 0;
+	for (size_t i_pixel = 0; i_pixel < cloud_reference.size(); i_pixel++) {
+		if (depth.ptr<float>(0)[i_pixel] > 0.0F) {
+			const pcl::PointXYZRGB& a = cloud_reference.points[i_pixel];
+			const pcl::PointXYZRGB& b = cloud.points[i_point++];
+			max_error = std::max(max_error,
+					std::abs(a.x - b.x) + std::abs(a.y - b.y) + std::abs(a.z - b.z));
+		}
+	}
+
+	std::cout << "Depth image: " << DEPTH_WIDTH << "x" << DEPTH_HEIGHT << ", " << num_points
+			<< " valid points, " << NUM_ITERATIONS << " iterations" << std::endl;
+	std::cout << "cvDepth32F2pclCloudColor:          " << reference_ms << " ms/frame" << std::endl;
+	std::cout << "depth_back_projector table build:  " << table_ms << " ms (once per camera)"
+			<< std::endl;
+	std::cout << "depth_back_projector ("
+			<< reco::utils::depth_back_projector::get_instruction_set() << ") kernel: "
+			<< kernel_ms << " ms/frame" << std::endl;
+	std::cout << "depth_back_projector + PCL cloud:  " << cloud_ms << " ms/frame, "
+			<< reference_ms / cloud_ms << "x speedup" << std::endl;
+	std::cout << "Max. abs. difference (m):          " << max_error << std::endl;
+	return 0;
+}
@@ -4,6 +4,8 @@
 #include <reco/segmentation/quickshift_common.h>
 #include <reco/segmentation/exception.h>
 #include <reco/segmentation/image.h>
+#include <reco/segmentation/superpixels.h>
+#include <reco/segmentation/quickshift_stream.h>
 #include <reco/utils/cpp_exception_util.h>
 #include <reco/utils/debug_util.h>
 
@@ -11,9 +13,12 @@
 #include <boost/filesystem.hpp>
 
 #include <opencv2/imgcodecs.hpp>
+#include <opencv2/videoio.hpp>
 
 #include <chrono>
 #include <fstream>
+#include <string>
+#include <vector>
 
 void write_image(image_t im, const char * filename) {
 	/********** Copy from matlab style **********/
@@ -36,136 +41,67 @@ void write_image(image_t im, const char * filename) {
 	ofs << IMGOUT;
 }
 
-void imseg_cv(const cv::Mat& orig, cv::Mat& out, int * flatmap) {
-	/********** Mean Color **********/
-	int layer_size = orig.rows * orig.cols;
-	if (out.empty()) {
-		out = cv::Mat(orig.size(), orig.type());
-	} else if (out.rows != orig.rows || out.cols != orig.cols || out.type() != orig.type()) {
-		err2(std::invalid_argument, "Output matrix type or size not matching the input matrix.");
-	}
-	float * counts = (float *) calloc(layer_size, sizeof(float));
-	if (orig.type() != CV_32F && orig.type() != CV_32FC3) {
-		err2(std::invalid_argument, "Expecting a continous matrix of type CV_32F or CV_32FC3");
-	}
-
-	//cv::Mat meancolor = cv::Mat(orig.size(), orig.type());
-	cv::Mat meancolor = cv::Mat::zeros(orig.size(), orig.type());
-
-	const float* data = orig.ptr<float>();
-	float* meancolor_data = reinterpret_cast<float*>(meancolor.data);
-	float* out_data = reinterpret_cast<float*>(out.data);
-	int n_channels = orig.channels();
-
-	for (int p = 0; p < layer_size; p++) {
-		counts[flatmap[p]]++;
-		for (int k = 0; k < orig.channels(); k++){
-			meancolor_data[flatmap[p]*n_channels + k] += data[p*n_channels+k];
-		}
-	}
-
-	int roots = 0;
-	for (int p = 0; p < layer_size; p++) {
-		if (flatmap[p] == p){
-			roots++;
-		}
-	}
-	printf("Roots: %d\n", roots);
-
-	int nonzero = 0;
-	for (int p = 0; p < layer_size; p++) {
-		if (counts[p] > 0) {
-			nonzero++;
-			for (int k = 0; k < orig.channels(); k++){
-				meancolor_data[p*n_channels + k] /= counts[p];
-			}
-		}
-	}
-	if (roots != nonzero)
-		printf("Nonzero: %d\n", nonzero);
-	assert(roots == nonzero);
-	/********** Create output image **********/
-	for (int p = 0; p < layer_size; p++) {
-		counts[flatmap[p]]++;
-		for (int k = 0; k < orig.channels(); k++){
-			out_data[p*n_channels+k] = meancolor_data[flatmap[p]*n_channels + k];
-		}
+/**
+ * Insert the given tau into an output file name, before the extension
+ * @param path output path
+ * @param tau tau value
+ * @return modified path
+ */
+std::string append_tau(const std::string& path, float tau) {
+	char suffix[64];
+	sprintf(suffix, "-tau%g", tau);
+	size_t extension_start = path.rfind('.');
+	if (extension_start == std::string::npos || path.find('/', extension_start) != std::string::npos) {
+		return path + suffix;
 	}
-	free(counts);
-}
-
-image_t imseg(image_t im, int * flatmap) {
-	/********** Mean Color **********/
-	float * meancolor = (float *) calloc(im.N1 * im.N2 * im.K, sizeof(float));
-	float * counts = (float *) calloc(im.N1 * im.N2, sizeof(float));
-
-	for (int p = 0; p < im.N1 * im.N2; p++) {
-		counts[flatmap[p]]++;
-		for (int k = 0; k < im.K; k++)
-			meancolor[flatmap[p] + k * im.N1 * im.N2] += im.I[p + k * im.N1 * im.N2];
-	}
-
-	int roots = 0;
-	for (int p = 0; p < im.N1 * im.N2; p++)
-			{
-		if (flatmap[p] == p)
-			roots++;
-	}
-	printf("Roots: %d\n", roots);
-
-	int nonzero = 0;
-	for (int p = 0; p < im.N1 * im.N2; p++){
-		if (counts[p] > 0){
-			nonzero++;
-			for (int k = 0; k < im.K; k++){
-				meancolor[p + k * im.N1 * im.N2] /= counts[p];
-			}
-		}
-	}
-	if (roots != nonzero)
-		printf("Nonzero: %d\n", nonzero);
-	assert(roots == nonzero);
-
-	/********** Create output image **********/
-	image_t imout = im;
-	imout.I = (float *) calloc(im.N1 * im.N2 * im.K, sizeof(float));
-	for (int p = 0; p < im.N1 * im.N2; p++)
-		for (int k = 0; k < im.K; k++)
-			imout.I[p + k * im.N1 * im.N2] = meancolor[flatmap[p] + k * im.N1 * im.N2];
-
-	free(meancolor);
-	free(counts);
-
-	return imout;
+	return path.substr(0, extension_start) + suffix + path.substr(extension_start);
 }
 
 /**
- * Generate a flat cluster map from a neighbor map
- * @param map - neighbor map, where each pixel indicates one of the neighbors in its cluster
- * @param size - total size of the neighbor map
- * @return
+ * Segment every frame of a video on the CPU, reusing the results of the earlier frames wherever
+ * the scene is static
+ * @param file input video
+ * @param out_path output video with mean superpixel colors, none if empty
+ * @param sigma sigma parameter for quickshift
+ * @param tau tau parameter for quickshift
+ * @param load_factor scale to apply to the pixel values
+ * @return exit code
  */
-int * map_to_flatmap(float * map, unsigned int size) {
-	/********** Flatmap **********/
-	int *flatmap = (int *) malloc(size * sizeof(int));
-	for (unsigned int p = 0; p < size; p++){
-		flatmap[p] = map[p];
+int segment_video(const std::string& file, const std::string& out_path, float sigma, float tau,
+		float load_factor) {
+	cv::VideoCapture capture(file);
+	if (!capture.isOpened()) {
+		std::cerr << "ERROR: could not open video " << file << std::endl;
+		return -1;
 	}
-
-	bool changed = true;
-	while (changed){
-		changed = false;
-		for (unsigned int p = 0; p < size; p++){
-			changed = changed || (flatmap[p] != flatmap[flatmap[p]]);
-			flatmap[p] = flatmap[flatmap[p]];
+	double fps = capture.get(cv::CAP_PROP_FPS);
+	if (fps <= 0.0) {
+		fps = 30.0;
+	}
+	reco::segmentation::quickshift_stream stream(sigma, tau);
+	cv::VideoWriter writer;
+	cv::Mat frame, frame_float, out, out_tmp;
+	for (int i_frame = 0; capture.read(frame); i_frame++) {
+		frame.convertTo(frame_float, frame.channels() == 1 ? CV_32F : CV_32FC3, load_factor);
+
+		std::chrono::time_point<std::chrono::system_clock> start = std::chrono::system_clock::now();
+		stream.process(frame_float);
+		std::chrono::duration<double> seconds = std::chrono::system_clock::now() - start;
+		printf("Frame %d: %d superpixels, %.0f%% recomputed, time: %f s\n", i_frame,
+				(int) stream.get_superpixels().size(), stream.get_recomputed_fraction() * 100.0F,
+				seconds.count());
+
+		if (out_path != "") {
+			reco::segmentation::paint_mean_colors(stream.get_superpixels(), out);
+			out.convertTo(out_tmp, frame.type(), 1.0 / load_factor);
+			if (!writer.isOpened()) {
+				writer.open(out_path, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), fps, out_tmp.size(),
+						out_tmp.channels() == 3);
+			}
+			writer.write(out_tmp);
 		}
 	}
-
-	/* Consistency check */
-	for (unsigned int p = 0; p < size; p++)
-		assert(flatmap[p] == flatmap[flatmap[p]]);
-
-	return flatmap;
+	return 0;
 }
 
 void image_to_matlab(Image & IMG, image_t & im){
@@ -197,6 +133,8 @@ int main(int argc, char ** argv) {
 	std::string mode;
 	std::string out_path;
 	bool use_cv;
+	bool stream_video;
+	std::vector<float> sweep_taus;
 	po::variables_map vm;
 	po::options_description regular_options("Options");
 	regular_options.add_options()
@@ -208,7 +146,12 @@ int main(int argc, char ** argv) {
 	("device,d", po::value<int>(&device)->default_value(-1),
 			"Device. Default: device with max. Gflops.")
 	("output,o", po::value<string>(&out_path)->default_value(""), "Output path.")
-	("cv", po::bool_switch(&use_cv)->default_value(false), "use OpenCV");
+	("cv", po::bool_switch(&use_cv)->default_value(false), "use OpenCV")
+	("sweep", po::value<std::vector<float>>(&sweep_taus)->multitoken(),
+			"Additional (smaller) tau values to segment with, all taken from the run at --tau.")
+	("stream", po::bool_switch(&stream_video)->default_value(false),
+			"Treat the input file as a video and segment it frame by frame on the CPU, reusing the "
+			"results of earlier frames where the scene is static.");
 
 	try {
 		po::store(po::command_line_parser(argc, argv)
@@ -229,6 +172,19 @@ int main(int argc, char ** argv) {
 		std::cerr << regular_options << std::endl;
 		return -2;
 	}
+	for (float sweep_tau : sweep_taus) {
+		if (sweep_tau > tau) {
+			std::cerr << "ERROR: sweep tau values cannot exceed --tau, the forest has no longer links."
+					<< std::endl;
+			return -2;
+		}
+	}
+
+	//const float load_factor = 1.0;
+	const float load_factor = 32.0 / 255.0;
+	if (stream_video) {
+		return segment_video(file, out_path, sigma, tau, load_factor);
+	}
 
 	//Use command-line specified CUDA device, otherwise use device with highest Gflops/s
 	if (device > -1) {
@@ -246,8 +202,6 @@ int main(int argc, char ** argv) {
 	int width, height;
 	image_t im;
 	cv::Mat img;
-	//const float load_factor = 1.0;
-	const float load_factor = 32.0 / 255.0;
 	const float save_factor = 1.0 / load_factor;
 	if (use_cv) {
 		cv::Mat tmp;
@@ -279,7 +233,7 @@ int main(int argc, char ** argv) {
 	start_total = std::chrono::system_clock::now();
 	/********** CUDA setup **********/
 	float *map, *E, *gaps;
-	int * flatmap;
+	std::vector<reco::segmentation::superpixel_table> superpixels;
 	image_t imout;
 
 	map = (float *) calloc(width * height, sizeof(float));
@@ -315,7 +269,15 @@ int main(int argc, char ** argv) {
 			if (map[p] == p)
 				assert(gaps[p] == INF);
 
-		flatmap = map_to_flatmap(map, width * height);
+		//the sweep taus come almost for free: all cuts are taken from the forest computed at tau
+		std::vector<float> taus(1, tau);
+		taus.insert(taus.end(), sweep_taus.begin(), sweep_taus.end());
+		if (use_cv) {
+			reco::segmentation::compute_superpixels(map, gaps, taus, img, superpixels);
+		} else {
+			reco::segmentation::compute_superpixels(map, gaps, taus, im.I, im.N1, im.N2, im.K,
+					reco::segmentation::PLANAR, superpixels);
+		}
 
 		/*Output file name*/
 		sprintf(outfile, "%s", file.c_str());
@@ -324,32 +286,34 @@ int main(int argc, char ** argv) {
 			*c = '\0';
 		sprintf(outfile, "%s-%s.pnm", outfile, modes[m].c_str());
 
-		if (use_cv) {
-			cv::Mat out, out_tmp;
-			imseg_cv(img, out, flatmap);
-			if (out.channels() == 1) {
-				out.convertTo(out_tmp, CV_8UC1, save_factor);
-			} else {						//assume 3 channels
-				out.convertTo(out_tmp, CV_8UC3, save_factor);
+		for (size_t i_tau = 0; i_tau < taus.size(); i_tau++) {
+			printf("Tau: %g, roots: %d\n", taus[i_tau], (int) superpixels[i_tau].size());
+			std::string tau_out_path = out_path != "" ? out_path : std::string(outfile);
+			if (i_tau > 0) {
+				tau_out_path = append_tau(tau_out_path, taus[i_tau]);
 			}
-			if (out_path != "") {
-				cv::imwrite(out_path.c_str(), out_tmp);
-			} else {
-				cv::imwrite(outfile, out_tmp);
-			}
-		} else {
-			imout = imseg(im, flatmap);
-			if (out_path != "") {
-				write_image(imout, out_path.c_str());
+			if (use_cv) {
+				cv::Mat out, out_tmp;
+				reco::segmentation::paint_mean_colors(superpixels[i_tau], out);
+				if (out.channels() == 1) {
+					out.convertTo(out_tmp, CV_8UC1, save_factor);
+				} else {						//assume 3 channels
+					out.convertTo(out_tmp, CV_8UC3, save_factor);
+				}
+				cv::imwrite(tau_out_path, out_tmp);
 			} else {
-				write_image(imout, outfile);
+				imout = im;
+				imout.I = (float *) calloc(im.N1 * im.N2 * im.K, sizeof(float));
+				reco::segmentation::paint_mean_colors(superpixels[i_tau], reco::segmentation::PLANAR,
+						imout.I);
+				write_image(imout, tau_out_path.c_str());
+				free(imout.I);
 			}
-			free(imout.I);
+		}
+		if (!use_cv) {
 			free(im.I);
 		}
 
-		free(flatmap);
-
 		std::chrono::duration<double> mode_seconds = end_dev - start_dev;
 		printf("Time: %f s\n\n\n", mode_seconds.count());
 	}
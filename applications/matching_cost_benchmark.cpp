@@ -0,0 +1,220 @@
+/*
+ * matching_cost_benchmark.cpp
+ *
+ *     Authors: Gregory Kramida
+ *     License: Apache v. 2
+ *   Copyright: (c) Gregory Kramida 2016
+ *
+ *  Measures the per-row throughput of the semi-global matcher's matching cost kernels: census
+ *  transforms & their Hamming distances for each instruction set supported by the CPU (see
+ *  stereo_workbench/src/census_transform.hpp) and DAISY descriptor distances (see
+ *  stereo_workbench/src/descriptor_distance.hpp), in microseconds per cost row and millions of
+ *  pixel-disparities per second.
+ */
+
+//standard
+#include <chrono>
+#include <cstdlib>
+#include <cstdint>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <vector>
+
+//local
+#include "stereo_workbench/src/census_transform.hpp"
+#include "stereo_workbench/src/descriptor_distance.hpp"
+
+#define IMAGE_WIDTH 640
+#define IMAGE_HEIGHT 480
+#define NUM_DISPARITIES 128
+#define DAISY_DESCRIPTOR_LENGTH 200
+
+using namespace reco::stereo_workbench;
+
+typedef std::chrono::high_resolution_clock benchmark_clock;
+
+namespace {
+
+const int width1 = IMAGE_WIDTH - NUM_DISPARITIES;
+
+/**
+ * Time per cost row of the given row function, which is run for every row of the image
+ */
+template<typename row_function>
+double microseconds_per_row(row_function compute_row) {
+	benchmark_clock::time_point start = benchmark_clock::now();
+	for (int y = 0; y < IMAGE_HEIGHT; y++) {
+		compute_row(y);
+	}
+	return std::chrono::duration<double, std::micro>(benchmark_clock::now() - start).count()
+			/ IMAGE_HEIGHT;
+}
+
+void print_result(const char* name, const char* instruction_set, double row_time) {
+	std::cout << std::left << std::setw(20) << name << std::setw(20) << instruction_set
+			<< std::setw(16) << row_time
+			<< (double) width1 * NUM_DISPARITIES / row_time << std::endl;
+}
+
+/**
+ * Costs of every pixel of row y of the first image against right-to-left bitstrings of the second
+ */
+template<typename census_type, typename kernel_type>
+void census_row(kernel_type kernel, const std::vector<census_type>& census1,
+		const std::vector<census_type>& census2_reversed, int y, CostType* cost) {
+	size_t row_offset = (size_t) y * IMAGE_WIDTH;
+	for (int x = NUM_DISPARITIES, xd = 0; x < IMAGE_WIDTH; x++, xd++) {
+		kernel(census1[row_offset + x], &census2_reversed[row_offset + IMAGE_WIDTH - 1 - x],
+				NUM_DISPARITIES, cost + xd * NUM_DISPARITIES);
+	}
+}
+
+/**
+ * Costs of every pixel of a row of descriptors of the first image against the descriptors of the second
+ */
+template<typename descriptor_type, typename kernel_type>
+void descriptor_row(kernel_type kernel, const std::vector<descriptor_type>& descriptors1,
+		const std::vector<descriptor_type>& descriptors2, int descriptor_length, float scale,
+		CostType* cost) {
+	for (int x = NUM_DISPARITIES, xd = 0; x < IMAGE_WIDTH; x++, xd++) {
+		kernel(&descriptors1[x * descriptor_length], &descriptors2[x * descriptor_length],
+				descriptor_length, NUM_DISPARITIES, scale, cost + xd * NUM_DISPARITIES);
+	}
+}
+
+/**
+ * Whether all costs are within tolerance of the reference ones
+ */
+bool costs_match(const std::vector<CostType>& cost, const std::vector<CostType>& reference_cost,
+		int tolerance) {
+	for (size_t i = 0; i < cost.size(); i++) {
+		if (std::abs(cost[i] - reference_cost[i]) > tolerance) {
+			return false;
+		}
+	}
+	return true;
+}
+
+} //end anonymous namespace
+
+int main(int argc, char* argv[]) {
+	std::mt19937 generator(42);
+	std::uniform_int_distribution<int> intensity(0, 255);
+	std::vector<uint8_t> image1(IMAGE_WIDTH * IMAGE_HEIGHT), image2(IMAGE_WIDTH * IMAGE_HEIGHT);
+	for (size_t i = 0; i < image1.size(); i++) {
+		image1[i] = (uint8_t) intensity(generator);
+		image2[i] = (uint8_t) intensity(generator);
+	}
+	std::vector<CostType> cost(width1 * NUM_DISPARITIES);
+
+	std::cout << "Image: " << IMAGE_WIDTH << "x" << IMAGE_HEIGHT << ", " << NUM_DISPARITIES
+			<< " disparities" << std::endl;
+	std::cout << std::left << std::setw(20) << "cost" << std::setw(20) << "ISA" << std::setw(16)
+			<< "us/row" << "Mpix*disp/s" << std::endl;
+
+	//census transforms, computed once per image pair
+	std::vector<uint64_t> census1(image1.size()), census2(image2.size());
+	std::vector<uint32_t> sparse_census1(image1.size()), sparse_census2(image2.size());
+	print_result("census transform", "-", microseconds_per_row([&](int y) {
+		census_transform(image1.data(), IMAGE_WIDTH, IMAGE_HEIGHT, IMAGE_WIDTH, y, y + 1, census1.data());
+	}));
+	print_result("sparse transform", "-", microseconds_per_row([&](int y) {
+		sparse_census_transform(image1.data(), IMAGE_WIDTH, IMAGE_HEIGHT, IMAGE_WIDTH, y, y + 1,
+				sparse_census1.data());
+	}));
+	//random bitstrings stand in for the second image's, the cost of the kernels doesn't depend on them
+	std::mt19937_64 bit_generator(7);
+	for (size_t i = 0; i < census2.size(); i++) {
+		census2[i] = bit_generator();
+		sparse_census2[i] = (uint32_t) bit_generator();
+	}
+
+	//Hamming distances
+	bool consistent = true;
+	long long reference_checksum = -1;
+	const hamming_instruction_set instruction_sets[] = { HAMMING_SCALAR, HAMMING_POPCNT, HAMMING_AVX2,
+			HAMMING_AVX512_VPOPCNTDQ };
+	for (hamming_instruction_set instruction_set : instruction_sets) {
+		if (instruction_set > detect_hamming_instruction_set()) {
+			//not supported by this CPU
+			continue;
+		}
+		const hamming_distance_kernels& kernels = get_hamming_distance_kernels(instruction_set);
+		long long kernel_checksum = 0;
+		print_result("census", kernels.name, microseconds_per_row([&](int y) {
+			census_row(kernels.row_costs_64, census1, census2, y, cost.data());
+			kernel_checksum += cost[y % cost.size()];
+		}));
+		print_result("sparse census", kernels.name, microseconds_per_row([&](int y) {
+			census_row(kernels.row_costs_32, sparse_census1, sparse_census2, y, cost.data());
+			kernel_checksum += cost[y % cost.size()];
+		}));
+		if (reference_checksum < 0) {
+			reference_checksum = kernel_checksum;
+		} else if (kernel_checksum != reference_checksum) {
+			consistent = false;
+		}
+	}
+
+	//DAISY descriptor distances, for random descriptors of one image row
+	const int descriptor_length = (DAISY_DESCRIPTOR_LENGTH + descriptor_length_alignment - 1)
+			/ descriptor_length_alignment * descriptor_length_alignment;
+	std::uniform_real_distribution<float> descriptor_value(0.0f, 0.25f);
+	std::vector<float> descriptors1(IMAGE_WIDTH * descriptor_length, 0.0f),
+			descriptors2(IMAGE_WIDTH * descriptor_length, 0.0f);
+	std::vector<uint8_t> quantized_descriptors1(descriptors1.size(), 0),
+			quantized_descriptors2(descriptors2.size(), 0);
+	for (int x = 0; x < IMAGE_WIDTH; x++) {
+		for (int k = 0; k < DAISY_DESCRIPTOR_LENGTH; k++) {
+			size_t i = (size_t) x * descriptor_length + k;
+			descriptors1[i] = descriptor_value(generator);
+			descriptors2[i] = descriptor_value(generator);
+			quantized_descriptors1[i] = (uint8_t) (descriptors1[i] * 255.0f + 0.5f);
+			quantized_descriptors2[i] = (uint8_t) (descriptors2[i] * 255.0f + 0.5f);
+		}
+	}
+	const float float_scale = 100.0f;
+	const float u8_scale = 100.0f / (255.0f * 255.0f);
+	//costs of the scalar kernels, which the vectorized ones are checked against
+	const descriptor_distance_kernels& scalar_kernels = get_descriptor_distance_kernels(DESCRIPTOR_SCALAR);
+	std::vector<CostType> reference_float_cost(cost.size()), reference_u8_cost(cost.size());
+	descriptor_row(scalar_kernels.row_costs_float, descriptors1, descriptors2, descriptor_length,
+			float_scale, reference_float_cost.data());
+	descriptor_row(scalar_kernels.row_costs_u8, quantized_descriptors1, quantized_descriptors2,
+			descriptor_length, u8_scale, reference_u8_cost.data());
+
+	bool descriptors_consistent = true;
+	const descriptor_instruction_set descriptor_instruction_sets[] = { DESCRIPTOR_SCALAR,
+			DESCRIPTOR_SSE2, DESCRIPTOR_AVX2 };
+	for (descriptor_instruction_set instruction_set : descriptor_instruction_sets) {
+		if (instruction_set > detect_descriptor_instruction_set()) {
+			//not supported by this CPU
+			continue;
+		}
+		const descriptor_distance_kernels& kernels = get_descriptor_distance_kernels(instruction_set);
+		print_result("DAISY float", kernels.name, microseconds_per_row([&](int y) {
+			descriptor_row(kernels.row_costs_float, descriptors1, descriptors2, descriptor_length,
+					float_scale, cost.data());
+		}));
+		//the vectorized kernels sum the squared differences in a different order (and with FMA),
+		//so a float cost may end up one off after truncation
+		if (!costs_match(cost, reference_float_cost, 1)) {
+			descriptors_consistent = false;
+		}
+		print_result("DAISY uint8", kernels.name, microseconds_per_row([&](int y) {
+			descriptor_row(kernels.row_costs_u8, quantized_descriptors1, quantized_descriptors2,
+					descriptor_length, u8_scale, cost.data());
+		}));
+		//integer sums are exact
+		if (!costs_match(cost, reference_u8_cost, 0)) {
+			descriptors_consistent = false;
+		}
+	}
+
+	std::cout << "Census results " << (consistent ? "match" : "DIFFER") << " across instruction sets."
+			<< std::endl;
+	std::cout << "DAISY results " << (descriptors_consistent ? "match" : "DIFFER")
+			<< " the scalar ones." << std::endl;
+	return consistent && descriptors_consistent ? 0 : 1;
+}
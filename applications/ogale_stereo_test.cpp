@@ -57,20 +57,13 @@ void testStereo2(const char*imgfilename1, const char*imgfilename2, double minshi
 		//DISPLAY/SAVE RESULTS
 
 		//BEGIN: rescale disparity maps to range (0,1) so that they can be displayed by OpenCV
-		OvImageT<double> ovtleftDisp, ovtrightDisp;
-		ovtleftDisp.copyFromAdapter(*ovaLeftDisp);
-		ovtrightDisp.copyFromAdapter(*ovaRightDisp);
-
-		ovtleftDisp = (ovtleftDisp - minshift) / (maxshift - minshift);
-		ovtrightDisp = (ovtrightDisp + maxshift) / (-minshift + maxshift);
-
-		ovtleftDisp.copyToAdapter(*ovaLeftDisp);
-		ovtrightDisp.copyToAdapter(*ovaRightDisp);
+		//(the results are already in the cv::Mat objects, so they are rescaled in the same pass as the conversion)
+		double dispScale = 65535 / (maxshift - minshift);
 
 		cv::Mat outLDisp, outRDisp, outLOcc, outROcc;
 
-		imgLeftDisparity.convertTo(outLDisp,CV_16UC1,65535);
-		imgRightDisparity.convertTo(outRDisp,CV_16UC1,65535);
+		imgLeftDisparity.convertTo(outLDisp,CV_16UC1,dispScale,-minshift*dispScale);
+		imgRightDisparity.convertTo(outRDisp,CV_16UC1,dispScale,maxshift*dispScale);
 		imgLeftOcclusions.convertTo(outLOcc,CV_16UC1,65535);
 		imgRightOcclusions.convertTo(outROcc,CV_16UC1,65535);
 
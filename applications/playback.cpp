@@ -23,6 +23,7 @@
 
 // Reco includes
 #include <reco/utils/cpp_exception_util.h>
+#include <reco/utils/depth_back_projector.h>
 
 //define what to display
 #define DISPLAY_FUSED_CLOUD
@@ -83,6 +84,34 @@ bool parse_command_line(int argc, char** argv, std::string &input_file, std::str
 	return true;
 }
 
+/**
+ * Back-project a depth image & append the resulting points, all of a single color, to a cloud
+ * @param back_projector - (in) back-projector for the depth camera
+ * @param depth - (in) CV_32F depth image, in mm
+ * @param rgb - (in) color of the points
+ * @param cloud - (out) cloud to append the points to
+ * @param x,y,z - (in/out) scratch buffers for the point coordinates
+ */
+void append_depth_cloud(const reco::utils::depth_back_projector& back_projector, const cv::Mat& depth,
+		uint32_t rgb, pcl::PointCloud<pcl::PointXYZRGB>& cloud,
+		std::vector<float>& x, std::vector<float>& y, std::vector<float>& z) {
+	x.resize(depth.total());
+	y.resize(depth.total());
+	z.resize(depth.total());
+	size_t num_points = back_projector.back_project(depth.ptr<float>(0), depth.step1(),
+			x.data(), y.data(), z.data());
+	const size_t start = cloud.size();
+	cloud.resize(start + num_points);
+	const float rgb_f = *reinterpret_cast<float*>(&rgb);
+	for (size_t i_point = 0; i_point < num_points; i_point++) {
+		pcl::PointXYZRGB& point = cloud.points[start + i_point];
+		point.x = x[i_point];
+		point.y = y[i_point];
+		point.z = z[i_point];
+		point.rgb = rgb_f;
+	}
+}
+
 template<typename T>
 void reorder(std::vector<T>& vec, std::vector<int> order) {
 	if (vec.size() != order.size()) {
@@ -178,6 +207,8 @@ int main(int argc, char* argv[]) {
 
 			//only x offset
 			P.at<float>(3, 0) = curOffset;
+			depth_rotations.push_back(Eigen::Matrix<float, 3, 3>::Identity());
+			depth_translations.push_back(Eigen::Vector3f(curOffset / 1000.0F, 0.0F, 0.0F));
 			curOffset += step;
 		}
 
@@ -205,6 +236,19 @@ int main(int argc, char* argv[]) {
 		}
 	}
 
+	//precompute the ray tables for back-projection
+	std::vector<reco::utils::depth_back_projector> back_projectors;
+	back_projectors.reserve(num_kinects);
+	for (int i_kinect = 0; i_kinect < num_kinects; i_kinect++) {
+		const cv::Mat& K = depth_intrinsics[i_kinect];
+		//Eigen matrices are column-major by default
+		Eigen::Matrix<float, 3, 3, Eigen::RowMajor> rotation = depth_rotations[i_kinect];
+		back_projectors.emplace_back(depth_size.width, depth_size.height,
+				K.at<float>(0, 0), K.at<float>(1, 1), K.at<float>(0, 2), K.at<float>(1, 2),
+				rotation.data(), depth_translations[i_kinect].data());
+	}
+	std::vector<float> points_x, points_y, points_z;
+
 	//reorder cameras here if needed
 	/*std::vector<int> order = {0,1,2};
 
@@ -293,9 +337,8 @@ int main(int argc, char* argv[]) {
 			depth_col_offset += depth_size.width;
 #ifdef DISPLAY_FUSED_CLOUD
 			//pcl::PointCloud<pcl::PointXYZ>::Ptr cloud_single(new pcl::PointCloud<pcl::PointXYZ>);
-			pcl::cvDepth32F2pclCloudColor(im_depth, depth_intrinsics[i_kinect],
-					depth_rotations[i_kinect], depth_translations[i_kinect], *cloud_fused,
-					colors[i_kinect % colors.size()]);
+			append_depth_cloud(back_projectors[i_kinect], im_depth, colors[i_kinect % colors.size()],
+					*cloud_fused, points_x, points_y, points_z);
 #endif
 
 
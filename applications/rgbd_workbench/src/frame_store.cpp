@@ -0,0 +1,217 @@
+/*
+ * frame_store.cpp
+ *
+ *      Author: Gregory Kramida
+ *   Copyright: 2015 Gregory Kramida
+ */
+
+//standard
+#include <cstring>
+#include <cstdio>
+#include <stdexcept>
+#include <algorithm>
+
+//boost
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+//utils
+#include <reco/utils/cpp_exception_util.h>
+
+#include "frame_store.h"
+
+namespace reco {
+namespace rgbd_workbench {
+
+namespace bi = boost::interprocess;
+
+namespace {
+const char index_magic[8] = { 'R', 'E', 'C', 'O', 'P', 'C', 'I', '1' };
+} //end anonymous namespace
+
+/**
+ * A single memory-mapped segment file. Bytes below "used" are immutable once published.
+ */
+struct frame_store::segment {
+	bi::file_mapping mapping;
+	bi::mapped_region region;
+	size_t capacity;
+	size_t used;
+
+	segment(const std::string& path, size_t used) :
+			mapping(path.c_str(), bi::read_write),
+					region(mapping, bi::read_write),
+					capacity(region.get_size()),
+					used(used) {
+	}
+	char* data() {
+		return static_cast<char*>(region.get_address());
+	}
+};
+
+frame_store::frame_store(const std::string& path_prefix, size_t segment_capacity,
+		bool open_existing) :
+		path_prefix(path_prefix),
+				segment_capacity(segment_capacity) {
+	if (open_existing) {
+		open();
+	} else {
+		clear();
+	}
+}
+
+frame_store::~frame_store() {
+}
+
+std::string frame_store::segment_path(size_t ix_segment) const {
+	return path_prefix + "." + std::to_string(ix_segment) + ".seg";
+}
+
+std::string frame_store::index_path() const {
+	return path_prefix + ".idx";
+}
+
+/**
+ * Allocate a new segment file of the given size on disk & map it
+ */
+std::shared_ptr<frame_store::segment> frame_store::create_segment(size_t ix_segment,
+		size_t capacity) {
+	const std::string path = segment_path(ix_segment);
+	{
+		std::filebuf file;
+		if (!file.open(path.c_str(), std::ios_base::out | std::ios_base::trunc | std::ios_base::binary)
+				|| file.pubseekoff(capacity - 1, std::ios_base::beg) == std::streampos(-1)
+				|| file.sputc(0) == std::filebuf::traits_type::eof()) {
+			err(std::runtime_error) << "Could not allocate point cloud segment file " << path
+					<< enderr;
+		}
+	}
+	return std::make_shared<segment>(path, 0);
+}
+
+/**
+ * Reload the index & segments written previously under the same prefix.
+ * A partially-written trailing index record (e.g. after a crash) is ignored.
+ */
+void frame_store::open() {
+	std::lock_guard<std::mutex> append_lock(append_mutex);
+	std::lock_guard<std::mutex> index_lock(index_mutex);
+	index.clear();
+	segments.clear();
+	std::ifstream index_in(index_path().c_str(), std::ios_base::binary);
+	char magic[sizeof(index_magic)];
+	if (!index_in.read(magic, sizeof(magic))
+			|| std::memcmp(magic, index_magic, sizeof(index_magic)) != 0) {
+		err(std::runtime_error) << "Could not open point cloud index " << index_path() << enderr;
+	}
+	frame_entry entry;
+	while (index_in.read(reinterpret_cast<char*>(&entry), sizeof(frame_entry))) {
+		while (segments.size() <= entry.ix_segment) {
+			segments.push_back(std::make_shared<segment>(segment_path(segments.size()), 0));
+		}
+		segment& seg = *segments[entry.ix_segment];
+		if (entry.offset + entry.size > seg.capacity) {
+			err(std::runtime_error) << "Point cloud index " << index_path()
+					<< " refers past the end of segment " << entry.ix_segment << enderr;
+		}
+		seg.used = std::max(seg.used, (size_t)(entry.offset + entry.size));
+		index.push_back(entry);
+	}
+	index_in.close();
+	//drop the partial record, if any, and continue appending after the last complete one
+	index_file.close();
+	index_file.open(index_path().c_str(), std::ios_base::in | std::ios_base::out | std::ios_base::binary);
+	index_file.seekp(sizeof(index_magic) + index.size() * sizeof(frame_entry));
+}
+
+/**
+ * Copies the frame into the current segment (starting a new one if it doesn't fit), then publishes
+ * its location in the index, making it visible to readers.
+ * The frame is synchronously flushed to its segment file before the index record is written, so a
+ * reopened store never indexes a frame whose data didn't reach the file. The index record itself is
+ * only handed to the OS: it survives the process crashing, but not necessarily the system failing.
+ */
+size_t frame_store::append(const char* data, size_t size) {
+	std::lock_guard<std::mutex> append_lock(append_mutex);
+	std::shared_ptr<segment> seg;
+	uint32_t ix_segment;
+	{
+		std::lock_guard<std::mutex> index_lock(index_mutex);
+		if (!segments.empty() && segments.back()->capacity - segments.back()->used >= size) {
+			seg = segments.back();
+			ix_segment = (uint32_t)(segments.size() - 1);
+		} else {
+			ix_segment = (uint32_t)segments.size();
+		}
+	}
+	if (!seg) {
+		//file creation & mapping happen outside the index lock so readers aren't held up
+		seg = create_segment(ix_segment, std::max(segment_capacity, std::max(size, (size_t)1)));
+	}
+	//only this thread ever writes past "used", and nobody reads there until the entry is published
+	frame_entry entry;
+	entry.ix_segment = ix_segment;
+	entry.offset = seg->used;
+	entry.size = size;
+	std::memcpy(seg->data() + seg->used, data, size);
+	seg->region.flush((size_t)entry.offset, size, false);
+	index_file.write(reinterpret_cast<const char*>(&entry), sizeof(frame_entry));
+	index_file.flush();
+	size_t ix_frame;
+	{
+		std::lock_guard<std::mutex> index_lock(index_mutex);
+		if (ix_segment == segments.size()) {
+			segments.push_back(seg);
+		}
+		seg->used += size;
+		ix_frame = index.size();
+		index.push_back(entry);
+	}
+	return ix_frame;
+}
+
+bool frame_store::get(size_t ix_frame, frame_view& view) const {
+	std::lock_guard<std::mutex> index_lock(index_mutex);
+	if (ix_frame >= index.size()) {
+		return false;
+	}
+	const frame_entry& entry = index[ix_frame];
+	const std::shared_ptr<segment>& seg = segments[entry.ix_segment];
+	view.data = seg->data() + entry.offset;
+	view.size = entry.size;
+	view.segment = seg;
+	return true;
+}
+
+size_t frame_store::size() const {
+	std::lock_guard<std::mutex> index_lock(index_mutex);
+	return index.size();
+}
+
+/**
+ * Segments still referenced by outstanding frame views stay mapped until the views are released.
+ */
+void frame_store::clear() {
+	std::lock_guard<std::mutex> append_lock(append_mutex);
+	size_t segment_count;
+	{
+		std::lock_guard<std::mutex> index_lock(index_mutex);
+		segment_count = segments.size();
+		segments.clear();
+		index.clear();
+	}
+	for (size_t ix_segment = 0; ix_segment < segment_count; ix_segment++) {
+		std::remove(segment_path(ix_segment).c_str());
+	}
+	index_file.close();
+	index_file.open(index_path().c_str(),
+			std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+	if (!index_file) {
+		err(std::runtime_error) << "Could not create point cloud index " << index_path() << enderr;
+	}
+	index_file.write(index_magic, sizeof(index_magic));
+	index_file.flush();
+}
+
+} /* namespace rgbd_workbench */
+} /* namespace reco */
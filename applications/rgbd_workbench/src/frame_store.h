@@ -0,0 +1,99 @@
+/*
+ * frame_store.h
+ *
+ *      Author: Gregory Kramida
+ *   Copyright: 2015 Gregory Kramida
+ */
+
+#pragma once
+#ifndef RECO_WORKBENCH_FRAME_STORE_H_
+#define RECO_WORKBENCH_FRAME_STORE_H_
+
+//standard
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <fstream>
+#include <cstdint>
+
+namespace reco {
+namespace rgbd_workbench {
+
+/**
+ * @brief Append-only, random-access on-disk storage for variable-sized binary frames.
+ *
+ * Frames are packed into fixed-capacity, memory-mapped segment files (<prefix>.<n>.seg). Each frame's
+ * location is recorded in an append-only index file (<prefix>.idx), so that a store can be reopened
+ * later. A single thread may append while any number of threads read: frames only become visible to
+ * readers once they are fully written and indexed.
+ */
+class frame_store {
+public:
+	static const size_t default_segment_capacity = 64 * 1024 * 1024;
+
+	/**
+	 * @brief A read-only view of a stored frame; keeps the underlying segment mapped while alive.
+	 */
+	struct frame_view {
+		const char* data = nullptr;
+		size_t size = 0;
+		std::shared_ptr<const void> segment;
+	};
+
+	/**
+	 * @param path_prefix path & file name prefix for the segment & index files
+	 * @param segment_capacity size of each segment file in bytes (larger frames get a segment of their own)
+	 * @param open_existing if true, reopen the store previously written with the same prefix
+	 * rather than starting over
+	 */
+	frame_store(const std::string& path_prefix, size_t segment_capacity = default_segment_capacity,
+			bool open_existing = false);
+	virtual ~frame_store();
+
+	/**
+	 * @brief Write a frame to the end of the store
+	 * @return index of the new frame
+	 */
+	size_t append(const char* data, size_t size);
+	/**
+	 * @brief Retrieve a frame by index
+	 * @return false if there is no such frame
+	 */
+	bool get(size_t ix_frame, frame_view& view) const;
+	size_t size() const;
+	/**
+	 * @brief Remove all frames & delete the files
+	 */
+	void clear();
+
+private:
+	struct segment;
+	struct frame_entry {
+		uint32_t ix_segment;
+		uint64_t offset;
+		uint64_t size;
+	};
+
+	const std::string path_prefix;
+	const size_t segment_capacity;
+
+	std::vector<std::shared_ptr<segment>> segments;
+	std::vector<frame_entry> index;
+	std::ofstream index_file;
+
+	//serializes appends & clears
+	std::mutex append_mutex;
+	//guards segments & index
+	mutable std::mutex index_mutex;
+
+	std::string segment_path(size_t ix_segment) const;
+	std::string index_path() const;
+	std::shared_ptr<segment> create_segment(size_t ix_segment, size_t capacity);
+	void open();
+};
+
+} /* namespace rgbd_workbench */
+} /* namespace reco */
+
+#endif /* RECO_WORKBENCH_FRAME_STORE_H_ */
@@ -13,6 +13,7 @@
 #include <QThread>
 #include <QDebug>
 #include <QFileDialog>
+#include <QDir>
 
 // Point Cloud Library
 
@@ -42,8 +43,26 @@ namespace rgbd_workbench {
 #define DEFAULT_LOG_FILE_PATH DEFAULT_CAP_PATH "pos_D_slow_rotating_human_2_kinects_1240_frames.log"
 //#define DEFAULT_LOG_FILE_PATH "/media/algomorph/Data/reco/cap/pos_E_moving_human_4_kinects.log"
 
+//maximum number of frames waiting for reconstruction, oldest frames get dropped past this
+#define RECO_INPUT_BUFFER_CAPACITY 64
+//name of the on-disk storage of reconstructed point clouds, used both for the per-instance
+//temporary directory and for the file name prefix inside it
+#define RECO_OUTPUT_STORAGE_NAME "rgbd_workbench_reco_output"
+
+/**
+ * @return path & file name prefix of the point cloud storage inside the given directory
+ */
+static std::string reco_output_storage_prefix(const QTemporaryDir& directory){
+	if(!directory.isValid()){
+		err(std::runtime_error) << "Could not create a temporary directory for the reconstructed point clouds in "
+				<< QDir::tempPath().toStdString() << enderr;
+	}
+	return (directory.path() + "/" RECO_OUTPUT_STORAGE_NAME).toStdString();
+}
+
 main_window::main_window() :
 		ui(new Ui_main_window),
+				reco_output_dir(QDir::tempPath() + "/" RECO_OUTPUT_STORAGE_NAME "_XXXXXX"),
 				rgb_viewer(NULL, "RGB Feed"),
 				depth_viewer(NULL, "Depth Feed"),
 				pipe_buffer(new utils::optimistic_assignment_swap_buffer<
@@ -52,9 +71,9 @@ main_window::main_window() :
 								DEFAULT_LOG_FILE_PATH)),
 				pipe_signals_hooked(false),
 				calibration_loaded(false),
-				num_frames_in_reconstruction_queue(0),
-				reco_input_buffer(new utils::unbounded_queue<std::shared_ptr<hal::ImageArray>>()),
-				reco_output_buffer(new point_cloud_buffer())
+				reco_input_buffer(new utils::spsc_ring_buffer<std::shared_ptr<hal::ImageArray>>(
+						RECO_INPUT_BUFFER_CAPACITY, utils::overflow_policy::drop_oldest)),
+				reco_output_buffer(new point_cloud_buffer(reco_output_storage_prefix(reco_output_dir)))
 {
 	ui->setupUi(this);
 	connect_actions();
@@ -213,8 +232,7 @@ void main_window::on_frame() {
 	std::shared_ptr<hal::ImageArray> images = this->pipe_buffer->pop_front();
 	//enqueue
 	this->reco_input_buffer->push_back(images);
-	num_frames_in_reconstruction_queue++;
-	this->ui->reco_queued_label->setText(QString::number(num_frames_in_reconstruction_queue));
+	update_reco_queued_label();
 	//display
 	this->rgb_viewer.on_frame(images);
 	this->depth_viewer.on_frame(images);
@@ -266,16 +284,19 @@ void main_window::load_calibration(std::string file_path){
 
 	reconstruction_worker.reset(new reconstructor(reco_input_buffer,reco_output_buffer,calibration));
 	reconstructor* reco_p = reconstruction_worker.get();
-	connect(reco_p,SIGNAL(frame_consumed()),this,SLOT(decrease_queue_counter()));
+	connect(reco_p,SIGNAL(frame_consumed()),this,SLOT(update_reco_queued_label()));
 
 	if(pipe_signals_hooked){
 		toggle_reco_controls();
 	}
 }
 
-void main_window::decrease_queue_counter(){
-	num_frames_in_reconstruction_queue--;
-	this->ui->reco_queued_label->setText(QString::number(num_frames_in_reconstruction_queue));
+/**
+ * Show the number of frames waiting for reconstruction. Read from the buffer itself, since frames
+ * dropped when it overflows are never consumed.
+ */
+void main_window::update_reco_queued_label(){
+	this->ui->reco_queued_label->setText(QString::number(reco_input_buffer->size()));
 }
 
 //====================================== BUTTON EVENTS==============================================
@@ -31,6 +31,7 @@ class point_cloud_viewer;
 
 //Qt
 #include <QMainWindow>
+#include <QTemporaryDir>
 
 //datapipe
 #include <reco/datapipe/kinect2_pipe.h>
@@ -39,6 +40,7 @@ class point_cloud_viewer;
 
 //utils
 #include <reco/utils/swap_buffer.h>
+#include <reco/utils/ring_buffer.h>
 
 //OpenCV
 #include <opencv2/core/core.hpp>
@@ -75,6 +77,10 @@ protected:
 private:
 	Ui_main_window* ui;
 
+	//per-instance directory holding the on-disk storage of reconstructed point clouds;
+	//declared first so that it is removed (on exit) only after everything using it is gone
+	QTemporaryDir reco_output_dir;
+
 	//GUI elements
 	datapipe::multi_kinect_rgb_viewer rgb_viewer;
 	datapipe::multi_kinect_depth_viewer depth_viewer;
@@ -89,9 +95,9 @@ private:
 	bool calibration_loaded;
 
 	//calibration parameters & reconstruction state
-	int num_frames_in_reconstruction_queue;
 	std::shared_ptr<misc::calibration_parameters> calibration;
-	datapipe::frame_buffer_type reco_input_buffer;
+	//frames waiting for reconstruction; its size is what the "queued" label shows, dropped frames included
+	std::shared_ptr<utils::spsc_ring_buffer<std::shared_ptr<hal::ImageArray>>> reco_input_buffer;
 	std::shared_ptr<point_cloud_buffer> reco_output_buffer;
 	std::unique_ptr<reconstructor> reconstruction_worker;
 
@@ -112,7 +118,7 @@ private slots:
 	void unhook_pipe_signals();
 	void on_frame();
 	void update_reco_processed_label(size_t value);
-	void decrease_queue_counter();
+	void update_reco_queued_label();
 
 	//for thread error reporting
 	void report_error(QString string);
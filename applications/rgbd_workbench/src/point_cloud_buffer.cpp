@@ -8,97 +8,308 @@
 
 
 #include <pcl/compression/compression_profiles.h>
+#include <streambuf>
+#include <sstream>
+#include <algorithm>
+#include <iostream>
 #include "point_cloud_buffer.h"
 
 namespace reco {
 namespace rgbd_workbench {
 
-point_cloud_buffer::point_cloud_buffer():
+namespace {
+/**
+ * Read-only stream buffer over a block of memory, lets the decoder read straight from the mapped file
+ */
+class memory_streambuf: public std::streambuf {
+public:
+	memory_streambuf(const char* data, size_t size) {
+		char* begin = const_cast<char*>(data);
+		setg(begin, begin, begin + size);
+	}
+protected:
+	virtual pos_type seekoff(off_type offset, std::ios_base::seekdir direction,
+			std::ios_base::openmode which = std::ios_base::in) {
+		char* target;
+		switch (direction) {
+		case std::ios_base::beg:
+			target = eback() + offset;
+			break;
+		case std::ios_base::cur:
+			target = gptr() + offset;
+			break;
+		default:
+			target = egptr() + offset;
+			break;
+		}
+		if (!(which & std::ios_base::in) || target < eback() || target > egptr()) {
+			return pos_type(off_type(-1));
+		}
+		setg(eback(), target, egptr());
+		return pos_type(target - eback());
+	}
+	virtual pos_type seekpos(pos_type position, std::ios_base::openmode which = std::ios_base::in) {
+		return seekoff(off_type(position), std::ios_base::beg, which);
+	}
+};
+
+/**
+ * By default, leave half of the cores to the reconstruction itself
+ */
+unsigned int pick_encoder_count(unsigned int requested_count){
+	if(requested_count > 0){
+		return requested_count;
+	}
+	return std::max(1U, std::thread::hardware_concurrency() / 2);
+}
+} //end anonymous namespace
+
+point_cloud_buffer::point_cloud_buffer(const std::string& storage_path, size_t decoded_cache_size,
+		unsigned int encoder_count, size_t segment_capacity, bool open_existing):
+	compressed_frames(storage_path, segment_capacity, open_existing),
 	compression_profile(pcl::io::HIGH_RES_ONLINE_COMPRESSION_WITH_COLOR),
-	point_cloud_encoder(new pcl::io::OctreePointCloudCompression<pcl::PointXYZRGB>(compression_profile, false)),
-	point_cloud_decoder(new pcl::io::OctreePointCloudCompression<pcl::PointXYZRGB> ()),
-	playback_counter(0),
-	size(0){
-	cloud_positions.push_back(0);
+	//allow each encoder to have one frame in progress and one waiting
+	encoding_queue(2 * pick_encoder_count(encoder_count)),
+	appended_count(0),
+	committed_count(0),
+	decoded_cache_size(decoded_cache_size),
+	generation(0),
+	playback_counter(0){
+	encoder_count = pick_encoder_count(encoder_count);
+	for(unsigned int i_encoder = 0; i_encoder < encoder_count; i_encoder++){
+		encoders.emplace_back(&point_cloud_buffer::run_encoder, this);
+	}
 }
 
 point_cloud_buffer::~point_cloud_buffer(){
-	delete point_cloud_encoder;
-	delete point_cloud_decoder;
+	//frames already in the queue are still committed before the encoders see the stop signals
+	for(size_t i_encoder = 0; i_encoder < encoders.size(); i_encoder++){
+		encoding_queue.push_back(std::shared_ptr<encoding_job>());
+	}
+	for(std::thread& encoder : encoders){
+		encoder.join();
+	}
+}
+
+/**
+ * @brief Make a codec instance with the buffer's compression profile
+ * @param encoder if true, the codec is configured to encode every frame as an I-frame
+ * (as opposed to differentially), so that frames can later be decoded independently of each other.
+ */
+point_cloud_buffer::codec_type* point_cloud_buffer::make_codec(bool encoder) const{
+	if(!encoder){
+		return new codec_type();
+	}
+	const pcl::io::configurationProfile_t& profile = pcl::io::compressionProfiles_[compression_profile];
+	return new codec_type(pcl::io::MANUAL_CONFIGURATION, false,
+			profile.pointResolution, profile.octreeResolution, profile.doVoxelGridDownSampling,
+			0 /*i-frame rate: every frame*/, profile.doColorEncoding, profile.colorBitResolution);
 }
 
 /**
  * @brief Append another point cloud to the end of the stream
- * Emits the size_changed(size_t) event
- * @param cloud point cloud to append
+ * The cloud is compressed & stored asynchronously, size_changed(size_t) is emitted once it is in
+ * storage. Blocks only if all encoders are busy and the encoding queue is full.
+ * @param cloud point cloud to append, must not be modified afterwards
  *
  */
 void point_cloud_buffer::append_point_cloud(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &cloud) {
-	//go to the end of the stream
-	compressed_data.seekp(0,ios_base::end);
-	//compress
-	point_cloud_encoder->encodePointCloud(cloud, compressed_data);
-	cloud_positions.push_back(compressed_data.tellp());
-	size++;
-	emit size_changed(size);
+	std::shared_ptr<encoding_job> job(new encoding_job());
+	job->cloud = cloud;
+	{
+		std::lock_guard<std::mutex> lock(commit_mutex);
+		job->sequence_number = appended_count++;
+	}
+	encoding_queue.push_back(job);
+}
+
+/**
+ * Encoder thread loop: compress frames from the queue with this thread's own codec until a null job
+ * (stop signal) comes up
+ */
+void point_cloud_buffer::run_encoder(){
+	std::unique_ptr<codec_type> point_cloud_encoder(make_codec(true));
+	for(;;){
+		std::shared_ptr<encoding_job> job = encoding_queue.pop_front();
+		if(!job){
+			return;
+		}
+		std::stringstream compressed_data;
+		try{
+			point_cloud_encoder->encodePointCloud(job->cloud, compressed_data);
+		}catch(std::exception& e){
+			//frame is skipped, but its successors still have to be committed
+			std::cerr << "Failed to compress point cloud: " << e.what() << std::endl;
+			compressed_data.str("");
+			point_cloud_encoder.reset(make_codec(true));
+		}
+		commit(job->sequence_number, compressed_data.str());
+	}
+}
+
+/**
+ * @brief Hand over an encoded frame for storage.
+ * Writes this frame & any following ones that were waiting on it to storage, in sequence order.
+ * @param sequence_number order in which the frame was appended
+ * @param compressed_frame the encoded frame, empty if it is to be skipped
+ */
+void point_cloud_buffer::commit(size_t sequence_number, std::string&& compressed_frame){
+	std::unique_lock<std::mutex> lock(commit_mutex);
+	encoded_frames.emplace(sequence_number, std::move(compressed_frame));
+	bool stored = false;
+	while(!encoded_frames.empty() && encoded_frames.begin()->first == committed_count){
+		const std::string& frame = encoded_frames.begin()->second;
+		if(!frame.empty()){
+			compressed_frames.append(frame.data(), frame.size());
+			stored = true;
+		}
+		encoded_frames.erase(encoded_frames.begin());
+		committed_count++;
+	}
+	lock.unlock();
+	commit_cv.notify_all();
+	if(stored){
+		emit size_changed(compressed_frames.size());
+	}
+}
+
+/**
+ * @brief Wait until all point clouds appended so far are in storage
+ */
+void point_cloud_buffer::flush(){
+	std::unique_lock<std::mutex> lock(commit_mutex);
+	commit_cv.wait(lock, [this]{return committed_count == appended_count;});
 }
 
 /**
- * @brief Clear out the contents of the point cloud.
- * Also emits the size_changed(size_t) event
+ * @brief Clear out the contents of the point cloud buffer, deleting the storage files.
+ * Frames still being compressed are stored first and cleared along with the rest, frames still being
+ * decoded are not cached. Also emits the size_changed(size_t) & playback_position_changed(size_t) events
  */
 void point_cloud_buffer::clear(){
-	compressed_data.clear();
-	cloud_positions.clear();
+	flush();
+	compressed_frames.clear();
+	{
+		std::lock_guard<std::mutex> lock(cache_mutex);
+		decoded_cache.clear();
+		decoded_cache_lookup.clear();
+		generation++;
+	}
 	playback_counter = 0;
-	compressed_data.seekp(0,ios_base::beg);
-	size = 0;
-	emit size_changed(size);
+	emit size_changed(0);
+	emit playback_position_changed(0);
+}
+
+size_t point_cloud_buffer::size() const{
+	return compressed_frames.size();
 }
 
 /**
- * Grab the point cloud at the current stream position
- * @return point cloud at the current stream position
+ * @brief Retrieve a decoded frame from the cache or, failing that, decode it from storage
+ * Decoding happens outside of any lock with a decoder of its own, so concurrent reads don't wait on each other.
+ * @return the decoded frame, null if there is no such frame
  */
-pcl::PointCloud<pcl::PointXYZRGB>::Ptr point_cloud_buffer::grab_point_cloud(){
-	if(!compressed_data.eof()){
-		pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_out (new pcl::PointCloud<pcl::PointXYZRGB> ());
-		point_cloud_decoder->decodePointCloud(compressed_data,cloud_out);
+pcl::PointCloud<pcl::PointXYZRGB>::Ptr point_cloud_buffer::decode(size_t ix_frame){
+	size_t decoding_generation;
+	{
+		std::lock_guard<std::mutex> lock(cache_mutex);
+		auto cached = decoded_cache_lookup.find(ix_frame);
+		if(cached != decoded_cache_lookup.end()){
+			decoded_cache.splice(decoded_cache.begin(), decoded_cache, cached->second);
+			return cached->second->second;
+		}
+		decoding_generation = generation;
+	}
+	frame_store::frame_view frame;
+	pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_out;
+	if(!compressed_frames.get(ix_frame, frame)){
 		return cloud_out;
-	}else{
-		pcl::PointCloud<pcl::PointXYZRGB>::Ptr empty;
-		return empty;
 	}
+	cloud_out.reset(new pcl::PointCloud<pcl::PointXYZRGB>());
+	memory_streambuf frame_buffer(frame.data, frame.size);
+	std::istream frame_stream(&frame_buffer);
+	std::unique_ptr<codec_type> point_cloud_decoder(make_codec(false));
+	point_cloud_decoder->decodePointCloud(frame_stream, cloud_out);
+	if(decoded_cache_size > 0){
+		std::lock_guard<std::mutex> lock(cache_mutex);
+		//if the buffer was cleared in the meantime, a new frame with the same index may follow
+		if(generation == decoding_generation
+				&& decoded_cache_lookup.find(ix_frame) == decoded_cache_lookup.end()){
+			decoded_cache.emplace_front(ix_frame, cloud_out);
+			decoded_cache_lookup[ix_frame] = decoded_cache.begin();
+			if(decoded_cache.size() > decoded_cache_size){
+				decoded_cache_lookup.erase(decoded_cache.back().first);
+				decoded_cache.pop_back();
+			}
+		}
+	}
+	return cloud_out;
+}
+
+/**
+ * Grab the point cloud at the current playback position, without advancing it
+ * @return point cloud at the current playback position (shared with the cache, do not modify)
+ */
+pcl::PointCloud<pcl::PointXYZRGB>::Ptr point_cloud_buffer::grab_point_cloud(){
+	return decode(playback_counter);
 }
 
 /**
  * Grab the point cloud at the specified frame number
  * @param ix_frame
- * @return point cloud at the specified frame number
+ * @return point cloud at the specified frame number (shared with the cache, do not modify)
  */
 pcl::PointCloud<pcl::PointXYZRGB>::Ptr point_cloud_buffer::grab_point_cloud(uint ix_frame){
-	if(ix_frame < size){
-		compressed_data.seekp(cloud_positions[ix_frame]);
-		return grab_point_cloud();
-	}else{
-		pcl::PointCloud<pcl::PointXYZRGB>::Ptr empty;
-		return empty;
-	}
+	return decode(ix_frame);
 }
 
 /**
  * Grab the cloud pointed to by the frame counter and advance the frame counter
- * @return the cloud at the counter position
+ * @return the cloud at the counter position (shared with the cache, do not modify)
  */
 pcl::PointCloud<pcl::PointXYZRGB>::Ptr point_cloud_buffer::grab_next_point_cloud(){
-	if(playback_counter < size){
-		compressed_data.seekp(cloud_positions[playback_counter]);
-		playback_counter++;
-		return grab_point_cloud();
-	}else{
-		pcl::PointCloud<pcl::PointXYZRGB>::Ptr empty;
-		return empty;
+	size_t ix_frame = playback_counter;
+	pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud = decode(ix_frame);
+	if(cloud){
+		advance_playback_position(ix_frame);
 	}
+	return cloud;
+}
+
+/**
+ * @return index of the frame that grab_next_point_cloud() will return next
+ */
+size_t point_cloud_buffer::get_playback_position() const{
+	return playback_counter;
+}
+
+/**
+ * Move the frame counter from the given frame on to the next one
+ * @param ix_frame frame that was just played back
+ * @return false if the frame counter was moved elsewhere in the meantime (e.g. by go_to_frame), in
+ * which case it is left alone; otherwise, playback_position_changed(size_t) is emitted
+ */
+bool point_cloud_buffer::advance_playback_position(size_t ix_frame){
+	if(playback_counter.compare_exchange_strong(ix_frame, ix_frame + 1)){
+		emit playback_position_changed(ix_frame + 1);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * @return whether the given frame is in the decoded frame cache, i.e. grabbing it won't decode it
+ */
+bool point_cloud_buffer::is_decoded(size_t ix_frame){
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	return decoded_cache_lookup.find(ix_frame) != decoded_cache_lookup.end();
+}
+
+/**
+ * @return maximum number of decoded frames kept in memory
+ */
+size_t point_cloud_buffer::get_decoded_cache_size() const{
+	return decoded_cache_size;
 }
 
 /**
@@ -107,8 +318,9 @@ pcl::PointCloud<pcl::PointXYZRGB>::Ptr point_cloud_buffer::grab_next_point_cloud
  * @return true on success, false if the given frame exceeds the current size
  */
 bool point_cloud_buffer::go_to_frame(uint ix_frame){
-	if(ix_frame < size){
+	if(ix_frame < compressed_frames.size()){
 		playback_counter = ix_frame;
+		emit playback_position_changed(ix_frame);
 		return true;
 	}
 	return false;
@@ -10,6 +10,16 @@
 #ifndef RECO_WORKBENCH_POINTCLOUDBUFFER_H_
 #define RECO_WORKBENCH_POINTCLOUDBUFFER_H_
 
+//standard
+#include <atomic>
+#include <mutex>
+#include <list>
+#include <unordered_map>
+#include <map>
+#include <string>
+#include <thread>
+#include <condition_variable>
+
 //PCL includes
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
@@ -18,31 +28,99 @@
 //QT includes
 #include <QObject>
 
+//utils
+#include <reco/utils/ring_buffer.h>
+
+//workbench
+#include "frame_store.h"
+
 namespace reco {
 namespace rgbd_workbench {
 
+/**
+ * @brief Octree-compressed point cloud sequence, stored on disk.
+ *
+ * Compressed frames go into a segmented, memory-mapped frame_store, so memory use doesn't grow with
+ * the length of the recording. Every frame is encoded as an independent I-frame, which makes any
+ * frame decodable on its own: frames can be appended and read (in any order) concurrently from
+ * different threads. The most recently decoded frames are kept in a small cache.
+ *
+ * Compression runs asynchronously on a pool of encoder threads, each with its own codec. Frames
+ * wait for an encoder in a bounded queue (appending blocks only when the queue is full) and are
+ * committed to storage in the order they were appended.
+ */
 class point_cloud_buffer : public QObject {
 	Q_OBJECT
 
+public:
+	typedef pcl::io::OctreePointCloudCompression<pcl::PointXYZRGB> codec_type;
+	static const size_t default_decoded_cache_size = 16;
+
 private:
-	std::stringstream compressed_data;
+	frame_store compressed_frames;
 	pcl::io::compression_Profiles_e compression_profile;
-	pcl::io::OctreePointCloudCompression<pcl::PointXYZRGB>* point_cloud_encoder;
-	pcl::io::OctreePointCloudCompression<pcl::PointXYZRGB>* point_cloud_decoder;
-	std::vector<uint64_t> cloud_positions;
-	size_t playback_counter;
-	size_t size;
+
+	//encoding pipeline
+	struct encoding_job {
+		size_t sequence_number;
+		pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr cloud;
+	};
+	utils::mpmc_ring_buffer<std::shared_ptr<encoding_job>> encoding_queue;
+	std::vector<std::thread> encoders;
+	//number of frames appended so far, i.e. sequence number of the next frame to append
+	size_t appended_count;
+	//sequence number of the next frame to commit to storage
+	size_t committed_count;
+	//encoded frames that are waiting for their predecessors to be committed
+	std::map<size_t, std::string> encoded_frames;
+	std::mutex commit_mutex;
+	std::condition_variable commit_cv;
+
+	//decoded frame cache, most recently used first
+	typedef std::list<std::pair<size_t, pcl::PointCloud<pcl::PointXYZRGB>::Ptr>> cache_list;
+	cache_list decoded_cache;
+	std::unordered_map<size_t, cache_list::iterator> decoded_cache_lookup;
+	const size_t decoded_cache_size;
+	//incremented by clear(), so that frames decoded from the cleared contents don't enter the cache
+	size_t generation;
+	std::mutex cache_mutex;
+
+	std::atomic<size_t> playback_counter;
+
+	codec_type* make_codec(bool encoder) const;
+	void run_encoder();
+	void commit(size_t sequence_number, std::string&& compressed_frame);
+	pcl::PointCloud<pcl::PointXYZRGB>::Ptr decode(size_t ix_frame);
+
 public:
 	void append_point_cloud(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &cloud);
 	pcl::PointCloud<pcl::PointXYZRGB>::Ptr grab_point_cloud();
 	pcl::PointCloud<pcl::PointXYZRGB>::Ptr grab_point_cloud(uint ix_frame);
 	pcl::PointCloud<pcl::PointXYZRGB>::Ptr grab_next_point_cloud();
 	bool go_to_frame(uint ix_frame);
+	size_t get_playback_position() const;
+	bool advance_playback_position(size_t ix_frame);
+	bool is_decoded(size_t ix_frame);
+	size_t get_decoded_cache_size() const;
+	size_t size() const;
+	void flush();
 	void clear();
-	point_cloud_buffer();
+	/**
+	 * @param storage_path path & file name prefix of the on-disk storage files
+	 * @param decoded_cache_size maximum number of decoded frames to keep in memory
+	 * @param encoder_count number of encoder threads, 0 to pick based on the number of CPU cores
+	 * @param segment_capacity size of each storage segment file, in bytes
+	 * @param open_existing reopen storage previously written to storage_path instead of starting anew
+	 */
+	point_cloud_buffer(const std::string& storage_path,
+			size_t decoded_cache_size = default_decoded_cache_size,
+			unsigned int encoder_count = 0,
+			size_t segment_capacity = frame_store::default_segment_capacity,
+			bool open_existing = false);
 	virtual ~point_cloud_buffer();
 signals:
 	void size_changed(size_t new_size);
+	void playback_position_changed(size_t position);
 };
 
 } /* namespace rgbd_workbench */
@@ -0,0 +1,180 @@
+/*
+ * point_cloud_prefetcher.cpp
+ *
+ *      Author: Gregory Kramida
+ *   Copyright: 2015 Gregory Kramida
+ */
+
+//standard
+#include <algorithm>
+#include <cmath>
+
+#include "point_cloud_prefetcher.h"
+
+namespace reco {
+namespace rgbd_workbench {
+
+namespace {
+//weight of the newest sample in the running averages
+const double averaging_weight = 0.2;
+//pauses between frames longer than this aren't counted towards the playback interval
+const double max_playback_interval = 1.0;
+
+double running_average(double average, double sample) {
+	return average + averaging_weight * (sample - average);
+}
+} //end anonymous namespace
+
+const size_t point_cloud_prefetcher::min_depth;
+
+point_cloud_prefetcher::point_cloud_prefetcher(std::shared_ptr<point_cloud_buffer> cloud_buffer,
+		unsigned int decoder_count, size_t max_depth) :
+		cloud_buffer(cloud_buffer),
+				//the window (depth_ahead + depth_behind frames) & the frame being played back have to
+				//fit into the cache, or prefetched frames get evicted before they are played back
+				max_depth(std::max(min_depth,
+						std::min(max_depth, 2 * cloud_buffer->get_decoded_cache_size() / 3))),
+				depth_ahead(min_depth),
+				depth_behind(min_depth / 2),
+				decode_time(0.0),
+				playback_interval(0.0),
+				grabbed_before(false),
+				stopping(false) {
+	//the signals come from the playback & encoder threads
+	connect(cloud_buffer.get(), SIGNAL(playback_position_changed(size_t)), this, SLOT(wake_decoders()),
+			Qt::DirectConnection);
+	connect(cloud_buffer.get(), SIGNAL(size_changed(size_t)), this, SLOT(wake_decoders()),
+			Qt::DirectConnection);
+	if (cloud_buffer->get_decoded_cache_size() == 0) {
+		return;
+	}
+	for (unsigned int i_decoder = 0; i_decoder < std::max(decoder_count, 1U); i_decoder++) {
+		decoders.emplace_back(&point_cloud_prefetcher::run_decoder, this);
+	}
+}
+
+point_cloud_prefetcher::~point_cloud_prefetcher() {
+	disconnect(cloud_buffer.get(), 0, this, 0);
+	{
+		std::lock_guard<std::mutex> lock(window_mutex);
+		stopping = true;
+	}
+	window_moved_cv.notify_all();
+	frame_decoded_cv.notify_all();
+	for (std::thread& decoder : decoders) {
+		decoder.join();
+	}
+}
+
+size_t point_cloud_prefetcher::get_depth() {
+	std::lock_guard<std::mutex> lock(window_mutex);
+	return depth_ahead;
+}
+
+/**
+ * Set the window depth so that frames are decoded at least twice as far ahead as the number of
+ * frames played back during a single decode (needs window_mutex).
+ */
+void point_cloud_prefetcher::update_depth() {
+	if (playback_interval <= 0.0) {
+		return;
+	}
+	const double frames_per_decode = decode_time / playback_interval;
+	depth_ahead = std::min(max_depth, min_depth + (size_t)std::ceil(2.0 * frames_per_decode));
+	depth_behind = std::max((size_t)1, depth_ahead / 2);
+}
+
+/**
+ * Wake idle decoders up to look at the window around the (new) playback position
+ */
+void point_cloud_prefetcher::wake_decoders() {
+	//lock, so that the notification can't slip in between a decoder's check and its wait
+	{
+		std::lock_guard<std::mutex> lock(window_mutex);
+	}
+	window_moved_cv.notify_all();
+}
+
+/**
+ * Find the frame nearest to the playback position (looking ahead first, then behind) that is in
+ * the window, is neither in the buffer's cache nor being decoded, and exists in the buffer (needs
+ * window_mutex).
+ * @return false if there is nothing to decode
+ */
+bool point_cloud_prefetcher::pick_frame_to_decode(size_t& ix_frame) {
+	const size_t position = cloud_buffer->get_playback_position();
+	const size_t size = cloud_buffer->size();
+	auto needs_decoding = [&](size_t ix) {
+		return ix < size && frames_in_flight.find(ix) == frames_in_flight.end()
+				&& !cloud_buffer->is_decoded(ix);
+	};
+	for (size_t offset = 0; offset < depth_ahead; offset++) {
+		if (needs_decoding(position + offset)) {
+			ix_frame = position + offset;
+			return true;
+		}
+	}
+	for (size_t offset = 1; offset <= depth_behind && offset <= position; offset++) {
+		if (needs_decoding(position - offset)) {
+			ix_frame = position - offset;
+			return true;
+		}
+	}
+	return false;
+}
+
+void point_cloud_prefetcher::run_decoder() {
+	std::unique_lock<std::mutex> lock(window_mutex);
+	while (!stopping) {
+		size_t ix_frame;
+		if (!pick_frame_to_decode(ix_frame)) {
+			window_moved_cv.wait(lock);
+			continue;
+		}
+		frames_in_flight.insert(ix_frame);
+		lock.unlock();
+		const clock_type::time_point start = clock_type::now();
+		//decodes the frame into the buffer's cache
+		pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud = cloud_buffer->grab_point_cloud(ix_frame);
+		const double elapsed = std::chrono::duration<double>(clock_type::now() - start).count();
+		lock.lock();
+		frames_in_flight.erase(ix_frame);
+		if (cloud) {
+			decode_time = running_average(decode_time, elapsed);
+			update_depth();
+		}
+		frame_decoded_cv.notify_all();
+	}
+}
+
+pcl::PointCloud<pcl::PointXYZRGB>::Ptr point_cloud_prefetcher::grab_next_point_cloud() {
+	const size_t ix_frame = cloud_buffer->get_playback_position();
+	{
+		std::unique_lock<std::mutex> lock(window_mutex);
+		const clock_type::time_point now = clock_type::now();
+		if (grabbed_before) {
+			const double interval = std::chrono::duration<double>(now - last_grab_time).count();
+			if (interval < max_playback_interval) {
+				playback_interval = playback_interval > 0.0 ?
+						running_average(playback_interval, interval) : interval;
+				update_depth();
+			}
+		}
+		last_grab_time = now;
+		grabbed_before = true;
+		//if the frame is already being decoded, waiting for it beats decoding it a second time
+		frame_decoded_cv.wait(lock, [&] {
+			return stopping || frames_in_flight.find(ix_frame) == frames_in_flight.end();
+		});
+	}
+	//from the buffer's cache if it was prefetched
+	pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud = cloud_buffer->grab_point_cloud(ix_frame);
+	if (cloud) {
+		//wakes the decoders up via playback_position_changed
+		cloud_buffer->advance_playback_position(ix_frame);
+	}
+	return cloud;
+}
+
+} /* namespace rgbd_workbench */
+} /* namespace reco */
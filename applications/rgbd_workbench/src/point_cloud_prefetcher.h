@@ -0,0 +1,106 @@
+/*
+ * point_cloud_prefetcher.h
+ *
+ *      Author: Gregory Kramida
+ *   Copyright: 2015 Gregory Kramida
+ */
+
+#pragma once
+#ifndef RECO_WORKBENCH_POINT_CLOUD_PREFETCHER_H_
+#define RECO_WORKBENCH_POINT_CLOUD_PREFETCHER_H_
+
+//standard
+#include <memory>
+#include <set>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+//PCL
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+//QT
+#include <QObject>
+
+//workbench
+#include "point_cloud_buffer.h"
+
+namespace reco {
+namespace rgbd_workbench {
+
+/**
+ * @brief Decodes point clouds around the playback position of a point_cloud_buffer ahead of time.
+ *
+ * Decoder threads keep a window of frames around the buffer's playback position decoded in the
+ * buffer's own cache: up to a certain depth ahead of it and half that depth behind it (for scrubbing
+ * backwards). The depth adapts to how long decoding takes relative to how fast frames are being
+ * played back, but the window never exceeds the cache. Jumps of the playback position
+ * (point_cloud_buffer::go_to_frame) simply move the window. Idle decoders wake up whenever the
+ * playback position moves or the buffer's contents change.
+ */
+class point_cloud_prefetcher : public QObject {
+	Q_OBJECT
+public:
+	/**
+	 * @param cloud_buffer buffer to prefetch from
+	 * @param decoder_count number of decoder threads, none are started if the buffer has no cache
+	 * @param max_depth maximum number of frames to decode ahead of the playback position, capped
+	 * so that the window fits into the buffer's decoded frame cache
+	 */
+	point_cloud_prefetcher(std::shared_ptr<point_cloud_buffer> cloud_buffer,
+			unsigned int decoder_count = 2, size_t max_depth = 32);
+	virtual ~point_cloud_prefetcher();
+
+	/**
+	 * Same as point_cloud_buffer::grab_next_point_cloud, but waits for the cloud if it is being
+	 * prefetched rather than decoding it a second time.
+	 * @return the cloud at the playback position, null if it is past the end
+	 */
+	pcl::PointCloud<pcl::PointXYZRGB>::Ptr grab_next_point_cloud();
+
+	/**
+	 * @return current number of frames being decoded ahead of the playback position
+	 */
+	size_t get_depth();
+
+private:
+	typedef std::chrono::steady_clock clock_type;
+	static const size_t min_depth = 2;
+
+	std::shared_ptr<point_cloud_buffer> cloud_buffer;
+	const size_t max_depth;
+
+	//frames being decoded
+	std::set<size_t> frames_in_flight;
+	size_t depth_ahead;
+	size_t depth_behind;
+
+	//running averages, in seconds
+	double decode_time;
+	double playback_interval;
+	clock_type::time_point last_grab_time;
+	bool grabbed_before;
+
+	bool stopping;
+	std::mutex window_mutex;
+	//signals decoders that the playback position or the buffer's contents changed or that they should stop
+	std::condition_variable window_moved_cv;
+	//signals the playback thread that a decode has finished
+	std::condition_variable frame_decoded_cv;
+	std::vector<std::thread> decoders;
+
+	void run_decoder();
+	bool pick_frame_to_decode(size_t& ix_frame);
+	void update_depth();
+
+private slots:
+	void wake_decoders();
+};
+
+} /* namespace rgbd_workbench */
+} /* namespace reco */
+
+#endif /* RECO_WORKBENCH_POINT_CLOUD_PREFETCHER_H_ */
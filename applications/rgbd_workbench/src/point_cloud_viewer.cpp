@@ -16,6 +16,7 @@ point_cloud_viewer::point_cloud_viewer(std::shared_ptr<point_cloud_buffer> cloud
 		QVTKWidget* hosting_widget):
 		worker(),
 		cloud_buffer(cloud_buffer),
+		prefetcher(cloud_buffer),
 		visualizer(new pcl::visualization::PCLVisualizer("result view", false)),
 		hosting_widget(hosting_widget)
 		{
@@ -36,7 +37,7 @@ point_cloud_viewer::~point_cloud_viewer(){
 }
 
 bool point_cloud_viewer::do_unit_of_work(){
-	pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud = cloud_buffer->grab_next_point_cloud();
+	pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud = prefetcher.grab_next_point_cloud();
 	if(cloud){
 		if (!visualizer->updatePointCloud(cloud)) {
 			visualizer->addPointCloud(cloud);
@@ -29,6 +29,7 @@
 
 //workbench
 #include "point_cloud_buffer.h"
+#include "point_cloud_prefetcher.h"
 
 namespace reco {
 namespace rgbd_workbench {
@@ -39,6 +40,7 @@ class point_cloud_viewer:
 Q_OBJECT
 private:
 	std::shared_ptr<point_cloud_buffer> cloud_buffer;
+	point_cloud_prefetcher prefetcher;
 	std::shared_ptr<pcl::visualization::PCLVisualizer> visualizer;
 	QVTKWidget* hosting_widget;
 protected:
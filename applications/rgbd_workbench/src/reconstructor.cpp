@@ -9,6 +9,12 @@
 #include <reco/utils/cpp_exception_util.h>
 #include <reco/utils/color_util.h>
 
+//opencv
+#include <opencv2/core/core.hpp>
+
+//standard
+#include <algorithm>
+
 //datapipe
 #include <reco/datapipe/kinect_v2_info.h>
 #include "reconstructor.h"
@@ -47,48 +53,152 @@ reconstructor::~reconstructor(){
 
 void reconstructor::pre_thread_join(){
 	//run through a "fake" frame to queue to ensure thread doesn't get
-	//stuck on popping from an empty queue
+	//stuck on popping from an empty queue. The queue is cleared first, since
+	//pushing onto a full bounded queue may otherwise block forever.
+	input_buffer->clear();
 	std::shared_ptr<hal::ImageArray> dummy;
 	input_buffer->push_back(dummy);
 }
 
 
 
-static void cvDepth32F2pclCloudColor(const cv::Mat& depth, const cv::Mat& K, Eigen::Matrix<float, 3, 3> R,
-		Eigen::Vector3f T, pcl::PointCloud<pcl::PointXYZRGB>& cloud, uint32_t rgb) {
-	// Check input
-	if (pcl::getFieldsList(cloud).find("x y z") == std::string::npos) {
-		std::cout << pcl::getFieldsList(cloud) << std::endl;
-		pcl::console::print_error("[cvDepth2pclCloud] output cloud must contain xyz data");
-		exit(EXIT_FAILURE);
+/**
+ * Back-projects bands of depth image rows from every kinect into structure-of-arrays point buffers.
+ * Each band gets its own disjoint region of the buffers, large enough to hold a point for every
+ * pixel, hence bands can be processed in parallel without locking. Since invalid pixels are
+ * skipped, only a prefix of each region ends up filled; its length is stored in band_point_counts.
+ */
+class back_projection_body:
+		public cv::ParallelLoopBody {
+public:
+	back_projection_body(const std::vector<cv::Mat>& depth_images,
+			const std::vector<utils::depth_back_projector>& back_projectors,
+			const std::vector<size_t>& kinect_offsets,
+			int bands_per_kinect,
+			float* x, float* y, float* z,
+			std::vector<size_t>& band_point_counts) :
+			depth_images(depth_images),
+					back_projectors(back_projectors),
+					kinect_offsets(kinect_offsets),
+					bands_per_kinect(bands_per_kinect),
+					x(x), y(y), z(z),
+					band_point_counts(band_point_counts) {
+	}
+
+	void operator()(const cv::Range& range) const {
+		for (int i_task = range.start; i_task < range.end; i_task++) {
+			const int i_kinect = i_task / bands_per_kinect;
+			const int i_band = i_task % bands_per_kinect;
+			const cv::Mat& depth = depth_images[i_kinect];
+			const int row_start = depth.rows * i_band / bands_per_kinect;
+			const int row_end = depth.rows * (i_band + 1) / bands_per_kinect;
+			const size_t offset = kinect_offsets[i_kinect] + (size_t)row_start * depth.cols;
+			band_point_counts[i_task] = back_projectors[i_kinect].back_project(
+					depth.ptr<float>(0), depth.step1(), row_start, row_end,
+					x + offset, y + offset, z + offset);
+		}
 	}
-	if (K.depth() != CV_32F) {
-		pcl::console::print_error("[cvDepth2pclCloud] calibration matrix must be CV_32F");
-		exit(EXIT_FAILURE);
+
+private:
+	const std::vector<cv::Mat>& depth_images;
+	const std::vector<utils::depth_back_projector>& back_projectors;
+	const std::vector<size_t>& kinect_offsets;
+	const int bands_per_kinect;
+	float* x;
+	float* y;
+	float* z;
+	std::vector<size_t>& band_point_counts;
+};
+
+/**
+ * Gathers the back-projected points of every band into the (presized) output cloud
+ */
+class cloud_assembly_body:
+		public cv::ParallelLoopBody {
+public:
+	cloud_assembly_body(const std::vector<cv::Mat>& depth_images,
+			const std::vector<uint32_t>& cloud_colors,
+			const std::vector<size_t>& kinect_offsets,
+			int bands_per_kinect,
+			const float* x, const float* y, const float* z,
+			const std::vector<size_t>& band_point_counts,
+			const std::vector<size_t>& band_cloud_offsets,
+			pcl::PointCloud<pcl::PointXYZRGB>& cloud) :
+			depth_images(depth_images),
+					cloud_colors(cloud_colors),
+					kinect_offsets(kinect_offsets),
+					bands_per_kinect(bands_per_kinect),
+					x(x), y(y), z(z),
+					band_point_counts(band_point_counts),
+					band_cloud_offsets(band_cloud_offsets),
+					cloud(cloud) {
 	}
 
-	const float inv_fx = 1.0 / K.at<float>(0, 0);
-	const float inv_fy = 1.0 / K.at<float>(1, 1);
-	const float ox = K.at<float>(0, 2);
-	const float oy = K.at<float>(1, 2);
-
-	Eigen::Vector3f pt;
-	for (int row = 0; row < depth.rows; row++) {
-		for (int col = 0; col < depth.cols; col++) {
-			float z = depth.at<float>(row, col) / 1000.0F;   //convert mm to m
-			//equivalent to multiplying the straight-up pixel coords + depth by inverse of intrinsic matrix K
-			pt << (col - ox) * z * inv_fx, (row - oy) * z * inv_fy, z;
-			pt = R*pt;
-			pt += T;
-			pcl::PointXYZRGB ptRGB;
-			ptRGB.rgb = *reinterpret_cast<float*>(&rgb);
-			ptRGB.x = pt.x();
-			ptRGB.y = pt.y();
-			ptRGB.z = pt.z();
-			cloud.push_back(ptRGB);
+	void operator()(const cv::Range& range) const {
+		for (int i_task = range.start; i_task < range.end; i_task++) {
+			const int i_kinect = i_task / bands_per_kinect;
+			const int i_band = i_task % bands_per_kinect;
+			const cv::Mat& depth = depth_images[i_kinect];
+			const int row_start = depth.rows * i_band / bands_per_kinect;
+			const size_t offset = kinect_offsets[i_kinect] + (size_t)row_start * depth.cols;
+			uint32_t rgb = cloud_colors[i_kinect];
+			const float rgb_f = *reinterpret_cast<float*>(&rgb);
+			pcl::PointXYZRGB* out = &cloud.points[band_cloud_offsets[i_task]];
+			for (size_t i_point = offset; i_point < offset + band_point_counts[i_task]; i_point++, out++) {
+				out->x = x[i_point];
+				out->y = y[i_point];
+				out->z = z[i_point];
+				out->rgb = rgb_f;
+			}
 		}
 	}
 
+private:
+	const std::vector<cv::Mat>& depth_images;
+	const std::vector<uint32_t>& cloud_colors;
+	const std::vector<size_t>& kinect_offsets;
+	const int bands_per_kinect;
+	const float* x;
+	const float* y;
+	const float* z;
+	const std::vector<size_t>& band_point_counts;
+	const std::vector<size_t>& band_cloud_offsets;
+	pcl::PointCloud<pcl::PointXYZRGB>& cloud;
+};
+
+/**
+ * (Re)build the per-kinect ray tables if there are none yet or the depth image sizes changed
+ * @param depth_images current depth images of all kinects
+ */
+void reconstructor::update_back_projectors(const std::vector<cv::Mat>& depth_images){
+	bool up_to_date = back_projectors.size() == depth_images.size();
+	for(size_t i_kinect = 0; up_to_date && i_kinect < depth_images.size(); i_kinect++){
+		up_to_date = back_projectors[i_kinect].get_width() == depth_images[i_kinect].cols
+				&& back_projectors[i_kinect].get_height() == depth_images[i_kinect].rows;
+	}
+	if(up_to_date){
+		return;
+	}
+	back_projectors.clear();
+	for(size_t i_kinect = 0; i_kinect < depth_images.size(); i_kinect++){
+		const cv::Mat& K = calibration->depth_intrinsics[i_kinect];
+		if (K.depth() != CV_32F) {
+			err(std::invalid_argument) << "Depth calibration matrix for kinect " << i_kinect
+					<< " must be CV_32F." << enderr;
+		}
+		const Eigen::Matrix<float, 3, 3>& R = calibration->depth_rotations[i_kinect];
+		const Eigen::Vector3f& T = calibration->depth_translations[i_kinect];
+		float rotation[9];
+		for(int i_row = 0; i_row < 3; i_row++){
+			for(int i_col = 0; i_col < 3; i_col++){
+				rotation[i_row * 3 + i_col] = R(i_row, i_col);
+			}
+		}
+		float translation[3] = {T(0), T(1), T(2)};
+		back_projectors.emplace_back(depth_images[i_kinect].cols, depth_images[i_kinect].rows,
+				K.at<float>(0, 0), K.at<float>(1, 1), K.at<float>(0, 2), K.at<float>(1, 2),
+				rotation, translation);
+	}
 }
 
 bool reconstructor::do_unit_of_work(){
@@ -103,15 +213,44 @@ bool reconstructor::do_unit_of_work(){
 		//if the frame came in as empty, time to go "bye-bye"
 		return false;
 	}
-	pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZRGB>);
+	//gather the depth images & figure out where each kinect's points go in the point buffers
+	std::vector<cv::Mat> depth_images;
+	std::vector<size_t> kinect_offsets;
+	depth_images.reserve(num_kinects);
+	kinect_offsets.reserve(num_kinects);
+	size_t total_pixels = 0;
 	for(int i_kinect = 0; i_kinect < num_kinects; i_kinect++){
 		std::shared_ptr<hal::Image> depth_img = images->at(i_kinect * channels_per_kinect + depth_offset);
-		//cv::Mat cv_depth_img = *reinterpret_cast<cv::Mat*>(depth_img.get());
-		cvDepth32F2pclCloudColor(*(depth_img.get()), calibration->depth_intrinsics[i_kinect],
-				calibration->depth_rotations[i_kinect], calibration->depth_translations[i_kinect], *cloud,
-							cloud_colors[i_kinect]);
+		depth_images.push_back(*(depth_img.get()));
+		kinect_offsets.push_back(total_pixels);
+		total_pixels += depth_images.back().total();
+	}
+	update_back_projectors(depth_images);
+	points_x.resize(total_pixels);
+	points_y.resize(total_pixels);
+	points_z.resize(total_pixels);
 
+	//split each kinect's image into row bands, so that the work scales with the number of cores
+	//rather than the number of kinects
+	const int bands_per_kinect = std::max(1, cv::getNumberOfCPUs());
+	const int num_bands = num_kinects * bands_per_kinect;
+	std::vector<size_t> band_point_counts(num_bands);
+	cv::parallel_for_(cv::Range(0, num_bands),
+			back_projection_body(depth_images, back_projectors, kinect_offsets, bands_per_kinect,
+					points_x.data(), points_y.data(), points_z.data(), band_point_counts));
+
+	std::vector<size_t> band_cloud_offsets(num_bands);
+	size_t total_points = 0;
+	for(int i_band = 0; i_band < num_bands; i_band++){
+		band_cloud_offsets[i_band] = total_points;
+		total_points += band_point_counts[i_band];
 	}
+	pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZRGB>);
+	cloud->resize(total_points);
+	cv::parallel_for_(cv::Range(0, num_bands),
+			cloud_assembly_body(depth_images, cloud_colors, kinect_offsets, bands_per_kinect,
+					points_x.data(), points_y.data(), points_z.data(), band_point_counts,
+					band_cloud_offsets, *cloud));
 	this->output_buffer->append_point_cloud(cloud);
 
 	emit frame_processed();
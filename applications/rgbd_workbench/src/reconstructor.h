@@ -16,6 +16,7 @@
 //utils
 #include <reco/utils/worker.h>
 #include <reco/utils/queue.h>
+#include <reco/utils/depth_back_projector.h>
 
 //HAL
 #include <HAL/Messages/ImageArray.h>
@@ -49,6 +50,14 @@ private:
 
 	std::vector<uint32_t> cloud_colors;
 
+	//back-projection state, reused between frames
+	std::vector<utils::depth_back_projector> back_projectors;
+	std::vector<float> points_x;
+	std::vector<float> points_y;
+	std::vector<float> points_z;
+
+	void update_back_projectors(const std::vector<cv::Mat>& depth_images);
+
 protected:
 	virtual bool do_unit_of_work();
 	virtual void pre_thread_join();
@@ -0,0 +1,306 @@
+/*
+ * sgm_kernel_benchmark.cpp
+ *
+ *     Authors: Gregory Kramida
+ *     License: Apache v. 2
+ *   Copyright: (c) Gregory Kramida 2016
+ *
+ *  Measures the throughput of the semi-global matcher's path aggregation kernels (see
+ *  stereo_workbench/src/sgm_path_kernels.hpp) for each instruction set supported by the CPU,
+ *  in millions of pixel-disparities per second, and checks that all of them produce the same costs
+ *  and that the compact (8-bit) path kernels agree with the 16-bit ones.
+ */
+
+//standard
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <vector>
+
+//local
+#include "stereo_workbench/src/sgm_path_kernels.hpp"
+
+#define IMAGE_WIDTH 640
+#define IMAGE_HEIGHT 480
+#define NUM_DISPARITIES 128
+#define P1 8
+#define P2 96
+#define UNIQUENESS_RATIO 10
+
+using namespace reco::stereo_workbench;
+
+typedef std::chrono::high_resolution_clock benchmark_clock;
+
+namespace {
+
+/**
+ * Matching costs for one image row with a distinct minimum at a disparity that drifts along the row
+ */
+std::vector<CostType> generate_cost_row(std::mt19937& generator) {
+	std::vector<CostType> costs(IMAGE_WIDTH * NUM_DISPARITIES);
+	std::uniform_int_distribution<int> noise(0, 40);
+	for (int x = 0; x < IMAGE_WIDTH; x++) {
+		int true_disparity = (x / 8) % NUM_DISPARITIES;
+		for (int d = 0; d < NUM_DISPARITIES; d++) {
+			costs[x * NUM_DISPARITIES + d] =
+					(CostType) (P2 + std::abs(d - true_disparity) * 4 + noise(generator));
+		}
+	}
+	return costs;
+}
+
+struct benchmark_result {
+	double four_paths_rate;
+	double final_path_rate;
+	double four_paths_compact_rate;
+	double final_path_compact_rate;
+	double three_way_rate;
+	long long checksum;
+};
+
+double rate(benchmark_clock::time_point start) {
+	double seconds = std::chrono::duration<double>(benchmark_clock::now() - start).count();
+	return (double) IMAGE_WIDTH * IMAGE_HEIGHT * NUM_DISPARITIES / seconds / 1e6;
+}
+
+/**
+ * Run each kernel over a synthetic image, cycling through a few cost rows
+ */
+benchmark_result run_benchmark(const sgm_path_kernels& kernels,
+		const std::vector<std::vector<CostType>>& cost_rows) {
+	const int D = NUM_DISPARITIES, D2 = D + 16;
+	benchmark_result result;
+	result.checksum = 0;
+
+	//MODE_SGBM/MODE_HH four-path update, one row of paths per pixel
+	std::vector<CostType> Lr_prev(4 * (D2 + 2), P2), Lr((IMAGE_WIDTH + 1) * 4 * D2, 0);
+	std::vector<CostType> S(IMAGE_WIDTH * D);
+	CostType minLr[4] = { 0, 0, 0, 0 };
+	const CostType* Lr_prev_ptrs[4];
+	for (int k = 0; k < 4; k++) {
+		CostType* row = &Lr_prev[k * (D2 + 2) + 1];
+		row[-1] = row[D] = SHRT_MAX;
+		Lr_prev_ptrs[k] = row;
+	}
+	benchmark_clock::time_point start = benchmark_clock::now();
+	for (int y = 0; y < IMAGE_HEIGHT; y++) {
+		const std::vector<CostType>& costs = cost_rows[y % cost_rows.size()];
+		std::fill(S.begin(), S.end(), 0);
+		for (int x = 0; x < IMAGE_WIDTH; x++) {
+			const int delta[4] = { minLr[0] + P2, minLr[1] + P2, minLr[2] + P2, minLr[3] + P2 };
+			kernels.aggregate_four_paths(&costs[x * D], Lr_prev_ptrs, &Lr[x * 4 * D2], D2, &S[x * D],
+					D, P1, delta, minLr);
+		}
+		result.checksum += S[(y * 7919) % S.size()];
+	}
+	result.four_paths_rate = rate(start);
+
+	//MODE_SGBM final path + best disparity + uniqueness check
+	std::vector<CostType> Lr_p0(D + 2, P2), Lr_p(D);
+	Lr_p0[0] = Lr_p0[D + 1] = SHRT_MAX;
+	long long num_unique = 0;
+	start = benchmark_clock::now();
+	for (int y = 0; y < IMAGE_HEIGHT; y++) {
+		const std::vector<CostType>& costs = cost_rows[y % cost_rows.size()];
+		std::fill(S.begin(), S.end(), 0);
+		for (int x = IMAGE_WIDTH - 1; x >= 0; x--) {
+			CostType minL0;
+			int minS, best_disp;
+			kernels.aggregate_path_and_find_best(&costs[x * D], &Lr_p0[1], &Lr_p[0], &S[x * D], D, P1,
+					P2, minL0, minS, best_disp);
+			if (!kernels.has_competing_disparity(&S[x * D], D, best_disp,
+					uniqueness_cost_bound(minS, UNIQUENESS_RATIO))) {
+				num_unique++;
+			}
+			result.checksum += best_disp;
+		}
+	}
+	result.final_path_rate = rate(start);
+	result.checksum += num_unique;
+
+	//the same two steps with compactly stored paths (differences to the path minimum, in 8 bits)
+	std::vector<CompactCostType> Lr8_prev(4 * (D2 + 2), P2), Lr8((IMAGE_WIDTH + 1) * 4 * D2, 0);
+	std::vector<CostType> L_buf(4 * D);
+	const CompactCostType* Lr8_prev_ptrs[4];
+	for (int k = 0; k < 4; k++) {
+		CompactCostType* row = &Lr8_prev[k * (D2 + 2) + 1];
+		row[-1] = row[D] = UCHAR_MAX;
+		Lr8_prev_ptrs[k] = row;
+	}
+	start = benchmark_clock::now();
+	for (int y = 0; y < IMAGE_HEIGHT; y++) {
+		const std::vector<CostType>& costs = cost_rows[y % cost_rows.size()];
+		std::fill(S.begin(), S.end(), 0);
+		for (int x = 0; x < IMAGE_WIDTH; x++) {
+			kernels.aggregate_four_paths_compact(&costs[x * D], Lr8_prev_ptrs, &Lr8[x * 4 * D2], D2,
+					&S[x * D], D, P1, P2, &L_buf[0]);
+		}
+		result.checksum += S[(y * 7919) % S.size()];
+	}
+	result.four_paths_compact_rate = rate(start);
+
+	std::vector<CompactCostType> Lr8_p0(D + 2, P2), Lr8_p(D);
+	Lr8_p0[0] = Lr8_p0[D + 1] = UCHAR_MAX;
+	start = benchmark_clock::now();
+	for (int y = 0; y < IMAGE_HEIGHT; y++) {
+		const std::vector<CostType>& costs = cost_rows[y % cost_rows.size()];
+		std::fill(S.begin(), S.end(), 0);
+		for (int x = IMAGE_WIDTH - 1; x >= 0; x--) {
+			int minS, best_disp;
+			kernels.aggregate_path_and_find_best_compact(&costs[x * D], &Lr8_p0[1], &Lr8_p[0],
+					&S[x * D], D, P1, P2, &L_buf[0], minS, best_disp);
+			result.checksum += best_disp;
+		}
+	}
+	result.final_path_compact_rate = rate(start);
+
+	//MODE_SGBM_3WAY: left & top paths forward, right path & best disparity backward
+	std::vector<CostType> horizontal((IMAGE_WIDTH + 1) * D, 0), vertical((IMAGE_WIDTH + 1) * D, 0);
+	std::vector<CostType> vertical_min(IMAGE_WIDTH + 1, 0), right(D);
+	start = benchmark_clock::now();
+	for (int y = 0; y < IMAGE_HEIGHT; y++) {
+		const std::vector<CostType>& costs = cost_rows[y % cost_rows.size()];
+		CostType previous_min = 0;
+		for (int x = 1; x <= IMAGE_WIDTH; x++) {
+			kernels.accumulate_costs_left_top(&horizontal[x * D], &horizontal[(x - 1) * D],
+					&vertical[x * D], &costs[(x - 1) * D], previous_min, vertical_min[x], D, P1, P2);
+		}
+		std::fill(right.begin(), right.end(), 0);
+		previous_min = 0;
+		for (int x = IMAGE_WIDTH; x >= 1; x--) {
+			int best_disp;
+			CostType min_cost;
+			kernels.accumulate_costs_right(&right[0], &vertical[x * D], &horizontal[x * D],
+					&costs[(x - 1) * D], previous_min, D, P1, P2, best_disp, min_cost);
+			result.checksum += best_disp + min_cost;
+		}
+	}
+	result.three_way_rate = rate(start);
+	return result;
+}
+
+/**
+ * Runs MODE_SGBM's path aggregation over the cost rows with both the 16-bit and the compact kernels,
+ * each path continuing from its value at the previous pixel (the four paths from the left, the final
+ * one from the right), and checks that both yield the same sums S, minimal sums & best disparities.
+ * The compact paths are lossless for large_penalty (P2) <= 255.
+ */
+bool compact_kernels_match(const sgm_path_kernels& kernels,
+		const std::vector<std::vector<CostType>>& cost_rows, int large_penalty) {
+	const int D = NUM_DISPARITIES, D2 = D + 16;
+	//path k at pixel x starts at (x * 4 + k) * D2 + 1, with a border at -1 and D
+	std::vector<CostType> Lr((IMAGE_WIDTH + 1) * 4 * D2, SHRT_MAX);
+	std::vector<CompactCostType> Lr8((IMAGE_WIDTH + 1) * 4 * D2, UCHAR_MAX);
+	std::vector<CostType> S(IMAGE_WIDTH * D), S8(IMAGE_WIDTH * D), L_buf(4 * D);
+	std::vector<CostType> Lr_p0(D + 2, SHRT_MAX), Lr_p(D + 2, SHRT_MAX);
+	std::vector<CompactCostType> Lr8_p0(D + 2, UCHAR_MAX), Lr8_p(D + 2, UCHAR_MAX);
+	auto path = [&](int x, int k) {return (x * 4 + k) * D2 + 1;};
+
+	for (const std::vector<CostType>& costs : cost_rows) {
+		for (int k = 0; k < 4; k++) {
+			std::fill(Lr.begin() + path(0, k), Lr.begin() + path(0, k) + D, 0);
+			std::fill(Lr8.begin() + path(0, k), Lr8.begin() + path(0, k) + D, 0);
+		}
+		std::fill(S.begin(), S.end(), 0);
+		std::fill(S8.begin(), S8.end(), 0);
+		CostType minLr[4] = { 0, 0, 0, 0 };
+		for (int x = 0; x < IMAGE_WIDTH; x++) {
+			const CostType* Lr_prev[4];
+			const CompactCostType* Lr8_prev[4];
+			int delta[4];
+			for (int k = 0; k < 4; k++) {
+				Lr_prev[k] = &Lr[path(x, k)];
+				Lr8_prev[k] = &Lr8[path(x, k)];
+				delta[k] = minLr[k] + large_penalty;
+			}
+			kernels.aggregate_four_paths(&costs[x * D], Lr_prev, &Lr[path(x + 1, 0)], D2, &S[x * D], D,
+					P1, delta, minLr);
+			kernels.aggregate_four_paths_compact(&costs[x * D], Lr8_prev, &Lr8[path(x + 1, 0)], D2,
+					&S8[x * D], D, P1, large_penalty, &L_buf[0]);
+		}
+		if (S != S8) {
+			return false;
+		}
+
+		std::fill(Lr_p0.begin() + 1, Lr_p0.end() - 1, 0);
+		std::fill(Lr8_p0.begin() + 1, Lr8_p0.end() - 1, 0);
+		CostType minL0 = 0;
+		for (int x = IMAGE_WIDTH - 1; x >= 0; x--) {
+			int minS, best_disp, minS8, best_disp8;
+			kernels.aggregate_path_and_find_best(&costs[x * D], &Lr_p0[1], &Lr_p[1], &S[x * D], D, P1,
+					minL0 + large_penalty, minL0, minS, best_disp);
+			kernels.aggregate_path_and_find_best_compact(&costs[x * D], &Lr8_p0[1], &Lr8_p[1],
+					&S8[x * D], D, P1, large_penalty, &L_buf[0], minS8, best_disp8);
+			if (minS != minS8 || best_disp != best_disp8) {
+				return false;
+			}
+			std::swap(Lr_p0, Lr_p);
+			std::swap(Lr8_p0, Lr8_p);
+		}
+		if (S != S8) {
+			return false;
+		}
+	}
+	return true;
+}
+
+} //end anonymous namespace
+
+int main(int argc, char* argv[]) {
+	std::mt19937 generator(42);
+	std::vector<std::vector<CostType>> cost_rows;
+	for (int i_row = 0; i_row < 16; i_row++) {
+		cost_rows.push_back(generate_cost_row(generator));
+	}
+
+	std::cout << "Image: " << IMAGE_WIDTH << "x" << IMAGE_HEIGHT << ", " << NUM_DISPARITIES
+			<< " disparities, rates in Mpix*disp/s" << std::endl;
+	std::cout << std::left << std::setw(12) << "ISA" << std::setw(16) << "4 paths"
+			<< std::setw(24) << "final path + best d" << std::setw(16) << "4 paths 8-bit"
+			<< std::setw(16) << "final 8-bit" << std::setw(16) << "3-way" << std::endl;
+
+	bool have_reference = false;
+	long long reference_checksum = 0;
+	bool consistent = true;
+	const sgm_instruction_set instruction_sets[] = { SGM_SSE2, SGM_AVX2, SGM_AVX512BW };
+	for (sgm_instruction_set instruction_set : instruction_sets) {
+		const sgm_path_kernels* kernels = get_sgm_path_kernels(instruction_set, NUM_DISPARITIES);
+		if (kernels == nullptr || kernels->instruction_set != instruction_set) {
+			//not supported by this CPU
+			continue;
+		}
+		benchmark_result result = run_benchmark(*kernels, cost_rows);
+		std::cout << std::setw(12) << kernels->name << std::setw(16) << result.four_paths_rate
+				<< std::setw(24) << result.final_path_rate << std::setw(16)
+				<< result.four_paths_compact_rate << std::setw(16) << result.final_path_compact_rate
+				<< std::setw(16) << result.three_way_rate << std::endl;
+		//the compact paths are lossless up to P2 = 255
+		if (!compact_kernels_match(*kernels, cost_rows, P2)
+				|| !compact_kernels_match(*kernels, cost_rows, UCHAR_MAX)) {
+			std::cout << kernels->name << ": compact (8-bit) paths DIFFER from the 16-bit ones."
+					<< std::endl;
+			consistent = false;
+		}
+		if (!have_reference) {
+			reference_checksum = result.checksum;
+			have_reference = true;
+		} else if (result.checksum != reference_checksum) {
+			consistent = false;
+		}
+	}
+	if (!have_reference) {
+		std::cout << "No vectorized SGM kernels for this CPU." << std::endl;
+		return 1;
+	}
+	std::cout << "Results " << (consistent ? "match" : "DIFFER") << " across instruction sets."
+			<< std::endl;
+	const sgm_path_kernels* default_kernels = get_sgm_path_kernels(default_sgm_instruction_set(),
+			NUM_DISPARITIES);
+	if (default_kernels != nullptr) {
+		std::cout << "The matchers use " << default_kernels->name << " by default." << std::endl;
+	}
+	return consistent ? 0 : 1;
+}
@@ -0,0 +1,98 @@
+/*
+ * disparity_service.hpp
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: Gregory Kramida
+ *   Copyright: 2016 Gregory Kramida
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+//qt
+#include <QObject>
+//utils
+#include <reco/utils/worker.h>
+//opencv
+#include <opencv2/core/core.hpp>
+//std
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+#include <reco/stereo_tuner/matcher_qt_wrapper.hpp>
+
+namespace reco {
+namespace stereo_tuner {
+
+/**
+ * Computes disparity on its own thread, so that the GUI never waits for the matcher.
+ * Only the latest request is kept: a new one replaces any pending request. Interactive requests
+ * (i.e. changes made by the user) also cancel the one in progress (cooperatively, before matching)
+ * and, if they need matching, get a low-resolution preview published first, then replaced by the
+ * full-resolution result. Requests for new frames let the one in progress finish, so that a steady
+ * stream of frames still yields full-resolution results.
+ */
+class disparity_service: public QObject, public utils::worker {
+	Q_OBJECT
+public:
+	disparity_service(int preview_level = 2);
+	virtual ~disparity_service();
+
+	/**
+	 * @brief request disparity for the given pair, superseding any earlier request
+	 * @param matcher matcher to use
+	 * @param left left image of the pair (must not be modified afterwards)
+	 * @param right right image of the pair (must not be modified afterwards)
+	 * @param interactive whether the request comes from the user (e.g. a parameter change) rather
+	 * than from a new frame
+	 */
+	void request(std::shared_ptr<matcher_qt_wrapper_base> matcher, cv::Mat left, cv::Mat right,
+			bool interactive);
+
+	int get_preview_level() const;
+	/**
+	 * @brief set the pyramid level previews are matched at, 0 to disable previews
+	 */
+	void set_preview_level(int value);
+
+signals:
+	/**
+	 * Emitted from the service thread whenever a result is ready
+	 * @param disparity the disparity, at full resolution
+	 * @param preview whether it is only a low-resolution preview
+	 */
+	void disparity_computed(cv::Mat disparity, bool preview);
+
+protected:
+	virtual bool do_unit_of_work();
+	virtual void pre_thread_join();
+
+private:
+	std::mutex request_guard;
+	std::condition_variable request_cv;
+	bool request_pending;
+	bool shutting_down;
+	std::shared_ptr<matcher_qt_wrapper_base> pending_matcher;
+	cv::Mat pending_left;
+	cv::Mat pending_right;
+	bool pending_interactive;
+	//raised when the request in progress is superseded by an interactive one
+	std::atomic<bool> cancelled;
+	std::atomic<int> preview_level;
+};
+
+} /* namespace stereo_tuner */
+} /* namespace reco */
@@ -21,7 +21,14 @@
 #pragma once
 #include <QObject>
 #include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
 #include <reco/stereo_tuner/tuning_panel.hpp>
+//std
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <vector>
 
 namespace reco {
 namespace stereo_tuner {
@@ -29,7 +36,54 @@ namespace stereo_tuner {
 class matcher_qt_wrapper_base: public QObject{
 	Q_OBJECT
 public:
-	virtual void compute(const cv::Mat& left,const cv::Mat& right, cv::Mat& disparity) = 0;
+	/**
+	 * Stages of the matching pipeline whose results the wrappers cache between calls to compute.
+	 * Invalidating a stage invalidates all stages downstream of it, so that e.g. a speckle filter
+	 * change only re-filters the cached raw disparity.
+	 */
+	enum stage{
+		//matcher-specific preparation of the (rectified) input pair, e.g. grayscale conversion
+		INPUT = 0,
+		//cost computation, aggregation, winner selection, uniqueness & left-right checks
+		MATCHING = 1,
+		//speckle filtering of the raw disparity
+		POST_FILTERING = 2,
+		//nothing to recompute
+		NONE = 3
+	};
+
+	matcher_qt_wrapper_base():first_invalid_stage(INPUT){}
+
+	/**
+	 * @brief compute disparity, redoing only the invalidated stages (the input pair is only read if
+	 * the input stage has been invalidated since the last call)
+	 * @param left left image of the pair
+	 * @param right right image of the pair
+	 * @param disparity output disparity
+	 * @param cancelled if set, checked before each stage up to matching; once it is raised, the
+	 * remaining stages are left invalid for the next call. Matching itself can't be interrupted, so once
+	 * it is done, its result is always filtered & returned.
+	 * @return false if cancelled, true otherwise
+	 */
+	virtual bool compute(const cv::Mat& left,const cv::Mat& right, cv::Mat& disparity,
+			const std::atomic<bool>* cancelled = NULL) = 0;
+	/**
+	 * @brief quick, approximate disparity computed at a coarser level of the image pyramid and scaled
+	 * back to full resolution; leaves the cached stages untouched (call from the same thread as compute)
+	 * @param level pyramid level to match at (each level halves the resolution)
+	 * @return false if no preview was computed, i.e. when the full-resolution result doesn't need
+	 * matching or the matcher doesn't support previews
+	 */
+	virtual bool compute_preview(const cv::Mat& left,const cv::Mat& right, cv::Mat& disparity,
+			int level) = 0;
+	/**
+	 * @brief mark the given stage and all stages downstream of it for recomputation
+	 * (call with INPUT whenever the input pair changes)
+	 */
+	void invalidate(stage from){
+		int current = first_invalid_stage.load();
+		while(from < current && !first_invalid_stage.compare_exchange_weak(current, from));
+	}
 	virtual int get_bock_size() const = 0;
 	virtual int get_disparity_max_diff() const = 0;
 	virtual int get_minimum_disparity() const = 0;
@@ -51,6 +105,45 @@ public slots:
 signals:
 	void parameters_changed();
 
+protected:
+	//earliest stage to redo on the next compute call
+	std::atomic<int> first_invalid_stage;
+	//guards the matcher's parameters & the queued changes to them: the GUI only reads the parameters
+	//under it, the thread computing disparity only writes them under it
+	mutable std::mutex parameter_guard;
+	std::vector<std::function<void()>> pending_parameter_changes;
+
+	/**
+	 * @brief invalidate the given stage & notify listeners that the parameters have changed
+	 */
+	void request_recompute(stage from = MATCHING){
+		invalidate(from);
+		emit parameters_changed();
+	}
+
+	/**
+	 * @brief queue a parameter change (of the matcher or of the wrapper itself) for the thread computing
+	 * disparity, which applies it before matching next, then invalidate the given stage. This way, the
+	 * GUI never writes to the matcher while it is matching.
+	 */
+	void change_parameters(std::function<void()> change, stage from = MATCHING){
+		{
+			std::unique_lock<std::mutex> lck(this->parameter_guard);
+			pending_parameter_changes.push_back(change);
+		}
+		request_recompute(from);
+	}
+
+	/**
+	 * @brief apply the queued parameter changes (called by the thread computing disparity)
+	 */
+	void apply_parameter_changes(){
+		std::unique_lock<std::mutex> lck(this->parameter_guard);
+		for(std::function<void()>& change : pending_parameter_changes){
+			change();
+		}
+		pending_parameter_changes.clear();
+	}
 };
 
 template<class MATCHER>
@@ -63,7 +156,10 @@ public:
 	matcher_qt_wrapper(cv::Ptr<MATCHER> matcher);
 	virtual ~matcher_qt_wrapper();
 
-	virtual void compute(const cv::Mat& left,const cv::Mat& right, cv::Mat& disparity);
+	virtual bool compute(const cv::Mat& left,const cv::Mat& right, cv::Mat& disparity,
+			const std::atomic<bool>* cancelled = NULL);
+	virtual bool compute_preview(const cv::Mat& left,const cv::Mat& right, cv::Mat& disparity,
+			int level);
 
 	virtual int get_bock_size() const;
 	virtual int get_disparity_max_diff() const;
@@ -83,6 +179,42 @@ public:
 
 protected:
 	cv::Ptr<MATCHER> stereo_matcher;
+
+	/**
+	 * @brief convert the input pair to what the matcher expects (by default, a shallow copy)
+	 */
+	virtual void prepare_input(const cv::Mat& left,const cv::Mat& right,
+			cv::Mat& prepared_left, cv::Mat& prepared_right);
+	/**
+	 * @brief set the matcher's disparity range for matching at the given pyramid level (called by the
+	 * thread computing disparity)
+	 */
+	void apply_disparity_range(int level);
+	/**
+	 * @brief run the matcher itself on the prepared input (with its own speckle filtering disabled)
+	 */
+	virtual void match(const cv::Mat& left,const cv::Mat& right, cv::Mat& disparity);
+	/**
+	 * @brief filter speckles in-place the way cv::StereoBM does it
+	 */
+	virtual void filter_speckles(cv::Mat& disparity);
+
+	//the disparity range is kept here & applied to the matcher right before matching, since previews
+	//use a scaled-down one.
+	//These and the matcher's own parameters are only changed via change_parameters
+	int minimum_disparity;
+	int num_disparities;
+	//speckle filtering is done by the wrapper, on a cached copy of the raw disparity
+	int speckle_window_size;
+	int speckle_range;
+	cv::Mat speckle_buffer;
+
+private:
+	//cached stage outputs
+	cv::Mat input_left;
+	cv::Mat input_right;
+	cv::Mat raw_disparity;
+	cv::Mat filtered_disparity;
 };
 
 } /* namespace stereo_tuner */
@@ -25,46 +25,133 @@ namespace stereo_tuner {
 
 template<class MATCHER>
 matcher_qt_wrapper<MATCHER>::matcher_qt_wrapper(cv::Ptr<MATCHER> matcher):
-	stereo_matcher(matcher){
+	stereo_matcher(matcher),
+	minimum_disparity(matcher->getMinDisparity()),
+	num_disparities(matcher->getNumDisparities()),
+	speckle_window_size(matcher->getSpeckleWindowSize()),
+	speckle_range(matcher->getSpeckleRange()){
+	//filter speckles in the wrapper instead, so that changing the speckle parameters doesn't require
+	//matching again
+	stereo_matcher->setSpeckleWindowSize(0);
+}
 
+template<class MATCHER>
+matcher_qt_wrapper<MATCHER>::~matcher_qt_wrapper(){
 
 }
 
 template<class MATCHER>
-matcher_qt_wrapper<MATCHER>::~matcher_qt_wrapper(){
+bool matcher_qt_wrapper<MATCHER>::compute(const cv::Mat& left,const cv::Mat& right,cv::Mat& disparity,
+		const std::atomic<bool>* cancelled){
+	//take over the invalidation: parameters changed from here on will be picked up on the next call
+	int first_stage = first_invalid_stage.exchange(NONE);
+	apply_parameter_changes();
+	for(int current_stage = first_stage; current_stage < NONE; current_stage++){
+		//matching can't be interrupted, so once it is done, finish up & return its result
+		if(current_stage <= MATCHING && cancelled && cancelled->load()){
+			//stages done so far stay cached, pick up from here on the next call
+			invalidate(static_cast<stage>(current_stage));
+			return false;
+		}
+		switch(current_stage){
+		case INPUT:
+			prepare_input(left,right,input_left,input_right);
+			break;
+		case MATCHING:
+			apply_disparity_range(0);
+			match(input_left,input_right,raw_disparity);
+			break;
+		case POST_FILTERING:
+			raw_disparity.copyTo(filtered_disparity);
+			filter_speckles(filtered_disparity);
+			break;
+		}
+	}
+	filtered_disparity.copyTo(disparity);
+	return true;
+}
 
+template<class MATCHER>
+bool matcher_qt_wrapper<MATCHER>::compute_preview(const cv::Mat& left,const cv::Mat& right,
+		cv::Mat& disparity, int level){
+	apply_parameter_changes();
+	//if only post-filtering is left to do, the full-resolution result is just as fast
+	if(level <= 0 || first_invalid_stage.load() > MATCHING){
+		return false;
+	}
+	std::vector<cv::Mat> left_pyramid, right_pyramid;
+	cv::buildPyramid(left, left_pyramid, level);
+	cv::buildPyramid(right, right_pyramid, level);
+	cv::Mat preview_left, preview_right, preview_disparity;
+	prepare_input(left_pyramid.back(), right_pyramid.back(), preview_left, preview_right);
+	apply_disparity_range(level);
+	match(preview_left, preview_right, preview_disparity);
+	//speckle sizes are in full-resolution pixels, so the preview is left unfiltered;
+	//scale back to full resolution, disparities included
+	cv::resize(preview_disparity, disparity, left.size(), 0, 0, cv::INTER_NEAREST);
+	disparity *= (1 << level);
+	return true;
 }
 
 template<class MATCHER>
-void matcher_qt_wrapper<MATCHER>::compute(const cv::Mat& left,const cv::Mat& right,cv::Mat& disparity){
+void matcher_qt_wrapper<MATCHER>::prepare_input(const cv::Mat& left,const cv::Mat& right,
+		cv::Mat& prepared_left, cv::Mat& prepared_right){
+	prepared_left = left;
+	prepared_right = right;
+}
+
+template<class MATCHER>
+void matcher_qt_wrapper<MATCHER>::apply_disparity_range(int level){
+	std::unique_lock<std::mutex> lck(this->parameter_guard);
+	//floor for the minimum, round the count up to the nearest multiple of 16
+	stereo_matcher->setMinDisparity(minimum_disparity >> level);
+	stereo_matcher->setNumDisparities(std::max(16, (((num_disparities >> level) + 15) / 16) * 16));
+}
+
+template<class MATCHER>
+void matcher_qt_wrapper<MATCHER>::match(const cv::Mat& left,const cv::Mat& right,cv::Mat& disparity){
 	stereo_matcher->compute(left,right,disparity);
 }
 
+template<class MATCHER>
+void matcher_qt_wrapper<MATCHER>::filter_speckles(cv::Mat& disparity){
+	if(speckle_window_size > 0){
+		cv::filterSpeckles(disparity, (stereo_matcher->getMinDisparity() - 1) * cv::StereoMatcher::DISP_SCALE,
+				speckle_window_size, speckle_range, speckle_buffer);
+	}
+}
+
 //===========================PARAMETER GETTERS======================================================
 
 template<class MATCHER>
 int matcher_qt_wrapper<MATCHER>::get_bock_size() const{
+	std::unique_lock<std::mutex> lck(this->parameter_guard);
 	return stereo_matcher->getBlockSize();
 }
 template<class MATCHER>
 int matcher_qt_wrapper<MATCHER>::get_disparity_max_diff() const{
+	std::unique_lock<std::mutex> lck(this->parameter_guard);
 	return stereo_matcher->getDisp12MaxDiff();
 }
 template<class MATCHER>
 int matcher_qt_wrapper<MATCHER>::get_minimum_disparity() const{
-	return stereo_matcher->getMinDisparity();
+	std::unique_lock<std::mutex> lck(this->parameter_guard);
+	return minimum_disparity;
 }
 template<class MATCHER>
 int matcher_qt_wrapper<MATCHER>::get_num_disparities() const{
-	return stereo_matcher->getNumDisparities();
+	std::unique_lock<std::mutex> lck(this->parameter_guard);
+	return num_disparities;
 }
 template<class MATCHER>
 int matcher_qt_wrapper<MATCHER>::get_speckle_range() const{
-	return stereo_matcher->getSpeckleRange();
+	std::unique_lock<std::mutex> lck(this->parameter_guard);
+	return speckle_range;
 }
 template<class MATCHER>
 int matcher_qt_wrapper<MATCHER>::get_speckle_window_size() const{
-	return stereo_matcher->getSpeckleWindowSize();
+	std::unique_lock<std::mutex> lck(this->parameter_guard);
+	return speckle_window_size;
 }
 
 
@@ -72,38 +159,44 @@ int matcher_qt_wrapper<MATCHER>::get_speckle_window_size() const{
 //===========================PARAMETER SETTER SLOTS=================================================
 template<class MATCHER>
 void matcher_qt_wrapper<MATCHER>::set_minimum_disparity(int value) {
-	stereo_matcher->setMinDisparity(value);
-	emit parameters_changed();
+	change_parameters([this, value]{
+		minimum_disparity = value;
+	});
 }
 
 template<class MATCHER>
 void matcher_qt_wrapper<MATCHER>::set_num_disparities(int value) {
-	stereo_matcher->setNumDisparities(value - (value % 16));
-	emit parameters_changed();
+	change_parameters([this, value]{
+		num_disparities = value - (value % 16);
+	});
 }
 
 template<class MATCHER>
 void matcher_qt_wrapper<MATCHER>::set_block_size(int value) {
 	int new_window_size = value + ((value + 1) % 2);
-	stereo_matcher->setBlockSize(new_window_size);
-	emit parameters_changed();
+	change_parameters([this, new_window_size]{
+		stereo_matcher->setBlockSize(new_window_size);
+	});
 }
 
 template<class MATCHER>
 void matcher_qt_wrapper<MATCHER>::set_speckle_window_size(int value) {
-	stereo_matcher->setSpeckleWindowSize(value);
-	emit parameters_changed();
+	change_parameters([this, value]{
+		speckle_window_size = value;
+	}, POST_FILTERING);
 }
 template<class MATCHER>
 void matcher_qt_wrapper<MATCHER>::set_speckle_range(int value) {
-	stereo_matcher->setSpeckleRange(value);
-	emit parameters_changed();
+	change_parameters([this, value]{
+		speckle_range = value;
+	}, POST_FILTERING);
 }
 
 template<class MATCHER>
 void matcher_qt_wrapper<MATCHER>::set_disparity_max_diff(int value){
-	stereo_matcher->setDisp12MaxDiff(value);
-	emit parameters_changed();
+	change_parameters([this, value]{
+		stereo_matcher->setDisp12MaxDiff(value);
+	});
 }
 //=======================END PARAMETER SETTER SLOTS=================================================
 //==================================================================================================
@@ -68,8 +68,6 @@ public:
 	matcher_qt_wrapper_bm();
 	virtual ~matcher_qt_wrapper_bm();
 
-	virtual void compute(const cv::Mat& left,const cv::Mat& right, cv::Mat& disparity);
-
 	//getters
 	int get_pre_filter_cap() const;
 	int get_pre_filter_size() const;
@@ -86,6 +84,10 @@ public slots:
 	void set_texture_threshold(int value);
 	void set_uniqueness_ratio(int value);
 
+protected:
+	virtual void prepare_input(const cv::Mat& left,const cv::Mat& right,
+			cv::Mat& prepared_left, cv::Mat& prepared_right);
+
 };
 
 } /* namespace stereo_tuner */
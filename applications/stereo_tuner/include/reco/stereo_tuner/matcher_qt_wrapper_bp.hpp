@@ -70,7 +70,8 @@ public:
 	matcher_qt_wrapper_bp();
 	virtual ~matcher_qt_wrapper_bp();
 
-	virtual void compute(const cv::Mat& left,const cv::Mat& right, cv::Mat& disparity);
+	virtual bool compute_preview(const cv::Mat& left,const cv::Mat& right, cv::Mat& disparity,
+			int level);
 
 	//getters
 	double get_data_weight() const;
@@ -90,6 +91,10 @@ public slots:
 	void set_num_iters(int value);
 	void set_num_levels(int value);
 
+protected:
+	virtual void match(const cv::Mat& left,const cv::Mat& right, cv::Mat& disparity);
+	virtual void filter_speckles(cv::Mat& disparity);
+
 };
 
 } /* namespace stereo_tuner */
@@ -69,6 +69,9 @@ public slots:
 	void set_p2(int value);
 	void set_pre_filter_cap(int value);
 	void set_uniqueness_ratio(int value);
+
+protected:
+	virtual void filter_speckles(cv::Mat& disparity);
 };
 
 } /* namespace stereo_tuner */
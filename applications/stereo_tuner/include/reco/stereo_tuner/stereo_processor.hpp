@@ -25,6 +25,7 @@
 
 #include <reco/stereo/rectifier.hpp>
 #include <reco/stereo_tuner/matcher_qt_wrapper.hpp>
+#include <reco/stereo_tuner/disparity_service.hpp>
 
 namespace reco {
 namespace stereo_tuner {
@@ -47,6 +48,10 @@ public:
 	int get_v_offset() const;
 	std::shared_ptr<matcher_qt_wrapper_base> get_matcher() const;
 
+	//also start / stop the disparity service
+	virtual void run();
+	virtual void stop();
+
 
 protected:
 
@@ -58,6 +63,7 @@ protected:
 private:
 	std::mutex rectify_guard;
 	std::mutex input_guard;
+	std::mutex output_guard;
 	bool rectification_enabled;
 	datapipe::frame_buffer_type input_frame_buffer;
 	datapipe::frame_buffer_type output_frame_buffer;
@@ -68,10 +74,16 @@ private:
 	cv::Mat last_right;
 	cv::Mat last_left_rectified;
 	cv::Mat last_right_rectified;
+	//matcher input: the (rectified) pair, with the vertical offset applied to the right image
+	cv::Mat matcher_left;
+	cv::Mat matcher_right;
 	cv::Mat disparity_normalized;
 	std::shared_ptr<stereo::rectifier> _rectifier;
+	//computes disparity in the background, latest request only
+	disparity_service service;
 
-	void compute_disparity(cv::Mat left, cv::Mat right);
+	void update_matcher_input();
+	void compute_disparity(bool interactive = true);
 
 public slots:
 
@@ -84,6 +96,7 @@ public slots:
 
 private slots:
 	void recompute_disparity();
+	void publish_disparity(cv::Mat disparity, bool preview);
 
 signals:
 	void frame(std::shared_ptr<std::vector<cv::Mat>> images);
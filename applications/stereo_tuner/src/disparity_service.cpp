@@ -0,0 +1,107 @@
+/*
+ * disparity_service.cpp
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: Gregory Kramida
+ *   Copyright: 2016 Gregory Kramida
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <reco/stereo_tuner/disparity_service.hpp>
+
+namespace reco {
+namespace stereo_tuner {
+
+disparity_service::disparity_service(int preview_level) :
+		worker(),
+		request_pending(false),
+		pending_interactive(false),
+		shutting_down(false),
+		cancelled(false),
+		preview_level(preview_level)
+{
+}
+
+disparity_service::~disparity_service() {
+
+}
+
+void disparity_service::request(std::shared_ptr<matcher_qt_wrapper_base> matcher, cv::Mat left,
+		cv::Mat right, bool interactive) {
+	std::unique_lock<std::mutex> lck(this->request_guard);
+	pending_matcher = matcher;
+	pending_left = left;
+	pending_right = right;
+	pending_interactive = interactive;
+	request_pending = true;
+	if (interactive) {
+		//whatever is in progress no longer reflects what the user asked for
+		cancelled = true;
+	}
+	request_cv.notify_one();
+}
+
+int disparity_service::get_preview_level() const {
+	return preview_level;
+}
+
+void disparity_service::set_preview_level(int value) {
+	preview_level = value;
+}
+
+bool disparity_service::do_unit_of_work() {
+	std::shared_ptr<matcher_qt_wrapper_base> matcher;
+	cv::Mat left, right;
+	bool interactive;
+	{
+		std::unique_lock<std::mutex> lck(this->request_guard);
+		request_cv.wait(lck, [&]{return request_pending || shutting_down;});
+		if (shutting_down) {
+			return false;
+		}
+		matcher = pending_matcher;
+		left = pending_left;
+		right = pending_right;
+		interactive = pending_interactive;
+		pending_matcher.reset();
+		request_pending = false;
+		cancelled = false;
+	}
+	if (!matcher || left.empty()) {
+		return true;
+	}
+
+	cv::Mat disparity;
+	if (interactive && matcher->compute_preview(left, right, disparity, preview_level)) {
+		if (cancelled) {
+			return true;
+		}
+		emit disparity_computed(disparity, true);
+	}
+	if (matcher->compute(left, right, disparity, &cancelled)) {
+		emit disparity_computed(disparity, false);
+	}
+	return true;
+}
+
+void disparity_service::pre_thread_join() {
+	//wake the thread up if it is waiting for requests
+	std::unique_lock<std::mutex> lck(this->request_guard);
+	shutting_down = true;
+	cancelled = true;
+	request_cv.notify_one();
+}
+
+} /* namespace stereo_tuner */
+} /* namespace reco */
@@ -49,7 +49,7 @@ namespace stereo_tuner {
 
 main_window::main_window() :
 		ui(new Ui_main_window),
-		video_buffer(new utils::optimistic_assignment_swap_buffer<std::shared_ptr<hal::ImageArray>>()),
+		video_buffer(new utils::triple_buffer<std::shared_ptr<hal::ImageArray>>()),
 		pipe(),
 		//stereo_input_buffer(new utils::unbounded_queue<std::shared_ptr<hal::Imag	eArray>>()),
 		stereo_input_buffer(new utils::pessimistic_assignment_swap_buffer<std::shared_ptr<hal::ImageArray>>()),
@@ -144,14 +144,16 @@ void main_window::hook_pipe(){
  * Triggered on each frame emergent from the pipe
  */
 void main_window::handle_frame(){
-	std::shared_ptr<hal::ImageArray> images = video_buffer->pop_front();
+	std::shared_ptr<hal::ImageArray> images;
+	//frames may get superseded before the signal is handled, in which case there is nothing new
+	if(!video_buffer->try_pop_front(images)){
+		return;
+	}
+	//an empty frame signals the end of the feed; nobody blocks on the triple buffer, so there is
+	//no need to send another one
 	if(images){
 		stereo_input_buffer->push_back(images);
 		ui->stereo_feed_viewer->on_frame(images);
-	}else{
-		std::shared_ptr<hal::ImageArray> dummy;
-		video_buffer->clear();
-		video_buffer->push_back(dummy);//send another dummy to signal end
 	}
 
 }
@@ -18,6 +18,9 @@
 #include <reco/stereo_tuner/stereo_matcher_tuning_panel.hpp>
 #include <reco/stereo_tuner/stereo_processor.hpp>
 
+//utils
+#include <reco/utils/swap_buffer.h>
+
 class Ui_main_window;
 
 namespace reco{
@@ -37,7 +40,8 @@ protected:
 private:
 	Ui_main_window* ui;
 
-	datapipe::frame_buffer_type video_buffer;
+	//latest-frame-wins buffer, so that the feed viewer never throttles capture
+	std::shared_ptr<utils::triple_buffer<std::shared_ptr<hal::ImageArray>>> video_buffer;
 	std::unique_ptr<datapipe::hal_stereo_pipe> pipe;
 	datapipe::frame_buffer_type stereo_input_buffer;
 	datapipe::frame_buffer_type stereo_output_buffer;
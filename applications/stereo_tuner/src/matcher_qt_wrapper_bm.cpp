@@ -151,14 +151,13 @@ void matcher_qt_wrapper_bm::tuning_panel_bm::construct_specialized_controls(){
 
 }
 
-void matcher_qt_wrapper_bm::compute(const cv::Mat& left,const cv::Mat& right, cv::Mat& disparity){
+void matcher_qt_wrapper_bm::prepare_input(const cv::Mat& left,const cv::Mat& right,
+		cv::Mat& prepared_left, cv::Mat& prepared_right){
 	if(left.type() == CV_8UC3 && right.type() == CV_8UC3){
-		cv::Mat left_target,right_target;
-		cv::cvtColor(left,left_target,cv::COLOR_BGR2GRAY);
-		cv::cvtColor(right,right_target,cv::COLOR_BGR2GRAY);
-		this->stereo_matcher->compute(left_target,right_target,disparity);
+		cv::cvtColor(left,prepared_left,cv::COLOR_BGR2GRAY);
+		cv::cvtColor(right,prepared_right,cv::COLOR_BGR2GRAY);
 	}else if(left.type() == CV_8UC1 && right.type() == CV_8UC1){
-		this->stereo_matcher->compute(left,right,disparity);
+		matcher_qt_wrapper::prepare_input(left,right,prepared_left,prepared_right);
 	}else{
 		err2(std::invalid_argument,"Expecting both left & right matrices both to have type CV_8UC3 or CV_8UC1.");
 	}
@@ -169,50 +168,62 @@ matcher_qt_wrapper_bm::tuning_panel_bm::~tuning_panel_bm(){
 }
 
 int matcher_qt_wrapper_bm::get_pre_filter_cap() const{
+	std::unique_lock<std::mutex> lck(this->parameter_guard);
 	return stereo_matcher->getPreFilterCap();
 }
 
 int matcher_qt_wrapper_bm::get_pre_filter_size() const{
+	std::unique_lock<std::mutex> lck(this->parameter_guard);
 	return stereo_matcher->getPreFilterSize();
 }
 int matcher_qt_wrapper_bm::get_pre_filter_type() const{
+	std::unique_lock<std::mutex> lck(this->parameter_guard);
 	return stereo_matcher->getPreFilterType();
 }
 int matcher_qt_wrapper_bm::get_smaller_block_size() const{
+	std::unique_lock<std::mutex> lck(this->parameter_guard);
 	return stereo_matcher->getSmallerBlockSize();
 }
 int matcher_qt_wrapper_bm::get_texture_threshold() const{
+	std::unique_lock<std::mutex> lck(this->parameter_guard);
 	return stereo_matcher->getTextureThreshold();
 }
 
 int matcher_qt_wrapper_bm::get_uniqueness_ratio() const{
+	std::unique_lock<std::mutex> lck(this->parameter_guard);
 	return stereo_matcher->getUniquenessRatio();
 }
 
 void matcher_qt_wrapper_bm::set_pre_filter_cap(int value) {
-	stereo_matcher->setPreFilterCap(value);
-	emit parameters_changed();
+	change_parameters([this, value]{
+		stereo_matcher->setPreFilterCap(value);
+	});
 }
 
 void matcher_qt_wrapper_bm::set_pre_filter_size(int value){
-	stereo_matcher->setPreFilterSize(value);
-	emit parameters_changed();
+	change_parameters([this, value]{
+		stereo_matcher->setPreFilterSize(value);
+	});
 }
 void matcher_qt_wrapper_bm::set_pre_filter_type(int value){
-	stereo_matcher->setPreFilterType(value);
-	emit parameters_changed();
+	change_parameters([this, value]{
+		stereo_matcher->setPreFilterType(value);
+	});
 }
 void matcher_qt_wrapper_bm::set_smaller_block_size(int value){
-	stereo_matcher->setSmallerBlockSize(value);
-	emit parameters_changed();
+	change_parameters([this, value]{
+		stereo_matcher->setSmallerBlockSize(value);
+	});
 }
 void matcher_qt_wrapper_bm::set_texture_threshold(int value){
-	stereo_matcher->setTextureThreshold(value);
-	emit parameters_changed();
+	change_parameters([this, value]{
+		stereo_matcher->setTextureThreshold(value);
+	});
 }
 void matcher_qt_wrapper_bm::set_uniqueness_ratio(int value) {
-	stereo_matcher->setUniquenessRatio(value);
-	emit parameters_changed();
+	change_parameters([this, value]{
+		stereo_matcher->setUniquenessRatio(value);
+	});
 }
 
 
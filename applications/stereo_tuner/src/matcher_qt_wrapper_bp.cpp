@@ -162,7 +162,7 @@ void matcher_qt_wrapper_bp::tuning_panel_bp::construct_specialized_controls(){
 
 }
 
-void matcher_qt_wrapper_bp::compute(const cv::Mat& left,const cv::Mat& right, cv::Mat& disparity){
+void matcher_qt_wrapper_bp::match(const cv::Mat& left,const cv::Mat& right, cv::Mat& disparity){
 	int rect_width = 1920;
 	int rect_height = 1080;
 	cv::cuda::GpuMat gpu_left(rect_height,rect_width,CV_8UC3);
@@ -176,63 +176,87 @@ void matcher_qt_wrapper_bp::compute(const cv::Mat& left,const cv::Mat& right, cv
 
 }
 
+bool matcher_qt_wrapper_bp::compute_preview(const cv::Mat& left,const cv::Mat& right, cv::Mat& disparity,
+		int level){
+	//matching works on a fixed-size region only
+	return false;
+}
+
+void matcher_qt_wrapper_bp::filter_speckles(cv::Mat& disparity){
+	//belief propagation output has never been speckle-filtered
+}
+
 matcher_qt_wrapper_bp::tuning_panel_bp::~tuning_panel_bp(){
 
 }
 
 double matcher_qt_wrapper_bp::get_data_weight() const{
+	std::unique_lock<std::mutex> lck(this->parameter_guard);
 	return stereo_matcher->getDataWeight();
 }
 
 double matcher_qt_wrapper_bp::get_disc_single_jump() const{
+	std::unique_lock<std::mutex> lck(this->parameter_guard);
 	return stereo_matcher->getDiscSingleJump();
 }
 double matcher_qt_wrapper_bp::get_max_data_term() const{
+	std::unique_lock<std::mutex> lck(this->parameter_guard);
 	return stereo_matcher->getMaxDataTerm();
 }
 double matcher_qt_wrapper_bp::get_max_disc_term() const{
+	std::unique_lock<std::mutex> lck(this->parameter_guard);
 	return stereo_matcher->getMaxDiscTerm();
 }
 int matcher_qt_wrapper_bp::get_msg_type() const{
+	std::unique_lock<std::mutex> lck(this->parameter_guard);
 	return stereo_matcher->getMsgType();
 }
 
 int matcher_qt_wrapper_bp::get_num_iters() const{
+	std::unique_lock<std::mutex> lck(this->parameter_guard);
 	return stereo_matcher->getNumIters();
 }
 
 int matcher_qt_wrapper_bp::get_num_levels() const{
+	std::unique_lock<std::mutex> lck(this->parameter_guard);
 	return stereo_matcher->getNumLevels();
 }
 
 void matcher_qt_wrapper_bp::set_data_weight(double value) {
-	stereo_matcher->setDataWeight(value);
-	emit parameters_changed();
+	change_parameters([this, value]{
+		stereo_matcher->setDataWeight(value);
+	});
 }
 
 void matcher_qt_wrapper_bp::set_disc_single_jump(double value){
-	stereo_matcher->setDiscSingleJump(value);
-	emit parameters_changed();
+	change_parameters([this, value]{
+		stereo_matcher->setDiscSingleJump(value);
+	});
 }
 void matcher_qt_wrapper_bp::set_max_data_term(double value){
-	stereo_matcher->setMaxDataTerm(value);
-	emit parameters_changed();
+	change_parameters([this, value]{
+		stereo_matcher->setMaxDataTerm(value);
+	});
 }
 void matcher_qt_wrapper_bp::set_max_disc_term(double value){
-	stereo_matcher->setMaxDiscTerm(value);
-	emit parameters_changed();
+	change_parameters([this, value]{
+		stereo_matcher->setMaxDiscTerm(value);
+	});
 }
 void matcher_qt_wrapper_bp::set_msg_type(int combo_box_index){
-	stereo_matcher->setMsgType(combo_box_index == 0? CV_16SC1 : CV_32FC1);
-	emit parameters_changed();
+	change_parameters([this, combo_box_index]{
+		stereo_matcher->setMsgType(combo_box_index == 0? CV_16SC1 : CV_32FC1);
+	});
 }
 void matcher_qt_wrapper_bp::set_num_iters(int value) {
-	stereo_matcher->setNumIters(value);
-	emit parameters_changed();
+	change_parameters([this, value]{
+		stereo_matcher->setNumIters(value);
+	});
 }
 void matcher_qt_wrapper_bp::set_num_levels(int value) {
-	stereo_matcher->setNumLevels(value);
-	emit parameters_changed();
+	change_parameters([this, value]{
+		stereo_matcher->setNumLevels(value);
+	});
 }
 
 
@@ -122,43 +122,60 @@ matcher_qt_wrapper_sgbm::tuning_panel_sgbm::~tuning_panel_sgbm(){
 
 }
 
+void matcher_qt_wrapper_sgbm::filter_speckles(cv::Mat& disparity){
+	//unlike cv::StereoBM, cv::StereoSGBM measures the speckle range in whole disparities
+	if(speckle_window_size > 0){
+		cv::filterSpeckles(disparity, (stereo_matcher->getMinDisparity() - 1) * cv::StereoMatcher::DISP_SCALE,
+				speckle_window_size, cv::StereoMatcher::DISP_SCALE * speckle_range, speckle_buffer);
+	}
+}
+
 //===============================PARAMETER GETTERS==================================================
 int matcher_qt_wrapper_sgbm::get_p1() const{
+	std::unique_lock<std::mutex> lck(this->parameter_guard);
 	return stereo_matcher->getP1();
 }
 int matcher_qt_wrapper_sgbm::get_p2() const{
+	std::unique_lock<std::mutex> lck(this->parameter_guard);
 	return stereo_matcher->getP2();
 }
 int matcher_qt_wrapper_sgbm::get_pre_filter_cap() const{
+	std::unique_lock<std::mutex> lck(this->parameter_guard);
 	return stereo_matcher->getPreFilterCap();
 }
 int matcher_qt_wrapper_sgbm::get_uniqueness_ratio() const{
+	std::unique_lock<std::mutex> lck(this->parameter_guard);
 	return stereo_matcher->getUniquenessRatio();
 }
 
 //===============================PARAMETER SETTER SLOTS=============================================
 void matcher_qt_wrapper_sgbm::set_p1(int value) {
-	if (value < stereo_matcher->getP2()) {
-		stereo_matcher->setP1(value);
-		emit parameters_changed();
-	}
+	//checked against the other penalty as of when the change is applied
+	change_parameters([this, value]{
+		if (value < stereo_matcher->getP2()) {
+			stereo_matcher->setP1(value);
+		}
+	});
 }
 
 void matcher_qt_wrapper_sgbm::set_p2(int value) {
-	if (value > stereo_matcher->getP1()) {
-		stereo_matcher->setP2(value);
-		emit parameters_changed();
-	}
+	change_parameters([this, value]{
+		if (value > stereo_matcher->getP1()) {
+			stereo_matcher->setP2(value);
+		}
+	});
 }
 
 void matcher_qt_wrapper_sgbm::set_pre_filter_cap(int value) {
-	stereo_matcher->setPreFilterCap(value);
-	emit parameters_changed();
+	change_parameters([this, value]{
+		stereo_matcher->setPreFilterCap(value);
+	});
 }
 
 void matcher_qt_wrapper_sgbm::set_uniqueness_ratio(int value) {
-	stereo_matcher->setUniquenessRatio(value);
-	emit parameters_changed();
+	change_parameters([this, value]{
+		stereo_matcher->setUniquenessRatio(value);
+	});
 }
 
 } /* namespace stereo_tuner */
@@ -46,6 +46,9 @@ stereo_processor::stereo_processor(
 	if(matcher){
 		connect(matcher.get(), SIGNAL(parameters_changed()), this, SLOT(recompute_disparity()));
 	}
+	//results are published right from the service thread, like the ones of this worker used to be
+	connect(&service, SIGNAL(disparity_computed(cv::Mat, bool)),
+			this, SLOT(publish_disparity(cv::Mat, bool)), Qt::DirectConnection);
 }
 
 stereo_processor::~stereo_processor() {
@@ -61,10 +64,9 @@ void stereo_processor::set_rectifier(std::shared_ptr<stereo::rectifier> _rectifi
 	if (!last_left.empty()) {
 		if (rectification_enabled) {
 			_rectifier->rectify(last_left, last_right, last_left_rectified, last_right_rectified);
-			compute_disparity(last_left_rectified, last_right_rectified);
-		} else {
-			compute_disparity(last_left, last_right);
 		}
+		update_matcher_input();
+		compute_disparity();
 	}
 }
 
@@ -75,6 +77,8 @@ void stereo_processor::set_matcher(std::shared_ptr<matcher_qt_wrapper_base> matc
 		err2(std::invalid_argument,"matcher contents cannot be null");
 	}
 	connect(matcher.get(), SIGNAL(parameters_changed()), this, SLOT(recompute_disparity()));
+	//the matcher may still hold stages computed from some earlier input
+	matcher->invalidate(matcher_qt_wrapper_base::INPUT);
 	emit matcher_updated(matcher.get());
 	recompute_disparity();
 }
@@ -107,10 +111,9 @@ bool stereo_processor::do_unit_of_work() {
 		if (rectification_enabled) {
 			//protect _rectifier from write access during rectification
 			_rectifier->rectify(last_left, last_right, last_left_rectified, last_right_rectified);
-			compute_disparity(last_left_rectified, last_right_rectified);
-		} else {
-			compute_disparity(last_left, last_right);
 		}
+		update_matcher_input();
+		compute_disparity(false);
 
 		return true;
 	}
@@ -127,6 +130,7 @@ void stereo_processor::save_current_matcher_input() {
 		cv::imwrite("left.png", last_left);
 		cv::imwrite("right.png", last_right);
 	}
+	std::unique_lock<std::mutex> output_lck(this->output_guard);
 	if (!disparity_normalized.empty()) {
 		cv::imwrite("output.png", disparity_normalized);
 	}
@@ -135,11 +139,8 @@ void stereo_processor::save_current_matcher_input() {
 void stereo_processor::recompute_disparity() {
 	std::unique_lock<std::mutex> lck(this->input_guard);
 	if(!last_left.empty()){
-		if (rectification_enabled) {
-			compute_disparity(last_left_rectified, last_right_rectified);
-		} else {
-			compute_disparity(last_left, last_right);
-		}
+		//the matcher redoes only the stages invalidated by the parameter change
+		compute_disparity();
 	}
 }
 
@@ -148,18 +149,23 @@ bool stereo_processor::is_rectification_enabled() const {
 }
 
 /**
- * Compute disparity and emit ready frame
- * @param left
- * @param right
+ * Prepare the matcher input from the last (rectified) pair and invalidate everything the matcher
+ * has cached. Expects the input guard to be held.
  */
-void stereo_processor::compute_disparity(cv::Mat left, cv::Mat right) {
-	if(!matcher){
-		return;
+void stereo_processor::update_matcher_input() {
+	//the disparity service reads the input asynchronously, while last_left & co. get overwritten
+	//by the next frame, hence the copies
+	cv::Mat right;
+	if (rectification_enabled) {
+		matcher_left = last_left_rectified.clone();
+		right = last_right_rectified;
+	} else {
+		matcher_left = last_left.clone();
+		right = last_right;
 	}
-	cv::Mat disparity;
 
 	int offset = this->right_v_offset;
-	if (right_v_offset != 0) {
+	if (offset != 0) {
 		cv::Mat right_adjusted = cv::Mat(right.rows, right.cols, right.type(), cv::Scalar(0, 0, 0));
 		if (offset > 0) {
 			right.rowRange(cv::Range(offset, right.rows))
@@ -169,29 +175,72 @@ void stereo_processor::compute_disparity(cv::Mat left, cv::Mat right) {
 					.copyTo(right_adjusted.rowRange(cv::Range(-offset, right.rows)));
 		}
 		right = right_adjusted;
+	} else {
+		right = right.clone();
 	}
+	matcher_right = right;
 
-	matcher->compute(left, right, disparity);
+	if (matcher) {
+		matcher->invalidate(matcher_qt_wrapper_base::INPUT);
+	}
+}
 
-	cv::normalize(disparity, disparity_normalized, 0, 255, cv::NORM_MINMAX, CV_8U);
+/**
+ * Request disparity for the current matcher input from the disparity service, superseding any
+ * earlier request
+ * @param interactive false for new frames, true for changes made by the user
+ */
+void stereo_processor::compute_disparity(bool interactive) {
+	if(!matcher){
+		return;
+	}
+	service.request(matcher, matcher_left, matcher_right, interactive);
+}
+
+/**
+ * Emit ready frame (called on the disparity service's thread)
+ * @param disparity computed disparity
+ * @param preview whether it is a low-resolution preview
+ */
+void stereo_processor::publish_disparity(cv::Mat disparity, bool preview) {
+	cv::Mat normalized;
+	cv::normalize(disparity, normalized, 0, 255, cv::NORM_MINMAX, CV_8U);
 #ifdef MORPHOLOGY_CLOSE
 	cv::Mat kernel = cv::getStructuringElement(cv::MORPH_CROSS,cv::Size(3,3));
-	cv::morphologyEx(disparity_normalized,disparity_normalized,cv::MORPH_CLOSE,kernel);
+	cv::morphologyEx(normalized,normalized,cv::MORPH_CLOSE,kernel);
 #endif
-	cv::cvtColor(disparity_normalized, disparity_normalized, CV_GRAY2BGR);
+	cv::cvtColor(normalized, normalized, CV_GRAY2BGR);
+	if (!preview) {
+		std::unique_lock<std::mutex> lck(this->output_guard);
+		disparity_normalized = normalized;
+	}
 
 	std::shared_ptr<std::vector<cv::Mat>> images(new std::vector<cv::Mat>());
-	images->push_back(disparity_normalized);
+	images->push_back(normalized);
 	emit frame(images);
 }
 
+void stereo_processor::run() {
+	service.run();
+	worker::run();
+}
+
+void stereo_processor::stop() {
+	worker::stop();
+	service.stop();
+}
+
 int stereo_processor::get_v_offset() const {
 	return this->right_v_offset;
 }
 
 void stereo_processor::set_v_offset(int value) {
+	std::unique_lock<std::mutex> lck(this->input_guard);
 	right_v_offset = value;
-	recompute_disparity();
+	if (!last_left.empty()) {
+		update_matcher_input();
+		compute_disparity();
+	}
 }
 
 void stereo_processor::toggle_rectification() {
@@ -201,10 +250,9 @@ void stereo_processor::toggle_rectification() {
 		if (!last_left.empty()) {
 			if (rectification_enabled) {
 				_rectifier->rectify(last_left, last_right, last_left_rectified, last_right_rectified);
-				compute_disparity(last_left_rectified, last_right_rectified);
-			} else {
-				compute_disparity(last_left, last_right);
 			}
+			update_matcher_input();
+			compute_disparity();
 		}
 	}
 }
@@ -21,21 +21,76 @@
 #pragma once
 
 #include <opencv2/calib3d.hpp>
+#include <cstddef>
 
 namespace reco{
 namespace stereo_workbench{
 enum pixel_cost_type{
 	BIRCHFIELD_TOMASI = 0,
 	DAISY = 1,
-	NORM_L2 = 3
+	NORM_L2 = 3,
+	//Hamming distance of 9x7 census transforms, 62 bits
+	CENSUS = 4,
+	//Hamming distance of sparse 9x7 census transforms (checkerboard pattern), 30 bits
+	SPARSE_CENSUS = 5
 };
 
-cv::Ptr<cv::StereoSGBM> create_semiglobal_matcher(int minDisparity, int numDisparities, int block_size,
+/**
+ * Whether & how the matching costs of the whole image are computed ahead of the aggregation
+ */
+enum cost_volume_type{
+	//compute the matching costs row by row, whenever the aggregation needs them; overlapping stripes
+	//compute their shared rows again
+	COST_VOLUME_NONE = 0,
+	//compute the matching costs of the whole image once, in parallel, and store them as 16-bit integers
+	COST_VOLUME_16BIT = 1,
+	//same, with 8-bit integers, which saturate for costs above 255 (i.e. Birchfield-Tomasi costs of
+	//color images or DAISY costs), but are exact for census costs
+	COST_VOLUME_8BIT = 2
+};
+
+/**
+ * @brief cv::StereoSGBM with multithreading and control over the memory it uses
+ */
+class semiglobal_matcher : public cv::StereoSGBM{
+public:
+	virtual int get_num_threads() const = 0;
+	virtual void set_num_threads(int num_threads) = 0;
+	/**
+	 * @brief see semiglobal_matcher_parameters::memory_budget
+	 */
+	virtual size_t get_memory_budget() const = 0;
+	virtual void set_memory_budget(size_t memory_budget) = 0;
+	/**
+	 * @brief see semiglobal_matcher_parameters::compact_path_costs
+	 */
+	virtual bool get_compact_path_costs() const = 0;
+	virtual void set_compact_path_costs(bool compact_path_costs) = 0;
+	/**
+	 * @brief see semiglobal_matcher_parameters::quantized_descriptors
+	 */
+	virtual bool get_quantized_descriptors() const = 0;
+	virtual void set_quantized_descriptors(bool quantized_descriptors) = 0;
+	/**
+	 * @brief see semiglobal_matcher_parameters::cost_volume
+	 */
+	virtual cost_volume_type get_cost_volume() const = 0;
+	virtual void set_cost_volume(cost_volume_type cost_volume) = 0;
+	/**
+	 * @brief Largest amount of memory (in bytes) used at once by the last compute call: the cost and
+	 * path buffers, the cost calculator's data (i.e. descriptors), the output disparity and the
+	 * speckle filter's buffer. The input images are not included.
+	 */
+	virtual size_t get_peak_memory() const = 0;
+};
+
+cv::Ptr<semiglobal_matcher> create_semiglobal_matcher(int minDisparity, int numDisparities, int block_size,
                                  int P1, int P2, int disp12MaxDiff,
                                  int preFilterCap, int uniquenessRatio,
                                  int speckleWindowSize, int speckleRange,
                                  int mode,
-								 pixel_cost_type cost_type = pixel_cost_type::BIRCHFIELD_TOMASI);
+								 pixel_cost_type cost_type = pixel_cost_type::BIRCHFIELD_TOMASI,
+								 int num_threads = 0);
 
 struct semiglobal_matcher_parameters{
     semiglobal_matcher_parameters(){
@@ -48,12 +103,17 @@ struct semiglobal_matcher_parameters{
         speckleWindowSize = 0;
         speckleRange = 0;
         mode = cv::StereoSGBM::MODE_SGBM;
+        num_threads = 0;
+        memory_budget = 0;
+        compact_path_costs = false;
+        quantized_descriptors = false;
+        cost_volume = COST_VOLUME_NONE;
     }
 
     semiglobal_matcher_parameters( int _minDisparity, int _numDisparities, int block_window_size,
                       int _P1, int _P2, int _disp12MaxDiff, int _preFilterCap,
                       int _uniquenessRatio, int _speckleWindowSize, int _speckleRange,
-                      int _mode ){
+                      int _mode, int _num_threads = 0 ){
         minDisparity = _minDisparity;
         numDisparities = _numDisparities;
         this->block_size = block_window_size;
@@ -65,6 +125,11 @@ struct semiglobal_matcher_parameters{
         speckleWindowSize = _speckleWindowSize;
         speckleRange = _speckleRange;
         mode = _mode;
+        num_threads = _num_threads;
+        memory_budget = 0;
+        compact_path_costs = false;
+        quantized_descriptors = false;
+        cost_volume = COST_VOLUME_NONE;
     }
 
     int minDisparity;
@@ -78,6 +143,27 @@ struct semiglobal_matcher_parameters{
     int speckleRange;
     int disp12MaxDiff;
     int mode;
+    //number of threads for MODE_SGBM & MODE_HH, 0 to use all cores;
+    //the image is split into a fixed number of stripes, which the threads share, so the result doesn't depend on it
+    int num_threads;
+    //upper bound (in bytes) on the cost & path buffers of MODE_SGBM & MODE_HH (and the precomputed cost
+    //volume, if any), 0 for no bound.
+    //Under a budget, fewer stripes are processed at a time and, if a single one still doesn't fit (MODE_HH
+    //keeps the costs of all the rows it processes at once), the image is split into more (thinner) stripes.
+    //The result depends on the resulting number of stripes.
+    size_t memory_budget;
+    //store the per-direction path costs of MODE_SGBM & MODE_HH in 8 rather than 16 bits, relative to
+    //their minimum at each pixel, which halves the largest buffer of MODE_SGBM. This is lossless only
+    //for P2 <= 255, so with a larger P2 (or no vectorized kernels for the CPU) the 16-bit path costs
+    //are used instead and the flag has no effect.
+    bool compact_path_costs;
+    //for pixel_cost_type::DAISY: quantize the descriptors to 8 bits, which makes their storage 4x
+    //smaller and the distances faster to compute, but slightly changes the costs
+    bool quantized_descriptors;
+    //precompute the matching costs of the whole image. With a memory_budget, the cost volume is only
+    //precomputed if it fits into the budget alongside the smallest buffers the matcher can work with;
+    //the rest of the budget goes to the buffers.
+    cost_volume_type cost_volume;
 
 };
 }//stereo_workbench
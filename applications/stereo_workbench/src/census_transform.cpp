@@ -0,0 +1,243 @@
+/*
+ * census_transform.cpp
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: Gregory Kramida
+ *   Copyright: 2016 Gregory Kramida
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+//standard
+#include <algorithm>
+
+#include "census_transform.hpp"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define RECO_HAMMING_X86
+#include <immintrin.h>
+#endif
+
+namespace reco {
+namespace stereo_workbench {
+
+namespace {
+
+const int WINDOW_RADIUS_X = 4;
+const int WINDOW_RADIUS_Y = 3;
+
+/**
+ * Census transform with the window pixels in raster order, first one in the most significant bit
+ */
+template<typename census_type, bool sparse>
+void census_transform_rows(const uint8_t* image, int width, int height, size_t step, int row_begin,
+		int row_end, census_type* census) {
+	const uint8_t* rows[2 * WINDOW_RADIUS_Y + 1];
+	for (int y = row_begin; y < row_end; y++){
+		for (int dy = -WINDOW_RADIUS_Y; dy <= WINDOW_RADIUS_Y; dy++){
+			rows[dy + WINDOW_RADIUS_Y] = image + std::min(std::max(y + dy, 0), height - 1) * step;
+		}
+		census_type* census_row = census + (size_t) y * width;
+		for (int x = 0; x < width; x++){
+			bool interior = x >= WINDOW_RADIUS_X && x < width - WINDOW_RADIUS_X;
+			const uint8_t center = rows[WINDOW_RADIUS_Y][x];
+			census_type bits = 0;
+			for (int dy = -WINDOW_RADIUS_Y; dy <= WINDOW_RADIUS_Y; dy++){
+				const uint8_t* row = rows[dy + WINDOW_RADIUS_Y];
+				for (int dx = -WINDOW_RADIUS_X; dx <= WINDOW_RADIUS_X; dx++){
+					if ((dx == 0 && dy == 0) || (sparse && ((dx + dy) & 1))){
+						continue;
+					}
+					int neighbor_x = interior ? x + dx : std::min(std::max(x + dx, 0), width - 1);
+					bits = (census_type) ((bits << 1) | (row[neighbor_x] < center ? 1 : 0));
+				}
+			}
+			census_row[x] = bits;
+		}
+	}
+}
+
+void row_costs_64_scalar(uint64_t a, const uint64_t* b, int count, CostType* cost) {
+	for (int i = 0; i < count; i++){
+		uint64_t bits = a ^ b[i];
+		int distance = 0;
+		for (; bits; distance++){
+			bits &= bits - 1;
+		}
+		cost[i] = (CostType) distance;
+	}
+}
+
+void row_costs_32_scalar(uint32_t a, const uint32_t* b, int count, CostType* cost) {
+	for (int i = 0; i < count; i++){
+		uint32_t bits = a ^ b[i];
+		int distance = 0;
+		for (; bits; distance++){
+			bits &= bits - 1;
+		}
+		cost[i] = (CostType) distance;
+	}
+}
+
+#ifdef RECO_HAMMING_X86
+
+#define RECO_HAMMING_POPCNT __attribute__((target("popcnt")))
+#define RECO_HAMMING_AVX2 __attribute__((target("avx2,popcnt")))
+#define RECO_HAMMING_AVX512 __attribute__((target("avx512f,avx512vpopcntdq,popcnt")))
+
+RECO_HAMMING_POPCNT
+void row_costs_64_popcnt(uint64_t a, const uint64_t* b, int count, CostType* cost) {
+	for (int i = 0; i < count; i++){
+		cost[i] = (CostType) __builtin_popcountll(a ^ b[i]);
+	}
+}
+
+RECO_HAMMING_POPCNT
+void row_costs_32_popcnt(uint32_t a, const uint32_t* b, int count, CostType* cost) {
+	for (int i = 0; i < count; i++){
+		cost[i] = (CostType) __builtin_popcount(a ^ b[i]);
+	}
+}
+
+/**
+ * Bit counts of the 32-bit lanes, via a 4-bit lookup table
+ */
+RECO_HAMMING_AVX2
+inline __m256i popcount_epi32_avx2(const __m256i& v) {
+	const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+			0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i low_mask = _mm256_set1_epi8(0x0f);
+	__m256i byte_counts = _mm256_add_epi8(
+			_mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low_mask)),
+			_mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask)));
+	return _mm256_madd_epi16(_mm256_maddubs_epi16(byte_counts, _mm256_set1_epi8(1)),
+			_mm256_set1_epi16(1));
+}
+
+RECO_HAMMING_AVX2
+void row_costs_64_avx2(uint64_t a, const uint64_t* b, int count, CostType* cost) {
+	const __m256i va = _mm256_set1_epi64x((long long) a);
+	//packing interleaves the 64-bit lanes of the two 128-bit halves, this puts them back in order
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	int i = 0;
+	for (; i + 16 <= count; i += 16){
+		__m256i counts[4];
+		for (int j = 0; j < 4; j++){
+			counts[j] = popcount_epi32_avx2(_mm256_xor_si256(va,
+					_mm256_loadu_si256((const __m256i*) (b + i + j * 4))));
+		}
+		//add up the halves of each 64-bit lane, then narrow to 16 bits
+		__m256i packed = _mm256_packs_epi32(_mm256_hadd_epi32(counts[0], counts[1]),
+				_mm256_hadd_epi32(counts[2], counts[3]));
+		_mm256_storeu_si256((__m256i*) (cost + i), _mm256_permutevar8x32_epi32(packed, order));
+	}
+	row_costs_64_popcnt(a, b + i, count - i, cost + i);
+}
+
+RECO_HAMMING_AVX2
+void row_costs_32_avx2(uint32_t a, const uint32_t* b, int count, CostType* cost) {
+	const __m256i va = _mm256_set1_epi32((int) a);
+	int i = 0;
+	for (; i + 16 <= count; i += 16){
+		__m256i counts0 = popcount_epi32_avx2(
+				_mm256_xor_si256(va, _mm256_loadu_si256((const __m256i*) (b + i))));
+		__m256i counts1 = popcount_epi32_avx2(
+				_mm256_xor_si256(va, _mm256_loadu_si256((const __m256i*) (b + i + 8))));
+		//packing interleaves the 64-bit lanes of the two 128-bit halves, this puts them back in order
+		_mm256_storeu_si256((__m256i*) (cost + i),
+				_mm256_permute4x64_epi64(_mm256_packs_epi32(counts0, counts1), 0xD8));
+	}
+	row_costs_32_popcnt(a, b + i, count - i, cost + i);
+}
+
+RECO_HAMMING_AVX512
+void row_costs_64_avx512(uint64_t a, const uint64_t* b, int count, CostType* cost) {
+	const __m512i va = _mm512_set1_epi64((long long) a);
+	int i = 0;
+	for (; i + 8 <= count; i += 8){
+		__m512i counts = _mm512_popcnt_epi64(_mm512_xor_si512(va, _mm512_loadu_si512(b + i)));
+		_mm512_mask_cvtepi64_storeu_epi16(cost + i, (__mmask8) 0xFF, counts);
+	}
+	row_costs_64_popcnt(a, b + i, count - i, cost + i);
+}
+
+RECO_HAMMING_AVX512
+void row_costs_32_avx512(uint32_t a, const uint32_t* b, int count, CostType* cost) {
+	const __m512i va = _mm512_set1_epi32((int) a);
+	int i = 0;
+	for (; i + 16 <= count; i += 16){
+		__m512i counts = _mm512_popcnt_epi32(_mm512_xor_si512(va, _mm512_loadu_si512(b + i)));
+		_mm512_mask_cvtepi32_storeu_epi16(cost + i, (__mmask16) 0xFFFF, counts);
+	}
+	row_costs_32_popcnt(a, b + i, count - i, cost + i);
+}
+
+#endif //RECO_HAMMING_X86
+
+const hamming_distance_kernels scalar_kernels = { "scalar", row_costs_64_scalar, row_costs_32_scalar };
+#ifdef RECO_HAMMING_X86
+const hamming_distance_kernels popcnt_kernels = { "POPCNT", row_costs_64_popcnt, row_costs_32_popcnt };
+const hamming_distance_kernels avx2_kernels = { "AVX2", row_costs_64_avx2, row_costs_32_avx2 };
+const hamming_distance_kernels avx512_kernels = { "AVX-512 VPOPCNTDQ", row_costs_64_avx512,
+		row_costs_32_avx512 };
+#endif
+
+} //end anonymous namespace
+
+void census_transform(const uint8_t* image, int width, int height, size_t step, int row_begin,
+		int row_end, uint64_t* census) {
+	census_transform_rows<uint64_t, false>(image, width, height, step, row_begin, row_end, census);
+}
+
+void sparse_census_transform(const uint8_t* image, int width, int height, size_t step, int row_begin,
+		int row_end, uint32_t* census) {
+	census_transform_rows<uint32_t, true>(image, width, height, step, row_begin, row_end, census);
+}
+
+hamming_instruction_set detect_hamming_instruction_set() {
+	static const hamming_instruction_set detected = []() {
+		hamming_instruction_set instruction_set = HAMMING_SCALAR;
+#ifdef RECO_HAMMING_X86
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512vpopcntdq") && __builtin_cpu_supports("popcnt")) {
+			instruction_set = HAMMING_AVX512_VPOPCNTDQ;
+		} else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+			instruction_set = HAMMING_AVX2;
+		} else if (__builtin_cpu_supports("popcnt")) {
+			instruction_set = HAMMING_POPCNT;
+		}
+#endif
+		return instruction_set;
+	}();
+	return detected;
+}
+
+const hamming_distance_kernels& get_hamming_distance_kernels(hamming_instruction_set instruction_set) {
+	instruction_set = std::min(instruction_set, detect_hamming_instruction_set());
+#ifdef RECO_HAMMING_X86
+	switch (instruction_set) {
+	case HAMMING_AVX512_VPOPCNTDQ:
+		return avx512_kernels;
+	case HAMMING_AVX2:
+		return avx2_kernels;
+	case HAMMING_POPCNT:
+		return popcnt_kernels;
+	default:
+		break;
+	}
+#endif
+	return scalar_kernels;
+}
+
+} //stereo_workbench
+} //reco
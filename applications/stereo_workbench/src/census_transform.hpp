@@ -0,0 +1,86 @@
+/*
+ * census_transform.hpp
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: Gregory Kramida
+ *   Copyright: 2016 Gregory Kramida
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+//standard
+#include <cstddef>
+#include <cstdint>
+
+namespace reco {
+namespace stereo_workbench {
+
+typedef short CostType;
+
+/**
+ * Census transforms over a 9x7 (width x height) window: each bit tells whether a pixel of the window is
+ * darker than the center one. Pixels outside the image are replicated from its border.
+ */
+//all 62 pixels of the window except the center, 64-bit bitstrings
+const int CENSUS_BITS = 62;
+//the 30 pixels of the window at an even (nonzero) Manhattan distance from the center, 32-bit bitstrings
+const int SPARSE_CENSUS_BITS = 30;
+
+/**
+ * @brief Census bitstrings of rows [row_begin, row_end) of a grayscale image, written to
+ * census + y * width for each row y.
+ * @param step distance between image rows in bytes
+ */
+void census_transform(const uint8_t* image, int width, int height, size_t step, int row_begin,
+		int row_end, uint64_t* census);
+/**
+ * @brief same as census_transform, for the sparse (checkerboard) pattern
+ */
+void sparse_census_transform(const uint8_t* image, int width, int height, size_t step, int row_begin,
+		int row_end, uint32_t* census);
+
+/**
+ * @brief Vectorized Hamming distances between bitstrings, for matching costs:
+ * cost[i] = popcount(a ^ b[i]) for i in [0, count).
+ *
+ * The bitstrings of the second image are expected to be stored right-to-left, so that a pixel's costs
+ * for disparities minD, minD + 1, ... come from consecutive bitstrings.
+ */
+struct hamming_distance_kernels {
+	const char* name;
+	void (*row_costs_64)(uint64_t a, const uint64_t* b, int count, CostType* cost);
+	void (*row_costs_32)(uint32_t a, const uint32_t* b, int count, CostType* cost);
+};
+
+enum hamming_instruction_set {
+	HAMMING_SCALAR = 0,
+	HAMMING_POPCNT = 1,
+	HAMMING_AVX2 = 2,
+	HAMMING_AVX512_VPOPCNTDQ = 3
+};
+
+/**
+ * @brief The widest instruction set the kernels support on this CPU (detected once via CPUID)
+ */
+hamming_instruction_set detect_hamming_instruction_set();
+
+/**
+ * @brief Kernels for the given instruction set, or the widest one the CPU supports below it
+ */
+const hamming_distance_kernels& get_hamming_distance_kernels(
+		hamming_instruction_set instruction_set = HAMMING_AVX512_VPOPCNTDQ);
+
+} //stereo_workbench
+} //reco
@@ -0,0 +1,251 @@
+/*
+ * descriptor_distance.cpp
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: Gregory Kramida
+ *   Copyright: 2016 Gregory Kramida
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+//standard
+#include <climits>
+#include <algorithm>
+
+#include "descriptor_distance.hpp"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define RECO_DESCRIPTOR_X86
+#include <immintrin.h>
+#endif
+
+namespace reco {
+namespace stereo_workbench {
+
+namespace {
+
+inline CostType to_cost(float distance, float scale) {
+	return (CostType) std::min(distance * scale, (float) SHRT_MAX);
+}
+
+void row_costs_float_scalar(const float* a, const float* b, int length, int count, float scale,
+		CostType* cost) {
+	for (int i = 0; i < count; i++, b -= length){
+		float sum = 0.0f;
+		for (int k = 0; k < length; k++){
+			float difference = a[k] - b[k];
+			sum += difference * difference;
+		}
+		cost[i] = to_cost(sum, scale);
+	}
+}
+
+void row_costs_u8_scalar(const uint8_t* a, const uint8_t* b, int length, int count, float scale,
+		CostType* cost) {
+	for (int i = 0; i < count; i++, b -= length){
+		int sum = 0;
+		for (int k = 0; k < length; k++){
+			int difference = (int) a[k] - (int) b[k];
+			sum += difference * difference;
+		}
+		cost[i] = to_cost((float) sum, scale);
+	}
+}
+
+#ifdef RECO_DESCRIPTOR_X86
+
+#define RECO_DESCRIPTOR_SSE2 __attribute__((target("sse2")))
+#define RECO_DESCRIPTOR_AVX2 __attribute__((target("avx2,fma")))
+
+RECO_DESCRIPTOR_SSE2
+void row_costs_float_sse2(const float* a, const float* b, int length, int count, float scale,
+		CostType* cost) {
+	int i = 0;
+	for (; i + 4 <= count; i += 4, b -= 4 * length){
+		const float* b1 = b - length;
+		const float* b2 = b1 - length;
+		const float* b3 = b2 - length;
+		__m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps(), s2 = _mm_setzero_ps(),
+				s3 = _mm_setzero_ps();
+		for (int k = 0; k < length; k += 4){
+			__m128 va = _mm_loadu_ps(a + k);
+			__m128 d0 = _mm_sub_ps(va, _mm_loadu_ps(b + k));
+			__m128 d1 = _mm_sub_ps(va, _mm_loadu_ps(b1 + k));
+			__m128 d2 = _mm_sub_ps(va, _mm_loadu_ps(b2 + k));
+			__m128 d3 = _mm_sub_ps(va, _mm_loadu_ps(b3 + k));
+			s0 = _mm_add_ps(s0, _mm_mul_ps(d0, d0));
+			s1 = _mm_add_ps(s1, _mm_mul_ps(d1, d1));
+			s2 = _mm_add_ps(s2, _mm_mul_ps(d2, d2));
+			s3 = _mm_add_ps(s3, _mm_mul_ps(d3, d3));
+		}
+		//transpose & add up, so that lane j holds the sum of sj
+		_MM_TRANSPOSE4_PS(s0, s1, s2, s3);
+		float sums[4];
+		_mm_storeu_ps(sums, _mm_add_ps(_mm_add_ps(s0, s1), _mm_add_ps(s2, s3)));
+		for (int j = 0; j < 4; j++){
+			cost[i + j] = to_cost(sums[j], scale);
+		}
+	}
+	row_costs_float_scalar(a, b, length, count - i, scale, cost + i);
+}
+
+RECO_DESCRIPTOR_AVX2
+void row_costs_float_avx2(const float* a, const float* b, int length, int count, float scale,
+		CostType* cost) {
+	int i = 0;
+	for (; i + 4 <= count; i += 4, b -= 4 * length){
+		const float* b1 = b - length;
+		const float* b2 = b1 - length;
+		const float* b3 = b2 - length;
+		__m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps(), s2 = _mm256_setzero_ps(),
+				s3 = _mm256_setzero_ps();
+		for (int k = 0; k < length; k += 8){
+			__m256 va = _mm256_loadu_ps(a + k);
+			__m256 d0 = _mm256_sub_ps(va, _mm256_loadu_ps(b + k));
+			__m256 d1 = _mm256_sub_ps(va, _mm256_loadu_ps(b1 + k));
+			__m256 d2 = _mm256_sub_ps(va, _mm256_loadu_ps(b2 + k));
+			__m256 d3 = _mm256_sub_ps(va, _mm256_loadu_ps(b3 + k));
+			s0 = _mm256_fmadd_ps(d0, d0, s0);
+			s1 = _mm256_fmadd_ps(d1, d1, s1);
+			s2 = _mm256_fmadd_ps(d2, d2, s2);
+			s3 = _mm256_fmadd_ps(d3, d3, s3);
+		}
+		//pairwise sums within 128-bit halves, then across them: lane j holds the sum of sj
+		__m256 s = _mm256_hadd_ps(_mm256_hadd_ps(s0, s1), _mm256_hadd_ps(s2, s3));
+		float sums[4];
+		_mm_storeu_ps(sums, _mm_add_ps(_mm256_castps256_ps128(s), _mm256_extractf128_ps(s, 1)));
+		for (int j = 0; j < 4; j++){
+			cost[i + j] = to_cost(sums[j], scale);
+		}
+	}
+	row_costs_float_scalar(a, b, length, count - i, scale, cost + i);
+}
+
+RECO_DESCRIPTOR_SSE2
+inline __m128i squared_differences_u8_sse2(const __m128i& va, const uint8_t* b) {
+	const __m128i zero = _mm_setzero_si128();
+	__m128i vb = _mm_loadu_si128((const __m128i*) b);
+	__m128i low = _mm_sub_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero));
+	__m128i high = _mm_sub_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero));
+	return _mm_add_epi32(_mm_madd_epi16(low, low), _mm_madd_epi16(high, high));
+}
+
+RECO_DESCRIPTOR_SSE2
+void row_costs_u8_sse2(const uint8_t* a, const uint8_t* b, int length, int count, float scale,
+		CostType* cost) {
+	int i = 0;
+	for (; i + 4 <= count; i += 4, b -= 4 * length){
+		const uint8_t* b1 = b - length;
+		const uint8_t* b2 = b1 - length;
+		const uint8_t* b3 = b2 - length;
+		__m128i s0 = _mm_setzero_si128(), s1 = _mm_setzero_si128(), s2 = _mm_setzero_si128(),
+				s3 = _mm_setzero_si128();
+		for (int k = 0; k < length; k += 16){
+			__m128i va = _mm_loadu_si128((const __m128i*) (a + k));
+			s0 = _mm_add_epi32(s0, squared_differences_u8_sse2(va, b + k));
+			s1 = _mm_add_epi32(s1, squared_differences_u8_sse2(va, b1 + k));
+			s2 = _mm_add_epi32(s2, squared_differences_u8_sse2(va, b2 + k));
+			s3 = _mm_add_epi32(s3, squared_differences_u8_sse2(va, b3 + k));
+		}
+		//transpose & add up, so that lane j holds the sum of sj
+		__m128i t0 = _mm_unpacklo_epi32(s0, s1), t1 = _mm_unpackhi_epi32(s0, s1);
+		__m128i t2 = _mm_unpacklo_epi32(s2, s3), t3 = _mm_unpackhi_epi32(s2, s3);
+		__m128i s = _mm_add_epi32(_mm_add_epi32(_mm_unpacklo_epi64(t0, t2), _mm_unpackhi_epi64(t0, t2)),
+				_mm_add_epi32(_mm_unpacklo_epi64(t1, t3), _mm_unpackhi_epi64(t1, t3)));
+		int sums[4];
+		_mm_storeu_si128((__m128i*) sums, s);
+		for (int j = 0; j < 4; j++){
+			cost[i + j] = to_cost((float) sums[j], scale);
+		}
+	}
+	row_costs_u8_scalar(a, b, length, count - i, scale, cost + i);
+}
+
+RECO_DESCRIPTOR_AVX2
+inline __m256i squared_differences_u8_avx2(const __m256i& va, const uint8_t* b) {
+	__m256i difference = _mm256_sub_epi16(va,
+			_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) b)));
+	return _mm256_madd_epi16(difference, difference);
+}
+
+RECO_DESCRIPTOR_AVX2
+void row_costs_u8_avx2(const uint8_t* a, const uint8_t* b, int length, int count, float scale,
+		CostType* cost) {
+	int i = 0;
+	for (; i + 4 <= count; i += 4, b -= 4 * length){
+		const uint8_t* b1 = b - length;
+		const uint8_t* b2 = b1 - length;
+		const uint8_t* b3 = b2 - length;
+		__m256i s0 = _mm256_setzero_si256(), s1 = _mm256_setzero_si256(),
+				s2 = _mm256_setzero_si256(), s3 = _mm256_setzero_si256();
+		for (int k = 0; k < length; k += 16){
+			__m256i va = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) (a + k)));
+			s0 = _mm256_add_epi32(s0, squared_differences_u8_avx2(va, b + k));
+			s1 = _mm256_add_epi32(s1, squared_differences_u8_avx2(va, b1 + k));
+			s2 = _mm256_add_epi32(s2, squared_differences_u8_avx2(va, b2 + k));
+			s3 = _mm256_add_epi32(s3, squared_differences_u8_avx2(va, b3 + k));
+		}
+		//pairwise sums within 128-bit halves, then across them: lane j holds the sum of sj
+		__m256i s = _mm256_hadd_epi32(_mm256_hadd_epi32(s0, s1), _mm256_hadd_epi32(s2, s3));
+		int sums[4];
+		_mm_storeu_si128((__m128i*) sums,
+				_mm_add_epi32(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1)));
+		for (int j = 0; j < 4; j++){
+			cost[i + j] = to_cost((float) sums[j], scale);
+		}
+	}
+	row_costs_u8_scalar(a, b, length, count - i, scale, cost + i);
+}
+
+#endif //RECO_DESCRIPTOR_X86
+
+} //end anonymous namespace
+
+descriptor_instruction_set detect_descriptor_instruction_set() {
+	static const descriptor_instruction_set detected = []() {
+		descriptor_instruction_set instruction_set = DESCRIPTOR_SCALAR;
+#ifdef RECO_DESCRIPTOR_X86
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+			instruction_set = DESCRIPTOR_AVX2;
+		} else if (__builtin_cpu_supports("sse2")) {
+			instruction_set = DESCRIPTOR_SSE2;
+		}
+#endif
+		return instruction_set;
+	}();
+	return detected;
+}
+
+const descriptor_distance_kernels& get_descriptor_distance_kernels(
+		descriptor_instruction_set instruction_set) {
+	static const descriptor_distance_kernels scalar = { "scalar", row_costs_float_scalar,
+			row_costs_u8_scalar };
+	instruction_set = std::min(instruction_set, detect_descriptor_instruction_set());
+#ifdef RECO_DESCRIPTOR_X86
+	static const descriptor_distance_kernels sse2 = { "SSE2", row_costs_float_sse2, row_costs_u8_sse2 };
+	static const descriptor_distance_kernels avx2 = { "AVX2", row_costs_float_avx2, row_costs_u8_avx2 };
+	switch (instruction_set) {
+	case DESCRIPTOR_AVX2:
+		return avx2;
+	case DESCRIPTOR_SSE2:
+		return sse2;
+	default:
+		break;
+	}
+#endif
+	return scalar;
+}
+
+} //stereo_workbench
+} //reco
@@ -0,0 +1,82 @@
+/*
+ * descriptor_distance.hpp
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: Gregory Kramida
+ *   Copyright: 2016 Gregory Kramida
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+//standard
+#include <cstdint>
+
+namespace reco {
+namespace stereo_workbench {
+
+typedef short CostType;
+
+/**
+ * Descriptors handed to the kernels are stored contiguously, one after another, and padded with zeros
+ * to a multiple of this many elements.
+ */
+const int descriptor_length_alignment = 16;
+
+/**
+ * @brief Vectorized squared-L2 distances between dense per-pixel descriptors, for matching costs.
+ *
+ * Each kernel computes the costs of one descriptor a of the first image against count consecutive
+ * descriptors of the second image going left from b, i.e. against b - i*length for i in [0, count),
+ * which is what one pixel of a matching cost row needs for disparities minD, minD + 1, ...
+ * Four descriptors of the second image are processed at once, so every chunk of a is loaded once
+ * for all four of them; consecutive pixels share all but one of their descriptors of the second
+ * image, which therefore stay in cache.
+ * cost[i] = min(scale * |a - b_i|^2, SHRT_MAX), truncated.
+ */
+struct descriptor_distance_kernels {
+	const char* name;
+	/**
+	 * @brief costs for descriptors of floats
+	 */
+	void (*row_costs_float)(const float* a, const float* b, int length, int count, float scale,
+			CostType* cost);
+	/**
+	 * @brief costs for quantized descriptors; the squared differences are summed with 16-bit
+	 * integer dot products, which is exact.
+	 */
+	void (*row_costs_u8)(const uint8_t* a, const uint8_t* b, int length, int count, float scale,
+			CostType* cost);
+};
+
+enum descriptor_instruction_set {
+	DESCRIPTOR_SCALAR = 0,
+	DESCRIPTOR_SSE2 = 1,
+	//AVX2 with FMA
+	DESCRIPTOR_AVX2 = 2
+};
+
+/**
+ * @brief The widest instruction set the kernels support on this CPU (detected once via CPUID)
+ */
+descriptor_instruction_set detect_descriptor_instruction_set();
+
+/**
+ * @brief Kernels for the given instruction set, or the widest one the CPU supports below it
+ */
+const descriptor_distance_kernels& get_descriptor_distance_kernels(
+		descriptor_instruction_set instruction_set = DESCRIPTOR_AVX2);
+
+} //stereo_workbench
+} //reco
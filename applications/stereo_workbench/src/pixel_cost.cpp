@@ -19,6 +19,9 @@
  */
 #include "pixel_cost.hpp"
 #include <opencv2/xfeatures2d.hpp>
+#include <opencv2/imgproc.hpp>
+#include <vector>
+#include <algorithm>
 
 #include <reco/utils/debug_util.h>
 #include <reco/utils/cpp_exception_util.h>
@@ -55,49 +58,101 @@ void calculate_row_cost_L2( const Mat& img1, const Mat& img2, int y,
 		}
 	}
 }
+
+namespace{
+//DAISY descriptor values lie in [0, 1] (the histograms are normalized to unit length), quantized ones
+//in [0, 255]
+const float DAISY_QUANTIZATION_SCALE = 255.0f;
+//scale from squared distances of float descriptors to costs
+const float DAISY_COST_SCALE = 100.0f;
+
+/**
+ * Copy the descriptors (one per row) into rows padded to a multiple of descriptor_length_alignment,
+ * converting them to 8-bit integers if quantized
+ */
+Mat pad_descriptors(const Mat& descriptors, bool quantized){
+	int padded_length = (descriptors.cols + descriptor_length_alignment - 1)
+			/ descriptor_length_alignment * descriptor_length_alignment;
+	Mat padded = Mat::zeros(descriptors.rows, padded_length, quantized ? CV_8U : CV_32F);
+	Mat unpadded = padded.colRange(0, descriptors.cols);
+	//converting to 8 bits rounds & saturates
+	descriptors.convertTo(unpadded, padded.type(), quantized ? DAISY_QUANTIZATION_SCALE : 1.0);
+	return padded;
+}
+
+struct DAISY_row_body : public ParallelLoopBody{
+	const descriptor_distance_kernels& kernels;
+	const Mat& descriptors1, & descriptors2;
+	bool quantized;
+	int descriptor_length;
+	float cost_scale;
+	//descriptor index of the first pixel of the cost row
+	int first_pixel;
+	int minD, D;
+	CostType* cost;
+
+	DAISY_row_body(const descriptor_distance_kernels& kernels, const Mat& descriptors1,
+			const Mat& descriptors2, bool quantized, int descriptor_length, float cost_scale,
+			int first_pixel, int minD, int D, CostType* cost):
+				kernels(kernels), descriptors1(descriptors1), descriptors2(descriptors2),
+				quantized(quantized), descriptor_length(descriptor_length), cost_scale(cost_scale),
+				first_pixel(first_pixel), minD(minD), D(D), cost(cost){}
+
+	void operator()(const Range& range) const{
+		for(int xd = range.start; xd < range.end; xd++){
+			int x = first_pixel + xd;
+			//costs for d = minD...maxD-1 come from pixels x - minD leftwards in the second image
+			if(quantized){
+				kernels.row_costs_u8(descriptors1.ptr<uint8_t>(x), descriptors2.ptr<uint8_t>(x - minD),
+						descriptor_length, D, cost_scale, cost + xd*D);
+			}else{
+				kernels.row_costs_float(descriptors1.ptr<float>(x), descriptors2.ptr<float>(x - minD),
+						descriptor_length, D, cost_scale, cost + xd*D);
+			}
+		}
+	}
+};
+}//end anonymous namespace
+
 DAISY_stereo_cost_calculator::DAISY_stereo_cost_calculator(const cv::Mat& img1, const cv::Mat& img2,
 			const semiglobal_matcher_parameters& params):
-			abstract_stereo_cost_calculator(img1, img2){
+			abstract_stereo_cost_calculator(img1, img2),
+			kernels(get_descriptor_distance_kernels()){
 	this->minD = params.minDisparity;
 	this->maxD = params.minDisparity + params.numDisparities;
 	this->image_width = img1.cols;
+	this->quantized = params.quantized_descriptors;
 	Ptr<xfeatures2d::DAISY> daisy = cv::xfeatures2d::DAISY::create(15,3,8,8,cv::xfeatures2d::DAISY::NRM_PARTIAL,
 			cv::noArray(),true,false);
-	daisy->compute(img1,descriptors1);
-	daisy->compute(img2,descriptors2);
+	Mat dense_descriptors;
+	//the dense descriptors are one row per pixel, in row-major order
+	daisy->compute(img1,dense_descriptors);
+	descriptors1 = pad_descriptors(dense_descriptors, quantized);
+	daisy->compute(img2,dense_descriptors);
+	descriptors2 = pad_descriptors(dense_descriptors, quantized);
+	descriptor_length = descriptors1.cols;
+	cost_scale = quantized ?
+			DAISY_COST_SCALE / (DAISY_QUANTIZATION_SCALE * DAISY_QUANTIZATION_SCALE) : DAISY_COST_SCALE;
 };
 
-//static int max = 0;
+size_t DAISY_stereo_cost_calculator::get_memory_footprint() const{
+	return descriptors1.total() * descriptors1.elemSize() + descriptors2.total() * descriptors2.elemSize();
+}
+
 void DAISY_stereo_cost_calculator::compute(int y,CostType* cost){
 	const int minX1 = std::max(maxD, 0), maxX1 = image_width + std::min(minD, 0);
-	int D = maxD - minD;
-	const int y_offset = y*image_width;
-	const double norm_factor = 100.0D;
-
-	//#pragma omp parallel for
-	for( int x = y_offset + minX1, xd = 0; x < y_offset + maxX1; x++, xd++ ){
-		Mat desc1 = descriptors1.row(x);
-		for( int d = minD; d < maxD; d++ ){
-			Mat desc2 = descriptors2.row(x - d);
-			double nrm = cv::norm(desc1,desc2,cv::NormTypes::NORM_L2SQR);
-//			if((int)(nrm*norm_factor) > max){
-//				max = nrm*norm_factor;
-//				dpt(max);
-//			}
-			cost[xd*D + d] = (CostType)(nrm * norm_factor);
-		}
-	}
+	const int D = maxD - minD;
+	//rows are usually computed concurrently already, so only split them into a few large chunks
+	const double num_chunks = 4;
+	parallel_for_(Range(0, maxX1 - minX1),
+			DAISY_row_body(kernels, descriptors1, descriptors2, quantized, descriptor_length,
+					cost_scale, y*image_width + minX1, minD, D, cost), num_chunks);
 }
 
 BT_stereo_cost_calculator::BT_stereo_cost_calculator(const cv::Mat& img1, const cv::Mat& img2, const semiglobal_matcher_parameters& params):
 				abstract_stereo_cost_calculator(img1, img2){
 	this->minD = params.minDisparity;
 	this->maxD = params.minDisparity + params.numDisparities;
-	Mat buffer;
-	int tmpBufSize   = img1.cols*16*img1.channels()*sizeof(PixType);
-	mat_buf.create(1, tmpBufSize, CV_8U);
-
-	this->buffer = (PixType*)mat_buf.ptr();
 	table_offset = 256*4;
 	int TAB_SIZE = 256 + table_offset*2;
 	ftzero = std::max(params.preFilterCap, 15) | 1;
@@ -130,6 +185,11 @@ void BT_stereo_cost_calculator::compute(int y, CostType* cost){
 	const PixType* row_img1 = img1.ptr<PixType>(y);
 	const PixType* row_img2 = img2.ptr<PixType>(y);
 
+	//scratch space is per-thread, since rows may be computed concurrently
+	static thread_local std::vector<PixType> scratch;
+	scratch.resize(image_width*16*channel_number);
+	PixType* buffer = scratch.data();
+
 	//TODO why is this offset necessary?
 	PixType* precomputed_buffer_img1 = buffer + width2*2;
 	PixType* precomputed_buffer_img2 = precomputed_buffer_img1 + image_width*channel_number*2;
@@ -270,6 +330,156 @@ void BT_stereo_cost_calculator::compute(int y, CostType* cost){
 	}
 }
 
+namespace{
+/**
+ * Census transform of a band of image rows; with reverse, the bitstrings of each row are stored
+ * right-to-left
+ */
+template<typename census_type>
+struct census_transform_body : public ParallelLoopBody{
+	const Mat& gray;
+	bool reverse;
+	census_type* census;
+
+	census_transform_body(const Mat& gray, bool reverse, census_type* census):
+		gray(gray), reverse(reverse), census(census){}
+
+	void transform(int row_begin, int row_end, uint64_t*) const{
+		census_transform(gray.ptr<uint8_t>(), gray.cols, gray.rows, gray.step, row_begin, row_end,
+				census);
+	}
+	void transform(int row_begin, int row_end, uint32_t*) const{
+		sparse_census_transform(gray.ptr<uint8_t>(), gray.cols, gray.rows, gray.step, row_begin,
+				row_end, census);
+	}
+
+	void operator()(const Range& range) const{
+		transform(range.start, range.end, census);
+		if(reverse){
+			for(int y = range.start; y < range.end; y++){
+				std::reverse(census + (size_t)y*gray.cols, census + (size_t)(y + 1)*gray.cols);
+			}
+		}
+	}
+};
+
+template<typename census_type>
+void compute_census(const Mat& image, bool reverse, std::vector<census_type>& census){
+	Mat gray;
+	if(image.channels() == 1){
+		gray = image;
+	}else{
+		cvtColor(image, gray, COLOR_BGR2GRAY);
+	}
+	census.resize(gray.total());
+	parallel_for_(Range(0, gray.rows), census_transform_body<census_type>(gray, reverse, census.data()));
+}
+}//end anonymous namespace
+
+census_stereo_cost_calculator::census_stereo_cost_calculator(const cv::Mat& img1, const cv::Mat& img2,
+		const semiglobal_matcher_parameters& params, bool sparse):
+		abstract_stereo_cost_calculator(img1, img2),
+		sparse(sparse),
+		kernels(get_hamming_distance_kernels()){
+	this->minD = params.minDisparity;
+	this->maxD = params.minDisparity + params.numDisparities;
+	this->image_width = img1.cols;
+	if(sparse){
+		compute_census(img1, false, sparse_census1);
+		compute_census(img2, true, sparse_census2);
+	}else{
+		compute_census(img1, false, census1);
+		compute_census(img2, true, census2);
+	}
+}
+
+size_t census_stereo_cost_calculator::get_memory_footprint() const{
+	return (census1.size() + census2.size()) * sizeof(uint64_t)
+			+ (sparse_census1.size() + sparse_census2.size()) * sizeof(uint32_t);
+}
+
+void census_stereo_cost_calculator::compute(int y, CostType* cost){
+	const int minX1 = std::max(maxD, 0), maxX1 = image_width + std::min(minD, 0);
+	const int D = maxD - minD;
+	const size_t row_offset = (size_t)y*image_width;
+	for(int x = minX1, xd = 0; x < maxX1; x++, xd++){
+		//pixel x - d of the second image is at image_width - 1 - x + d in its reversed row
+		const size_t reversed_offset = row_offset + image_width - 1 - x + minD;
+		if(sparse){
+			kernels.row_costs_32(sparse_census1[row_offset + x], &sparse_census2[reversed_offset], D,
+					cost + xd*D);
+		}else{
+			kernels.row_costs_64(census1[row_offset + x], &census2[reversed_offset], D, cost + xd*D);
+		}
+	}
+}
+
+namespace{
+/**
+ * Computes the cost rows of a band of image rows into the cost volume
+ */
+struct cost_volume_body : public ParallelLoopBody{
+	abstract_stereo_cost_calculator& source;
+	Mat& volume;
+
+	cost_volume_body(abstract_stereo_cost_calculator& source, Mat& volume):
+		source(source), volume(volume){}
+
+	void operator()(const Range& range) const{
+		if(volume.depth() == CV_16S){
+			for(int y = range.start; y < range.end; y++){
+				source.compute(y, volume.ptr<CostType>(y));
+			}
+		}else{
+			std::vector<CostType> row(volume.cols);
+			for(int y = range.start; y < range.end; y++){
+				source.compute(y, row.data());
+				uchar* compact_row = volume.ptr<uchar>(y);
+				for(int i = 0; i < volume.cols; i++){
+					compact_row[i] = saturate_cast<uchar>(row[i]);
+				}
+			}
+		}
+	}
+};
+}//end anonymous namespace
+
+precomputed_stereo_cost_calculator::precomputed_stereo_cost_calculator(const cv::Mat& img1,
+		const cv::Mat& img2, const semiglobal_matcher_parameters& params,
+		std::unique_ptr<abstract_stereo_cost_calculator> source, bool compact):
+		abstract_stereo_cost_calculator(img1, img2),
+		source(std::move(source)),
+		compact(compact){
+	int minD = params.minDisparity, maxD = params.minDisparity + params.numDisparities;
+	int width1 = img1.cols + std::min(minD, 0) - std::max(maxD, 0);
+	row_size = (size_t)std::max(width1, 0) * params.numDisparities;
+	volume.create(img1.rows, (int)row_size, compact ? CV_8U : CV_16S);
+	parallel_for_(Range(0, img1.rows), cost_volume_body(*this->source, volume));
+}
+
+size_t precomputed_stereo_cost_calculator::get_volume_size(cv::Size image_size,
+		const semiglobal_matcher_parameters& params, bool compact){
+	int minD = params.minDisparity, maxD = params.minDisparity + params.numDisparities;
+	int width1 = image_size.width + std::min(minD, 0) - std::max(maxD, 0);
+	return (size_t)std::max(width1, 0) * params.numDisparities * image_size.height
+			* (compact ? sizeof(uchar) : sizeof(CostType));
+}
+
+size_t precomputed_stereo_cost_calculator::get_memory_footprint() const{
+	return volume.total() * volume.elemSize() + source->get_memory_footprint();
+}
+
+void precomputed_stereo_cost_calculator::compute(int y, CostType* cost){
+	if(compact){
+		const uchar* compact_row = volume.ptr<uchar>(y);
+		for(size_t i = 0; i < row_size; i++){
+			cost[i] = compact_row[i];
+		}
+	}else{
+		memcpy(cost, volume.ptr<CostType>(y), row_size*sizeof(CostType));
+	}
+}
+
 std::unique_ptr<abstract_stereo_cost_calculator> build_stereo_cost_calculator(pixel_cost_type type,
 		const cv::Mat& img1, const cv::Mat& img2,const semiglobal_matcher_parameters& params){
 	switch(type){
@@ -279,6 +489,12 @@ std::unique_ptr<abstract_stereo_cost_calculator> build_stereo_cost_calculator(pi
 	case DAISY:
 		return std::unique_ptr<abstract_stereo_cost_calculator>(new DAISY_stereo_cost_calculator(img1,img2,params));
 		break;
+	case CENSUS:
+		return std::unique_ptr<abstract_stereo_cost_calculator>(new census_stereo_cost_calculator(img1,img2,params,false));
+		break;
+	case SPARSE_CENSUS:
+		return std::unique_ptr<abstract_stereo_cost_calculator>(new census_stereo_cost_calculator(img1,img2,params,true));
+		break;
 	default:
 		err2(std::runtime_error, "Unknown semiglobal matcher cost type: " << static_cast<int>(type));
 		return std::unique_ptr<abstract_stereo_cost_calculator>();
@@ -23,8 +23,11 @@
 #include <opencv2/core.hpp>
 #include <functional>
 #include <memory>
+#include <vector>
 
 #include <reco/stereo_workbench/semiglobal_matcher.hpp>
+#include "descriptor_distance.hpp"
+#include "census_transform.hpp"
 
 namespace reco{
 namespace stereo_workbench{
@@ -39,25 +42,48 @@ void calculate_row_cost_L2( const cv::Mat& img1, const cv::Mat& img2, int y,
         int tabOfs, int);
 
 
+/**
+ * Computes rows of the raw matching cost volume. compute may be called concurrently from several
+ * threads (for different rows), so implementations must not keep per-call state in members.
+ */
 class abstract_stereo_cost_calculator{
 public:
 	abstract_stereo_cost_calculator(const cv::Mat& img1, const cv::Mat& img2):img1(img1),img2(img2){}
 	virtual ~abstract_stereo_cost_calculator(){};
 	virtual void compute(int y, CostType* cost) = 0;
+	/**
+	 * @brief memory (in bytes) kept by the calculator for the whole image, i.e. precomputed descriptors
+	 */
+	virtual size_t get_memory_footprint() const {
+		return 0;
+	}
 protected:
 	const cv::Mat& img1;
 	const cv::Mat& img2;
 };
 
+/**
+ * Squared L2 distances between dense DAISY descriptors. The descriptors of each image are stored
+ * contiguously (one row per pixel, padded for the distance kernels), as floats or, with
+ * semiglobal_matcher_parameters::quantized_descriptors, as 8-bit integers, which takes a quarter of
+ * the memory.
+ */
 class DAISY_stereo_cost_calculator : public abstract_stereo_cost_calculator{
 
 public:
 	DAISY_stereo_cost_calculator(const cv::Mat& img1, const cv::Mat& img2,
 			const semiglobal_matcher_parameters& params);
 	virtual void compute(int y,CostType* cost);
+	virtual size_t get_memory_footprint() const;
 private:
 	int minD, maxD;
 	int image_width;
+	bool quantized;
+	//padded length of the descriptors
+	int descriptor_length;
+	//scale from squared distances to costs
+	float cost_scale;
+	const descriptor_distance_kernels& kernels;
 	cv::Mat descriptors1, descriptors2;
 };
 
@@ -69,9 +95,7 @@ public:
 	virtual ~BT_stereo_cost_calculator();
 
 private:
-	cv::Mat mat_buf;
 	int minD, maxD;
-	PixType* buffer;
 	PixType* clip_table;
 	PixType* clip_table_relevant;
 	int table_offset;
@@ -79,6 +103,55 @@ private:
 
 };
 
+/**
+ * Hamming distances between census transforms (see census_transform.hpp) of the images, converted to
+ * grayscale. Census costs are not affected by exposure or gain differences between the cameras and
+ * range from 0 to the number of bits, so P1 & P2 have to be set accordingly.
+ * The bitstrings of both images are computed up front, those of the second image are kept in
+ * right-to-left order, so that each pixel's costs come from consecutive bitstrings.
+ */
+class census_stereo_cost_calculator : public abstract_stereo_cost_calculator{
+public:
+	census_stereo_cost_calculator(const cv::Mat& img1, const cv::Mat& img2,
+			const semiglobal_matcher_parameters& params, bool sparse);
+	virtual void compute(int y,CostType* cost);
+	virtual size_t get_memory_footprint() const;
+private:
+	int minD, maxD;
+	int image_width;
+	//use the 32-bit sparse census transform
+	bool sparse;
+	const hamming_distance_kernels& kernels;
+	std::vector<uint64_t> census1, census2;
+	std::vector<uint32_t> sparse_census1, sparse_census2;
+};
+
+/**
+ * Computes all rows of another calculator up front, in parallel bands of rows, and serves them from
+ * memory afterwards, so that rows needed by several stripes or passes are only computed once.
+ * The costs are stored as 16-bit or, if compact, as saturated 8-bit integers.
+ */
+class precomputed_stereo_cost_calculator : public abstract_stereo_cost_calculator{
+public:
+	precomputed_stereo_cost_calculator(const cv::Mat& img1, const cv::Mat& img2,
+			const semiglobal_matcher_parameters& params,
+			std::unique_ptr<abstract_stereo_cost_calculator> source, bool compact);
+	virtual void compute(int y,CostType* cost);
+	virtual size_t get_memory_footprint() const;
+	/**
+	 * @brief size in bytes of the cost volume for images of the given size
+	 */
+	static size_t get_volume_size(cv::Size image_size, const semiglobal_matcher_parameters& params,
+			bool compact);
+private:
+	std::unique_ptr<abstract_stereo_cost_calculator> source;
+	bool compact;
+	//number of costs per row
+	size_t row_size;
+	//one row per image row, CV_16S or CV_8U
+	cv::Mat volume;
+};
+
 std::unique_ptr<abstract_stereo_cost_calculator> build_stereo_cost_calculator(pixel_cost_type type,
 		const cv::Mat& img1, const cv::Mat& img2,const semiglobal_matcher_parameters& params);
 
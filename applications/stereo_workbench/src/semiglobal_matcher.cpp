@@ -23,10 +23,13 @@
 #include <opencv2/core/utility.hpp>
 #include <opencv2/core/ocl.hpp>
 
+#include <vector>
+
 
 #include <reco/stereo_workbench/semiglobal_matcher.hpp>
 #include <reco/utils/cpp_exception_util.h>
 #include "pixel_cost.hpp"
+#include "sgm_path_kernels.hpp"
 
 namespace reco {
 namespace stereo_workbench {
@@ -35,8 +38,45 @@ enum {
 	NR = 16, NR2 = NR / 2
 };
 
+// the number of L_r(.,.) and min_k L_r(.,.) lines in the buffer:
+// for 8-way dynamic programming we need the current row and
+// the previous row, i.e. 2 rows in total
+enum {
+	NLR = 2, LrBorder = NLR - 1
+};
+
 using namespace cv;
 
+/*
+ size (in bytes) of the buffer compute_disparity_SGBM_rows needs to process nrows rows.
+ MODE_HH (fullDP) keeps the costs C & S of every row, the other modes only those of the current row.
+ */
+static size_t SGBM_buffer_size(int width, int width1, int D, int num_channels, int SH2, int nrows,
+		bool fullDP, bool compact_paths){
+	size_t costBufSize = (size_t) width1 * D;
+	size_t CSBufSize = costBufSize * (fullDP ? nrows : 1);
+	size_t minLrSize = (width1 + LrBorder * 2) * NR2, LrSize = minLrSize * (D + 16);
+	int hsumBufNRows = SH2 * 2 + 2;
+	return LrSize * NLR * (compact_paths ? sizeof(CompactCostType) : sizeof(CostType)) + // Lr[]
+			(minLrSize * NLR + 4 * D) * sizeof(CostType) + // minLr[], compact path scratch
+			costBufSize * (hsumBufNRows + 1) * sizeof(CostType) + // hsumBuf, pixdiff
+			CSBufSize * 2 * sizeof(CostType) + // C, S
+			width * 16 * num_channels * sizeof(PixType) + // temp buffer for computing per-pixel cost
+			width * (sizeof(CostType) + sizeof(DispType)) + // disp2cost + disp2
+			width * sizeof(DispType) + 1024; // disp1 row outside of the output range
+}
+
+/*
+ whether compute_disparity_SGBM_rows stores the path costs compactly: params.compact_path_costs asks for it,
+ there are kernels for it and the compact paths are lossless, i.e. the effective P2 is at most 255
+ (otherwise, the 16-bit paths are used).
+ */
+static bool SGBM_use_compact_paths(const semiglobal_matcher_parameters& params,
+		const sgm_path_kernels* kernels){
+	int P1 = params.P1 > 0 ? params.P1 : 2, P2 = std::max(params.P2 > 0 ? params.P2 : 5, P1 + 1);
+	return params.compact_path_costs && kernels && P2 <= UCHAR_MAX;
+}
+
 /*
  computes disparity for "roi" in img1 w.r.t. img2 and write it to disp1buf.
  that is, disp1buf(x, y)=d means that img1(x+roi.x, y+roi.y) ~ img2(x+roi.x-d, y+roi.y).
@@ -56,34 +96,21 @@ using namespace cv;
 
  disp2cost also has the same size as img1 (or img2).
  It contains the minimum current cost, used to find the best disparity, corresponding to the minimal cost.
+
+ only rows [row_begin, row_end) are processed, as if they made up the whole image (except that the
+ box filter still reads real image rows below row_end), and only rows [out_begin, out_end) of disp1
+ are written. Processing the rows on either side of the output range warms up the vertical and
+ diagonal paths, so that stripes of the image can be processed independently.
+
+ kernels are the vectorized path aggregation loops to use, if any (see sgm_path_kernels.hpp).
+ with compact_paths (which requires kernels and P2 <= 255, see SGBM_use_compact_paths), the path costs
+ L_r are stored in 8 bits relative to min_k L_r (see sgm_path_kernels::aggregate_four_paths_compact).
  */
-static void compute_disparity_SGBM(const Mat& img1, const Mat& img2,
+static void compute_disparity_SGBM_rows(const Mat& img1, const Mat& img2,
 		Mat& disp1, const semiglobal_matcher_parameters& params,
-		Mat& buffer, pixel_cost_type cost_type =
-				pixel_cost_type::BIRCHFIELD_TOMASI){
-#if CV_SSE2
-	static const uchar bit_reverse_table[] =
-			{
-					0, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1,
-					0, 2, 0, 1, 0,
-					5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1,
-					0, 2, 0, 1, 0,
-					6, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1,
-					0, 2, 0, 1, 0,
-					5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1,
-					0, 2, 0, 1, 0,
-					7, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1,
-					0, 2, 0, 1, 0,
-					5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1,
-					0, 2, 0, 1, 0,
-					6, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1,
-					0, 2, 0, 1, 0,
-					5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1,
-					0, 2, 0, 1, 0
-			};
-
-	volatile bool use_SIMD = checkHardwareSupport(CV_CPU_SSE2);
-#endif
+		Mat& buffer, abstract_stereo_cost_calculator& cost_calculator,
+		const sgm_path_kernels* kernels, bool compact_paths,
+		int row_begin, int row_end, int out_begin, int out_end){
 	//TODO: use allocate_buffers command instead of redoing the work here (first reorder commands so
 	//that allocations all happen continuously in one place)
 
@@ -106,41 +133,24 @@ static void compute_disparity_SGBM(const Mat& img1, const Mat& img2,
 	int SW2 = block_size.width / 2, SH2 = block_size.height / 2;
 	bool fullDP = params.mode == StereoSGBM::MODE_HH;
 	int npasses = fullDP ? 2 : 1;
-
-	//precomputation for faster cost computation
-	Mat descriptor_img1, descriptor_img2;
-	std::unique_ptr<abstract_stereo_cost_calculator> cost_calculator
-	= build_stereo_cost_calculator(cost_type, img1, img2, params);
-
-	if (minX1 >= maxX1){
-		disp1 = Scalar::all(INVALID_DISP_SCALED);
-		return;
-	}
+	int nrows = row_end - row_begin;
 
 	CV_Assert(D % 16 == 0);
+	compact_paths = compact_paths && SGBM_use_compact_paths(params, kernels);
 
 	// NR - the number of directions. the loop on x below that computes Lr assumes that NR == 8.
 	// if you change NR, please, modify the loop as well.
 	int D2 = D + 16, NRD2 = NR2 * D2;
 
-	// the number of L_r(.,.) and min_k L_r(.,.) lines in the buffer:
-	// for 8-way dynamic programming we need the current row and
-	// the previous row, i.e. 2 rows in total
-	const int NLR = 2;
-	const int LrBorder = NLR - 1;
-
 	// for each possible stereo match (img1(x,y) <=> img2(x-d,y))
 	// we keep pixel difference cost (C) and the summary cost over NR directions (S).
 	// we also keep all the partial costs for the previous line L_r(x,d) and also min_k L_r(x, k)
 	size_t costBufSize = width1 * D;
-	size_t CSBufSize = costBufSize * (fullDP ? height : 1);
+	size_t CSBufSize = costBufSize * (fullDP ? nrows : 1);
 	size_t minLrSize = (width1 + LrBorder * 2) * NR2, LrSize = minLrSize * D2;
 	int hsumBufNRows = SH2 * 2 + 2;
-	size_t totalBufSize = (LrSize + minLrSize) * NLR * sizeof(CostType) + // minLr[] and Lr[]
-			costBufSize * (hsumBufNRows + 1) * sizeof(CostType) + // hsumBuf, pixdiff
-			CSBufSize * 2 * sizeof(CostType) + // C, S
-			width * 16 * img1.channels() * sizeof(PixType) + // temp buffer for computing per-pixel cost
-			width * (sizeof(CostType) + sizeof(DispType)) + 1024; // disp2cost + disp2
+	size_t totalBufSize = SGBM_buffer_size(width, width1, D, img1.channels(), SH2, nrows, fullDP,
+			compact_paths);
 
 	if (buffer.empty() || !buffer.isContinuous() ||
 			buffer.cols * buffer.rows * buffer.elemSize() < totalBufSize)
@@ -152,8 +162,14 @@ static void compute_disparity_SGBM(const Mat& img1, const Mat& img2,
 	CostType* hsumBuf = Sbuf + CSBufSize;
 	CostType* pixDiff = hsumBuf + costBufSize * hsumBufNRows;
 
-	CostType* disp2cost = pixDiff + costBufSize + (LrSize + minLrSize) * NLR;
+	CostType* minLrBuf = pixDiff + costBufSize;
+	// scratch space for the compact path kernels
+	CostType* L_buf = minLrBuf + minLrSize * NLR;
+	CostType* disp2cost = L_buf + 4 * D;
 	DispType* disp2ptr = (DispType*) (disp2cost + width);
+	DispType* disp1_discarded = disp2ptr + width;
+	// Lr[] in either representation
+	uchar* LrBuf = (uchar*) (disp1_discarded + width);
 
 	// add P2 to every C(x,y). it saves a few operations in the inner loops
 	for (k = 0; k < width1 * D; k++)
@@ -163,15 +179,15 @@ static void compute_disparity_SGBM(const Mat& img1, const Mat& img2,
 		int x1, y1, x2, y2, dx, dy;
 
 		if (pass == 1){
-			y1 = 0;
-			y2 = height;
+			y1 = row_begin;
+			y2 = row_end;
 			dy = 1;//go top down
 			x1 = 0;
 			x2 = width1;
 			dx = 1;
 		}else{
-			y1 = height - 1;
-			y2 = -1;
+			y1 = row_end - 1;
+			y2 = row_begin - 1;
 			dy = -1;//go bottom up
 			x1 = width1 - 1;
 			x2 = -1;
@@ -179,6 +195,7 @@ static void compute_disparity_SGBM(const Mat& img1, const Mat& img2,
 		}
 
 		CostType *Lr[NLR] = { 0 }, *minLr[NLR] = { 0 };
+		CompactCostType *Lr8[NLR] = { 0 };
 
 		for (k = 0; k < NLR; k++){
 			// shift Lr[k] and minLr[k] pointers, because we allocated them with the borders,
@@ -186,28 +203,35 @@ static void compute_disparity_SGBM(const Mat& img1, const Mat& img2,
 			// we need to shift Lr[k] pointers by 1, to give the space for d=-1.
 			// however, then the alignment will be imperfect, i.e. bad for SSE,
 			// thus we shift the pointers by 8 (8*sizeof(short) == 16 - ideal alignment)
-			Lr[k] = pixDiff + costBufSize + LrSize * k + NRD2 * LrBorder + 8;
-			memset(Lr[k] - LrBorder * NRD2 - 8, 0, LrSize * sizeof(CostType));
-			minLr[k] = pixDiff + costBufSize + LrSize * NLR + minLrSize * k + NR2 * LrBorder;
+			if (compact_paths){
+				Lr8[k] = (CompactCostType*) LrBuf + LrSize * k + NRD2 * LrBorder + 8;
+				memset(Lr8[k] - LrBorder * NRD2 - 8, 0, LrSize * sizeof(CompactCostType));
+			}else{
+				Lr[k] = (CostType*) LrBuf + LrSize * k + NRD2 * LrBorder + 8;
+				memset(Lr[k] - LrBorder * NRD2 - 8, 0, LrSize * sizeof(CostType));
+			}
+			minLr[k] = minLrBuf + minLrSize * k + NR2 * LrBorder;
 			memset(minLr[k] - LrBorder * NR2, 0, minLrSize * sizeof(CostType));
 		}
 
 		for (int y = y1; y != y2; y += dy){
 			int x, d;
-			DispType* disp1ptr = disp1.ptr<DispType>(y);
-			CostType* C = Cbuf + (!fullDP ? 0 : y * costBufSize);
-			CostType* S = Sbuf + (!fullDP ? 0 : y * costBufSize);
+			DispType* disp1ptr = y >= out_begin && y < out_end ?
+					disp1.ptr<DispType>(y) : disp1_discarded;
+			CostType* C = Cbuf + (!fullDP ? 0 : (y - row_begin) * costBufSize);
+			CostType* S = Sbuf + (!fullDP ? 0 : (y - row_begin) * costBufSize);
 
 			// compute cost on the first pass, and reuse it on the second pass, if any.
 			if (pass == 1) {
-				int dy1 = y == 0 ? 0 : y + SH2, dy2 = y == 0 ? SH2 : dy1;
+				int dy1 = y == row_begin ? row_begin : y + SH2,
+						dy2 = y == row_begin ? row_begin + SH2 : dy1;
 
 				for (k = dy1; k <= dy2; k++){
 					CostType* hsumAdd = hsumBuf
 							+ (std::min(k, height - 1) % hsumBufNRows) * costBufSize;
 
 					if (k < height){
-						cost_calculator->compute(k, pixDiff);
+						cost_calculator.compute(k, pixDiff);
 
 						memset(hsumAdd, 0, D * sizeof(CostType));
 						for (x = 0; x <= SW2 * D; x += D){
@@ -216,10 +240,10 @@ static void compute_disparity_SGBM(const Mat& img1, const Mat& img2,
 								hsumAdd[d] = (CostType) (hsumAdd[d] + pixDiff[x + d] * scale);
 						}
 
-						if (y > 0){
+						if (y > row_begin){
 							const CostType* hsumSub = hsumBuf
-									+ (std::max(y - SH2 - 1, 0) % hsumBufNRows) * costBufSize;
-							const CostType* Cprev = !fullDP || y == 0 ? C : C - costBufSize;
+									+ (std::max(y - SH2 - 1, row_begin) % hsumBufNRows) * costBufSize;
+							const CostType* Cprev = !fullDP || y == row_begin ? C : C - costBufSize;
 
 							for (x = D; x < width1 * D; x += D){
 								const CostType* pixAdd = pixDiff
@@ -227,34 +251,31 @@ static void compute_disparity_SGBM(const Mat& img1, const Mat& img2,
 								const CostType* pixSub = pixDiff + std::max(x - (SW2 + 1) * D, 0);
 
 #if CV_SSE2
-								if (use_SIMD) {
-									for (d = 0; d < D; d += 8)
-											{
-										__m128i hv = _mm_load_si128(
-												(const __m128i *) (hsumAdd + x - D + d));
-										__m128i Cx = _mm_load_si128((__m128i *) (Cprev + x + d));
-										hv = _mm_adds_epi16(_mm_subs_epi16(hv,
-												_mm_load_si128((const __m128i *) (pixSub + d))),
-												_mm_load_si128((const __m128i *) (pixAdd + d)));
-										Cx =
-												_mm_adds_epi16(
-														_mm_subs_epi16(Cx,
-																_mm_load_si128(
-																		(const __m128i *) (hsumSub
-																				+ x + d))),
-														hv);
-										_mm_store_si128((__m128i *) (hsumAdd + x + d), hv);
-										_mm_store_si128((__m128i *) (C + x + d), Cx);
-									}
-								} else
-								#endif
-								{
-									for (d = 0; d < D; d++){
-										int hv = hsumAdd[x + d] = (CostType) (hsumAdd[x - D + d]
-												+ pixAdd[d] - pixSub[d]);
-										C[x + d] = (CostType) (Cprev[x + d] + hv - hsumSub[x + d]);
-									}
+								for (d = 0; d < D; d += 8)
+										{
+									__m128i hv = _mm_load_si128(
+											(const __m128i *) (hsumAdd + x - D + d));
+									__m128i Cx = _mm_load_si128((__m128i *) (Cprev + x + d));
+									hv = _mm_adds_epi16(_mm_subs_epi16(hv,
+											_mm_load_si128((const __m128i *) (pixSub + d))),
+											_mm_load_si128((const __m128i *) (pixAdd + d)));
+									Cx =
+											_mm_adds_epi16(
+													_mm_subs_epi16(Cx,
+															_mm_load_si128(
+																	(const __m128i *) (hsumSub
+																			+ x + d))),
+													hv);
+									_mm_store_si128((__m128i *) (hsumAdd + x + d), hv);
+									_mm_store_si128((__m128i *) (C + x + d), Cx);
 								}
+#else
+								for (d = 0; d < D; d++){
+									int hv = hsumAdd[x + d] = (CostType) (hsumAdd[x - D + d]
+											+ pixAdd[d] - pixSub[d]);
+									C[x + d] = (CostType) (Cprev[x + d] + hv - hsumSub[x + d]);
+								}
+#endif
 							}
 						}else{
 							for (x = D; x < width1 * D; x += D){
@@ -269,8 +290,8 @@ static void compute_disparity_SGBM(const Mat& img1, const Mat& img2,
 						}
 					}
 
-					if (y == 0){
-						int scale = k == 0 ? SH2 + 1 : 1;
+					if (y == row_begin){
+						int scale = k == row_begin ? SH2 + 1 : 1;
 						for (x = 0; x < width1 * D; x++){
 							C[x] = (CostType) (C[x] + hsumAdd[x] * scale);
 						}
@@ -284,8 +305,13 @@ static void compute_disparity_SGBM(const Mat& img1, const Mat& img2,
 			}
 
 			// clear the left and the right borders
-			memset(Lr[0] - NRD2 * LrBorder - 8, 0, NRD2 * LrBorder * sizeof(CostType));
-			memset(Lr[0] + width1 * NRD2 - 8, 0, NRD2 * LrBorder * sizeof(CostType));
+			if (compact_paths){
+				memset(Lr8[0] - NRD2 * LrBorder - 8, 0, NRD2 * LrBorder * sizeof(CompactCostType));
+				memset(Lr8[0] + width1 * NRD2 - 8, 0, NRD2 * LrBorder * sizeof(CompactCostType));
+			}else{
+				memset(Lr[0] - NRD2 * LrBorder - 8, 0, NRD2 * LrBorder * sizeof(CostType));
+				memset(Lr[0] + width1 * NRD2 - 8, 0, NRD2 * LrBorder * sizeof(CostType));
+			}
 			memset(minLr[0] - NR2 * LrBorder, 0, NR2 * LrBorder * sizeof(CostType));
 			memset(minLr[0] + width1 * NR2, 0, NR2 * LrBorder * sizeof(CostType));
 
@@ -310,6 +336,22 @@ static void compute_disparity_SGBM(const Mat& img1, const Mat& img2,
 			for (x = x1; x != x2; x += dx){
 				int xm = x * NR2, xd = xm * D2;
 
+				if (compact_paths){
+					// the path minima cancel out, the deltas are all P2
+					CompactCostType* Lr8_p0 = Lr8[0] + xd - dx * NRD2;
+					CompactCostType* Lr8_p1 = Lr8[1] + xd - NRD2 + D2;
+					CompactCostType* Lr8_p2 = Lr8[1] + xd + D2 * 2;
+					CompactCostType* Lr8_p3 = Lr8[1] + xd + NRD2 + D2 * 3;
+
+					Lr8_p0[-1] = Lr8_p0[D] = Lr8_p1[-1] = Lr8_p1[D] =
+							Lr8_p2[-1] = Lr8_p2[D] = Lr8_p3[-1] = Lr8_p3[D] = UCHAR_MAX;
+
+					const CompactCostType* Lr_prev[] = { Lr8_p0, Lr8_p1, Lr8_p2, Lr8_p3 };
+					kernels->aggregate_four_paths_compact(C + x * D, Lr_prev, Lr8[0] + xd, D2, S + x * D,
+							D, P1, P2, L_buf);
+					continue;
+				}
+
 				int delta0 = minLr[0][xm - dx * NR2] + P2, delta1 = minLr[1][xm - NR2 + 1] + P2;
 				int delta2 = minLr[1][xm + 2] + P2, delta3 = minLr[1][xm + NR2 + 3] + P2;
 
@@ -325,93 +367,12 @@ static void compute_disparity_SGBM(const Mat& img1, const Mat& img2,
 				const CostType* Cp = C + x * D;
 				CostType* Sp = S + x * D;
 
-#if CV_SSE2
-				if (use_SIMD){
-					__m128i _P1 = _mm_set1_epi16((short) P1);
-
-					__m128i _delta0 = _mm_set1_epi16((short) delta0);
-					__m128i _delta1 = _mm_set1_epi16((short) delta1);
-					__m128i _delta2 = _mm_set1_epi16((short) delta2);
-					__m128i _delta3 = _mm_set1_epi16((short) delta3);
-					__m128i _minL0 = _mm_set1_epi16((short) MAX_COST);
-
-					for (d = 0; d < D; d += 8)
-							{
-						__m128i Cpd = _mm_load_si128((const __m128i *) (Cp + d));
-						__m128i L0, L1, L2, L3;
-
-						L0 = _mm_load_si128((const __m128i *) (Lr_p0 + d));
-						L1 = _mm_load_si128((const __m128i *) (Lr_p1 + d));
-						L2 = _mm_load_si128((const __m128i *) (Lr_p2 + d));
-						L3 = _mm_load_si128((const __m128i *) (Lr_p3 + d));
-
-						L0 = _mm_min_epi16(L0,
-								_mm_adds_epi16(_mm_loadu_si128((const __m128i *) (Lr_p0 + d - 1)),
-										_P1));
-						L0 = _mm_min_epi16(L0,
-								_mm_adds_epi16(_mm_loadu_si128((const __m128i *) (Lr_p0 + d + 1)),
-										_P1));
-
-						L1 = _mm_min_epi16(L1,
-								_mm_adds_epi16(_mm_loadu_si128((const __m128i *) (Lr_p1 + d - 1)),
-										_P1));
-						L1 = _mm_min_epi16(L1,
-								_mm_adds_epi16(_mm_loadu_si128((const __m128i *) (Lr_p1 + d + 1)),
-										_P1));
-
-						L2 = _mm_min_epi16(L2,
-								_mm_adds_epi16(_mm_loadu_si128((const __m128i *) (Lr_p2 + d - 1)),
-										_P1));
-						L2 = _mm_min_epi16(L2,
-								_mm_adds_epi16(_mm_loadu_si128((const __m128i *) (Lr_p2 + d + 1)),
-										_P1));
-
-						L3 = _mm_min_epi16(L3,
-								_mm_adds_epi16(_mm_loadu_si128((const __m128i *) (Lr_p3 + d - 1)),
-										_P1));
-						L3 = _mm_min_epi16(L3,
-								_mm_adds_epi16(_mm_loadu_si128((const __m128i *) (Lr_p3 + d + 1)),
-										_P1));
-
-						L0 = _mm_min_epi16(L0, _delta0);
-						L0 = _mm_adds_epi16(_mm_subs_epi16(L0, _delta0), Cpd);
-
-						L1 = _mm_min_epi16(L1, _delta1);
-						L1 = _mm_adds_epi16(_mm_subs_epi16(L1, _delta1), Cpd);
-
-						L2 = _mm_min_epi16(L2, _delta2);
-						L2 = _mm_adds_epi16(_mm_subs_epi16(L2, _delta2), Cpd);
-
-						L3 = _mm_min_epi16(L3, _delta3);
-						L3 = _mm_adds_epi16(_mm_subs_epi16(L3, _delta3), Cpd);
-
-						_mm_store_si128((__m128i *) (Lr_p + d), L0);
-						_mm_store_si128((__m128i *) (Lr_p + d + D2), L1);
-						_mm_store_si128((__m128i *) (Lr_p + d + D2 * 2), L2);
-						_mm_store_si128((__m128i *) (Lr_p + d + D2 * 3), L3);
-
-						__m128i t0 = _mm_min_epi16(_mm_unpacklo_epi16(L0, L2),
-								_mm_unpackhi_epi16(L0, L2));
-						__m128i t1 = _mm_min_epi16(_mm_unpacklo_epi16(L1, L3),
-								_mm_unpackhi_epi16(L1, L3));
-						t0 = _mm_min_epi16(_mm_unpacklo_epi16(t0, t1), _mm_unpackhi_epi16(t0, t1));
-						_minL0 = _mm_min_epi16(_minL0, t0);
-
-						__m128i Sval = _mm_load_si128((const __m128i *) (Sp + d));
-
-						L0 = _mm_adds_epi16(L0, L1);
-						L2 = _mm_adds_epi16(L2, L3);
-						Sval = _mm_adds_epi16(Sval, L0);
-						Sval = _mm_adds_epi16(Sval, L2);
-
-						_mm_store_si128((__m128i *) (Sp + d), Sval);
-					}
-
-					_minL0 = _mm_min_epi16(_minL0, _mm_srli_si128(_minL0, 8));
-					_mm_storel_epi64((__m128i *) &minLr[0][xm], _minL0);
+				if (kernels){
+					const CostType* Lr_prev[] = { Lr_p0, Lr_p1, Lr_p2, Lr_p3 };
+					const int delta[] = { delta0, delta1, delta2, delta3 };
+					kernels->aggregate_four_paths(Cp, Lr_prev, Lr_p, D2, Sp, D, P1, delta, &minLr[0][xm]);
 				}
 				else
-				#endif
 				{
 					int minL0 = MAX_COST, minL1 = MAX_COST, minL2 = MAX_COST, minL3 = MAX_COST;
 
@@ -466,7 +427,13 @@ static void compute_disparity_SGBM(const Mat& img1, const Mat& img2,
 					CostType* Sp = S + x * D;
 					int minS = MAX_COST, bestDisp = -1;
 
-					if (npasses == 1) {
+					if (npasses == 1 && compact_paths) {
+						int xd = x * NR2 * D2;
+						CompactCostType* Lr8_p0 = Lr8[0] + xd + NRD2;
+						Lr8_p0[-1] = Lr8_p0[D] = UCHAR_MAX;
+						kernels->aggregate_path_and_find_best_compact(C + x * D, Lr8_p0, Lr8[0] + xd, Sp,
+								D, P1, P2, L_buf, minS, bestDisp);
+					}else if (npasses == 1) {
 						int xm = x * NR2, xd = xm * D2;
 
 						int minL0 = MAX_COST;
@@ -477,66 +444,10 @@ static void compute_disparity_SGBM(const Mat& img1, const Mat& img2,
 
 						const CostType* Cp = C + x * D;
 
-#if CV_SSE2
-						if (use_SIMD){
-							__m128i _P1 = _mm_set1_epi16((short) P1);
-							__m128i _delta0 = _mm_set1_epi16((short) delta0);
-
-							__m128i _minL0 = _mm_set1_epi16((short) minL0);
-							__m128i _minS = _mm_set1_epi16(MAX_COST), _bestDisp = _mm_set1_epi16(
-									-1);
-							__m128i _d8 = _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7), _8 =
-									_mm_set1_epi16(8);
-
-							for (d = 0; d < D; d += 8)
-									{
-								__m128i Cpd = _mm_load_si128((const __m128i *) (Cp + d)), L0;
-
-								L0 = _mm_load_si128((const __m128i *) (Lr_p0 + d));
-								L0 = _mm_min_epi16(L0,
-										_mm_adds_epi16(
-												_mm_loadu_si128((const __m128i *) (Lr_p0 + d - 1)),
-												_P1));
-								L0 = _mm_min_epi16(L0,
-										_mm_adds_epi16(
-												_mm_loadu_si128((const __m128i *) (Lr_p0 + d + 1)),
-												_P1));
-								L0 = _mm_min_epi16(L0, _delta0);
-								L0 = _mm_adds_epi16(_mm_subs_epi16(L0, _delta0), Cpd);
-
-								_mm_store_si128((__m128i *) (Lr_p + d), L0);
-								_minL0 = _mm_min_epi16(_minL0, L0);
-								L0 = _mm_adds_epi16(L0, *(__m128i *) (Sp + d));
-								_mm_store_si128((__m128i *) (Sp + d), L0);
-
-								__m128i mask = _mm_cmpgt_epi16(_minS, L0);
-								_minS = _mm_min_epi16(_minS, L0);
-								_bestDisp = _mm_xor_si128(_bestDisp,
-										_mm_and_si128(_mm_xor_si128(_bestDisp, _d8), mask));
-								_d8 = _mm_adds_epi16(_d8, _8);
-							}
-
-							short CV_DECL_ALIGNED(16) bestDispBuf[8];
-							_mm_store_si128((__m128i *) bestDispBuf, _bestDisp);
-
-							_minL0 = _mm_min_epi16(_minL0, _mm_srli_si128(_minL0, 8));
-							_minL0 = _mm_min_epi16(_minL0, _mm_srli_si128(_minL0, 4));
-							_minL0 = _mm_min_epi16(_minL0, _mm_srli_si128(_minL0, 2));
-
-							__m128i qS = _mm_min_epi16(_minS, _mm_srli_si128(_minS, 8));
-							qS = _mm_min_epi16(qS, _mm_srli_si128(qS, 4));
-							qS = _mm_min_epi16(qS, _mm_srli_si128(qS, 2));
-
-							minLr[0][xm] = (CostType) _mm_cvtsi128_si32(_minL0);
-							minS = (CostType) _mm_cvtsi128_si32(qS);
-
-							qS = _mm_shuffle_epi32(_mm_unpacklo_epi16(qS, qS), 0);
-							qS = _mm_cmpeq_epi16(_minS, qS);
-							int idx = _mm_movemask_epi8(_mm_packs_epi16(qS, qS)) & 255;
-
-							bestDisp = bestDispBuf[bit_reverse_table[idx]];
+						if (kernels){
+							kernels->aggregate_path_and_find_best(Cp, Lr_p0, Lr_p, Sp, D, P1, delta0,
+									minLr[0][xm], minS, bestDisp);
 						} else
-						#endif
 						{
 							for (d = 0; d < D; d++)
 									{
@@ -568,14 +479,21 @@ static void compute_disparity_SGBM(const Mat& img1, const Mat& img2,
 						}
 					}
 
-					for (d = 0; d < D; d++){
-						if (Sp[d] * (100 - uniquenessRatio) < minS * 100
-								&& std::abs(bestDisp - d) > 1){
-							break;
+					if (kernels && uniquenessRatio < 100){
+						if (kernels->has_competing_disparity(Sp, D, bestDisp,
+								uniqueness_cost_bound(minS, uniquenessRatio))){
+							continue;
+						}
+					}else{
+						for (d = 0; d < D; d++){
+							if (Sp[d] * (100 - uniquenessRatio) < minS * 100
+									&& std::abs(bestDisp - d) > 1){
+								break;
+							}
+						}
+						if (d < D){
+							continue;
 						}
-					}
-					if (d < D){
-						continue;
 					}
 					d = bestDisp;
 					int _x2 = x + minX1 - d - minD;
@@ -617,13 +535,218 @@ static void compute_disparity_SGBM(const Mat& img1, const Mat& img2,
 
 			// now shift the cyclic buffers
 			std::swap(Lr[0], Lr[1]);
+			std::swap(Lr8[0], Lr8[1]);
 			std::swap(minLr[0], minLr[1]);
 		}
 	}
 }
 
+// minimum number of extra rows each stripe is extended by to warm up the vertical & diagonal paths
+static const int SGBM_MIN_STRIPE_OVERLAP = 16;
+// number of horizontal stripes MODE_SGBM & MODE_HH split the image into (at most, see
+// compute_disparity_SGBM). it is fixed, so that the result doesn't depend on the number of threads, and
+// large enough for the stripes to keep many cores busy
+static const int SGBM_NUM_STRIPES = 32;
+
+/*
+ number of extra rows each of nstripes stripes of the image is extended by to warm up the vertical &
+ diagonal paths
+ */
+static int SGBM_stripe_overlap(int height, int nstripes, int SH2){
+	int stripe_sz = (height + nstripes - 1) / nstripes;
+	return nstripes == 1 ? 0 :
+			SH2 + 1 + std::max(SGBM_MIN_STRIPE_OVERLAP, (int) ceil(0.1 * stripe_sz));
+}
+
+/*
+ wraps cost_calculator into a precomputed cost volume if params.cost_volume asks for one and, with a memory
+ budget, the volume fits into it alongside reserved_memory bytes. returns the size of the volume, 0 if there
+ is none.
+ */
+static size_t precompute_cost_volume(std::unique_ptr<abstract_stereo_cost_calculator>& cost_calculator,
+		const Mat& img1, const Mat& img2, const semiglobal_matcher_parameters& params,
+		size_t reserved_memory){
+	if (params.cost_volume == COST_VOLUME_NONE)
+		return 0;
+	bool compact = params.cost_volume == COST_VOLUME_8BIT;
+	size_t volume_size = precomputed_stereo_cost_calculator::get_volume_size(img1.size(), params,
+			compact);
+	if (params.memory_budget > 0 && volume_size + reserved_memory > params.memory_budget)
+		return 0;
+	cost_calculator.reset(new precomputed_stereo_cost_calculator(img1, img2, params,
+			std::move(cost_calculator), compact));
+	return volume_size;
+}
+
+/*
+ processes horizontal stripes of the image with compute_disparity_SGBM_rows, each worker in range
+ processes every nworkers-th stripe, starting with its own index, using its own buffer.
+ each stripe is extended by stripe_overlap rows above it (and, for the bottom-up pass of MODE_HH, below it),
+ the disparities computed for the extra rows are discarded. stripes write disjoint rows of disp1.
+ */
+struct SGBM_stripe_loop:
+		public ParallelLoopBody {
+	const Mat *img1, *img2;
+	Mat* disp1;
+	const semiglobal_matcher_parameters* params;
+	Mat* buffers;
+	abstract_stereo_cost_calculator* cost_calculator;
+	const sgm_path_kernels* kernels;
+	int nstripes, nworkers, stripe_overlap;
+
+	SGBM_stripe_loop(const Mat& _img1, const Mat& _img2, Mat& _disp1,
+			const semiglobal_matcher_parameters& _params, Mat* _buffers,
+			abstract_stereo_cost_calculator& _cost_calculator, const sgm_path_kernels* _kernels,
+			int _nstripes, int _nworkers, int _stripe_overlap) :
+			img1(&_img1), img2(&_img2), disp1(&_disp1), params(&_params), buffers(_buffers),
+					cost_calculator(&_cost_calculator), kernels(_kernels), nstripes(_nstripes),
+					nworkers(_nworkers), stripe_overlap(_stripe_overlap) {
+	}
+
+	void operator ()(const Range& range) const {
+		int height = disp1->rows;
+		bool fullDP = params->mode == StereoSGBM::MODE_HH;
+		for (int i_worker = range.start; i_worker < range.end; i_worker++){
+			for (int i_stripe = i_worker; i_stripe < nstripes; i_stripe += nworkers){
+				int out_begin = (int) ((int64) height * i_stripe / nstripes);
+				int out_end = (int) ((int64) height * (i_stripe + 1) / nstripes);
+				int row_begin = std::max(out_begin - stripe_overlap, 0);
+				int row_end = fullDP ? std::min(out_end + stripe_overlap, height) : out_end;
+				compute_disparity_SGBM_rows(*img1, *img2, *disp1, *params, buffers[i_worker],
+						*cost_calculator, kernels, params->compact_path_costs, row_begin, row_end,
+						out_begin, out_end);
+			}
+		}
+	}
+};
+
+/*
+ computes disparity (see compute_disparity_SGBM_rows) for the whole image, split into SGBM_NUM_STRIPES
+ horizontal stripes (fewer for images too short for stripes twice as tall as their warm-up rows), which are
+ processed by params.num_threads threads (all CPU cores if it is 0), at most one per stripe. The stripes
+ don't depend on the thread count, so neither does the result.
+ if params.memory_budget is set and the stripes' buffers exceed it, fewer stripes are processed at once
+ and, if a single one still doesn't fit, the image is split into more, thinner stripes (MODE_HH only).
+ The budget cannot be undercut with a single stripe buffer of the thinnest possible stripes. A precomputed
+ cost volume (see params.cost_volume) takes its share of the budget first, if it fits next to that single
+ buffer.
+ path aggregation uses the kernels for the widest instruction set up to instruction_set that can handle
+ the number of disparities; all of them yield the same result.
+ returns the amount of memory (in bytes) used by the buffers and the cost calculator.
+ */
+static size_t compute_disparity_SGBM(const Mat& img1, const Mat& img2,
+		Mat& disp1, const semiglobal_matcher_parameters& params,
+		std::vector<Mat>& buffers, pixel_cost_type cost_type =
+				pixel_cost_type::BIRCHFIELD_TOMASI,
+		sgm_instruction_set instruction_set = SGM_SCALAR){
+	int minD = params.minDisparity, maxD = minD + params.numDisparities;
+	int width = disp1.cols, height = disp1.rows;
+	if (std::max(maxD, 0) >= width + std::min(minD, 0)){
+		disp1 = Scalar::all((minD - 1) * StereoMatcher::DISP_SCALE);
+		return 0;
+	}
+
+	std::unique_ptr<abstract_stereo_cost_calculator> cost_calculator
+	= build_stereo_cost_calculator(cost_type, img1, img2, params);
+	const sgm_path_kernels* kernels = get_sgm_path_kernels(instruction_set, params.numDisparities);
+
+	int SH2 = (params.block_size > 0 ? params.block_size : 5) / 2;
+	int width1 = width + std::min(minD, 0) - std::max(maxD, 0);
+	bool fullDP = params.mode == StereoSGBM::MODE_HH;
+	bool compact_paths = SGBM_use_compact_paths(params, kernels);
+	// don't let the stripes get so thin that the warm-up rows dominate
+	int max_stripes = std::max(1, height / (2 * (SH2 + 1 + SGBM_MIN_STRIPE_OVERLAP)));
+	int nstripes = std::min(SGBM_NUM_STRIPES, max_stripes);
+	int nworkers = params.num_threads > 0 ? params.num_threads : getNumberOfCPUs();
+	nworkers = std::max(1, std::min(nworkers, nstripes));
+
+	// size of the buffer for the tallest of nstripes stripes
+	auto stripe_buffer_size = [&](int n){
+		int nrows = std::min((height + n - 1) / n + 2 * SGBM_stripe_overlap(height, n, SH2), height);
+		return SGBM_buffer_size(width, width1, params.numDisparities, img1.channels(), SH2, nrows,
+				fullDP, compact_paths);
+	};
+
+	size_t buffer_budget = params.memory_budget;
+	size_t volume_size = precompute_cost_volume(cost_calculator, img1, img2, params,
+			stripe_buffer_size(max_stripes));
+	if (buffer_budget > 0){
+		buffer_budget -= volume_size;
+		// first process fewer stripes at once, then, with a single one, make the stripes thinner
+		while (nworkers > 1 && nworkers * stripe_buffer_size(nstripes) > buffer_budget){
+			nworkers--;
+		}
+		while (nstripes < max_stripes && stripe_buffer_size(nstripes) > buffer_budget){
+			nstripes++;
+		}
+		// don't hold on to buffers from previous calls that don't fit into the budget
+		buffers.resize(nworkers);
+		size_t buffer_size = stripe_buffer_size(nstripes);
+		for (Mat& buffer : buffers){
+			if (buffer.total() * buffer.elemSize() > buffer_size + 16){
+				buffer.release();
+			}
+		}
+	}
+
+	if ((int) buffers.size() < nworkers)
+		buffers.resize(nworkers);
+
+	SGBM_stripe_loop stripe_loop(img1, img2, disp1, params, buffers.data(), *cost_calculator,
+			kernels, nstripes, nworkers, SGBM_stripe_overlap(height, nstripes, SH2));
+	if (nworkers == 1)
+		stripe_loop(Range(0, 1));
+	else
+		parallel_for_(Range(0, nworkers), stripe_loop, nworkers);
+
+	size_t used_memory = cost_calculator->get_memory_footprint();
+	for (int i_worker = 0; i_worker < nworkers; i_worker++){
+		used_memory += buffers[i_worker].total() * buffers[i_worker].elemSize();
+	}
+	return used_memory;
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////
 
+/*
+ size (in bytes) of the buffer allocate_buffers sets up for one stripe of MODE_SGBM_3WAY
+ */
+static size_t SGBM3Way_buffer_size(int width, int width1, int D, int SH2){
+	int costVolumeLineSize = width1 * D;
+	int width1_ext = width1 + 2;
+	int costVolumeLineSize_ext = width1_ext * D;
+	int hsumBufNRows = SH2 * 2 + 2;
+
+	// main buffer to store matching costs for the current line:
+	int curCostVolumeLineSize = costVolumeLineSize * sizeof(CostType);
+
+	// auxiliary buffers for the raw matching cost computation:
+	int hsumBufSize = costVolumeLineSize * hsumBufNRows * sizeof(CostType);
+	int pixDiffSize = costVolumeLineSize * sizeof(CostType);
+
+	// auxiliary buffers for the matching cost aggregation:
+	int horPassCostVolumeSize = costVolumeLineSize_ext * sizeof(CostType); // buffer for the 2-pass horizontal cost aggregation
+	int vertPassCostVolumeSize = costVolumeLineSize_ext * sizeof(CostType); // buffer for the vertical cost aggregation
+	int vertPassMinSize = width1_ext * sizeof(CostType); // buffer for storing minimum costs from the previous line
+	int rightPassBufSize = D * sizeof(CostType); // additional small buffer for the right-to-left pass
+
+	// buffers for the pseudo-LRC check:
+	int disp2CostBufSize = width * sizeof(CostType);
+	int disp2BufSize = width * sizeof(short);
+
+	// sum up the sizes of all the buffers:
+	return curCostVolumeLineSize +
+			hsumBufSize +
+			pixDiffSize +
+			horPassCostVolumeSize +
+			vertPassCostVolumeSize +
+			vertPassMinSize +
+			rightPassBufSize +
+			disp2CostBufSize +
+			disp2BufSize +
+			16;  //to compensate for the alignPtr shifts
+}
+
 void allocate_buffers(Mat& buffer, int width, int width1, int D, int num_ch, int SH2, int P2,
 		CostType*& curCostVolumeLine, CostType*& hsumBuf, CostType*& pixDiff,
 		CostType*& horPassCostVolume,
@@ -650,10 +773,12 @@ struct SGBM3WayMainLoop:
 
 	int costBufSize, hsumBufNRows;
 	std::unique_ptr<abstract_stereo_cost_calculator> cost_calculator;
+	const sgm_path_kernels* kernels;
 
 	SGBM3WayMainLoop(Mat *_buffers, const Mat& _img1, const Mat& _img2, Mat* _dst_disp,
 			const semiglobal_matcher_parameters& params, int _nstripes, int _stripe_overlap,
-			pixel_cost_type cost_type = pixel_cost_type::BIRCHFIELD_TOMASI);
+			pixel_cost_type cost_type = pixel_cost_type::BIRCHFIELD_TOMASI,
+			sgm_instruction_set instruction_set = SGM_SCALAR);
 
 	void getRawMatchingCost(CostType* C, CostType* hsumBuf, CostType* pixDiff,
 			int y, int src_start_idx) const;
@@ -663,10 +788,10 @@ struct SGBM3WayMainLoop:
 SGBM3WayMainLoop::SGBM3WayMainLoop(Mat *_buffers, const Mat& _img1, const Mat& _img2,
 		Mat* _dst_disp,
 		const semiglobal_matcher_parameters& params, int _nstripes, int _stripe_overlap,
-		pixel_cost_type cost_type) :
+		pixel_cost_type cost_type, sgm_instruction_set instruction_set) :
 		buffers(_buffers), img1(&_img1), img2(&_img2), dst_disp(_dst_disp),
-				cost_calculator(build_stereo_cost_calculator(cost_type, _img1, _img2, params)) {
-
+				cost_calculator(build_stereo_cost_calculator(cost_type, _img1, _img2, params)),
+				kernels(get_sgm_path_kernels(instruction_set, params.numDisparities)) {
 	nstripes = _nstripes;
 	stripe_overlap = _stripe_overlap;
 	stripe_sz = (int) ceil(img1->rows / (double) nstripes);
@@ -690,6 +815,14 @@ SGBM3WayMainLoop::SGBM3WayMainLoop(Mat *_buffers, const Mat& _img1, const Mat& _
 
 	costBufSize = width1 * D;
 	hsumBufNRows = SH2 * 2 + 2;
+
+	// the stripes overlap, so a precomputed cost volume saves computing their shared rows twice.
+	// it has to fit into the memory budget next to the stripes' buffers & intermediate disparities
+	size_t stripes_size = 0;
+	for (int i = 0; i < nstripes; i++)
+		stripes_size += SGBM3Way_buffer_size(width, width1, D, SH2)
+				+ dst_disp[i].total() * dst_disp[i].elemSize();
+	precompute_cost_volume(cost_calculator, _img1, _img2, params, stripes_size);
 }
 
 void allocate_buffers(Mat& buffer, int width, int width1, int D, int num_ch, int SH2, int P2,
@@ -702,35 +835,7 @@ void allocate_buffers(Mat& buffer, int width, int width1, int D, int num_ch, int
 	int width1_ext = width1 + 2;
 	int costVolumeLineSize_ext = width1_ext * D;
 	int hsumBufNRows = SH2 * 2 + 2;
-
-	// main buffer to store matching costs for the current line:
-	int curCostVolumeLineSize = costVolumeLineSize * sizeof(CostType);
-
-	// auxiliary buffers for the raw matching cost computation:
-	int hsumBufSize = costVolumeLineSize * hsumBufNRows * sizeof(CostType);
-	int pixDiffSize = costVolumeLineSize * sizeof(CostType);
-
-	// auxiliary buffers for the matching cost aggregation:
-	int horPassCostVolumeSize = costVolumeLineSize_ext * sizeof(CostType); // buffer for the 2-pass horizontal cost aggregation
-	int vertPassCostVolumeSize = costVolumeLineSize_ext * sizeof(CostType); // buffer for the vertical cost aggregation
-	int vertPassMinSize = width1_ext * sizeof(CostType); // buffer for storing minimum costs from the previous line
-	int rightPassBufSize = D * sizeof(CostType); // additional small buffer for the right-to-left pass
-
-	// buffers for the pseudo-LRC check:
-	int disp2CostBufSize = width * sizeof(CostType);
-	int disp2BufSize = width * sizeof(short);
-
-	// sum up the sizes of all the buffers:
-	size_t totalBufSize = curCostVolumeLineSize +
-			hsumBufSize +
-			pixDiffSize +
-			horPassCostVolumeSize +
-			vertPassCostVolumeSize +
-			vertPassMinSize +
-			rightPassBufSize +
-			disp2CostBufSize +
-			disp2BufSize +
-			16;  //to compensate for the alignPtr shifts
+	size_t totalBufSize = SGBM3Way_buffer_size(width, width1, D, SH2);
 
 	if (buffer.empty() || !buffer.isContinuous()
 			|| buffer.cols * buffer.rows * buffer.elemSize() < totalBufSize)
@@ -1121,7 +1226,8 @@ void SGBM3WayMainLoop::operator ()(const Range& range) const
 	else
 		dst_offset = 0;
 
-	Mat cur_buffer = buffers[range.start];
+	// keep the buffer around for the next call
+	Mat& cur_buffer = buffers[range.start];
 	Mat cur_disp = dst_disp[range.start];
 	cur_disp = Scalar(INVALID_DISP_SCALED);
 
@@ -1154,19 +1260,35 @@ void SGBM3WayMainLoop::operator ()(const Range& range) const
 
 		// forward pass
 		prev_min = 0;
-		for (int x = D; x < (1 + width1) * D; x += D)
-			accumulateCostsLeftTop(horPassCostVolume + x, horPassCostVolume + x - D,
-					vertPassCostVolume + x, C + x, prev_min, vertPassMin[x / D], D, P1, P2);
+		for (int x = D; x < (1 + width1) * D; x += D){
+			if (kernels)
+				kernels->accumulate_costs_left_top(horPassCostVolume + x, horPassCostVolume + x - D,
+						vertPassCostVolume + x, C + x, prev_min, vertPassMin[x / D], D, P1, P2);
+			else
+				accumulateCostsLeftTop(horPassCostVolume + x, horPassCostVolume + x - D,
+						vertPassCostVolume + x, C + x, prev_min, vertPassMin[x / D], D, P1, P2);
+		}
 
 		//backward pass
 		memset(rightPassBuf, 0, D * sizeof(CostType));
 		prev_min = 0;
 		for (int x = width1 * D; x >= D; x -= D)
 				{
-			accumulateCostsRight(rightPassBuf, vertPassCostVolume + x, horPassCostVolume + x, C + x,
-					prev_min, D, P1, P2, best_d, min_cost);
+			if (kernels)
+				kernels->accumulate_costs_right(rightPassBuf, vertPassCostVolume + x,
+						horPassCostVolume + x, C + x, prev_min, D, P1, P2, best_d, min_cost);
+			else
+				accumulateCostsRight(rightPassBuf, vertPassCostVolume + x, horPassCostVolume + x,
+						C + x, prev_min, D, P1, P2, best_d, min_cost);
 
-			if (uniquenessRatio > 0)
+			if (uniquenessRatio > 0 && kernels)
+					{
+				int thresh = (100 * min_cost) / (100 - uniquenessRatio);
+				if (kernels->has_competing_disparity(horPassCostVolume + x, D, best_d,
+						(short) (thresh + 1)))
+					continue;
+			}
+			else if (uniquenessRatio > 0)
 					{
 #if CV_SIMD128
 				horPassCostVolume += x;
@@ -1254,9 +1376,14 @@ void SGBM3WayMainLoop::operator ()(const Range& range) const
 	}
 }
 
-static void computeDisparity3WaySGBM(const Mat& img1, const Mat& img2,
+/*
+ returns the amount of memory (in bytes) used by the buffers, the intermediate disparities and the cost
+ calculator
+ */
+static size_t computeDisparity3WaySGBM(const Mat& img1, const Mat& img2,
 		Mat& disp1, const semiglobal_matcher_parameters& params,
-		Mat* buffers, int nstripes, pixel_cost_type cost_type = pixel_cost_type::BIRCHFIELD_TOMASI)
+		Mat* buffers, int nstripes, pixel_cost_type cost_type = pixel_cost_type::BIRCHFIELD_TOMASI,
+		sgm_instruction_set instruction_set = SGM_SCALAR)
 		{
 
 	// allocate separate dst_disp arrays to avoid conflicts due to stripe overlap:
@@ -1266,9 +1393,14 @@ static void computeDisparity3WaySGBM(const Mat& img1, const Mat& img2,
 	for (int i = 0; i < nstripes; i++)
 		dst_disp[i].create(stripe_sz + stripe_overlap, img1.cols, CV_16S);
 
-	parallel_for_(Range(0, nstripes),
-			SGBM3WayMainLoop(buffers, img1, img2, dst_disp, params, nstripes, stripe_overlap,
-					cost_type));
+	SGBM3WayMainLoop main_loop(buffers, img1, img2, dst_disp, params, nstripes, stripe_overlap,
+			cost_type, instruction_set);
+	parallel_for_(Range(0, nstripes), main_loop);
+
+	size_t used_memory = main_loop.cost_calculator->get_memory_footprint();
+	for (int i = 0; i < nstripes; i++)
+		used_memory += buffers[i].total() * buffers[i].elemSize()
+				+ dst_disp[i].total() * dst_disp[i].elemSize();
 
 	//assemble disp1 from dst_disp:
 	short* dst_row;
@@ -1280,24 +1412,31 @@ static void computeDisparity3WaySGBM(const Mat& img1, const Mat& img2,
 		memcpy(dst_row, src_row, disp1.cols * sizeof(short));
 	}
 	delete[] dst_disp;
+	return used_memory;
 }
 
 class semiglobal_matcher_implementation:
-		public StereoSGBM
+		public semiglobal_matcher
 {
 private:
 	pixel_cost_type cost_type;
+	// instruction set for the path aggregation kernels, picked when the matcher is created
+	sgm_instruction_set instruction_set;
+	size_t peak_memory;
 
 public:
 	semiglobal_matcher_implementation() :
-			cost_type(pixel_cost_type::BIRCHFIELD_TOMASI), params() {
+			cost_type(pixel_cost_type::BIRCHFIELD_TOMASI),
+					instruction_set(default_sgm_instruction_set()), peak_memory(0), params() {
 	}
 
 	semiglobal_matcher_implementation(int _minDisparity, int _numDisparities, int _SADWindowSize,
 			int _P1, int _P2, int _disp12MaxDiff, int _preFilterCap,
 			int _uniquenessRatio, int _speckleWindowSize, int _speckleRange,
 			int _mode) :
-			cost_type(pixel_cost_type::BIRCHFIELD_TOMASI), params(_minDisparity, _numDisparities,
+			cost_type(pixel_cost_type::BIRCHFIELD_TOMASI),
+					instruction_set(default_sgm_instruction_set()), peak_memory(0),
+					params(_minDisparity, _numDisparities,
 					_SADWindowSize,
 					_P1, _P2, _disp12MaxDiff, _preFilterCap,
 					_uniquenessRatio, _speckleWindowSize, _speckleRange,
@@ -1307,12 +1446,13 @@ public:
 	semiglobal_matcher_implementation(int _minDisparity, int _numDisparities, int _SADWindowSize,
 			int _P1, int _P2, int _disp12MaxDiff, int _preFilterCap,
 			int _uniquenessRatio, int _speckleWindowSize, int _speckleRange,
-			int _mode, pixel_cost_type cost_type) :
+			int _mode, pixel_cost_type cost_type, int _num_threads = 0) :
 			cost_type(cost_type),
+					instruction_set(default_sgm_instruction_set()), peak_memory(0),
 					params(_minDisparity, _numDisparities, _SADWindowSize,
 							_P1, _P2, _disp12MaxDiff, _preFilterCap,
 							_uniquenessRatio, _speckleWindowSize, _speckleRange,
-							_mode)
+							_mode, _num_threads)
 	{
 	}
 
@@ -1324,11 +1464,16 @@ public:
 		disparr.create(left.size(), CV_16S);
 		Mat disp = disparr.getMat();
 
+		size_t matching_memory;
 		if (params.mode == MODE_SGBM_3WAY) {
-			computeDisparity3WaySGBM(left, right, disp, params, buffers, num_stripes, cost_type);
+			matching_memory = computeDisparity3WaySGBM(left, right, disp, params, buffers, num_stripes,
+					cost_type, instruction_set);
 		} else {
-			compute_disparity_SGBM(left, right, disp, params, buffer, cost_type);
+			matching_memory = compute_disparity_SGBM(left, right, disp, params, stripe_buffers,
+					cost_type, instruction_set);
 		}
+		size_t disparity_memory = disp.total() * disp.elemSize();
+		peak_memory = matching_memory + disparity_memory;
 
 		medianBlur(disp, disp, 3);
 
@@ -1336,6 +1481,8 @@ public:
 			filterSpeckles(disp, (params.minDisparity - 1) * StereoMatcher::DISP_SCALE,
 					params.speckleWindowSize,
 					StereoMatcher::DISP_SCALE * params.speckleRange, buffer);
+			peak_memory = std::max(peak_memory,
+					disparity_memory + buffer.total() * buffer.elemSize());
 		}
 	}
 
@@ -1416,6 +1563,45 @@ public:
 		params.mode = mode;
 	}
 
+	int get_num_threads() const {
+		return params.num_threads;
+	}
+	void set_num_threads(int num_threads) {
+		params.num_threads = num_threads;
+	}
+
+	size_t get_memory_budget() const {
+		return params.memory_budget;
+	}
+	void set_memory_budget(size_t memory_budget) {
+		params.memory_budget = memory_budget;
+	}
+
+	bool get_compact_path_costs() const {
+		return params.compact_path_costs;
+	}
+	void set_compact_path_costs(bool compact_path_costs) {
+		params.compact_path_costs = compact_path_costs;
+	}
+
+	bool get_quantized_descriptors() const {
+		return params.quantized_descriptors;
+	}
+	void set_quantized_descriptors(bool quantized_descriptors) {
+		params.quantized_descriptors = quantized_descriptors;
+	}
+
+	cost_volume_type get_cost_volume() const {
+		return params.cost_volume;
+	}
+	void set_cost_volume(cost_volume_type cost_volume) {
+		params.cost_volume = cost_volume;
+	}
+
+	size_t get_peak_memory() const {
+		return peak_memory;
+	}
+
 	void write(FileStorage& fs) const
 			{
 		fs << "name" << name_
@@ -1429,7 +1615,12 @@ public:
 				<< "uniquenessRatio" << params.uniquenessRatio
 				<< "P1" << params.P1
 				<< "P2" << params.P2
-				<< "mode" << params.mode;
+				<< "mode" << params.mode
+				<< "numThreads" << params.num_threads
+				<< "memoryBudget" << (double) params.memory_budget
+				<< "compactPathCosts" << (int) params.compact_path_costs
+				<< "quantizedDescriptors" << (int) params.quantized_descriptors
+				<< "costVolume" << (int) params.cost_volume;
 	}
 
 	void read(const FileNode& fn)
@@ -1447,10 +1638,17 @@ public:
 		params.P1 = (int) fn["P1"];
 		params.P2 = (int) fn["P2"];
 		params.mode = (int) fn["mode"];
+		params.num_threads = (int) fn["numThreads"];
+		params.memory_budget = (size_t) (double) fn["memoryBudget"];
+		params.compact_path_costs = (int) fn["compactPathCosts"] != 0;
+		params.quantized_descriptors = (int) fn["quantizedDescriptors"] != 0;
+		params.cost_volume = (cost_volume_type) (int) fn["costVolume"];
 	}
 
 	semiglobal_matcher_parameters params;
 	Mat buffer;
+	// one buffer per stripe for MODE_SGBM and MODE_HH
+	std::vector<Mat> stripe_buffers;
 
 	// the number of stripes is fixed, disregarding the number of threads/processors
 	// to make the results fully reproducible:
@@ -1462,18 +1660,18 @@ public:
 
 const char* semiglobal_matcher_implementation::name_ = "StereoMatcher.SGBM";
 
-Ptr<StereoSGBM> create_semiglobal_matcher(int minDisparity, int numDisparities, int block_size,
+Ptr<semiglobal_matcher> create_semiglobal_matcher(int minDisparity, int numDisparities, int block_size,
 		int P1, int P2, int disp12MaxDiff,
 		int preFilterCap, int uniquenessRatio,
 		int speckleWindowSize, int speckleRange,
-		int mode, pixel_cost_type cost_type) {
-	return Ptr<StereoSGBM>(
+		int mode, pixel_cost_type cost_type, int num_threads) {
+	return Ptr<semiglobal_matcher>(
 			new reco::stereo_workbench::semiglobal_matcher_implementation(minDisparity,
 					numDisparities, block_size,
 					P1, P2, disp12MaxDiff,
 					preFilterCap, uniquenessRatio,
 					speckleWindowSize, speckleRange,
-					mode, cost_type));
+					mode, cost_type, num_threads));
 }
 
 Rect getValidDisparityROI(Rect roi1, Rect roi2,
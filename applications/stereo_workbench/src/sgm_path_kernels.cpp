@@ -0,0 +1,417 @@
+/*
+ * sgm_path_kernels.cpp
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: Gregory Kramida
+ *   Copyright: 2016 Gregory Kramida
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+//standard
+#include <climits>
+#include <algorithm>
+
+#include "sgm_path_kernels.hpp"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define RECO_SGM_X86
+#include <immintrin.h>
+#endif
+
+namespace reco {
+namespace stereo_workbench {
+
+#ifdef RECO_SGM_X86
+namespace {
+
+const short lane_index[64] = {
+		0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+		16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31,
+		32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47,
+		48, 49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 62, 63
+};
+
+// the helpers below are always inlined into the kernels, so that they are compiled for the kernel's
+// instruction set: calling non-VEX SSE code from AVX code incurs transition penalties.
+#define RECO_SGM_HELPER inline __attribute__((always_inline))
+
+RECO_SGM_HELPER short saturate_to_cost(int value) {
+	return (short) std::min(std::max(value, SHRT_MIN), SHRT_MAX);
+}
+
+RECO_SGM_HELPER short horizontal_min(const short* values, int count) {
+	short result = values[0];
+	for (int i = 1; i < count; i++){
+		result = std::min(result, values[i]);
+	}
+	return result;
+}
+
+/**
+ * Merge two sets of lanes tracking the minimal value & its position: keeps the smaller value and,
+ * for equal values, the lower position (or the higher one if "last" is set)
+ */
+RECO_SGM_HELPER __attribute__((target("sse2")))
+void merge_min_lanes(__m128i& value, __m128i& position, const __m128i& other_value,
+		const __m128i& other_position, bool last) {
+	__m128i take_other = _mm_or_si128(_mm_cmpgt_epi16(value, other_value),
+			_mm_and_si128(_mm_cmpeq_epi16(value, other_value),
+					last ? _mm_cmpgt_epi16(other_position, position) :
+							_mm_cmpgt_epi16(position, other_position)));
+	value = _mm_xor_si128(value, _mm_and_si128(_mm_xor_si128(value, other_value), take_other));
+	position = _mm_xor_si128(position,
+			_mm_and_si128(_mm_xor_si128(position, other_position), take_other));
+}
+
+RECO_SGM_HELPER __attribute__((target("avx2")))
+void merge_min_lanes(__m256i& value, __m256i& position, const __m256i& other_value,
+		const __m256i& other_position, bool last) {
+	__m256i take_other = _mm256_or_si256(_mm256_cmpgt_epi16(value, other_value),
+			_mm256_and_si256(_mm256_cmpeq_epi16(value, other_value),
+					last ? _mm256_cmpgt_epi16(other_position, position) :
+							_mm256_cmpgt_epi16(position, other_position)));
+	value = _mm256_blendv_epi8(value, other_value, take_other);
+	position = _mm256_blendv_epi8(position, other_position, take_other);
+}
+
+/**
+ * The SSE2 code tracks the first minimum within each of its 8 lanes, i.e. among the disparities
+ * that are equal mod 8, & then picks the lowest lane holding the overall minimum. Wider registers
+ * hold several disparities equal mod 8 at once, so they are folded down to 8 lanes (fold_to_8) first.
+ */
+RECO_SGM_HELPER void reduce_first_min(const short* values, const short* positions, int& min_value,
+		int& position) {
+	min_value = horizontal_min(values, 8);
+	for (int i = 0; i < 8; i++){
+		if (values[i] == min_value){
+			position = positions[i];
+			return;
+		}
+	}
+}
+
+/**
+ * Same as reduce_first_min, for lanes tracking the last minimum; also mirrors the SSE2 code in
+ * returning 0 when all of the costs saturate.
+ */
+RECO_SGM_HELPER int reduce_last_min(const short* values, const short* positions) {
+	short min_value = SHRT_MAX;
+	int position = 0;
+	for (int i = 0; i < 8; i++){
+		if (values[i] < min_value){
+			min_value = values[i];
+			position = positions[i];
+		}
+	}
+	return position;
+}
+
+} //end anonymous namespace
+
+namespace sse2 {
+#define RECO_SGM_TARGET __attribute__((target("sse2")))
+const sgm_instruction_set instruction_set = SGM_SSE2;
+const char* const instruction_set_name = "SSE2";
+
+struct vec {
+	typedef __m128i reg;
+	typedef __m128i mask;
+	static const int lanes = 8;
+	RECO_SGM_TARGET static inline reg load(const short* ptr) {
+		return _mm_loadu_si128((const __m128i*) ptr);
+	}
+	RECO_SGM_TARGET static inline void store(short* ptr, const reg& a) {
+		_mm_storeu_si128((__m128i*) ptr, a);
+	}
+	RECO_SGM_TARGET static inline reg set1(short value) {
+		return _mm_set1_epi16(value);
+	}
+	//widen lanes 8-bit values
+	RECO_SGM_TARGET static inline reg load_u8(const CompactCostType* ptr) {
+		return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) ptr), _mm_setzero_si128());
+	}
+	//narrow to 8 bits with unsigned saturation
+	RECO_SGM_TARGET static inline void store_u8(CompactCostType* ptr, const reg& a) {
+		_mm_storel_epi64((__m128i*) ptr, _mm_packus_epi16(a, a));
+	}
+	RECO_SGM_TARGET static inline reg index() {
+		return load(lane_index);
+	}
+	RECO_SGM_TARGET static inline reg adds(const reg& a, const reg& b) {
+		return _mm_adds_epi16(a, b);
+	}
+	RECO_SGM_TARGET static inline reg subs(const reg& a, const reg& b) {
+		return _mm_subs_epi16(a, b);
+	}
+	RECO_SGM_TARGET static inline reg min(const reg& a, const reg& b) {
+		return _mm_min_epi16(a, b);
+	}
+	RECO_SGM_TARGET static inline mask cmpgt(const reg& a, const reg& b) {
+		return _mm_cmpgt_epi16(a, b);
+	}
+	RECO_SGM_TARGET static inline mask cmpeq(const reg& a, const reg& b) {
+		return _mm_cmpeq_epi16(a, b);
+	}
+	RECO_SGM_TARGET static inline mask mask_and(const mask& a, const mask& b) {
+		return _mm_and_si128(a, b);
+	}
+	RECO_SGM_TARGET static inline mask mask_or(const mask& a, const mask& b) {
+		return _mm_or_si128(a, b);
+	}
+	//mask ? b : a
+	RECO_SGM_TARGET static inline reg blend(const reg& a, const reg& b, const mask& m) {
+		return _mm_xor_si128(a, _mm_and_si128(_mm_xor_si128(a, b), m));
+	}
+	RECO_SGM_TARGET static inline bool any(const mask& m) {
+		return _mm_movemask_epi8(m) != 0;
+	}
+	//[a[lanes-1], b[0], ..., b[lanes-2]]
+	RECO_SGM_TARGET static inline reg shift_in_left(const reg& a, const reg& b) {
+		return _mm_or_si128(_mm_srli_si128(a, 14), _mm_slli_si128(b, 2));
+	}
+	//[a[1], ..., a[lanes-1], b[0]]
+	RECO_SGM_TARGET static inline reg shift_in_right(const reg& a, const reg& b) {
+		return _mm_or_si128(_mm_srli_si128(a, 2), _mm_slli_si128(b, 14));
+	}
+	RECO_SGM_TARGET static inline short hmin(const reg& a) {
+		short buf[lanes];
+		store(buf, a);
+		return horizontal_min(buf, lanes);
+	}
+	//merge lanes holding disparities that are equal mod 8 (see reduce_first_min)
+	RECO_SGM_TARGET static inline void fold_to_8(const reg& value, const reg& position, bool,
+			short* value8, short* position8) {
+		store(value8, value);
+		store(position8, position);
+	}
+};
+
+#include "sgm_path_kernels.tpp"
+#undef RECO_SGM_TARGET
+} //sse2
+
+namespace avx2 {
+#define RECO_SGM_TARGET __attribute__((target("avx2")))
+const sgm_instruction_set instruction_set = SGM_AVX2;
+const char* const instruction_set_name = "AVX2";
+
+struct vec {
+	typedef __m256i reg;
+	typedef __m256i mask;
+	static const int lanes = 16;
+	RECO_SGM_TARGET static inline reg load(const short* ptr) {
+		return _mm256_loadu_si256((const __m256i*) ptr);
+	}
+	RECO_SGM_TARGET static inline void store(short* ptr, const reg& a) {
+		_mm256_storeu_si256((__m256i*) ptr, a);
+	}
+	RECO_SGM_TARGET static inline reg set1(short value) {
+		return _mm256_set1_epi16(value);
+	}
+	RECO_SGM_TARGET static inline reg load_u8(const CompactCostType* ptr) {
+		return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) ptr));
+	}
+	//packus works within 128-bit halves, the 64-bit results are gathered in the lower half after it
+	RECO_SGM_TARGET static inline void store_u8(CompactCostType* ptr, const reg& a) {
+		_mm_storeu_si128((__m128i*) ptr,
+				_mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi16(a, a), 0x08)));
+	}
+	RECO_SGM_TARGET static inline reg index() {
+		return load(lane_index);
+	}
+	RECO_SGM_TARGET static inline reg adds(const reg& a, const reg& b) {
+		return _mm256_adds_epi16(a, b);
+	}
+	RECO_SGM_TARGET static inline reg subs(const reg& a, const reg& b) {
+		return _mm256_subs_epi16(a, b);
+	}
+	RECO_SGM_TARGET static inline reg min(const reg& a, const reg& b) {
+		return _mm256_min_epi16(a, b);
+	}
+	RECO_SGM_TARGET static inline mask cmpgt(const reg& a, const reg& b) {
+		return _mm256_cmpgt_epi16(a, b);
+	}
+	RECO_SGM_TARGET static inline mask cmpeq(const reg& a, const reg& b) {
+		return _mm256_cmpeq_epi16(a, b);
+	}
+	RECO_SGM_TARGET static inline mask mask_and(const mask& a, const mask& b) {
+		return _mm256_and_si256(a, b);
+	}
+	RECO_SGM_TARGET static inline mask mask_or(const mask& a, const mask& b) {
+		return _mm256_or_si256(a, b);
+	}
+	RECO_SGM_TARGET static inline reg blend(const reg& a, const reg& b, const mask& m) {
+		return _mm256_blendv_epi8(a, b, m);
+	}
+	RECO_SGM_TARGET static inline bool any(const mask& m) {
+		return _mm256_movemask_epi8(m) != 0;
+	}
+	//alignr works within 128-bit halves, so the neighbouring halves are put side by side first
+	RECO_SGM_TARGET static inline reg shift_in_left(const reg& a, const reg& b) {
+		return _mm256_alignr_epi8(b, _mm256_permute2x128_si256(a, b, 0x21), 14);
+	}
+	RECO_SGM_TARGET static inline reg shift_in_right(const reg& a, const reg& b) {
+		return _mm256_alignr_epi8(_mm256_permute2x128_si256(a, b, 0x21), a, 2);
+	}
+	RECO_SGM_TARGET static inline short hmin(const reg& a) {
+		__m128i m = _mm_min_epi16(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1));
+		//minpos works on unsigned values: flip the sign bit
+		const __m128i sign = _mm_set1_epi16(SHRT_MIN);
+		m = _mm_minpos_epu16(_mm_xor_si128(m, sign));
+		return (short) (_mm_cvtsi128_si32(m) ^ SHRT_MIN);
+	}
+	RECO_SGM_TARGET static inline void fold_to_8(const reg& value, const reg& position, bool last,
+			short* value8, short* position8) {
+		__m128i value_low = _mm256_castsi256_si128(value);
+		__m128i position_low = _mm256_castsi256_si128(position);
+		merge_min_lanes(value_low, position_low, _mm256_extracti128_si256(value, 1),
+				_mm256_extracti128_si256(position, 1), last);
+		_mm_storeu_si128((__m128i*) value8, value_low);
+		_mm_storeu_si128((__m128i*) position8, position_low);
+	}
+};
+
+#include "sgm_path_kernels.tpp"
+#undef RECO_SGM_TARGET
+} //avx2
+
+namespace avx512bw {
+#define RECO_SGM_TARGET __attribute__((target("avx512bw")))
+const sgm_instruction_set instruction_set = SGM_AVX512BW;
+const char* const instruction_set_name = "AVX-512BW";
+
+struct vec {
+	typedef __m512i reg;
+	typedef __mmask32 mask;
+	static const int lanes = 32;
+	RECO_SGM_TARGET static inline reg load(const short* ptr) {
+		return _mm512_loadu_si512((const void*) ptr);
+	}
+	RECO_SGM_TARGET static inline void store(short* ptr, const reg& a) {
+		_mm512_storeu_si512((void*) ptr, a);
+	}
+	RECO_SGM_TARGET static inline reg set1(short value) {
+		return _mm512_set1_epi16(value);
+	}
+	RECO_SGM_TARGET static inline reg load_u8(const CompactCostType* ptr) {
+		return _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*) ptr));
+	}
+	//the input is never negative, so unsigned saturation works here
+	RECO_SGM_TARGET static inline void store_u8(CompactCostType* ptr, const reg& a) {
+		_mm512_mask_cvtusepi16_storeu_epi8(ptr, (__mmask32) 0xFFFFFFFF, a);
+	}
+	RECO_SGM_TARGET static inline reg index() {
+		return load(lane_index);
+	}
+	RECO_SGM_TARGET static inline reg adds(const reg& a, const reg& b) {
+		return _mm512_adds_epi16(a, b);
+	}
+	RECO_SGM_TARGET static inline reg subs(const reg& a, const reg& b) {
+		return _mm512_subs_epi16(a, b);
+	}
+	RECO_SGM_TARGET static inline reg min(const reg& a, const reg& b) {
+		return _mm512_min_epi16(a, b);
+	}
+	RECO_SGM_TARGET static inline mask cmpgt(const reg& a, const reg& b) {
+		return _mm512_cmpgt_epi16_mask(a, b);
+	}
+	RECO_SGM_TARGET static inline mask cmpeq(const reg& a, const reg& b) {
+		return _mm512_cmpeq_epi16_mask(a, b);
+	}
+	RECO_SGM_TARGET static inline mask mask_and(const mask& a, const mask& b) {
+		return a & b;
+	}
+	RECO_SGM_TARGET static inline mask mask_or(const mask& a, const mask& b) {
+		return a | b;
+	}
+	RECO_SGM_TARGET static inline reg blend(const reg& a, const reg& b, const mask& m) {
+		return _mm512_mask_blend_epi16(m, a, b);
+	}
+	RECO_SGM_TARGET static inline bool any(const mask& m) {
+		return m != 0;
+	}
+	//indices 0..31 pick from the first operand, 32..63 from the second
+	RECO_SGM_TARGET static inline reg shift_in_left(const reg& a, const reg& b) {
+		return _mm512_permutex2var_epi16(a, load(lane_index + 31), b);
+	}
+	RECO_SGM_TARGET static inline reg shift_in_right(const reg& a, const reg& b) {
+		return _mm512_permutex2var_epi16(a, load(lane_index + 1), b);
+	}
+	RECO_SGM_TARGET static inline short hmin(const reg& a) {
+		short buf[lanes];
+		store(buf, a);
+		return horizontal_min(buf, lanes);
+	}
+	//the halves go through memory, which also sidesteps bogus -Wuninitialized warnings in the
+	//AVX-512 cast/extract intrinsics of some compilers
+	RECO_SGM_TARGET static inline void fold_to_8(const reg& value, const reg& position, bool last,
+			short* value8, short* position8) {
+		short value_buf[lanes], position_buf[lanes];
+		store(value_buf, value);
+		store(position_buf, position);
+		__m256i value_low = _mm256_loadu_si256((const __m256i*) value_buf);
+		__m256i position_low = _mm256_loadu_si256((const __m256i*) position_buf);
+		merge_min_lanes(value_low, position_low,
+				_mm256_loadu_si256((const __m256i*) (value_buf + lanes / 2)),
+				_mm256_loadu_si256((const __m256i*) (position_buf + lanes / 2)), last);
+		avx2::vec::fold_to_8(value_low, position_low, last, value8, position8);
+	}
+};
+
+#include "sgm_path_kernels.tpp"
+#undef RECO_SGM_TARGET
+} //avx512bw
+#endif
+
+sgm_instruction_set detect_sgm_instruction_set() {
+	static const sgm_instruction_set detected = []() {
+		sgm_instruction_set instruction_set = SGM_SCALAR;
+#ifdef RECO_SGM_X86
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512bw")) {
+			instruction_set = SGM_AVX512BW;
+		} else if (__builtin_cpu_supports("avx2")) {
+			instruction_set = SGM_AVX2;
+		} else if (__builtin_cpu_supports("sse2")) {
+			instruction_set = SGM_SSE2;
+		}
+#endif
+		return instruction_set;
+	}();
+	return detected;
+}
+
+sgm_instruction_set default_sgm_instruction_set() {
+	return std::min(detect_sgm_instruction_set(), SGM_AVX2);
+}
+
+const sgm_path_kernels* get_sgm_path_kernels(sgm_instruction_set instruction_set,
+		int num_disparities) {
+	instruction_set = std::min(instruction_set, detect_sgm_instruction_set());
+#ifdef RECO_SGM_X86
+	if (instruction_set >= SGM_AVX512BW && num_disparities % avx512bw::vec::lanes == 0) {
+		return &avx512bw::kernels;
+	}
+	if (instruction_set >= SGM_AVX2 && num_disparities % avx2::vec::lanes == 0) {
+		return &avx2::kernels;
+	}
+	if (instruction_set >= SGM_SSE2 && num_disparities % sse2::vec::lanes == 0) {
+		return &sse2::kernels;
+	}
+#endif
+	return nullptr;
+}
+
+} //stereo_workbench
+} //reco
@@ -0,0 +1,140 @@
+/*
+ * sgm_path_kernels.hpp
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: Gregory Kramida
+ *   Copyright: 2016 Gregory Kramida
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+namespace reco {
+namespace stereo_workbench {
+
+typedef short CostType;
+typedef unsigned char CompactCostType;
+
+enum sgm_instruction_set {
+	SGM_SCALAR = 0,
+	SGM_SSE2 = 1,
+	SGM_AVX2 = 2,
+	SGM_AVX512BW = 3
+};
+
+/**
+ * @brief Vectorized inner loops of the semi-global matcher's path aggregation, for one instruction set.
+ *
+ * All kernels use saturating 16-bit arithmetic in exactly the same order as the original SSE2 code
+ * and resolve ties between equal costs the same way, so every instruction set produces bit-identical
+ * disparities. The number of disparities has to be a multiple of lanes.
+ */
+struct sgm_path_kernels {
+	sgm_instruction_set instruction_set;
+	const char* name;
+	//number of 16-bit costs processed at once
+	int lanes;
+
+	/**
+	 * @brief MODE_SGBM/MODE_HH: update four paths L_r(p,d) for one pixel, accumulate them into S(p,d)
+	 * @param Cp matching costs C(p,.) (P2 included)
+	 * @param Lr_prev the four paths at the previous pixels along each direction (with MAX_COST at -1 and D)
+	 * @param Lr_p output paths, D2 apart
+	 * @param delta min_k L_r(p-r,k) + P2 for each of the four paths
+	 * @param minLr output min_k L_r(p,k) for each of the four paths
+	 */
+	void (*aggregate_four_paths)(const CostType* Cp, const CostType* const * Lr_prev, CostType* Lr_p,
+			int D2, CostType* Sp, int D, int P1, const int* delta, CostType* minLr);
+	/**
+	 * @brief MODE_SGBM final step: update a single path, accumulate it into S(p,.) and find
+	 * the disparity with the minimal S (ties are resolved like the 8-lane SSE2 code does)
+	 * @param minL0 output min_k L_0(p,k)
+	 * @param minS output minimal S(p,d)
+	 * @param best_disp output disparity of minS, -1 if all costs saturate
+	 */
+	void (*aggregate_path_and_find_best)(const CostType* Cp, const CostType* Lr_p0, CostType* Lr_p,
+			CostType* Sp, int D, int P1, int delta0, CostType& minL0, int& minS, int& best_disp);
+	/**
+	 * @brief Uniqueness check: whether any cost[d] < bound at |d - best_disp| > 1
+	 */
+	bool (*has_competing_disparity)(const CostType* cost, int D, int best_disp, int bound);
+	/**
+	 * @brief Same as aggregate_four_paths, for paths stored compactly, as L_r(p,d) - min_k L_r(p,k)
+	 * saturated to 8 bits, which is lossless as long as P2 <= 255. Since
+	 * L_r(p,d) = C(p,d) + min(L_r(p-r,d), L_r(p-r,d-+1) + P1, min_k L_r(p-r,k) + P2) - min_k L_r(p-r,k),
+	 * the path minima cancel out and only the differences have to be stored.
+	 * @param Lr_prev the four paths at the previous pixels along each direction (with 255 at -1 and D)
+	 * @param L_buf scratch space for 4*D costs
+	 */
+	void (*aggregate_four_paths_compact)(const CostType* Cp, const CompactCostType* const * Lr_prev,
+			CompactCostType* Lr_p, int D2, CostType* Sp, int D, int P1, int P2, CostType* L_buf);
+	/**
+	 * @brief Same as aggregate_path_and_find_best, for paths stored compactly (see
+	 * aggregate_four_paths_compact)
+	 * @param L_buf scratch space for D costs
+	 */
+	void (*aggregate_path_and_find_best_compact)(const CostType* Cp, const CompactCostType* Lr_p0,
+			CompactCostType* Lr_p, CostType* Sp, int D, int P1, int P2, CostType* L_buf, int& minS,
+			int& best_disp);
+	/**
+	 * @brief MODE_SGBM_3WAY: left-to-right path (into leftBuf) & in-place top-to-bottom path (topBuf)
+	 */
+	void (*accumulate_costs_left_top)(CostType* leftBuf, const CostType* leftBuf_prev,
+			CostType* topBuf, const CostType* costs, CostType& leftMinCost, CostType& topMinCost, int D,
+			int P1, int P2);
+	/**
+	 * @brief MODE_SGBM_3WAY: in-place right-to-left path (rightBuf), sum of all three paths (into
+	 * leftBuf) & the disparity of the minimal sum
+	 */
+	void (*accumulate_costs_right)(CostType* rightBuf, const CostType* topBuf, CostType* leftBuf,
+			const CostType* costs, CostType& rightMinCost, int D, int P1, int P2, int& optimal_disp,
+			CostType& min_cost);
+};
+
+/**
+ * @brief The widest instruction set the kernels support on this CPU (detected once via CPUID)
+ */
+sgm_instruction_set detect_sgm_instruction_set();
+
+/**
+ * @brief The instruction set the matchers use by default: the widest one supported, but at most AVX2.
+ * The AVX-512BW kernels are slower than the AVX2 ones for the four-path & 3-way loops that dominate
+ * matching (see sgm_kernel_benchmark), so they are only used when asked for explicitly.
+ */
+sgm_instruction_set default_sgm_instruction_set();
+
+/**
+ * @brief Kernels for the given instruction set or the widest narrower one that can handle
+ * num_disparities costs per pixel.
+ * @return nullptr if there are no vectorized kernels for this CPU or number of disparities
+ */
+const sgm_path_kernels* get_sgm_path_kernels(sgm_instruction_set instruction_set, int num_disparities);
+
+/**
+ * @brief The condition cost*(100 - uniqueness_ratio) < min_cost*100 of MODE_SGBM's uniqueness check,
+ * rewritten as cost < bound, for uniqueness_ratio < 100
+ */
+inline int uniqueness_cost_bound(int min_cost, int uniqueness_ratio) {
+	const int numerator = min_cost * 100 - 1;
+	const int denominator = 100 - uniqueness_ratio;
+	//floor division
+	int quotient = numerator / denominator;
+	if (numerator % denominator != 0 && numerator < 0) {
+		quotient--;
+	}
+	return quotient + 1;
+}
+
+} //stereo_workbench
+} //reco
@@ -0,0 +1,314 @@
+/*
+ * sgm_path_kernels.tpp
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: Gregory Kramida
+ *   Copyright: 2016 Gregory Kramida
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+// Instruction-set-independent bodies of the SGM path kernels, included by sgm_path_kernels.cpp once
+// per instruction set, inside a namespace that defines the vector traits "vec" and RECO_SGM_TARGET.
+// A template can't carry a per-instantiation target attribute, hence the repeated inclusion.
+
+RECO_SGM_TARGET
+void aggregate_four_paths(const CostType* Cp, const CostType* const * Lr_prev, CostType* Lr_p,
+		int D2, CostType* Sp, int D, int P1, const int* delta, CostType* minLr) {
+	const vec::reg _P1 = vec::set1((short) P1);
+	vec::reg _delta[4], _minL[4];
+	for (int k = 0; k < 4; k++){
+		_delta[k] = vec::set1((short) delta[k]);
+		_minL[k] = vec::set1(SHRT_MAX);
+	}
+
+	for (int d = 0; d < D; d += vec::lanes){
+		vec::reg Cpd = vec::load(Cp + d);
+		vec::reg L[4];
+		for (int k = 0; k < 4; k++){
+			const CostType* Lr_pk = Lr_prev[k];
+			L[k] = vec::load(Lr_pk + d);
+			L[k] = vec::min(L[k], vec::adds(vec::load(Lr_pk + d - 1), _P1));
+			L[k] = vec::min(L[k], vec::adds(vec::load(Lr_pk + d + 1), _P1));
+			L[k] = vec::min(L[k], _delta[k]);
+			L[k] = vec::adds(vec::subs(L[k], _delta[k]), Cpd);
+			vec::store(Lr_p + d + D2 * k, L[k]);
+			_minL[k] = vec::min(_minL[k], L[k]);
+		}
+		vec::reg Sval = vec::load(Sp + d);
+		Sval = vec::adds(Sval, vec::adds(L[0], L[1]));
+		Sval = vec::adds(Sval, vec::adds(L[2], L[3]));
+		vec::store(Sp + d, Sval);
+	}
+
+	for (int k = 0; k < 4; k++){
+		minLr[k] = vec::hmin(_minL[k]);
+	}
+}
+
+RECO_SGM_TARGET
+void aggregate_path_and_find_best(const CostType* Cp, const CostType* Lr_p0, CostType* Lr_p,
+		CostType* Sp, int D, int P1, int delta0, CostType& minL0, int& minS, int& best_disp) {
+	const vec::reg _P1 = vec::set1((short) P1);
+	const vec::reg _delta0 = vec::set1((short) delta0);
+	const vec::reg _step = vec::set1((short) vec::lanes);
+	vec::reg _minL0 = vec::set1(SHRT_MAX);
+	vec::reg _minS = vec::set1(SHRT_MAX), _best_disp = vec::set1(-1);
+	vec::reg _d = vec::index();
+
+	for (int d = 0; d < D; d += vec::lanes){
+		vec::reg L0 = vec::load(Lr_p0 + d);
+		L0 = vec::min(L0, vec::adds(vec::load(Lr_p0 + d - 1), _P1));
+		L0 = vec::min(L0, vec::adds(vec::load(Lr_p0 + d + 1), _P1));
+		L0 = vec::min(L0, _delta0);
+		L0 = vec::adds(vec::subs(L0, _delta0), vec::load(Cp + d));
+
+		vec::store(Lr_p + d, L0);
+		_minL0 = vec::min(_minL0, L0);
+		L0 = vec::adds(L0, vec::load(Sp + d));
+		vec::store(Sp + d, L0);
+
+		//keep the first disparity with the minimal cost in each lane
+		vec::mask mask = vec::cmpgt(_minS, L0);
+		_minS = vec::min(_minS, L0);
+		_best_disp = vec::blend(_best_disp, _d, mask);
+		_d = vec::adds(_d, _step);
+	}
+
+	short min_buf[8], best_buf[8];
+	vec::fold_to_8(_minS, _best_disp, false, min_buf, best_buf);
+	minL0 = vec::hmin(_minL0);
+	reduce_first_min(min_buf, best_buf, minS, best_disp);
+}
+
+RECO_SGM_TARGET
+bool has_competing_disparity(const CostType* cost, int D, int best_disp, int bound) {
+	if (bound > SHRT_MAX){
+		//every cost is below the bound
+		return best_disp - 2 >= 0 || best_disp + 2 < D;
+	}
+	if (bound <= SHRT_MIN){
+		return false;
+	}
+	const vec::reg _bound = vec::set1((short) bound);
+	const vec::reg _d1 = vec::set1((short) (best_disp - 1));
+	const vec::reg _d2 = vec::set1((short) (best_disp + 1));
+	const vec::reg _step = vec::set1((short) vec::lanes);
+	vec::reg _d = vec::index();
+	for (int d = 0; d < D; d += vec::lanes){
+		vec::mask mask = vec::mask_and(vec::cmpgt(_bound, vec::load(cost + d)),
+				vec::mask_or(vec::cmpgt(_d1, _d), vec::cmpgt(_d, _d2)));
+		if (vec::any(mask)){
+			return true;
+		}
+		_d = vec::adds(_d, _step);
+	}
+	return false;
+}
+
+/**
+ * Store L - min_d L for the D costs at L_buf, saturated to 8 bits
+ */
+RECO_SGM_TARGET
+inline void store_compact_path(const CostType* L_buf, const vec::reg& _minL, CompactCostType* Lr_p,
+		int D) {
+	for (int d = 0; d < D; d += vec::lanes){
+		vec::store_u8(Lr_p + d, vec::subs(vec::load(L_buf + d), _minL));
+	}
+}
+
+RECO_SGM_TARGET
+void aggregate_four_paths_compact(const CostType* Cp, const CompactCostType* const * Lr_prev,
+		CompactCostType* Lr_p, int D2, CostType* Sp, int D, int P1, int P2, CostType* L_buf) {
+	const vec::reg _P1 = vec::set1((short) P1);
+	const vec::reg _P2 = vec::set1((short) P2);
+	vec::reg _minL[4];
+	for (int k = 0; k < 4; k++){
+		_minL[k] = vec::set1(SHRT_MAX);
+	}
+
+	for (int d = 0; d < D; d += vec::lanes){
+		vec::reg Cpd = vec::load(Cp + d);
+		vec::reg L[4];
+		for (int k = 0; k < 4; k++){
+			const CompactCostType* Lr_pk = Lr_prev[k];
+			L[k] = vec::load_u8(Lr_pk + d);
+			L[k] = vec::min(L[k], vec::adds(vec::load_u8(Lr_pk + d - 1), _P1));
+			L[k] = vec::min(L[k], vec::adds(vec::load_u8(Lr_pk + d + 1), _P1));
+			L[k] = vec::min(L[k], _P2);
+			L[k] = vec::adds(vec::subs(L[k], _P2), Cpd);
+			vec::store(L_buf + d + D * k, L[k]);
+			_minL[k] = vec::min(_minL[k], L[k]);
+		}
+		vec::reg Sval = vec::load(Sp + d);
+		Sval = vec::adds(Sval, vec::adds(L[0], L[1]));
+		Sval = vec::adds(Sval, vec::adds(L[2], L[3]));
+		vec::store(Sp + d, Sval);
+	}
+
+	for (int k = 0; k < 4; k++){
+		store_compact_path(L_buf + D * k, vec::set1(vec::hmin(_minL[k])), Lr_p + D2 * k, D);
+	}
+}
+
+RECO_SGM_TARGET
+void aggregate_path_and_find_best_compact(const CostType* Cp, const CompactCostType* Lr_p0,
+		CompactCostType* Lr_p, CostType* Sp, int D, int P1, int P2, CostType* L_buf, int& minS,
+		int& best_disp) {
+	const vec::reg _P1 = vec::set1((short) P1);
+	const vec::reg _P2 = vec::set1((short) P2);
+	const vec::reg _step = vec::set1((short) vec::lanes);
+	vec::reg _minL0 = vec::set1(SHRT_MAX);
+	vec::reg _minS = vec::set1(SHRT_MAX), _best_disp = vec::set1(-1);
+	vec::reg _d = vec::index();
+
+	for (int d = 0; d < D; d += vec::lanes){
+		vec::reg L0 = vec::load_u8(Lr_p0 + d);
+		L0 = vec::min(L0, vec::adds(vec::load_u8(Lr_p0 + d - 1), _P1));
+		L0 = vec::min(L0, vec::adds(vec::load_u8(Lr_p0 + d + 1), _P1));
+		L0 = vec::min(L0, _P2);
+		L0 = vec::adds(vec::subs(L0, _P2), vec::load(Cp + d));
+
+		vec::store(L_buf + d, L0);
+		_minL0 = vec::min(_minL0, L0);
+		L0 = vec::adds(L0, vec::load(Sp + d));
+		vec::store(Sp + d, L0);
+
+		vec::mask mask = vec::cmpgt(_minS, L0);
+		_minS = vec::min(_minS, L0);
+		_best_disp = vec::blend(_best_disp, _d, mask);
+		_d = vec::adds(_d, _step);
+	}
+	store_compact_path(L_buf, vec::set1(vec::hmin(_minL0)), Lr_p, D);
+
+	short min_buf[8], best_buf[8];
+	vec::fold_to_8(_minS, _best_disp, false, min_buf, best_buf);
+	reduce_first_min(min_buf, best_buf, minS, best_disp);
+}
+
+/**
+ * One block of a horizontal/vertical path update:
+ * costs + min(L(d-1) + P1, L(d+1) + P1, L(d), minL + P2) - (minL + P2),
+ * where "previous" holds L(d - lanes .. d - 1), "current" L(d .. d + lanes - 1) & "next" the block after
+ */
+RECO_SGM_TARGET
+inline vec::reg update_path_block(const vec::reg& previous, const vec::reg& current,
+		const vec::reg& next, const vec::reg& costs, const vec::reg& _P1, const vec::reg& _minCostP2) {
+	vec::reg shifted_left = vec::adds(vec::shift_in_left(previous, current), _P1);
+	vec::reg shifted_right = vec::adds(vec::shift_in_right(current, next), _P1);
+	return vec::adds(costs,
+			vec::subs(vec::min(vec::min(shifted_left, shifted_right), vec::min(current, _minCostP2)),
+					_minCostP2));
+}
+
+RECO_SGM_TARGET
+void accumulate_costs_left_top(CostType* leftBuf, const CostType* leftBuf_prev, CostType* topBuf,
+		const CostType* costs, CostType& leftMinCost, CostType& topMinCost, int D, int P1, int P2) {
+	const vec::reg _P1 = vec::set1(saturate_to_cost(P1));
+	const vec::reg _max = vec::set1(SHRT_MAX);
+
+	const vec::reg leftMinCostP2 = vec::set1(saturate_to_cost(leftMinCost + P2));
+	vec::reg leftMinCost_new = _max;
+	vec::reg src0_left = _max;
+	vec::reg src1_left = vec::load(leftBuf_prev);
+
+	const vec::reg topMinCostP2 = vec::set1(saturate_to_cost(topMinCost + P2));
+	vec::reg topMinCost_new = _max;
+	vec::reg src0_top = _max;
+	vec::reg src1_top = vec::load(topBuf);
+
+	int i = 0;
+	for (;; i += vec::lanes){
+		const bool last = i + vec::lanes >= D;
+		const vec::reg cost = vec::load(costs + i);
+
+		vec::reg src2 = last ? _max : vec::load(leftBuf_prev + i + vec::lanes);
+		vec::reg res = update_path_block(src0_left, src1_left, src2, cost, _P1, leftMinCostP2);
+		leftMinCost_new = vec::min(leftMinCost_new, res);
+		vec::store(leftBuf + i, res);
+		src0_left = src1_left;
+		src1_left = src2;
+
+		//topBuf is updated in place, but the block after the current one is loaded before the store
+		src2 = last ? _max : vec::load(topBuf + i + vec::lanes);
+		res = update_path_block(src0_top, src1_top, src2, cost, _P1, topMinCostP2);
+		topMinCost_new = vec::min(topMinCost_new, res);
+		vec::store(topBuf + i, res);
+		src0_top = src1_top;
+		src1_top = src2;
+
+		if (last){
+			break;
+		}
+	}
+	leftMinCost = vec::hmin(leftMinCost_new);
+	topMinCost = vec::hmin(topMinCost_new);
+}
+
+RECO_SGM_TARGET
+void accumulate_costs_right(CostType* rightBuf, const CostType* topBuf, CostType* leftBuf,
+		const CostType* costs, CostType& rightMinCost, int D, int P1, int P2, int& optimal_disp,
+		CostType& min_cost) {
+	const vec::reg _P1 = vec::set1(saturate_to_cost(P1));
+	const vec::reg _max = vec::set1(SHRT_MAX);
+	const vec::reg _step = vec::set1((short) vec::lanes);
+
+	const vec::reg rightMinCostP2 = vec::set1(saturate_to_cost(rightMinCost + P2));
+	vec::reg rightMinCost_new = _max;
+	vec::reg src0 = _max;
+	vec::reg src1 = vec::load(rightBuf);
+
+	vec::reg min_sum_cost = _max;
+	vec::reg min_sum_pos = vec::set1(0);
+	vec::reg _d = vec::index();
+
+	for (int i = 0;; i += vec::lanes){
+		const bool last = i + vec::lanes >= D;
+		vec::reg src2 = last ? _max : vec::load(rightBuf + i + vec::lanes);
+		vec::reg res = update_path_block(src0, src1, src2, vec::load(costs + i), _P1, rightMinCostP2);
+		rightMinCost_new = vec::min(rightMinCost_new, res);
+		vec::store(rightBuf + i, res);
+
+		//total cost
+		res = vec::adds(vec::adds(res, vec::load(leftBuf + i)), vec::load(topBuf + i));
+		vec::store(leftBuf + i, res);
+
+		//keep the last disparity with the minimal cost in each lane
+		min_sum_cost = vec::min(min_sum_cost, res);
+		min_sum_pos = vec::blend(min_sum_pos, _d, vec::cmpeq(min_sum_cost, res));
+		_d = vec::adds(_d, _step);
+
+		src0 = src1;
+		src1 = src2;
+		if (last){
+			break;
+		}
+	}
+
+	short min_buf[8], pos_buf[8];
+	vec::fold_to_8(min_sum_cost, min_sum_pos, true, min_buf, pos_buf);
+	rightMinCost = vec::hmin(rightMinCost_new);
+	min_cost = horizontal_min(min_buf, 8);
+	optimal_disp = reduce_last_min(min_buf, pos_buf);
+}
+
+const sgm_path_kernels kernels = {
+		instruction_set, instruction_set_name, vec::lanes,
+		aggregate_four_paths,
+		aggregate_path_and_find_best,
+		has_competing_disparity,
+		aggregate_four_paths_compact,
+		aggregate_path_and_find_best_compact,
+		accumulate_costs_left_top,
+		accumulate_costs_right
+};
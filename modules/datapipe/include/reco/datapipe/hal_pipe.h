@@ -23,6 +23,7 @@
 #include <thread>
 #include <condition_variable>
 #include <mutex>
+#include <chrono>
 
 //utils
 #include <reco/utils/queue.h>
@@ -49,7 +50,8 @@ public:
 /**
  * Type of the buffer object required to use the pipe
  */
-	hal_pipe(frame_buffer_type buffer, std::string camera_uri);
+	hal_pipe(frame_buffer_type buffer, std::string camera_uri,
+			std::chrono::microseconds frame_interval = std::chrono::microseconds::zero());
 	virtual ~hal_pipe();
 
 protected:
@@ -61,6 +63,8 @@ private:
 	//thread state
 	bool playback_allowed;
 	bool stop_requested;
+	//minimum time between two captured frames (zero to capture as fast as the source allows)
+	std::chrono::microseconds frame_interval;
 	std::thread runner_thread;
 	std::condition_variable pause_cv;
 	std::mutex pause_mtx;
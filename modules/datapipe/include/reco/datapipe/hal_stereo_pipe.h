@@ -26,10 +26,17 @@ public:
 			stereo_source source = video_files,
 			std::vector<std::string> video_file_paths = {},
 			std::string calibration_file_path = "",
-			bool use_stereo_rectification = true);
+			bool use_stereo_rectification = true,
+			double frame_rate = default_video_frame_rate);
 	virtual ~hal_stereo_pipe();
 
+	/**
+	 * Rate at which frames are read from video files by default (frames per second)
+	 */
+	static constexpr double default_video_frame_rate = 30.0;
+
 private:
+	static std::chrono::microseconds compile_frame_interval(stereo_source source, double frame_rate);
 	static std::string compile_camera_uri(stereo_source source,
 			std::vector<std::string> paths,
 			std::string calibration_file_path,
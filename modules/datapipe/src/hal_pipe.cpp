@@ -10,15 +10,20 @@
 #include <reco/utils/cpp_exception_util.h>
 #include <reco/utils/debug_util.h>
 
+//std
+#include <algorithm>
+
 namespace reco {
 namespace datapipe {
 
-hal_pipe::hal_pipe(frame_buffer_type buffer, std::string camera_uri):
+hal_pipe::hal_pipe(frame_buffer_type buffer, std::string camera_uri,
+		std::chrono::microseconds frame_interval):
 	pipe(buffer),
 	camera_uri(camera_uri),
 	camera(hal::Camera(camera_uri)),
 	playback_allowed(false),
 	stop_requested(false),
+	frame_interval(frame_interval),
 	runner_thread(&hal_pipe::work, this)
 	{
 	num_channels = (int)camera.NumChannels();
@@ -40,11 +45,18 @@ void hal_pipe::work() {
 			return;
 		}
 		std::shared_ptr<hal::ImageArray> images = hal::ImageArray::Create();
+		std::chrono::steady_clock::time_point next_frame_time = std::chrono::steady_clock::now();
 		while (!stop_requested && playback_allowed
 				&& camera.Capture(*images)) {
 			this->buffer->push_back(images);
 			emit frame();
 			images = hal::ImageArray::Create();
+			if (frame_interval > std::chrono::microseconds::zero()) {
+				//pace the frames, without trying to catch up after falling behind
+				next_frame_time = std::max(next_frame_time + frame_interval,
+						std::chrono::steady_clock::now());
+				std::this_thread::sleep_until(next_frame_time);
+			}
 		}
 	}
 
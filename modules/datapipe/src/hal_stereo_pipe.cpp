@@ -18,16 +18,32 @@ hal_stereo_pipe::hal_stereo_pipe(frame_buffer_type buffer,
 						stereo_source source,
 						std::vector<std::string> paths,
 						std::string calibration_file_path,
-						bool use_stereo_rectification):
+						bool use_stereo_rectification,
+						double frame_rate):
 						hal_pipe(buffer,
 								compile_camera_uri(source,paths,
 										calibration_file_path,
-										use_stereo_rectification)),
+										use_stereo_rectification),
+								compile_frame_interval(source, frame_rate)),
 						source(source),
 						paths(paths){}
 
 hal_stereo_pipe::~hal_stereo_pipe(){}
 
+/**
+ * Video files can be read much faster than they play, so their frames are paced at the given rate
+ * (a latest-frame-wins downstream buffer never holds the reader back).
+ * @param source source of the frames
+ * @param frame_rate frames per second (non-positive to read as fast as possible)
+ * @return minimum time between frames
+ */
+std::chrono::microseconds hal_stereo_pipe::compile_frame_interval(stereo_source source, double frame_rate){
+	if(source != video_files || frame_rate <= 0.0){
+		return std::chrono::microseconds::zero();
+	}
+	return std::chrono::microseconds((long long)(1000000.0 / frame_rate));
+}
+
 std::string hal_stereo_pipe::compile_camera_uri(stereo_source source,
 		std::vector<std::string> paths,
 		std::string calibration_file_path,
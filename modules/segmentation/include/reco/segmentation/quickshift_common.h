@@ -22,6 +22,10 @@ typedef struct _image_t
 
 void quickshift(image_t im, float sigma, float tau, float * map, float * gaps, float * E);
 
+void quickshift_tiles(image_t im, float sigma, float tau, int tile_size,
+                      unsigned char const * density_tiles, unsigned char const * neighbor_tiles,
+                      float * map, float * gaps, float * E);
+
 extern "C" 
 void quickshift_gpu(image_t im_d, float sigma, float tau, float * map, float * gaps, float * E_d);
 
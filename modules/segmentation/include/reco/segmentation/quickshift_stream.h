@@ -0,0 +1,140 @@
+/*
+ * quickshift_stream.h
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: Gregory Kramida
+ *   Copyright: 2016 Gregory Kramida
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef RECO_SEGMENTATION_QUICKSHIFT_STREAM_H_
+#define RECO_SEGMENTATION_QUICKSHIFT_STREAM_H_
+#pragma once
+
+//local
+#include <reco/segmentation/quickshift_common.h>
+#include <reco/segmentation/superpixels.h>
+//opencv
+#include <opencv2/core/core.hpp>
+//standard
+#include <vector>
+
+namespace reco {
+namespace segmentation {
+
+/**
+ * Quickshift (CPU) over a sequence of frames, e.g. video from a static camera.
+ *
+ * The image is split into square tiles. The density and the links of the previous frame are kept
+ * for tiles far enough from any change, and recomputed for the rest only, so the per-frame cost
+ * follows the amount of motion in the scene. A pixel counts as changed when it differs from the
+ * value it had when it last changed by more than the change threshold in any channel (so slow
+ * drift is caught as well), or when the caller's change mask (e.g. from optical flow) says so.
+ *
+ * Superpixels keep their ids from frame to frame: a superpixel inherits the id of the previous
+ * superpixel its root (mode) pixel belonged to, or gets a new id if the previous superpixel split
+ * and a larger part already took the id.
+ */
+class quickshift_stream {
+public:
+	/**
+	 * @param sigma standard deviation of the Parzen window
+	 * @param tau maximum distance between a pixel and its parent
+	 * @param change_threshold minimum change of a channel value for a pixel to count as changed
+	 * @param tile_size side of the tiles, in pixels
+	 */
+	quickshift_stream(float sigma, float tau, float change_threshold = 0.5F, int tile_size = 32);
+	virtual ~quickshift_stream();
+
+	/**
+	 * Segment the next frame
+	 * @param frame channel-planar frame (see quickshift())
+	 * @param change_mask optional N1 x N2 mask, nonzero where the frame is known to have changed,
+	 * used instead of comparing the frame against the earlier ones
+	 */
+	void process(image_t frame, const unsigned char* change_mask = NULL);
+
+	/**
+	 * Segment the next frame
+	 * @param frame continuous frame of type CV_32F or CV_32FC3, processed with N1 = columns and
+	 * N2 = rows like quickshift_gpu_cv does
+	 * @param change_mask optional continuous CV_8U mask of the same size, nonzero where the frame is
+	 * known to have changed
+	 */
+	void process(const cv::Mat& frame, const cv::Mat& change_mask = cv::Mat());
+
+	/**
+	 * Forget all earlier frames, so that the next one is segmented from scratch
+	 */
+	void reset();
+
+	/**
+	 * @return superpixels of the last frame
+	 */
+	const superpixel_table& get_superpixels() const;
+	/**
+	 * @return persistent id of each superpixel of the last frame, by label
+	 */
+	const std::vector<int>& get_superpixel_ids() const;
+	const std::vector<float>& get_map() const;
+	const std::vector<float>& get_gaps() const;
+	const std::vector<float>& get_density() const;
+	/**
+	 * @return fraction of the tiles whose density had to be recomputed for the last frame
+	 */
+	float get_recomputed_fraction() const;
+
+	float get_sigma() const;
+	float get_tau() const;
+
+private:
+	/**
+	 * Flag tiles within the given number of tiles from the flagged source tiles
+	 */
+	void dilate_tiles(const std::vector<unsigned char>& source, int radius,
+			std::vector<unsigned char>& dilated) const;
+	void assign_ids();
+
+	float sigma;
+	float tau;
+	float change_threshold;
+	int tile_size;
+
+	int N1;
+	int N2;
+	int K;
+	int T1;
+	int T2;
+	//frame values as of the last change of each pixel, planar
+	std::vector<float> reference;
+	std::vector<float> planar_frame;
+	std::vector<float> map;
+	std::vector<float> gaps;
+	std::vector<float> density;
+	std::vector<unsigned char> changed_tiles;
+	std::vector<unsigned char> density_tiles;
+	std::vector<unsigned char> neighbor_tiles;
+	float recomputed_fraction;
+
+	superpixel_table superpixels;
+	std::vector<int> superpixel_ids;
+	std::vector<int> previous_labels;
+	std::vector<int> previous_superpixel_ids;
+	int next_id;
+};
+
+} /* namespace segmentation */
+} /* namespace reco */
+
+#endif /* RECO_SEGMENTATION_QUICKSHIFT_STREAM_H_ */
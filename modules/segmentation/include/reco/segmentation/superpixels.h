@@ -0,0 +1,188 @@
+/*
+ * superpixels.h
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: Gregory Kramida
+ *   Copyright: 2016 Gregory Kramida
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef RECO_SEGMENTATION_SUPERPIXELS_H_
+#define RECO_SEGMENTATION_SUPERPIXELS_H_
+#pragma once
+
+//opencv
+#include <opencv2/core/core.hpp>
+//standard
+#include <cstddef>
+#include <vector>
+
+namespace reco {
+namespace segmentation {
+
+/**
+ * Memory layout of the color channels of an image
+ */
+enum pixel_layout {
+	//channel k of pixel p at p + k * N1 * N2 (image_t, MATLAB style)
+	PLANAR,
+	//channel k of pixel p at p * K + k (cv::Mat)
+	INTERLEAVED
+};
+
+/**
+ * Superpixels resulting from a quickshift forest, with per-superpixel statistics.
+ * Superpixels are labeled 0..size()-1, in the order of their root pixel indices. Coordinates
+ * follow the quickshift convention: pixel p lies at i1 = p % N1, i2 = p / N1, and points / boxes
+ * have x along i1 and y along i2 (i.e. x = column, y = row for a cv::Mat).
+ */
+struct superpixel_table {
+	int N1;
+	int N2;
+	int K;
+	//compact superpixel label of each pixel
+	std::vector<int> labels;
+	//linear index of the root (mode) pixel of each superpixel
+	std::vector<int> roots;
+	std::vector<int> pixel_counts;
+	//K mean channel values per superpixel
+	std::vector<float> mean_colors;
+	std::vector<cv::Point2f> centroids;
+	std::vector<cv::Rect> bounding_boxes;
+
+	size_t size() const {
+		return roots.size();
+	}
+	const float* mean_color(int label) const {
+		return &mean_colors[label * K];
+	}
+};
+
+/**
+ * A merge in the quickshift hierarchy: from the given tau on, the tree rooted at the child pixel
+ * is linked into the tree rooted at the parent pixel
+ */
+struct superpixel_merge {
+	//root (mode) pixel of the tree that gets linked
+	int child;
+	//root pixel of the tree it gets linked into, as of right before the merge
+	int parent;
+	//smallest tau the two trees are merged at, i.e. the gap of the child
+	float tau;
+};
+
+/**
+ * Resolve the root of every pixel in a quickshift forest by parallel pointer jumping, which takes
+ * a logarithmic (in tree depth) number of passes over the image.
+ * @param map quickshift neighbor map, each pixel holding the linear index of its parent (roots point to themselves)
+ * @param size number of pixels
+ * @param[out] roots linear index of the root of each pixel, size elements
+ */
+void flatten_forest(const float* map, int size, int* roots);
+
+/**
+ * Resolve the root of every pixel in a quickshift forest cut at a smaller tau than the one it was
+ * computed with. Quickshift links each pixel to the nearest denser pixel within distance tau, so
+ * dropping the links longer than tau' <= tau yields exactly the forest quickshift would compute
+ * with tau'.
+ * @param map quickshift neighbor map
+ * @param gaps quickshift distance of each pixel to its parent
+ * @param tau distance threshold
+ * @param size number of pixels
+ * @param[out] roots linear index of the root of each pixel, size elements
+ */
+void flatten_forest(const float* map, const float* gaps, float tau, int size, int* roots);
+
+/**
+ * Label the superpixels of a quickshift forest & gather their statistics in one pass over the image
+ * @param map quickshift neighbor map
+ * @param image image the map was computed on, N1 x N2 x K floats
+ * @param N1 size of the first (fastest-changing) image dimension
+ * @param N2 size of the second image dimension
+ * @param K channel count
+ * @param layout layout of the image channels
+ * @param[out] table resulting superpixels
+ */
+void compute_superpixels(const float* map, const float* image, int N1, int N2, int K,
+		pixel_layout layout, superpixel_table& table);
+
+/**
+ * Label the superpixels of a quickshift forest computed on a cv::Mat (as quickshift_gpu_cv does)
+ * @param map quickshift neighbor map
+ * @param image continuous image of type CV_32F or CV_32FC3
+ * @param[out] table resulting superpixels
+ */
+void compute_superpixels(const float* map, const cv::Mat& image, superpixel_table& table);
+
+/**
+ * Compute the superpixels of several cuts of one quickshift forest (see flatten_forest), e.g. to
+ * segment at several tau values with a single quickshift run at the largest one. Only the finest
+ * cut takes a pass over the image, each coarser one is merged from the previous.
+ * @param map quickshift neighbor map
+ * @param gaps quickshift distance of each pixel to its parent
+ * @param taus distance thresholds, in any order, no larger than the tau of the run to be exact
+ * @param image image the map was computed on, N1 x N2 x K floats
+ * @param N1 size of the first (fastest-changing) image dimension
+ * @param N2 size of the second image dimension
+ * @param K channel count
+ * @param layout layout of the image channels
+ * @param[out] tables resulting superpixels, one table per tau
+ */
+void compute_superpixels(const float* map, const float* gaps, const std::vector<float>& taus,
+		const float* image, int N1, int N2, int K, pixel_layout layout,
+		std::vector<superpixel_table>& tables);
+
+/**
+ * Compute the superpixels of several cuts of one quickshift forest computed on a cv::Mat
+ * @param map quickshift neighbor map
+ * @param gaps quickshift distance of each pixel to its parent
+ * @param taus distance thresholds, in any order
+ * @param image continuous image of type CV_32F or CV_32FC3
+ * @param[out] tables resulting superpixels, one table per tau
+ */
+void compute_superpixels(const float* map, const float* gaps, const std::vector<float>& taus,
+		const cv::Mat& image, std::vector<superpixel_table>& tables);
+
+/**
+ * List all merges of superpixels that happen as tau grows from tau_min up to the tau the forest
+ * was computed with, in merge order. Replaying them onto the superpixels at tau_min yields the
+ * superpixels at any larger tau.
+ * @param map quickshift neighbor map
+ * @param gaps quickshift distance of each pixel to its parent
+ * @param size number of pixels
+ * @param tau_min tau to start from (0 to start from single pixels)
+ * @param[out] merges merges, ordered by tau
+ */
+void compute_merge_hierarchy(const float* map, const float* gaps, int size, float tau_min,
+		std::vector<superpixel_merge>& merges);
+
+/**
+ * Fill every pixel with the mean color of its superpixel
+ * @param table superpixels
+ * @param layout channel layout of the output
+ * @param[out] image output, N1 x N2 x K floats
+ */
+void paint_mean_colors(const superpixel_table& table, pixel_layout layout, float* image);
+
+/**
+ * Fill every pixel with the mean color of its superpixel
+ * @param table superpixels
+ * @param[out] image output, (re)allocated as N2 rows x N1 columns of type CV_32FC(K)
+ */
+void paint_mean_colors(const superpixel_table& table, cv::Mat& image);
+
+} /* namespace segmentation */
+} /* namespace reco */
+
+#endif /* RECO_SEGMENTATION_SUPERPIXELS_H_ */
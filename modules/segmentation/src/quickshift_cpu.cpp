@@ -2,7 +2,7 @@
  ** @file:       quickshift.cpp
  ** @author:     Brian Fulkerson
  ** @author:     Andrea Vedaldi
- ** @brief:      Quickshift command line 
+ ** @brief:      Quickshift command line
  **/
 
 #include <math.h>
@@ -10,324 +10,419 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <vector>
 #include <reco/segmentation/quickshift_common.h>
 
+/* The kernels are compiled for AVX2 as well and picked at load time on x86 */
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define QUICKSHIFT_KERNEL __attribute__((target_clones("avx2","default")))
+#else
+#define QUICKSHIFT_KERNEL
+#endif
+
+/* Number of image lines (along the second dimension) each thread takes at a time */
+#define QUICKSHIFT_TILE_LINES 8
+
 /** -----------------------------------------------------------------
  ** @internal
- ** @brief Computes the accumulated channel L2 distance between i,j + the distance between i,j
+ ** @brief Fast negative exponential for the Parzen window weights
+ **
+ ** @param y    non-negative argument
  **
- ** @param I    input image buffer
- ** @param N1   size of the first dimension of the image
- ** @param N2   size of the second dimension of the image
- ** @param K    number of channels
- ** @param i1   first dimension index of the first pixel to compare
- ** @param i2   second dimension of the first pixel
- ** @param j1   index of the second pixel to compare
- ** @param j2   second dimension of the second pixel
+ ** Splits e^-y into 2^i * 2^f, with 2^i built directly in the float exponent bits and 2^f, f in (0,1],
+ ** approximated with a minimax polynomial. The relative error is about 1e-5 at worst (mostly from
+ ** rounding y * log2(e) for large y). Unlike exp(), the function vectorizes: y is clamped to 87, below
+ ** e^-87 the weights are negligible anyway, by comparing the bits of the non-negative floats as
+ ** integers, which unlike float comparisons can be if-converted without -fno-trapping-math.
  **
- ** Takes the L2 distance between the values in I at pixel i and j, accumulating along K channels
- ** and adding in the distance between i,j in the image.
- ** 
- ** @return the distance as described above
+ ** @return e^-y
  **/
 
 inline
 float
-distance(float const * I, 
-         int N1, int N2, int K,
-         int i1, int i2,
-         int j1, int j2) 
+fast_exp_negative(float y)
 {
-  float dist = 0 ;
-  int d1 = j1 - i1 ;
-  int d2 = j2 - i2 ;
-  int k ;
-  dist += d1*d1 + d2*d2 ;
-  // For k = 0...K-1, d+= L2 distance between I(i1,i2,k) and I(j1,j2,k)
-  for (k = 0 ; k < K ; ++k) {
-    float d = 
-      I [i1 + N1 * i2 + (N1*N2) * k] - 
-      I [j1 + N1 * j2 + (N1*N2) * k] ;
-    dist += d*d ;
-  }
-  return dist ;
+  union { int i ; float f ; } clamped, scale ;
+  clamped.f = y ;
+  clamped.i = VL_MIN(clamped.i, 0x42ae0000) ; /* 87.0f */
+  float t = - clamped.f * 1.44269504f ; /* log2(e) */
+  /* t <= 0, truncating it and subtracting one leaves f in (0,1] */
+  int i = (int) t - 1 ;
+  float f = t - (float) i ;
+  float p = 1.53533619e-4f ;
+  p = p * f + 1.33988744e-3f ;
+  p = p * f + 9.61843736e-3f ;
+  p = p * f + 5.55033247e-2f ;
+  p = p * f + 2.40226479e-1f ;
+  p = p * f + 6.93147203e-1f ;
+  p = p * f + 1.0f ;
+  scale.i = (i + 127) << 23 ;
+  return p * scale.f ;
 }
 
 /** -----------------------------------------------------------------
  ** @internal
- ** @brief Computes the accumulated channel inner product between i,j + the
- **        distance between i,j
- ** 
- ** @param I    input image buffer
- ** @param N1   size of the first dimension of the image
- ** @param N2   size of the second dimension of the image
- ** @param K    number of channels
- ** @param i1   first dimension index of the first pixel to compare
- ** @param i2   second dimension of the first pixel
- ** @param j1   index of the second pixel to compare
- ** @param j2   second dimension of the second pixel
+ ** @brief Computes the accumulated channel L2 distances between two runs of pixels + the squared
+ **        spatial distance between them
+ **
+ ** @param A        first pixel of the first run in the first channel plane of the input image
+ ** @param B        first pixel of the second run in the first channel plane of the input image
+ ** @param plane    size of a channel plane (N1*N2)
+ ** @param K        number of channels
+ ** @param count    length of the runs (along the first dimension)
+ ** @param spatial  squared spatial distance between the pixels of a pair, the same for all pairs
+ ** @param dist     output distances
  **
- ** Takes the channel-wise inner product between the values in I at pixel i and
- ** j, accumulating along K channels and adding in the inner product between i,j in
- ** the image.
- ** 
- ** @return the inner product as described above
+ ** Channels are planar and runs contiguous within each plane, so the loops vectorize. Per pair,
+ ** the operations are the same as those of the scalar distance, in the same order. The loops over
+ ** runs here and in the kernels are marked omp simd, as GCC only auto-vectorizes them from -O3 on.
  **/
 
 inline
-float
-inner(float const * I, 
-      int N1, int N2, int K,
-      int i1, int i2,
-      int j1, int j2) 
+void
+run_distances(float const * A, float const * B, int plane, int K, int count, float spatial,
+              float * dist)
+{
+#pragma omp simd
+  for (int j = 0 ; j < count ; ++j) {
+    dist[j] = spatial ;
+  }
+  for (int k = 0 ; k < K ; ++k) {
+    float const * Ak = A + plane * k ;
+    float const * Bk = B + plane * k ;
+#pragma omp simd
+    for (int j = 0 ; j < count ; ++j) {
+      float d = Ak[j] - Bk[j] ;
+      dist[j] += d*d ;
+    }
+  }
+}
+
+/** -----------------------------------------------------------------
+ ** @internal
+ ** @brief Parzen density of a segment of a line of pixels (i1 = b1..e1-1 for a given i2)
+ **
+ ** @param I        input image buffer
+ ** @param N1       size of the first dimension of the image
+ ** @param N2       size of the second dimension of the image
+ ** @param K        number of channels
+ ** @param i2       index of the line along the second dimension
+ ** @param b1       first index of the segment along the first dimension
+ ** @param e1       index one past the last of the segment
+ ** @param R        radius of the window
+ ** @param g        spatial Gaussian table, g[d] = exp(-d^2 / (2 sigma^2)) for d = 0..R
+ ** @param inv_2s2  1 / (2 sigma^2)
+ ** @param dist     scratch buffer of N1 floats
+ ** @param E        output density
+ **
+ ** Rather than going window by window, the whole segment is visited once per window offset (d1,d2),
+ ** which turns each visit into elementwise operations over contiguous runs. The Gaussian of the joint
+ ** spatial & color distance factors into g[|d1|] * g[|d2|] times the Gaussian of the color distance,
+ ** so only the latter needs an exponential per pair.
+ **/
+
+QUICKSHIFT_KERNEL
+void
+density_line(float const * I, int N1, int N2, int K, int i2, int b1, int e1, int R, float const * g,
+             float inv_2s2, float * dist, float * E)
+{
+  int plane = N1 * N2 ;
+  float * Eline = E + N1 * i2 ;
+  int j2min = VL_MAX(i2 - R, 0   ) ;
+  int j2max = VL_MIN(i2 + R, N2-1) ;
+  for (int i1 = b1 ; i1 < e1 ; ++i1) {
+    Eline[i1] = 0 ;
+  }
+  for (int j2 = j2min ; j2 <= j2max ; ++j2) {
+    for (int d1 = -R ; d1 <= R ; ++d1) {
+      /* centers whose window, clipped to the image, includes this offset */
+      int i1min = VL_MAX(-d1, b1    ) ;
+      int i1max = VL_MIN(N1-1-d1, e1-1) ;
+      int count = i1max - i1min + 1 ;
+      if (count <= 0) {
+        continue ;
+      }
+      run_distances(I + i1min + N1 * i2, I + i1min + d1 + N1 * j2, plane, K, count, 0.0f, dist) ;
+      float weight = g [VL_ABS(d1)] * g [VL_ABS(j2 - i2)] ;
+      float * Erun = Eline + i1min ;
+#pragma omp simd
+      for (int j = 0 ; j < count ; ++j) {
+        Erun[j] += weight * fast_exp_negative(dist[j] * inv_2s2) ;
+      }
+    }
+  }
+  /* Normalize */
+  for (int i1 = b1 ; i1 < e1 ; ++i1) {
+    int j1min = VL_MAX(i1 - R, 0   ) ;
+    int j1max = VL_MIN(i1 + R, N1-1) ;
+    Eline[i1] = Eline[i1] / ((j1max-j1min)*(j2max-j2min)) ;
+  }
+}
+
+/** -----------------------------------------------------------------
+ ** @internal
+ ** @brief Links each pixel of a segment of a line (i1 = b1..e1-1 for a given i2) to its closest
+ **        neighbor of higher density
+ **
+ ** @param I          input image buffer
+ ** @param N1         size of the first dimension of the image
+ ** @param N2         size of the second dimension of the image
+ ** @param K          number of channels
+ ** @param E          density
+ ** @param i2         index of the line along the second dimension
+ ** @param b1         first index of the segment along the first dimension
+ ** @param e1         index one past the last of the segment
+ ** @param tR         radius of the neighborhood
+ ** @param tau2       squared maximum distance of a link
+ ** @param dist       scratch buffer of N1 floats
+ ** @param d_best     scratch buffer of N1 floats
+ ** @param best       scratch buffer of N1 ints
+ ** @param map        output parent indices
+ ** @param gaps       output link distances
+ **
+ ** Like the density, goes over the segment once per neighborhood offset. Offsets are visited in the
+ ** order a pixel-by-pixel search visits the neighborhood, so that ties are resolved the same way.
+ ** Offsets farther than tau are skipped altogether.
+ **/
+
+QUICKSHIFT_KERNEL
+void
+neighbors_line(float const * I, int N1, int N2, int K, float const * E, int i2, int b1, int e1,
+               int tR, float tau2, float * dist, float * d_best, int * best, float * map, float * gaps)
 {
-  float ker = 0 ;
-  int k ;
-  ker += i1*j1 + i2*j2 ;
-  for (k = 0 ; k < K ; ++k) {
-    ker += 
-      I [i1 + N1 * i2 + (N1*N2) * k] *
-      I [j1 + N1 * j2 + (N1*N2) * k] ;
+  int plane = N1 * N2 ;
+  float const * Eline = E + N1 * i2 ;
+  int j2min = VL_MAX(i2 - tR, 0   ) ;
+  int j2max = VL_MIN(i2 + tR, N2-1) ;
+  for (int i1 = b1 ; i1 < e1 ; ++i1) {
+    d_best[i1] = INF ;
+    best[i1] = i1 + N1 * i2 ;
+  }
+  for (int j2 = j2min ; j2 <= j2max ; ++j2) {
+    int d2 = j2 - i2 ;
+    for (int d1 = -tR ; d1 <= tR ; ++d1) {
+      float spatial = (float) (d1*d1 + d2*d2) ;
+      int i1min = VL_MAX(-d1, b1    ) ;
+      int i1max = VL_MIN(N1-1-d1, e1-1) ;
+      int count = i1max - i1min + 1 ;
+      if (spatial > tau2 || count <= 0) {
+        continue ;
+      }
+      run_distances(I + i1min + N1 * i2, I + i1min + d1 + N1 * j2, plane, K, count, spatial, dist) ;
+      float const * Erun = E + i1min + d1 + N1 * j2 ;
+#pragma omp simd
+      for (int j = 0 ; j < count ; ++j) {
+        int i1 = i1min + j ;
+        if (Erun[j] > Eline[i1] && dist[j] <= tau2 && dist[j] < d_best[i1]) {
+          d_best[i1] = dist[j] ;
+          best[i1] = i1 + d1 + N1 * j2 ;
+        }
+      }
+    }
+  }
+
+  /* map is the index of the best pair */
+  /* gaps_i is the minimal distance, inf implies no Ej > Ei within
+   * distance tau from the point */
+  for (int i1 = b1 ; i1 < e1 ; ++i1) {
+    map [i1 + N1 * i2] = best[i1] ;
+    if (best[i1] != i1 + N1 * i2)
+      gaps[i1 + N1 * i2] = sqrt(d_best[i1]) ;
+    else
+      gaps[i1 + N1 * i2] = d_best[i1]; /* inf */
   }
-  return ker ;
 }
 
+/** -----------------------------------------------------------------
+ ** @brief Quick shift on the CPU
+ **
+ ** @param im     input image, channel-planar, first dimension contiguous
+ ** @param sigma  standard deviation of the Parzen window
+ ** @param tau    maximum distance between a pixel and its parent
+ ** @param map    output parent index of each pixel (itself for roots)
+ ** @param gaps   output distance to the parent (INF for roots)
+ ** @param E      output Parzen density estimate
+ **
+ ** Both passes are split into tiles of lines shared among OpenMP threads. Within a line, window
+ ** rows are processed as contiguous runs by vectorized kernels.
+ **/
 
 void quickshift(image_t im, float sigma, float tau, float * map, float * gaps, float * E)
 {
   int verb = 1 ;
 
-  float *M = 0, *n = 0;
   float tau2;
-  
-  int K, d;
-  int N1,N2, i1,i2, j1,j2, R, tR;
 
-  int medoid = 0 ;
+  int K;
+  int N1,N2, R, tR;
 
   float const * I = im.I;
   N1 = im.N1;
   N2 = im.N2;
   K = im.K;
 
-  d = 2 + K ; /* Total dimensions include spatial component (x,y) */
-  
   tau2  = tau*tau;
 
-  
-  if (medoid) { /* n and M are only used in mediod shift */
-    M = (float *) calloc(N1*N2*d, sizeof(float)) ;
-    n = (float *) calloc(N1*N2,   sizeof(float)) ;
-  }
-
   R = (int) ceil (3 * sigma) ;
   tR = (int) ceil (tau) ;
-  
+
   if (verb) {
     printf("quickshift: [N1,N2,K]: [%d,%d,%d]\n", N1,N2,K) ;
-    printf("quickshift: type: %s\n", medoid ? "medoid" : "quick");
+    printf("quickshift: type: %s\n", "quick");
     printf("quickshift: sigma:   %g\n", sigma) ;
     /* R is ceil(3 * sigma) and determines the window size to accumulate
      * similarity */
-    printf("quickshift: R:       %d\n", R) ; 
+    printf("quickshift: R:       %d\n", R) ;
     printf("quickshift: tau:     %g\n", tau) ;
     printf("quickshift: tR:      %d\n", tR) ;
   }
 
   /* -----------------------------------------------------------------
-   *                                                                 n 
+   *                                                           E
    * -------------------------------------------------------------- */
 
-  /* If we are doing medoid shift, initialize n to the inner product of the
-   * image with itself
-   */
-  if (n) { 
-    for (i2 = 0 ; i2 < N2 ; ++ i2) {
-      for (i1 = 0 ; i1 < N1 ; ++ i1) {        
-        n [i1 + N1 * i2] = inner(I,N1,N2,K,
-                                 i1,i2,
-                                 i1,i2) ;
-      }
-    }
-  }
-  
-//  unsigned int Etimer;
-//  cutilCheckError( cutCreateTimer(&Etimer) );
-//  cutilCheckError( cutResetTimer(Etimer) );
-//  cutilCheckError( cutStartTimer(Etimer) );
-
-  /* -----------------------------------------------------------------
-   *                                                 E = - [oN'*F]', M
-   * -------------------------------------------------------------- */
-  
-  /* 
+  /*
      D_ij = d(x_i,x_j)
      E_ij = exp(- .5 * D_ij / sigma^2) ;
-     F_ij = - E_ij             
      E_i  = sum_j E_ij
-     M_di = sum_j X_j F_ij
 
      E is the parzen window estimate of the density
      0 = dissimilar to everything, windowsize = identical
   */
-  
-  for (i2 = 0 ; i2 < N2 ; ++ i2) {
-    for (i1 = 0 ; i1 < N1 ; ++ i1) {
-      
-      float Ei = 0;
-      int j1min = VL_MAX(i1 - R, 0   ) ;
-      int j1max = VL_MIN(i1 + R, N1-1) ;
-      int j2min = VL_MAX(i2 - R, 0   ) ;
-      int j2max = VL_MIN(i2 + R, N2-1) ;      
-      
-      /* For each pixel in the window compute the distance between it and the
-       * source pixel */
-      for (j2 = j2min ; j2 <= j2max ; ++ j2) {
-        for (j1 = j1min ; j1 <= j1max ; ++ j1) {
-          float Dij = distance(I,N1,N2,K, i1,i2, j1,j2) ;          
-          /* Make distance a similarity */ 
-          float Fij = exp(- Dij / (2*sigma*sigma)) ;
-
-          /* E is E_i above */
-          Ei += Fij;
-          
-          if (M) {
-            /* Accumulate votes for the median */
-            int k ;
-            M [i1 + N1*i2 + (N1*N2) * 0] += j1 * Fij ;
-            M [i1 + N1*i2 + (N1*N2) * 1] += j2 * Fij ;
-            for (k = 0 ; k < K ; ++k) {
-              M [i1 + N1*i2 + (N1*N2) * (k+2)] += 
-                I [j1 + N1*j2 + (N1*N2) * k] * Fij ;
-            }
-          } 
-          
-        } /* j1 */ 
-      } /* j2 */
-      /* Normalize */
-      E [i1 + N1 * i2] = Ei / ((j1max-j1min)*(j2max-j2min));
-      
-      /*E [i1 + N1 * i2] = Ei ; */
-
-    }  /* i1 */
-  } /* i2 */
-  
-  //cutilCheckError( cutStopTimer(Etimer) );
-  //float ETime = cutGetTimerValue(Etimer);
-  //printf("ComputeE: %fms\n", ETime);
-
-  //unsigned int Ntimer;
-//  cutilCheckError( cutCreateTimer(&Ntimer) );
-//  cutilCheckError( cutResetTimer(Ntimer) );
-//  cutilCheckError( cutStartTimer(Ntimer) );
- 
+
+  float inv_2s2 = 1.0f / (2*sigma*sigma) ;
+  std::vector<float> g (R + 1) ;
+  for (int d = 0 ; d <= R ; ++d) {
+    g[d] = exp(- d*d * inv_2s2) ;
+  }
+
+#pragma omp parallel
+  {
+    std::vector<float> dist (N1) ;
+#pragma omp for schedule(dynamic, QUICKSHIFT_TILE_LINES)
+    for (int i2 = 0 ; i2 < N2 ; ++i2) {
+      density_line(I, N1, N2, K, i2, 0, N1, R, g.data(), inv_2s2, dist.data(), E) ;
+    }
+  }
+
   /* -----------------------------------------------------------------
    *                                               Find best neighbors
    * -------------------------------------------------------------- */
-  
-  if (medoid) {
-    
-    /* 
-       Qij = - nj Ei - 2 sum_k Gjk Mik
-       n is I.^2
-    */
-    
-    /* medoid shift */
-    for (i2 = 0 ; i2 < N2 ; ++i2) {
-      for (i1 = 0 ; i1 < N1 ; ++i1) {
-        
-        float sc_best = 0  ;
-        /* j1/j2 best are the best indicies for each i */
-        float j1_best = i1 ;
-        float j2_best = i2 ; 
-        
-        int j1min = VL_MAX(i1 - R, 0   ) ;
-        int j1max = VL_MIN(i1 + R, N1-1) ;
-        int j2min = VL_MAX(i2 - R, 0   ) ;
-        int j2max = VL_MIN(i2 + R, N2-1) ;      
-        
-        for (j2 = j2min ; j2 <= j2max ; ++ j2) {
-          for (j1 = j1min ; j1 <= j1max ; ++ j1) {            
-            
-            float Qij = - n [j1 + j2 * N1] * E [i1 + i2 * N1] ;
-            int k ;
-
-            Qij -= 2 * j1 * M [i1 + i2 * N1 + (N1*N2) * 0] ;
-            Qij -= 2 * j2 * M [i1 + i2 * N1 + (N1*N2) * 1] ;
-            for (k = 0 ; k < K ; ++k) {
-              Qij -= 2 * 
-                I [j1 + j2 * N1 + (N1*N2) * k] *
-                M [i1 + i2 * N1 + (N1*N2) * (k + 2)] ;
-            }
-            
-            if (Qij > sc_best) {
-              sc_best = Qij ;
-              j1_best = j1 ;
-              j2_best = j2 ;
-            }
-          }
-        }
 
-        /* map_i is the linear index of j which is the best pair (in matlab
-         * notation
-         * gaps_i is the score of the best match
-         */
-        map [i1 + N1 * i2] = j1_best + N1 * j2_best ; /*+ 1 ; */
-        gaps[i1 + N1 * i2] = sc_best ;
-      }
-    }  
-
-  } else {
-    
-    /* Quickshift assigns each i to the closest j which has an increase in the
-     * density (E). If there is no j s.t. Ej > Ei, then gaps_i == inf (a root
-     * node in one of the trees of merges).
-     */
-    for (i2 = 0 ; i2 < N2 ; ++i2) {
-      for (i1 = 0 ; i1 < N1 ; ++i1) {
-        
-        float E0 = E [i1 + N1 * i2] ;
-        float d_best = INF ;
-        float j1_best = i1   ;
-        float j2_best = i2   ; 
-        
-        int j1min = VL_MAX(i1 - tR, 0   ) ;
-        int j1max = VL_MIN(i1 + tR, N1-1) ;
-        int j2min = VL_MAX(i2 - tR, 0   ) ;
-        int j2max = VL_MIN(i2 + tR, N2-1) ;      
-        
-        for (j2 = j2min ; j2 <= j2max ; ++ j2) {
-          for (j1 = j1min ; j1 <= j1max ; ++ j1) {            
-            if (E [j1 + N1 * j2] > E0) {
-              float Dij = distance(I,N1,N2,K, i1,i2, j1,j2) ;           
-              if (Dij <= tau2 && Dij < d_best) {
-                d_best = Dij ;
-                j1_best = j1 ;
-                j2_best = j2 ;
-              }
-            }
-          }
-        }
-        
-        /* map is the index of the best pair */
-        /* gaps_i is the minimal distance, inf implies no Ej > Ei within
-         * distance tau from the point */
-        map [i1 + N1 * i2] = j1_best + N1 * j2_best ; /* + 1 ; */
-        if (map[i1 + N1 * i2] != i1 + N1 * i2)
-          gaps[i1 + N1 * i2] = sqrt(d_best) ;
-        else
-          gaps[i1 + N1 * i2] = d_best; /* inf */
-      }
-    }  
+  /* Quickshift assigns each i to the closest j which has an increase in the
+   * density (E). If there is no j s.t. Ej > Ei, then gaps_i == inf (a root
+   * node in one of the trees of merges).
+   */
+#pragma omp parallel
+  {
+    std::vector<float> dist (N1), d_best (N1) ;
+    std::vector<int> best (N1) ;
+#pragma omp for schedule(dynamic, QUICKSHIFT_TILE_LINES)
+    for (int i2 = 0 ; i2 < N2 ; ++i2) {
+      neighbors_line(I, N1, N2, K, E, i2, 0, N1, tR, tau2, dist.data(), d_best.data(), best.data(),
+                     map, gaps) ;
+    }
   }
-  
-  if (M) free(M) ;
-  if (n) free(n) ;
-  
-//  cutilCheckError( cutStopTimer(Ntimer) );
-//  float NTime = cutGetTimerValue(Ntimer);
-//  printf("ComputeN: %fms\n", NTime);
+}
+
+/** -----------------------------------------------------------------
+ ** @internal
+ ** @brief Lists the line segments covered by flagged tiles
+ **
+ ** @param tiles      tile flags, first dimension contiguous
+ ** @param N1         size of the first dimension of the image
+ ** @param N2         size of the second dimension of the image
+ ** @param tile_size  side of the tiles
+ ** @param segments   output (i2, b1, e1) triplets
+ **
+ ** Flagged tiles that are adjacent along the first dimension make up a single segment per line,
+ ** so that the kernels get runs as long as possible.
+ **/
 
+void
+list_segments(unsigned char const * tiles, int N1, int N2, int tile_size,
+              std::vector<int> & segments)
+{
+  int T1 = (N1 + tile_size - 1) / tile_size ;
+  for (int i2 = 0 ; i2 < N2 ; ++i2) {
+    unsigned char const * row = tiles + T1 * (i2 / tile_size) ;
+    for (int t1 = 0 ; t1 < T1 ; ) {
+      if (!row[t1]) {
+        ++t1 ;
+        continue ;
+      }
+      int t1_end = t1 ;
+      while (t1_end < T1 && row[t1_end]) ++t1_end ;
+      segments.push_back(i2) ;
+      segments.push_back(t1 * tile_size) ;
+      segments.push_back(VL_MIN(t1_end * tile_size, N1)) ;
+      t1 = t1_end ;
+    }
+  }
 }
 
+/** -----------------------------------------------------------------
+ ** @brief Quick shift on the CPU, restricted to some square tiles of the image
+ **
+ ** @param im              input image, channel-planar, first dimension contiguous
+ ** @param sigma           standard deviation of the Parzen window
+ ** @param tau             maximum distance between a pixel and its parent
+ ** @param tile_size       side of the tiles, in pixels
+ ** @param density_tiles   flags of the tiles to recompute the density of, T1 x T2 with
+ **                        T1 = ceil(N1 / tile_size), T2 = ceil(N2 / tile_size), first dimension
+ **                        contiguous
+ ** @param neighbor_tiles  flags of the tiles to recompute the links of, same layout
+ ** @param map             parent index of each pixel, updated in the flagged tiles only
+ ** @param gaps            distance to the parent, updated in the flagged tiles only
+ ** @param E               Parzen density estimate, updated in the flagged tiles only
+ **
+ ** Meant for updating the results of an earlier run on a similar image: the caller has to flag
+ ** every tile whose density or links could be affected by the changes, i.e. the tiles within R
+ ** (= ceil(3 sigma)) of a change for the density, and the tiles within tau of a density update
+ ** for the links. Produces the same values as quickshift() in the flagged tiles.
+ **/
 
+void quickshift_tiles(image_t im, float sigma, float tau, int tile_size,
+                      unsigned char const * density_tiles, unsigned char const * neighbor_tiles,
+                      float * map, float * gaps, float * E)
+{
+  float const * I = im.I;
+  int N1 = im.N1;
+  int N2 = im.N2;
+  int K = im.K;
+  float tau2 = tau*tau;
+  int R = (int) ceil (3 * sigma) ;
+  int tR = (int) ceil (tau) ;
+
+  float inv_2s2 = 1.0f / (2*sigma*sigma) ;
+  std::vector<float> g (R + 1) ;
+  for (int d = 0 ; d <= R ; ++d) {
+    g[d] = exp(- d*d * inv_2s2) ;
+  }
+
+  std::vector<int> density_segments, neighbor_segments ;
+  list_segments(density_tiles, N1, N2, tile_size, density_segments) ;
+  list_segments(neighbor_tiles, N1, N2, tile_size, neighbor_segments) ;
+  int density_count = (int) density_segments.size() / 3 ;
+  int neighbor_count = (int) neighbor_segments.size() / 3 ;
+
+#pragma omp parallel
+  {
+    std::vector<float> dist (N1), d_best (N1) ;
+    std::vector<int> best (N1) ;
+
+#pragma omp for schedule(dynamic, QUICKSHIFT_TILE_LINES)
+    for (int s = 0 ; s < density_count ; ++s) {
+      int const * segment = &density_segments[3 * s] ;
+      density_line(I, N1, N2, K, segment[0], segment[1], segment[2], R, g.data(), inv_2s2,
+                   dist.data(), E) ;
+    }
+    /* the implicit barrier above makes all densities available to the links */
+#pragma omp for schedule(dynamic, QUICKSHIFT_TILE_LINES)
+    for (int s = 0 ; s < neighbor_count ; ++s) {
+      int const * segment = &neighbor_segments[3 * s] ;
+      neighbors_line(I, N1, N2, K, E, segment[0], segment[1], segment[2], tR, tau2, dist.data(),
+                     d_best.data(), best.data(), map, gaps) ;
+    }
+  }
+}
@@ -0,0 +1,224 @@
+/*
+ * quickshift_stream.cpp
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: Gregory Kramida
+ *   Copyright: 2016 Gregory Kramida
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <reco/segmentation/quickshift_stream.h>
+
+//utils
+#include <reco/utils/cpp_exception_util.h>
+//standard
+#include <algorithm>
+#include <cmath>
+
+namespace reco {
+namespace segmentation {
+
+quickshift_stream::quickshift_stream(float sigma, float tau, float change_threshold, int tile_size) :
+		sigma(sigma),
+		tau(tau),
+		change_threshold(change_threshold),
+		tile_size(tile_size),
+		N1(0), N2(0), K(0), T1(0), T2(0),
+		recomputed_fraction(0.0F),
+		next_id(0)
+{
+	if (tile_size <= 0) {
+		err2(std::invalid_argument, "Tile size has to be positive, got " << tile_size << ".");
+	}
+}
+
+quickshift_stream::~quickshift_stream() {
+
+}
+
+void quickshift_stream::reset() {
+	reference.clear();
+	previous_labels.clear();
+	previous_superpixel_ids.clear();
+}
+
+void quickshift_stream::process(image_t frame, const unsigned char* change_mask) {
+	const int size = frame.N1 * frame.N2;
+	const int plane = size;
+	const bool restart = reference.empty() || frame.N1 != N1 || frame.N2 != N2 || frame.K != K;
+
+	if (restart) {
+		N1 = frame.N1;
+		N2 = frame.N2;
+		K = frame.K;
+		T1 = (N1 + tile_size - 1) / tile_size;
+		T2 = (N2 + tile_size - 1) / tile_size;
+		reference.assign(frame.I, frame.I + size * K);
+		map.resize(size);
+		gaps.resize(size);
+		density.resize(size);
+		changed_tiles.assign(T1 * T2, 1);
+		previous_labels.clear();
+		previous_superpixel_ids.clear();
+	} else {
+		changed_tiles.assign(T1 * T2, 0);
+		//a tile row per iteration, so that each tile flag is written by a single thread
+#pragma omp parallel for schedule(dynamic, 1)
+		for (int t2 = 0; t2 < T2; t2++) {
+			const int i2_end = std::min((t2 + 1) * tile_size, N2);
+			for (int i2 = t2 * tile_size; i2 < i2_end; i2++) {
+				for (int i1 = 0; i1 < N1; i1++) {
+					const int p = i1 + N1 * i2;
+					bool changed = false;
+					if (change_mask) {
+						changed = change_mask[p] != 0;
+					} else {
+						for (int k = 0; k < K; k++) {
+							changed |= std::abs(frame.I[p + k * plane] - reference[p + k * plane]) > change_threshold;
+						}
+					}
+					if (changed) {
+						for (int k = 0; k < K; k++) {
+							reference[p + k * plane] = frame.I[p + k * plane];
+						}
+						changed_tiles[i1 / tile_size + T1 * t2] = 1;
+					}
+				}
+			}
+		}
+	}
+
+	//changes reach the density within the window radius, and the links within tau from there
+	const int R = (int) std::ceil(3 * sigma);
+	const int tR = (int) std::ceil(tau);
+	dilate_tiles(changed_tiles, (R + tile_size - 1) / tile_size, density_tiles);
+	dilate_tiles(density_tiles, (tR + tile_size - 1) / tile_size, neighbor_tiles);
+	recomputed_fraction = (float) std::count(density_tiles.begin(), density_tiles.end(), 1)
+			/ (T1 * T2);
+
+	quickshift_tiles(frame, sigma, tau, tile_size, density_tiles.data(), neighbor_tiles.data(),
+			map.data(), gaps.data(), density.data());
+	compute_superpixels(map.data(), frame.I, N1, N2, K, PLANAR, superpixels);
+	assign_ids();
+}
+
+void quickshift_stream::process(const cv::Mat& frame, const cv::Mat& change_mask) {
+	if ((frame.type() != CV_32F && frame.type() != CV_32FC3) || !frame.isContinuous()) {
+		err2(std::invalid_argument, "Expecting a continous matrix of type CV_32F or CV_32FC3");
+	}
+	if (!change_mask.empty() && (change_mask.type() != CV_8U || !change_mask.isContinuous()
+			|| change_mask.rows != frame.rows || change_mask.cols != frame.cols)) {
+		err2(std::invalid_argument, "Expecting a continous CV_8U change mask of the same size as the frame");
+	}
+	const int size = frame.rows * frame.cols;
+	const int channel_count = frame.channels();
+	const float* data = frame.ptr<float>();
+	planar_frame.resize(size * channel_count);
+	for (int k = 0; k < channel_count; k++) {
+		float* plane = &planar_frame[k * size];
+		for (int p = 0; p < size; p++) {
+			plane[p] = data[p * channel_count + k];
+		}
+	}
+	image_t planar;
+	planar.I = planar_frame.data();
+	planar.N1 = frame.cols;
+	planar.N2 = frame.rows;
+	planar.K = channel_count;
+	process(planar, change_mask.empty() ? NULL : change_mask.ptr<unsigned char>());
+}
+
+void quickshift_stream::dilate_tiles(const std::vector<unsigned char>& source, int radius,
+		std::vector<unsigned char>& dilated) const {
+	dilated.assign(T1 * T2, 0);
+	for (int t2 = 0; t2 < T2; t2++) {
+		for (int t1 = 0; t1 < T1; t1++) {
+			if (!source[t1 + T1 * t2]) {
+				continue;
+			}
+			const int u2_end = std::min(t2 + radius, T2 - 1);
+			const int u1_end = std::min(t1 + radius, T1 - 1);
+			for (int u2 = std::max(t2 - radius, 0); u2 <= u2_end; u2++) {
+				for (int u1 = std::max(t1 - radius, 0); u1 <= u1_end; u1++) {
+					dilated[u1 + T1 * u2] = 1;
+				}
+			}
+		}
+	}
+}
+
+/**
+ * Give each superpixel the id of the previous superpixel its root pixel was in. When several
+ * superpixels claim the same previous one, the largest gets its id & the others new ids.
+ */
+void quickshift_stream::assign_ids() {
+	const int count = (int) superpixels.size();
+	superpixel_ids.assign(count, -1);
+	if (!previous_labels.empty()) {
+		std::vector<int> claimants(previous_superpixel_ids.size(), -1);
+		for (int label = 0; label < count; label++) {
+			int& claimant = claimants[previous_labels[superpixels.roots[label]]];
+			if (claimant == -1 || superpixels.pixel_counts[label] > superpixels.pixel_counts[claimant]) {
+				claimant = label;
+			}
+		}
+		for (size_t previous_label = 0; previous_label < claimants.size(); previous_label++) {
+			if (claimants[previous_label] != -1) {
+				superpixel_ids[claimants[previous_label]] = previous_superpixel_ids[previous_label];
+			}
+		}
+	}
+	for (int label = 0; label < count; label++) {
+		if (superpixel_ids[label] == -1) {
+			superpixel_ids[label] = next_id++;
+		}
+	}
+	previous_labels = superpixels.labels;
+	previous_superpixel_ids = superpixel_ids;
+}
+
+const superpixel_table& quickshift_stream::get_superpixels() const {
+	return superpixels;
+}
+
+const std::vector<int>& quickshift_stream::get_superpixel_ids() const {
+	return superpixel_ids;
+}
+
+const std::vector<float>& quickshift_stream::get_map() const {
+	return map;
+}
+
+const std::vector<float>& quickshift_stream::get_gaps() const {
+	return gaps;
+}
+
+const std::vector<float>& quickshift_stream::get_density() const {
+	return density;
+}
+
+float quickshift_stream::get_recomputed_fraction() const {
+	return recomputed_fraction;
+}
+
+float quickshift_stream::get_sigma() const {
+	return sigma;
+}
+
+float quickshift_stream::get_tau() const {
+	return tau;
+}
+
+} /* namespace segmentation */
+} /* namespace reco */
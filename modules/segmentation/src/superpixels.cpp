@@ -0,0 +1,451 @@
+/*
+ * superpixels.cpp
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: Gregory Kramida
+ *   Copyright: 2016 Gregory Kramida
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <reco/segmentation/superpixels.h>
+#include <reco/segmentation/quickshift_common.h>
+
+//utils
+#include <reco/utils/cpp_exception_util.h>
+//standard
+#include <algorithm>
+#include <climits>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace reco {
+namespace segmentation {
+
+namespace {
+
+//pixels per chunk of the parallel root-numbering scan
+const int label_chunk_size = 1 << 16;
+
+int get_thread_count() {
+#ifdef _OPENMP
+	return omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+int get_thread_index() {
+#ifdef _OPENMP
+	return omp_get_thread_num();
+#else
+	return 0;
+#endif
+}
+
+/**
+ * Per-thread partial statistics of all superpixels
+ */
+struct superpixel_accumulator {
+	std::vector<int> counts;
+	std::vector<double> color_sums;
+	std::vector<double> i1_sums;
+	std::vector<double> i2_sums;
+	std::vector<int> i1_min;
+	std::vector<int> i1_max;
+	std::vector<int> i2_min;
+	std::vector<int> i2_max;
+
+	void reset(int superpixel_count, int K) {
+		counts.assign(superpixel_count, 0);
+		color_sums.assign(superpixel_count * K, 0.0);
+		i1_sums.assign(superpixel_count, 0.0);
+		i2_sums.assign(superpixel_count, 0.0);
+		i1_min.assign(superpixel_count, INT_MAX);
+		i1_max.assign(superpixel_count, INT_MIN);
+		i2_min.assign(superpixel_count, INT_MAX);
+		i2_max.assign(superpixel_count, INT_MIN);
+	}
+};
+
+/**
+ * Replace the parent of each node in a forest by its root, via pointer jumping: each pass replaces
+ * every parent by the grandparent, halving the distance to the root.
+ * @param parents parent of each node (roots point to themselves), roots on output
+ * @param size node count
+ */
+void jump_to_roots(int* parents, int size) {
+	std::vector<int> buffer(size);
+	int* current = parents;
+	int* next = buffer.data();
+	int changed = 1;
+	while (changed) {
+		changed = 0;
+#pragma omp parallel for schedule(static) reduction(|:changed)
+		for (int p = 0; p < size; p++) {
+			const int parent = current[p];
+			const int grandparent = current[parent];
+			next[p] = grandparent;
+			changed |= parent != grandparent;
+		}
+		std::swap(current, next);
+	}
+	if (current != parents) {
+		std::copy(current, current + size, parents);
+	}
+}
+
+/**
+ * Number the roots in order of their linear indices & propagate the numbers to all pixels
+ * @param roots root of each pixel
+ * @param size pixel count
+ * @param[out] labels compact label of each pixel
+ * @param[out] root_indices linear index of the root of each label
+ */
+void label_roots(const int* roots, int size, std::vector<int>& labels, std::vector<int>& root_indices) {
+	const int chunk_count = (size + label_chunk_size - 1) / label_chunk_size;
+	std::vector<int> chunk_offsets(chunk_count + 1, 0);
+	labels.resize(size);
+
+#pragma omp parallel for schedule(static)
+	for (int chunk = 0; chunk < chunk_count; chunk++) {
+		const int end = std::min(size, (chunk + 1) * label_chunk_size);
+		int root_count = 0;
+		for (int p = chunk * label_chunk_size; p < end; p++) {
+			root_count += roots[p] == p;
+		}
+		chunk_offsets[chunk + 1] = root_count;
+	}
+	for (int chunk = 0; chunk < chunk_count; chunk++) {
+		chunk_offsets[chunk + 1] += chunk_offsets[chunk];
+	}
+	root_indices.resize(chunk_offsets[chunk_count]);
+
+#pragma omp parallel for schedule(static)
+	for (int chunk = 0; chunk < chunk_count; chunk++) {
+		const int end = std::min(size, (chunk + 1) * label_chunk_size);
+		int label = chunk_offsets[chunk];
+		for (int p = chunk * label_chunk_size; p < end; p++) {
+			if (roots[p] == p) {
+				labels[p] = label;
+				root_indices[label] = p;
+				label++;
+			}
+		}
+	}
+	//roots are only read from here on
+#pragma omp parallel for schedule(static)
+	for (int p = 0; p < size; p++) {
+		if (roots[p] != p) {
+			labels[p] = labels[roots[p]];
+		}
+	}
+}
+
+/**
+ * Gather the statistics of labeled superpixels in one pass over the image
+ * @param image image the superpixels come from
+ * @param layout layout of the image channels
+ * @param table superpixels with dimensions, labels and roots set, statistics set on output
+ */
+void gather_statistics(const float* image, pixel_layout layout, superpixel_table& table) {
+	const int N1 = table.N1;
+	const int N2 = table.N2;
+	const int K = table.K;
+	const int size = N1 * N2;
+	const int superpixel_count = (int) table.roots.size();
+	const int pixel_stride = layout == PLANAR ? 1 : K;
+	const int channel_stride = layout == PLANAR ? size : 1;
+	const int* labels = table.labels.data();
+
+	table.pixel_counts.resize(superpixel_count);
+	table.mean_colors.resize(superpixel_count * K);
+	table.centroids.resize(superpixel_count);
+	table.bounding_boxes.resize(superpixel_count);
+
+	std::vector<superpixel_accumulator> accumulators(get_thread_count());
+
+#pragma omp parallel
+	{
+		superpixel_accumulator& own = accumulators[get_thread_index()];
+		own.reset(superpixel_count, K);
+
+#pragma omp for schedule(static)
+		for (int i2 = 0; i2 < N2; i2++) {
+			for (int i1 = 0; i1 < N1; i1++) {
+				const int p = i1 + N1 * i2;
+				const int label = labels[p];
+				own.counts[label]++;
+				const float* color = image + p * pixel_stride;
+				double* color_sum = &own.color_sums[label * K];
+				for (int k = 0; k < K; k++) {
+					color_sum[k] += color[k * channel_stride];
+				}
+				own.i1_sums[label] += i1;
+				own.i2_sums[label] += i2;
+				own.i1_min[label] = std::min(own.i1_min[label], i1);
+				own.i1_max[label] = std::max(own.i1_max[label], i1);
+				own.i2_min[label] = std::min(own.i2_min[label], i2);
+				own.i2_max[label] = std::max(own.i2_max[label], i2);
+			}
+		}
+		//implicit barrier above: all partial statistics are in
+		const int partial_count = (int) accumulators.size();
+#pragma omp for schedule(static)
+		for (int label = 0; label < superpixel_count; label++) {
+			int count = 0;
+			double i1_sum = 0.0, i2_sum = 0.0;
+			int i1_min = INT_MAX, i1_max = INT_MIN, i2_min = INT_MAX, i2_max = INT_MIN;
+			float* mean_color = &table.mean_colors[label * K];
+			std::fill(mean_color, mean_color + K, 0.0F);
+			for (int i_partial = 0; i_partial < partial_count; i_partial++) {
+				const superpixel_accumulator& partial = accumulators[i_partial];
+				//threads that did not make it into the region have nothing to add
+				if (partial.counts.empty() || partial.counts[label] == 0) {
+					continue;
+				}
+				count += partial.counts[label];
+				for (int k = 0; k < K; k++) {
+					mean_color[k] += (float) partial.color_sums[label * K + k];
+				}
+				i1_sum += partial.i1_sums[label];
+				i2_sum += partial.i2_sums[label];
+				i1_min = std::min(i1_min, partial.i1_min[label]);
+				i1_max = std::max(i1_max, partial.i1_max[label]);
+				i2_min = std::min(i2_min, partial.i2_min[label]);
+				i2_max = std::max(i2_max, partial.i2_max[label]);
+			}
+			//every superpixel holds at least its root
+			table.pixel_counts[label] = count;
+			for (int k = 0; k < K; k++) {
+				mean_color[k] /= count;
+			}
+			table.centroids[label] = cv::Point2f((float) (i1_sum / count), (float) (i2_sum / count));
+			table.bounding_boxes[label] = cv::Rect(i1_min, i2_min, i1_max - i1_min + 1, i2_max - i2_min + 1);
+		}
+	}
+}
+
+/**
+ * Merge the superpixels of a forest cut at some tau into those of the same forest cut at a larger
+ * tau, from the statistics alone. Every link added by raising tau starts at a root of the finer
+ * cut, so the coarser superpixels are trees of finer ones.
+ * @param fine superpixels of the finer cut
+ * @param map quickshift neighbor map
+ * @param gaps quickshift distance of each pixel to its parent
+ * @param tau threshold of the coarser cut
+ * @param[out] coarse superpixels of the coarser cut
+ */
+void merge_superpixels(const superpixel_table& fine, const float* map, const float* gaps, float tau,
+		superpixel_table& coarse) {
+	const int fine_count = (int) fine.size();
+	const int K = fine.K;
+	std::vector<int> parents(fine_count);
+	for (int label = 0; label < fine_count; label++) {
+		const int root = fine.roots[label];
+		parents[label] = gaps[root] <= tau ? fine.labels[(int) map[root]] : label;
+	}
+	jump_to_roots(parents.data(), fine_count);
+	std::vector<int> coarse_labels, coarse_roots;
+	label_roots(parents.data(), fine_count, coarse_labels, coarse_roots);
+
+	const int coarse_count = (int) coarse_roots.size();
+	coarse.N1 = fine.N1;
+	coarse.N2 = fine.N2;
+	coarse.K = K;
+	coarse.roots.resize(coarse_count);
+	coarse.pixel_counts.assign(coarse_count, 0);
+	coarse.mean_colors.resize(coarse_count * K);
+	coarse.centroids.resize(coarse_count);
+	coarse.bounding_boxes.resize(coarse_count);
+	//root labels are ordered like the root pixels, and so are the coarse labels
+	for (int label = 0; label < coarse_count; label++) {
+		coarse.roots[label] = fine.roots[coarse_roots[label]];
+	}
+
+	std::vector<double> color_sums(coarse_count * K, 0.0);
+	std::vector<double> i1_sums(coarse_count, 0.0), i2_sums(coarse_count, 0.0);
+	for (int fine_label = 0; fine_label < fine_count; fine_label++) {
+		const int label = coarse_labels[fine_label];
+		const int count = fine.pixel_counts[fine_label];
+		const float* mean_color = fine.mean_color(fine_label);
+		for (int k = 0; k < K; k++) {
+			color_sums[label * K + k] += (double) mean_color[k] * count;
+		}
+		i1_sums[label] += (double) fine.centroids[fine_label].x * count;
+		i2_sums[label] += (double) fine.centroids[fine_label].y * count;
+		if (coarse.pixel_counts[label] == 0) {
+			coarse.bounding_boxes[label] = fine.bounding_boxes[fine_label];
+		} else {
+			coarse.bounding_boxes[label] |= fine.bounding_boxes[fine_label];
+		}
+		coarse.pixel_counts[label] += count;
+	}
+	for (int label = 0; label < coarse_count; label++) {
+		const int count = coarse.pixel_counts[label];
+		for (int k = 0; k < K; k++) {
+			coarse.mean_colors[label * K + k] = (float) (color_sums[label * K + k] / count);
+		}
+		coarse.centroids[label] = cv::Point2f((float) (i1_sums[label] / count), (float) (i2_sums[label] / count));
+	}
+
+	const int size = fine.N1 * fine.N2;
+	coarse.labels.resize(size);
+#pragma omp parallel for schedule(static)
+	for (int p = 0; p < size; p++) {
+		coarse.labels[p] = coarse_labels[fine.labels[p]];
+	}
+}
+
+void check_dimensions(int N1, int N2, int K) {
+	if (N1 <= 0 || N2 <= 0 || K <= 0) {
+		err2(std::invalid_argument, "Expecting positive image dimensions, got " << N1 << " x " << N2
+				<< " x " << K << ".");
+	}
+}
+
+void check_image(const cv::Mat& image) {
+	if ((image.type() != CV_32F && image.type() != CV_32FC3) || !image.isContinuous()) {
+		err2(std::invalid_argument, "Expecting a continous matrix of type CV_32F or CV_32FC3");
+	}
+}
+
+} //anonymous namespace
+
+void flatten_forest(const float* map, int size, int* roots) {
+#pragma omp parallel for schedule(static)
+	for (int p = 0; p < size; p++) {
+		roots[p] = (int) map[p];
+	}
+	jump_to_roots(roots, size);
+}
+
+void flatten_forest(const float* map, const float* gaps, float tau, int size, int* roots) {
+#pragma omp parallel for schedule(static)
+	for (int p = 0; p < size; p++) {
+		roots[p] = gaps[p] <= tau ? (int) map[p] : p;
+	}
+	jump_to_roots(roots, size);
+}
+
+void compute_superpixels(const float* map, const float* image, int N1, int N2, int K,
+		pixel_layout layout, superpixel_table& table) {
+	check_dimensions(N1, N2, K);
+	const int size = N1 * N2;
+	table.N1 = N1;
+	table.N2 = N2;
+	table.K = K;
+
+	std::vector<int> roots(size);
+	flatten_forest(map, size, roots.data());
+	label_roots(roots.data(), size, table.labels, table.roots);
+	gather_statistics(image, layout, table);
+}
+
+void compute_superpixels(const float* map, const cv::Mat& image, superpixel_table& table) {
+	check_image(image);
+	compute_superpixels(map, image.ptr<float>(), image.cols, image.rows, image.channels(), INTERLEAVED,
+			table);
+}
+
+void compute_superpixels(const float* map, const float* gaps, const std::vector<float>& taus,
+		const float* image, int N1, int N2, int K, pixel_layout layout,
+		std::vector<superpixel_table>& tables) {
+	check_dimensions(N1, N2, K);
+	const int size = N1 * N2;
+	tables.resize(taus.size());
+	if (taus.empty()) {
+		return;
+	}
+	std::vector<int> order(taus.size());
+	for (size_t i_tau = 0; i_tau < taus.size(); i_tau++) {
+		order[i_tau] = (int) i_tau;
+	}
+	std::sort(order.begin(), order.end(), [&](int a, int b) {return taus[a] < taus[b];});
+
+	//only the finest cut takes a pass over the image, the others are merged from the previous one
+	superpixel_table& finest = tables[order[0]];
+	finest.N1 = N1;
+	finest.N2 = N2;
+	finest.K = K;
+	std::vector<int> roots(size);
+	flatten_forest(map, gaps, taus[order[0]], size, roots.data());
+	label_roots(roots.data(), size, finest.labels, finest.roots);
+	gather_statistics(image, layout, finest);
+	for (size_t i_cut = 1; i_cut < order.size(); i_cut++) {
+		merge_superpixels(tables[order[i_cut - 1]], map, gaps, taus[order[i_cut]], tables[order[i_cut]]);
+	}
+}
+
+void compute_superpixels(const float* map, const float* gaps, const std::vector<float>& taus,
+		const cv::Mat& image, std::vector<superpixel_table>& tables) {
+	check_image(image);
+	compute_superpixels(map, gaps, taus, image.ptr<float>(), image.cols, image.rows, image.channels(),
+			INTERLEAVED, tables);
+}
+
+void compute_merge_hierarchy(const float* map, const float* gaps, int size, float tau_min,
+		std::vector<superpixel_merge>& merges) {
+	//union-find forest whose set representatives are the roots of the trees of the current cut
+	std::vector<int> sets(size);
+	flatten_forest(map, gaps, tau_min, size, sets.data());
+
+	merges.clear();
+	for (int p = 0; p < size; p++) {
+		if (sets[p] == p && gaps[p] != INF) {
+			superpixel_merge merge;
+			merge.child = p;
+			merge.parent = (int) map[p];
+			merge.tau = gaps[p];
+			merges.push_back(merge);
+		}
+	}
+	std::sort(merges.begin(), merges.end(), [](const superpixel_merge& a, const superpixel_merge& b) {
+		return a.tau < b.tau || (a.tau == b.tau && a.child < b.child);
+	});
+
+	for (superpixel_merge& merge : merges) {
+		//find the root of the tree the parent pixel is in, halving the path on the way
+		int root = merge.parent;
+		while (sets[root] != root) {
+			sets[root] = sets[sets[root]];
+			root = sets[root];
+		}
+		merge.parent = root;
+		sets[merge.child] = root;
+	}
+}
+
+void paint_mean_colors(const superpixel_table& table, pixel_layout layout, float* image) {
+	const int size = table.N1 * table.N2;
+	const int K = table.K;
+	const int pixel_stride = layout == PLANAR ? 1 : K;
+	const int channel_stride = layout == PLANAR ? size : 1;
+#pragma omp parallel for schedule(static)
+	for (int p = 0; p < size; p++) {
+		const float* mean_color = table.mean_color(table.labels[p]);
+		float* color = image + p * pixel_stride;
+		for (int k = 0; k < K; k++) {
+			color[k * channel_stride] = mean_color[k];
+		}
+	}
+}
+
+void paint_mean_colors(const superpixel_table& table, cv::Mat& image) {
+	image.create(table.N2, table.N1, CV_32FC(table.K));
+	paint_mean_colors(table, INTERLEAVED, image.ptr<float>());
+}
+
+} /* namespace segmentation */
+} /* namespace reco */
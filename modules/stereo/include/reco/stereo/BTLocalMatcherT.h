@@ -2,6 +2,39 @@
 #define __BTLOCALMATCHERT_H
 
 #include "OvLocalMatcherT.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+/**  Fast single precision exponential (Cephes expf polynomial, within 2 ulp of expf),
+* written so that loops over it vectorize.
+* @param x	input value, between -87 and 88 (callers clamp beforehand, so that the loop stays branch free)
+* @return e to the power x
+*/
+inline float ov_fast_expf(float x)
+{
+  //split into x = n*log(2) + r, |r| <= log(2)/2
+  float fn = x*1.44269504088896341f + 0.5f;
+  int n = static_cast<int>(fn);
+  n -= static_cast<int>(static_cast<float>(n) > fn); //floor for negative values
+  float r = x - static_cast<float>(n)*0.693359375f;
+  r -= static_cast<float>(n)*(-2.12194440e-4f);
+
+  float r2 = r*r;
+  float y = 1.9875691500e-4f;
+  y = y*r + 1.3981999507e-3f;
+  y = y*r + 8.3334519073e-3f;
+  y = y*r + 4.1665795894e-2f;
+  y = y*r + 1.6666665459e-1f;
+  y = y*r + 5.0000001201e-1f;
+  y = y*r2 + r + 1.0f;
+
+  //multiply by 2^n through the exponent bits
+  int bits = (n + 127) << 23;
+  float scale;
+  std::memcpy(&scale, &bits, sizeof(scale));
+  return y*scale;
+}
 
 ///Birchfield-Tomasi sampling-insensitive intensity local matcher.
 /** 
@@ -19,8 +52,10 @@ public:
   virtual ~BTLocalMatcherT(); /**< Destructor */
   virtual bool setImagePair(const OvImageT<T> & i1, const OvImageT<T> & i2);
   virtual bool setParams(int nparams, double*params);
-  virtual const OvImageT<double> getMatch(int shiftx, int shifty=0);
-  virtual const OvImageT<double> getRawMatch(int shiftx, int shifty=0);
+  virtual OvImageT<double> getMatch(int shiftx, int shifty=0);
+  virtual OvImageT<double> getRawMatch(int shiftx, int shifty=0);
+  virtual void getMatches(int count, const int * shiftsx, const int * shiftsy, OvImageT<double> * results);
+  virtual void getRegionMatches(int count, const int * shiftsx, const int * shiftsy, int rowLo, int rowHi, int columnLo, int columnHi, OvImageT<double> * results);
 
 protected:
   OvImageT<double> mImage1; /**< copy of input image 1. */
@@ -31,6 +66,14 @@ protected:
   OvImageT<double> mMin2; /**< precomputed minimum image from i2 for speeding up Birchfield Tomasi matching. */
   OvImageT<double> mMax2; /**< precomputed maximum image from i2 for speeding up Birchfield Tomasi matching. */
 
+  //single precision copies of the above for getMatches
+  OvImageT<float> mImage1F;
+  OvImageT<float> mImage2F;
+  OvImageT<float> mMin1F;
+  OvImageT<float> mMax1F;
+  OvImageT<float> mMin2F;
+  OvImageT<float> mMax2F;
+
 
   /**
   * Alpha is a constant used to convert
@@ -81,6 +124,13 @@ bool BTLocalMatcherT<T>::setImagePair(const OvImageT<T> & i1, const OvImageT<T>
   mMin2 = (mImage2 + minFilter2D(mImage2, 3, 3))/2;
   mMax2 = (mImage2 + maxFilter2D(mImage2, 3, 3))/2;
 
+  mImage1F = mImage1;
+  mImage2F = mImage2;
+  mMin1F = mMin1;
+  mMax1F = mMax1;
+  mMin2F = mMin2;
+  mMax2F = mMax2;
+
   return true;
 }
 
@@ -111,11 +161,111 @@ bool BTLocalMatcherT<T>::setParams(int nparams, double*params)
 */
 
 template<typename T>
-const OvImageT<double> BTLocalMatcherT<T>::getMatch(int shiftx, int shifty)
+OvImageT<double> BTLocalMatcherT<T>::getMatch(int shiftx, int shifty)
+{
+  OvImageT<double> result;
+  getMatches(1, &shiftx, &shifty, &result);
+  return result;
+}
+
+/**
+* Used to retrieve results of matching the two images with several relative 2D translations at once.
+* Equivalent to calling getMatch for each shift, but the score of each pixel is computed in a single pass
+* in single precision: for each image column, all shifts are matched while the column of image 1 is in cache.
+* @param count number of shifts
+* @param shiftsx horizontal relative shifts, count values
+* @param shiftsy vertical relative shifts, count values
+* @param results resulting single channel images, count images
+* @see getMatch(int shiftx, int shifty)
+*/
+template<typename T>
+void BTLocalMatcherT<T>::getMatches(int count, const int * shiftsx, const int * shiftsy, OvImageT<double> * results)
+{
+  getRegionMatches(count, shiftsx, shiftsy, 0, mImage1.getHeight()-1, 0, mImage1.getWidth()-1, results);
+}
+
+/**
+* Used to retrieve results of matching the two images with several relative 2D translations at once, for a
+* rectangular region of image 1 only. Only the columns of the region are matched.
+* @param count number of shifts
+* @param shiftsx horizontal relative shifts, count values
+* @param shiftsy vertical relative shifts, count values
+* @param rowLo first row of the region
+* @param rowHi last row of the region
+* @param columnLo first column of the region
+* @param columnHi last column of the region
+* @param results resulting single channel images of the size of the region, count images
+* @see getMatches(int count, const int * shiftsx, const int * shiftsy, OvImageT<double> * results)
+*/
+template<typename T>
+void BTLocalMatcherT<T>::getRegionMatches(int count, const int * shiftsx, const int * shiftsy, int rowLo, int rowHi, int columnLo, int columnHi, OvImageT<double> * results)
 {
-  double tempAlpha;
-  tempAlpha = alpha/255.0;
-  return exp(-tempAlpha*mean(abs(getRawMatch(shiftx,shifty)),3));
+  int height, width, nchannels;
+  mImage1.getDimensions(height,width,nchannels);
+  if(height*width*nchannels==0) return;
+
+  rowLo = std::max(rowLo, 0);
+  rowHi = std::min(rowHi, height-1);
+  columnLo = std::max(columnLo, 0);
+  columnHi = std::min(columnHi, width-1);
+  if((rowLo>rowHi)||(columnLo>columnHi)) return;
+  int regionHeight = rowHi-rowLo+1;
+  int regionWidth = columnHi-columnLo+1;
+
+  double tempAlpha = alpha/255.0;
+  //score of pixels without a counterpart in image 2, whose raw match is 255 in every channel
+  double outsideScore = exp(-tempAlpha*255.0);
+  float scoreScale = static_cast<float>(-tempAlpha/nchannels);
+  int planeSize = height*width;
+
+  const float *image1 = &mImage1F(0,0,0), *min1 = &mMin1F(0,0,0), *max1 = &mMax1F(0,0,0);
+  const float *image2 = &mImage2F(0,0,0), *min2 = &mMin2F(0,0,0), *max2 = &mMax2F(0,0,0);
+  std::vector<float> sums(height);
+
+  for(int b=0; b<count; b++)
+  {
+    if((results[b].getHeight()!=regionHeight)||(results[b].getWidth()!=regionWidth)||(results[b].getNumChannels()!=1))
+      results[b].resetDimensions(regionHeight,regionWidth,1);
+  }
+
+  //images are stored column by column, so each column of each channel is a contiguous run
+  for(int j1=columnLo; j1<=columnHi; j1++)
+  {
+    for(int b=0; b<count; b++)
+    {
+      double *out = &results[b](0,j1-columnLo);
+      int j2 = j1 + shiftsx[b];
+      int ilo = std::max(rowLo, -shiftsy[b]);
+      int ihi = std::min(rowHi+1, height-shiftsy[b]);
+      if((j2<0)||(j2>=width)||(ilo>=ihi))
+      {
+        for(int i=0; i<regionHeight; i++) out[i] = outsideScore;
+        continue;
+      }
+
+      float *sum = &sums[0];
+      for(int i=ilo; i<ihi; i++) sum[i] = 0.0f;
+      for(int k=0; k<nchannels; k++)
+      {
+        int offset1 = k*planeSize + j1*height;
+        int offset2 = k*planeSize + j2*height + shiftsy[b];
+        const float *v1 = image1 + offset1, *lo1 = min1 + offset1, *hi1 = max1 + offset1;
+        const float *v2 = image2 + offset2, *lo2 = min2 + offset2, *hi2 = max2 + offset2;
+        for(int i=ilo; i<ihi; i++)
+        {
+          //distance from each pixel to the interval spanned by its half-pixel neighbors in the other image
+          float match1 = std::max(std::max(lo2[i]-v1[i], v1[i]-hi2[i]), 0.0f);
+          float match2 = std::max(std::max(lo1[i]-v2[i], v2[i]-hi1[i]), 0.0f);
+          sum[i] += (match1+match2)*0.5f;
+        }
+      }
+
+      for(int i=rowLo; i<ilo; i++) out[i-rowLo] = outsideScore;
+      for(int i=ilo; i<ihi; i++) sum[i] = std::max(sum[i]*scoreScale, -87.0f);
+      for(int i=ilo; i<ihi; i++) out[i-rowLo] = ov_fast_expf(sum[i]);
+      for(int i=ihi; i<=rowHi; i++) out[i-rowLo] = outsideScore;
+    }
+  }
 }
 
 /**
@@ -127,7 +277,7 @@ const OvImageT<double> BTLocalMatcherT<T>::getMatch(int shiftx, int shifty)
 * @see getMatch(int shiftx, int shifty)
 */
 template<typename T>
-const OvImageT<double> BTLocalMatcherT<T>::getRawMatch(int shiftx, int shifty)
+OvImageT<double> BTLocalMatcherT<T>::getRawMatch(int shiftx, int shifty)
 {
   int height, width, nchannels;
   int i1,j1,k,i2,j2,jlo,jhi,ilo,ihi;
@@ -25,6 +25,7 @@ public:
 
   virtual double getPixel(int row, int column, int channel) const;
   virtual void   setPixel(double value, int row, int column, int channel);
+  virtual bool   getDataLayout(unsigned char *& data, long & rowStep, long & columnStep, long & channelStep) const;
 
 protected:
   IplImage*mIplImage;	/**< saved pointer to OpenCV IplImage object */
@@ -44,6 +44,7 @@ public:
 
   virtual double getPixel(int row, int column, int channel) const;
   virtual void   setPixel(double value, int row, int column, int channel);
+  virtual bool   getDataLayout(unsigned char *& data, long & rowStep, long & columnStep, long & channelStep) const;
 
 protected:
   cv::Mat mat;	/**< saved OpenCV matrix object */
@@ -4,6 +4,10 @@
 #include "OvImageT.h"
 #include "OvFlowGlobalMatcherT.h"
 #include "OvLocalMatcherT.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
 
 ///Global optical flow algorithm based on fast diffusion (see Ogale et al. ICRA April 05, IJCV July 06).
 /** 
@@ -41,6 +45,27 @@ public:
   */
   virtual bool doMatching(OvImageT<T> & i1, OvImageT<T> & i2, double minshiftX, double maxshiftX, double minshiftY, double maxshiftY, OvImageT<double> & u1, OvImageT<double> & v1, OvImageT<double> & o1, OvImageT<double> & u2, OvImageT<double> & v2,  OvImageT<double> & o2);
 
+  /**
+  * Optical flow with a separate search range for every pixel of image 1.
+  * Each shift is only matched over the region of the pixels that search it, and the other pixels
+  * of the region neither take it nor pass on support for it.
+  * Note: This method modifies the input images, so be careful.
+  * @param i1 the first image
+  * @param i2 the second image
+  * @param minshiftsX each pixel searches for horizontal flow values from its minshiftsX value to its maxshiftsX value (same height and width as i1)
+  * @param maxshiftsX each pixel searches for horizontal flow values from its minshiftsX value to its maxshiftsX value (same height and width as i1)
+  * @param minshiftsY each pixel searches for vertical flow values from its minshiftsY value to its maxshiftsY value (same height and width as i1)
+  * @param maxshiftsY each pixel searches for vertical flow values from its minshiftsY value to its maxshiftsY value (same height and width as i1)
+  * @param u1 the horizontal flow for image 1. (method sets this).
+  * @param v1 the vertical flow for image 1. (method sets this).
+  * @param o1 the occlusion map for image 1. (method sets this).
+  * @param u2 the horizontal flow for image 2. (method sets this).
+  * @param v2 the vertical flow for image 2. (method sets this).
+  * @param o2 the occlusion map for image 2. (method sets this).
+  * @return true if successful.
+  */
+  virtual bool doMatchingInRanges(OvImageT<T> & i1, OvImageT<T> & i2, const OvImageT<double> & minshiftsX, const OvImageT<double> & maxshiftsX, const OvImageT<double> & minshiftsY, const OvImageT<double> & maxshiftsY, OvImageT<double> & u1, OvImageT<double> & v1, OvImageT<double> & o1, OvImageT<double> & u2, OvImageT<double> & v2,  OvImageT<double> & o2);
+
   /**
   * Used for specifying any parameters required.
   * @param nparams number of parameters which are being passed
@@ -61,6 +86,23 @@ protected:
   virtual void computeGoodnessHoriz (const OvImageT<double> & iMatch, const OvImageT<double> & iConductivity, OvImageT<double> & iGoodness); 
   virtual void computeGoodnessVert  (const OvImageT<double> & iMatch, const OvImageT<double> & iConductivity, OvImageT<double> & iGoodness); 
 
+  /**
+  * Finds the bounding box of the pixels that search each shift. Shift (shiftX, shiftY) has index
+  * (shiftX-firstShiftX)*shiftCountY + (shiftY-firstShiftY).
+  * @param firstShiftsX first horizontal shift searched by each pixel
+  * @param lastShiftsX last horizontal shift searched by each pixel
+  * @param firstShiftsY first vertical shift searched by each pixel
+  * @param lastShiftsY last vertical shift searched by each pixel
+  * @param firstShiftX lowest horizontal shift searched by any pixel
+  * @param shiftCountX number of horizontal shifts from firstShiftX on
+  * @param firstShiftY lowest vertical shift searched by any pixel
+  * @param shiftCountY number of vertical shifts from firstShiftY on
+  * @param rowLo first row of each shift (height if no pixel searches it)
+  * @param rowHi last row of each shift (-1 if no pixel searches it)
+  * @param columnLo first column of each shift
+  * @param columnHi last column of each shift
+  */
+  void computeShiftRegions(const OvImageT<int> & firstShiftsX, const OvImageT<int> & lastShiftsX, const OvImageT<int> & firstShiftsY, const OvImageT<int> & lastShiftsY, int firstShiftX, int shiftCountX, int firstShiftY, int shiftCountY, std::vector<int> & rowLo, std::vector<int> & rowHi, std::vector<int> & columnLo, std::vector<int> & columnHi);
 };
 
 
@@ -76,54 +118,182 @@ OvFlowDiffuseMatcherT<T>::~OvFlowDiffuseMatcherT()
 
 template<typename T>
 bool OvFlowDiffuseMatcherT<T>::doMatching(OvImageT<T> & i1, OvImageT<T> & i2, double minshiftX, double maxshiftX, double minshiftY, double maxshiftY, OvImageT<double> & u1, OvImageT<double> & v1, OvImageT<double> & o1, OvImageT<double> & u2, OvImageT<double> & v2,  OvImageT<double> & o2)
+{
+  OvImageT<double> minshiftsX(i1.getHeight(), i1.getWidth(), 1), maxshiftsX(i1.getHeight(), i1.getWidth(), 1);
+  OvImageT<double> minshiftsY(i1.getHeight(), i1.getWidth(), 1), maxshiftsY(i1.getHeight(), i1.getWidth(), 1);
+  minshiftsX = minshiftX;
+  maxshiftsX = maxshiftX;
+  minshiftsY = minshiftY;
+  maxshiftsY = maxshiftY;
+  return doMatchingInRanges(i1, i2, minshiftsX, maxshiftsX, minshiftsY, maxshiftsY, u1, v1, o1, u2, v2, o2);
+}
+
+template<typename T>
+bool OvFlowDiffuseMatcherT<T>::doMatchingInRanges(OvImageT<T> & i1, OvImageT<T> & i2, const OvImageT<double> & minshiftsX, const OvImageT<double> & maxshiftsX, const OvImageT<double> & minshiftsY, const OvImageT<double> & maxshiftsY, OvImageT<double> & u1, OvImageT<double> & v1, OvImageT<double> & o1, OvImageT<double> & u2, OvImageT<double> & v2,  OvImageT<double> & o2)
 {
   int height, width, channels;
-  int i,j,iproj,jproj;
+  int i,j,k,iproj,jproj;
 
-  OvImageT<double> iMatch, iGoodnessVert, iGoodnessHoriz, iGoodnessL, iGoodnessR, bestprobabL, bestprobabR, bestprobabRshifted;
-  OvImageT<bool> maskL, maskR;
+  OvImageT<double> bestprobabL, bestprobabR;
 
   i1.getDimensions(height,width,channels);
-  iMatch.resetDimensions(height,width);
-  iGoodnessHoriz.resetDimensions(height,width);
-  iGoodnessVert.resetDimensions(height,width);
-  iGoodnessL.resetDimensions(height,width);
-  iGoodnessR.resetDimensions(height,width);
+  if((minshiftsX.getHeight()!=height)||(minshiftsX.getWidth()!=width)) return false;
+  if((maxshiftsX.getHeight()!=height)||(maxshiftsX.getWidth()!=width)) return false;
+  if((minshiftsY.getHeight()!=height)||(minshiftsY.getWidth()!=width)) return false;
+  if((maxshiftsY.getHeight()!=height)||(maxshiftsY.getWidth()!=width)) return false;
   bestprobabL.resetDimensions(height,width);
   bestprobabR.resetDimensions(height,width);
-  bestprobabRshifted.resetDimensions(height,width);
 
   mLocalMatcher->setImagePair(i1, i2);
 
-  u1 = minshiftX;
-  v1 = minshiftY;
+  for(k=0; k<u1.getNumChannels(); k++)
+    for(j=0; j<width; j++)
+      for(i=0; i<height; i++) u1(i,j,k) = minshiftsX(i,j);
+  for(k=0; k<v1.getNumChannels(); k++)
+    for(j=0; j<width; j++)
+      for(i=0; i<height; i++) v1(i,j,k) = minshiftsY(i,j);
   o1 = 0;
-  u2 = -minshiftX;
-  v2 = -minshiftY;
+  for(k=0; k<u2.getNumChannels(); k++)
+    for(j=0; j<width; j++)
+      for(i=0; i<height; i++) u2(i,j,k) = -minshiftsX(i,j);
+  for(k=0; k<v2.getNumChannels(); k++)
+    for(j=0; j<width; j++)
+      for(i=0; i<height; i++) v2(i,j,k) = -minshiftsY(i,j);
   o2 = 0;
 
-  for(int shiftX=static_cast<int>(minshiftX); shiftX<=maxshiftX; shiftX++)
+  //integer shifts searched by each pixel: from its truncated minimum up to its maximum
+  OvImageT<int> firstShiftsX(height,width,1), lastShiftsX(height,width,1), firstShiftsY(height,width,1), lastShiftsY(height,width,1);
+  int firstShiftX = std::numeric_limits<int>::max(), lastShiftX = std::numeric_limits<int>::min();
+  int firstShiftY = std::numeric_limits<int>::max(), lastShiftY = std::numeric_limits<int>::min();
+  for(j=0; j<width; j++)
+    for(i=0; i<height; i++)
+    {
+      firstShiftsX(i,j) = static_cast<int>(minshiftsX(i,j));
+      lastShiftsX(i,j) = static_cast<int>(floor(maxshiftsX(i,j)));
+      firstShiftsY(i,j) = static_cast<int>(minshiftsY(i,j));
+      lastShiftsY(i,j) = static_cast<int>(floor(maxshiftsY(i,j)));
+      if((firstShiftsX(i,j)>lastShiftsX(i,j))||(firstShiftsY(i,j)>lastShiftsY(i,j))) continue;
+      firstShiftX = std::min(firstShiftX, firstShiftsX(i,j));
+      lastShiftX = std::max(lastShiftX, lastShiftsX(i,j));
+      firstShiftY = std::min(firstShiftY, firstShiftsY(i,j));
+      lastShiftY = std::max(lastShiftY, lastShiftsY(i,j));
+    }
+
+  //shifts searched by at least one pixel, in the same order as nested loops over shiftX (outer) and shiftY (inner),
+  //and the region of the pixels searching each
+  std::vector<int> shiftRowLo, shiftRowHi, shiftColumnLo, shiftColumnHi, shiftIndices;
+  int shiftCountX = 0, shiftCountY = 0;
+  if((firstShiftX<=lastShiftX)&&(firstShiftY<=lastShiftY))
   {
-    for(int shiftY=static_cast<int>(minshiftY); shiftY<=maxshiftY; shiftY++)
+    shiftCountX = lastShiftX-firstShiftX+1;
+    shiftCountY = lastShiftY-firstShiftY+1;
+    computeShiftRegions(firstShiftsX, lastShiftsX, firstShiftsY, lastShiftsY, firstShiftX, shiftCountX, firstShiftY, shiftCountY, shiftRowLo, shiftRowHi, shiftColumnLo, shiftColumnHi);
+    for(int index=0; index<shiftCountX*shiftCountY; index++)
+      if(shiftRowLo[index]<=shiftRowHi[index]) shiftIndices.push_back(index);
+  }
+  int shiftCount = static_cast<int>(shiftIndices.size());
+
+  //goodness of a batch of shifts, computed in parallel: each thread takes a block of consecutive shifts,
+  //which the local matcher can match together over the union of their regions
+  const int blockSize = 4;
+  int blockCount = std::max(1, std::min(ov_thread_count(), (shiftCount+blockSize-1)/blockSize));
+  int batchSize = blockCount*blockSize;
+  std::vector<OvImageT<double> > iGoodnessL(batchSize), iGoodnessHoriz(blockCount), iGoodnessVert(blockCount);
+  std::vector<int> shiftsX(batchSize), shiftsY(batchSize);
+  std::vector<int> blockRowLo(blockCount), blockRowHi(blockCount), blockColumnLo(blockCount), blockColumnHi(blockCount);
+
+  for(int batchStart=0; batchStart<shiftCount; batchStart+=batchSize)
+  {
+    int batchCount = std::min(batchSize, shiftCount-batchStart);
+    for(int b=0; b<batchCount; b++)
+    {
+      shiftsX[b] = firstShiftX+shiftIndices[batchStart+b]/shiftCountY;
+      shiftsY[b] = firstShiftY+shiftIndices[batchStart+b]%shiftCountY;
+    }
+    for(int block=0; block<blockCount; block++)
     {
-      iMatch = mLocalMatcher->getMatch(shiftX,shiftY);
-      computeGoodnessHoriz(iMatch, iMatch, iGoodnessHoriz);
-      computeGoodnessVert(iMatch, iMatch, iGoodnessVert);
+      blockRowLo[block] = height; blockRowHi[block] = -1;
+      blockColumnLo[block] = width; blockColumnHi[block] = -1;
+      for(int b=block*blockSize; b<std::min((block+1)*blockSize, batchCount); b++)
+      {
+        int index = shiftIndices[batchStart+b];
+        blockRowLo[block] = std::min(blockRowLo[block], shiftRowLo[index]);
+        blockRowHi[block] = std::max(blockRowHi[block], shiftRowHi[index]);
+        blockColumnLo[block] = std::min(blockColumnLo[block], shiftColumnLo[index]);
+        blockColumnHi[block] = std::max(blockColumnHi[block], shiftColumnHi[index]);
+      }
+    }
 
-      iGoodnessL = iGoodnessHoriz*iGoodnessVert;
-      iGoodnessR = shiftImageXY(iGoodnessL, shiftX, shiftY); 
+#pragma omp parallel for schedule(dynamic,1)
+    for(int block=0; block<blockCount; block++)
+    {
+      int first = block*blockSize;
+      int count = std::min(blockSize, batchCount-first);
+      if(count<=0) continue;
 
-      bestprobabRshifted = shiftImageXY(bestprobabR, -shiftX, -shiftY);
-      maskL = (iGoodnessL>bestprobabL) && (iGoodnessL>bestprobabRshifted);
-      maskR = shiftImageXY(maskL, shiftX, shiftY); 
+      int rowLo = blockRowLo[block], columnLo = blockColumnLo[block];
+      int regionHeight = blockRowHi[block]-rowLo+1, regionWidth = blockColumnHi[block]-columnLo+1;
+      if((iGoodnessHoriz[block].getHeight()!=regionHeight)||(iGoodnessHoriz[block].getWidth()!=regionWidth))
+      {
+        iGoodnessHoriz[block].resetDimensions(regionHeight,regionWidth);
+        iGoodnessVert[block].resetDimensions(regionHeight,regionWidth);
+      }
 
-      u1.copyMasked(maskL, shiftX);
-      v1.copyMasked(maskL, shiftY);
-      bestprobabL.copyMasked(maskL, iGoodnessL);
+      //the match images are replaced by the goodness once diffused
+      mLocalMatcher->getRegionMatches(count, &shiftsX[first], &shiftsY[first], rowLo, blockRowHi[block], columnLo, blockColumnHi[block], &iGoodnessL[first]);
+      for(int b=first; b<first+count; b++)
+      {
+        //pixels that do not search the shift neither match nor conduct
+        OvImageT<double> & iMatch = iGoodnessL[b];
+        for(int column=0; column<regionWidth; column++)
+          for(int row=0; row<regionHeight; row++)
+          {
+            int row1 = row+rowLo, column1 = column+columnLo;
+            if((shiftsX[b]<firstShiftsX(row1,column1))||(shiftsX[b]>lastShiftsX(row1,column1))||
+              (shiftsY[b]<firstShiftsY(row1,column1))||(shiftsY[b]>lastShiftsY(row1,column1))) iMatch(row,column) = 0;
+          }
+
+        computeGoodnessHoriz(iMatch, iMatch, iGoodnessHoriz[block]);
+        computeGoodnessVert(iMatch, iMatch, iGoodnessVert[block]);
+        iMatch = iGoodnessHoriz[block]*iGoodnessVert[block];
+      }
+    }
 
-      u2.copyMasked(maskR, -shiftX);
-      v2.copyMasked(maskR, -shiftY);
-      bestprobabR.copyMasked(maskR, iGoodnessR);
+    //winner-take-all, shift by shift in the original order: a pixel takes a shift if its goodness beats both its own
+    //best so far and the best so far of the image 2 pixel it maps to (earlier shifts win ties). Within one shift each
+    //pixel maps to a different image 2 pixel, so pixels are updated in parallel with the same result as a serial run.
+#pragma omp parallel
+    for(int b=0; b<batchCount; b++)
+    {
+      int shiftX = shiftsX[b];
+      int shiftY = shiftsY[b];
+      int block = b/blockSize;
+      int rowLo = blockRowLo[block], columnLo = blockColumnLo[block];
+      const OvImageT<double> & iGoodness = iGoodnessL[b];
+
+#pragma omp for schedule(static)
+      for(int row=rowLo; row<=blockRowHi[block]; row++)
+      {
+        int row2 = row + shiftY; //matching row in image 2
+        for(int column=columnLo; column<=blockColumnHi[block]; column++)
+        {
+          int column2 = column + shiftX;
+          bool inside2 = (row2>=0) && (row2<height) && (column2>=0) && (column2<width);
+          double goodness = iGoodness(row-rowLo,column-columnLo);
+          if((goodness>bestprobabL(row,column)) && (goodness>(inside2 ? bestprobabR(row2,column2) : 0.0)))
+          {
+            u1(row,column) = shiftX;
+            v1(row,column) = shiftY;
+            bestprobabL(row,column) = goodness;
+            if(inside2)
+            {
+              u2(row2,column2) = -shiftX;
+              v2(row2,column2) = -shiftY;
+              bestprobabR(row2,column2) = goodness;
+            }
+          }
+        }
+      }
     }
   }
 
@@ -241,4 +411,58 @@ void OvFlowDiffuseMatcherT<T>::computeGoodnessVert(const OvImageT<double> & iMat
   }		
 }
 
+template<typename T>
+void OvFlowDiffuseMatcherT<T>::computeShiftRegions(const OvImageT<int> & firstShiftsX, const OvImageT<int> & lastShiftsX, const OvImageT<int> & firstShiftsY, const OvImageT<int> & lastShiftsY, int firstShiftX, int shiftCountX, int firstShiftY, int shiftCountY, std::vector<int> & rowLo, std::vector<int> & rowHi, std::vector<int> & columnLo, std::vector<int> & columnHi)
+{
+  int i, j, x, y, height, width, channels;
+  const int stride = shiftCountY+1;
+  std::vector<int> coverage((shiftCountX+1)*stride);
+
+  firstShiftsX.getDimensions(height, width, channels);
+  rowLo.assign(shiftCountX*shiftCountY, height);
+  rowHi.assign(shiftCountX*shiftCountY, -1);
+  columnLo.assign(shiftCountX*shiftCountY, width);
+  columnHi.assign(shiftCountX*shiftCountY, -1);
+
+  for(int pass=0; pass<2; pass++)
+  {
+    //rows, then columns
+    int lineCount = (pass==0) ? height : width;
+    int lineLength = (pass==0) ? width : height;
+    std::vector<int> & lineLo = (pass==0) ? rowLo : columnLo;
+    std::vector<int> & lineHi = (pass==0) ? rowHi : columnHi;
+
+    for(int line=0; line<lineCount; line++)
+    {
+      //the shifts searched in a line are the union of the rectangular ranges of its pixels: mark the corners of each range...
+      std::fill(coverage.begin(), coverage.end(), 0);
+      for(int position=0; position<lineLength; position++)
+      {
+        i = (pass==0) ? line : position;
+        j = (pass==0) ? position : line;
+        if((firstShiftsX(i,j)>lastShiftsX(i,j))||(firstShiftsY(i,j)>lastShiftsY(i,j))) continue;
+        int x1 = firstShiftsX(i,j)-firstShiftX, x2 = lastShiftsX(i,j)-firstShiftX+1;
+        int y1 = firstShiftsY(i,j)-firstShiftY, y2 = lastShiftsY(i,j)-firstShiftY+1;
+        coverage[x1*stride+y1]++;
+        coverage[x1*stride+y2]--;
+        coverage[x2*stride+y1]--;
+        coverage[x2*stride+y2]++;
+      }
+
+      //...and sum them up
+      for(x=0; x<shiftCountX; x++)
+        for(y=0; y<shiftCountY; y++)
+        {
+          if(x>0) coverage[x*stride+y] += coverage[(x-1)*stride+y];
+          if(y>0) coverage[x*stride+y] += coverage[x*stride+y-1];
+          if((x>0)&&(y>0)) coverage[x*stride+y] -= coverage[(x-1)*stride+y-1];
+          if(coverage[x*stride+y]==0) continue;
+          int index = x*shiftCountY+y;
+          if(lineLo[index]==lineCount) lineLo[index] = line;
+          lineHi[index] = line;
+        }
+    }
+  }
+}
+
 #endif //__OVFLOWDIFFUSEMATCHERT_H
@@ -39,6 +39,27 @@ public:
   */
   virtual bool doMatching(OvImageT<T> & i1, OvImageT<T> & i2, double minshiftX, double maxshiftX, double minshiftY, double maxshiftY, OvImageT<double> & u1, OvImageT<double> & v1, OvImageT<double> & o1, OvImageT<double> & u2, OvImageT<double> & v2,  OvImageT<double> & o2) = 0;
 
+  /**
+  * Optical flow with a separate search range for every pixel of image 1,
+  * e.g., a band around an estimate found at a coarser resolution.
+  * By default, doMatching searches the union of the ranges.
+  * Note: This method modifies the input images, so be careful.
+  * @param i1 the first image
+  * @param i2 the second image
+  * @param minshiftsX each pixel searches for horizontal flow values from its minshiftsX value to its maxshiftsX value (same height and width as i1)
+  * @param maxshiftsX each pixel searches for horizontal flow values from its minshiftsX value to its maxshiftsX value (same height and width as i1)
+  * @param minshiftsY each pixel searches for vertical flow values from its minshiftsY value to its maxshiftsY value (same height and width as i1)
+  * @param maxshiftsY each pixel searches for vertical flow values from its minshiftsY value to its maxshiftsY value (same height and width as i1)
+  * @param u1 the horizontal flow for image 1. (method sets this).
+  * @param v1 the vertical flow for image 1. (method sets this).
+  * @param o1 the occlusion map for image 1. (method sets this).
+  * @param u2 the horizontal flow for image 2. (method sets this).
+  * @param v2 the vertical flow for image 2. (method sets this).
+  * @param o2 the occlusion map for image 2. (method sets this).
+  * @return true if successful.
+  */
+  virtual bool doMatchingInRanges(OvImageT<T> & i1, OvImageT<T> & i2, const OvImageT<double> & minshiftsX, const OvImageT<double> & maxshiftsX, const OvImageT<double> & minshiftsY, const OvImageT<double> & maxshiftsY, OvImageT<double> & u1, OvImageT<double> & v1, OvImageT<double> & o1, OvImageT<double> & u2, OvImageT<double> & v2,  OvImageT<double> & o2);
+
 
   /**
   * Used for specifying any parameters required.
@@ -65,4 +86,29 @@ OvFlowGlobalMatcherT<T>::~OvFlowGlobalMatcherT()
 {
 }
 
+template<typename T>
+bool OvFlowGlobalMatcherT<T>::doMatchingInRanges(OvImageT<T> & i1, OvImageT<T> & i2, const OvImageT<double> & minshiftsX, const OvImageT<double> & maxshiftsX, const OvImageT<double> & minshiftsY, const OvImageT<double> & maxshiftsY, OvImageT<double> & u1, OvImageT<double> & v1, OvImageT<double> & o1, OvImageT<double> & u2, OvImageT<double> & v2,  OvImageT<double> & o2)
+{
+  int i, j, height, width, channels;
+  double minshiftX, maxshiftX, minshiftY, maxshiftY;
+
+  minshiftsX.getDimensions(height, width, channels);
+  if(height*width==0) return false;
+
+  minshiftX = minshiftsX(0,0);
+  maxshiftX = maxshiftsX(0,0);
+  minshiftY = minshiftsY(0,0);
+  maxshiftY = maxshiftsY(0,0);
+  for(j=0;j<width;j++)
+    for(i=0;i<height;i++)
+    {
+      if(minshiftsX(i,j)<minshiftX) minshiftX = minshiftsX(i,j);
+      if(maxshiftsX(i,j)>maxshiftX) maxshiftX = maxshiftsX(i,j);
+      if(minshiftsY(i,j)<minshiftY) minshiftY = minshiftsY(i,j);
+      if(maxshiftsY(i,j)>maxshiftY) maxshiftY = maxshiftsY(i,j);
+    }
+
+  return doMatching(i1, i2, minshiftX, maxshiftX, minshiftY, maxshiftY, u1, v1, o1, u2, v2, o2);
+}
+
 #endif //__OVFLOWGLOBALMATCHERT_H
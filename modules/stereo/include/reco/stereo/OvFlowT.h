@@ -7,6 +7,10 @@
 #include "OvLocalMatcherT.h"
 #include "OvFlowGlobalMatcherT.h"
 #include "OvFlowPostprocessor.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
 
 
 ///Class for managing the execution of an optical flow algorithm.
@@ -83,6 +87,16 @@ public:
   */
   virtual void setFlowPostprocessorParams(int nparams, double*params);
 
+  /**
+  * Enables coarse-to-fine matching: the flow is first found on downsampled images, and each finer
+  * level only searches a band around the estimate of the coarser one (using the per-pixel ranges of
+  * the global flow matcher, see OvFlowGlobalMatcherT::doMatchingInRanges). Large motions can then be
+  * found without searching all of them at full resolution.
+  * @param nLevels number of pyramid levels, including the original images (1, the default, disables the pyramid)
+  * @param searchRadius the band extends this many pixels of the finer level beyond the coarser flow of the pixel and its neighbors
+  */
+  virtual void setPyramidParams(int nLevels, double searchRadius = 2);
+
   /**
   * Main method for computing optical flow on an image pair.
   * Note: This method modifies the input images, so be careful.
@@ -109,6 +123,13 @@ protected:
   OvLocalMatcherT<T>				*mLocalImageMatcher;		/**< Local image pair matcher */
   OvFlowGlobalMatcherT<T>			*mFlowGlobalMatcher;		/**< Global optical flow algorithm */
   OvFlowPostprocessor				*mFlowPostprocessor;	/**< Flow post processor */
+  int								mPyramidLevels;			/**< Number of coarse-to-fine levels */
+  double							mPyramidSearchRadius;	/**< Search band radius around coarser estimates */
+
+  /**
+  * Coarse-to-fine optical flow with the global flow matcher, see setPyramidParams.
+  */
+  virtual bool doPyramidMatching(OvImageT<T> & i1, OvImageT<T> & i2, double minshiftX, double maxshiftX, double minshiftY, double maxshiftY, OvImageT<double> & u1, OvImageT<double> & v1, OvImageT<double> & o1, OvImageT<double> & u2, OvImageT<double> & v2,  OvImageT<double> & o2);
 
   // The flags below are for marking whether the above variables are internally allocated.
   // In case they are, we are responsible for releasing them at destruction. 
@@ -121,7 +142,7 @@ protected:
 
 template<typename T>
 OvFlowT<T>::OvFlowT()
-: mImagePairPreprocessor(0), mLocalImageMatcher(0), mFlowGlobalMatcher(0), mFlowPostprocessor(0), 
+: mImagePairPreprocessor(0), mLocalImageMatcher(0), mFlowGlobalMatcher(0), mFlowPostprocessor(0), mPyramidLevels(1), mPyramidSearchRadius(2),
 isImagePairPreprocessorInternallyAllocated(false), isLocalImageMatcherInternallyAllocated(false), isFlowGlobalMatcherInternallyAllocated(false), isFlowPostprocessorInternallyAllocated(false)
 {
 }
@@ -183,6 +204,13 @@ void OvFlowT<T>::setFlowPostprocessorParams(int nparams, double*params)
   if(mFlowPostprocessor)mFlowPostprocessor->setParams(nparams, params);
 }
 
+template<typename T>
+void OvFlowT<T>::setPyramidParams(int nLevels, double searchRadius)
+{
+  mPyramidLevels = std::max(nLevels, 1);
+  mPyramidSearchRadius = std::max(searchRadius, 0.0);
+}
+
 template<typename T>
 bool OvFlowT<T>::doOpticalFlow(const OvImageAdapter & i1, const OvImageAdapter & i2, double minshiftX, double maxshiftX, double minshiftY, double maxshiftY, OvImageAdapter & u1, OvImageAdapter & v1, OvImageAdapter & o1, OvImageAdapter & u2, OvImageAdapter & v2,  OvImageAdapter & o2)
 {
@@ -191,12 +219,13 @@ bool OvFlowT<T>::doOpticalFlow(const OvImageAdapter & i1, const OvImageAdapter &
 
   mImage1.copyFromAdapter(i1);
   mImage2.copyFromAdapter(i2);
-  mU1.copyFromAdapter(u1);
-  mV1.copyFromAdapter(v1);
-  mO1.copyFromAdapter(o1);
-  mU2.copyFromAdapter(u2);
-  mV2.copyFromAdapter(v2);
-  mO2.copyFromAdapter(o2);
+  //the outputs are only sized here: the global matcher sets all their values
+  mU1.copyFromAdapter(u1, false);
+  mV1.copyFromAdapter(v1, false);
+  mO1.copyFromAdapter(o1, false);
+  mU2.copyFromAdapter(u2, false);
+  mV2.copyFromAdapter(v2, false);
+  mO2.copyFromAdapter(o2, false);
 
   if(!haveEqualDimensions(mImage1, mImage2)) return false; //return if images have different dimensions	
 
@@ -220,7 +249,8 @@ bool OvFlowT<T>::doOpticalFlow(const OvImageAdapter & i1, const OvImageAdapter &
   mFlowGlobalMatcher->setLocalImageMatcher(*mLocalImageMatcher); //tell global matcher about local matcher
 
   if(mImagePairPreprocessor)mImagePairPreprocessor->preProcessImagePair(mImage1, mImage2);
-  mFlowGlobalMatcher->doMatching(mImage1, mImage2, minshiftX, maxshiftX, minshiftY, maxshiftY, mU1, mV1, mO1, mU2, mV2, mO2);
+  if(mPyramidLevels>1) doPyramidMatching(mImage1, mImage2, minshiftX, maxshiftX, minshiftY, maxshiftY, mU1, mV1, mO1, mU2, mV2, mO2);
+  else mFlowGlobalMatcher->doMatching(mImage1, mImage2, minshiftX, maxshiftX, minshiftY, maxshiftY, mU1, mV1, mO1, mU2, mV2, mO2);
   if(mFlowPostprocessor)mFlowPostprocessor->postProcessFlow(mU1, mV1, mO1, mU2, mV2, mO2);
 
   mU1.copyToAdapter(u1);
@@ -233,4 +263,116 @@ bool OvFlowT<T>::doOpticalFlow(const OvImageAdapter & i1, const OvImageAdapter &
   return true;
 }
 
+template<typename T>
+bool OvFlowT<T>::doPyramidMatching(OvImageT<T> & i1, OvImageT<T> & i2, double minshiftX, double maxshiftX, double minshiftY, double maxshiftY, OvImageT<double> & u1, OvImageT<double> & v1, OvImageT<double> & o1, OvImageT<double> & u2, OvImageT<double> & v2,  OvImageT<double> & o2)
+{
+  const int minimumSize = 16; //levels are not made smaller than this many pixels across
+  int i, j, level, height, width;
+  double scale, levelMinshiftX, levelMaxshiftX, levelMinshiftY, levelMaxshiftY;
+
+  //levels 1 and up of the image pyramid
+  std::vector<OvImageT<T> > pyramid1, pyramid2;
+  pyramid1.reserve(mPyramidLevels);
+  pyramid2.reserve(mPyramidLevels);
+  const OvImageT<T> * coarsest1 = &i1, * coarsest2 = &i2;
+  while((static_cast<int>(pyramid1.size())+1<mPyramidLevels)&&(std::min(coarsest1->getHeight(), coarsest1->getWidth())>=2*minimumSize))
+  {
+    pyramid1.push_back(downsample2D(*coarsest1));
+    pyramid2.push_back(downsample2D(*coarsest2));
+    coarsest1 = &pyramid1.back();
+    coarsest2 = &pyramid2.back();
+  }
+
+  level = static_cast<int>(pyramid1.size());
+  if(level==0) return mFlowGlobalMatcher->doMatching(i1, i2, minshiftX, maxshiftX, minshiftY, maxshiftY, u1, v1, o1, u2, v2, o2);
+
+  //full search at the coarsest level
+  OvImageT<double> levelU1, levelV1, levelO1, levelU2, levelV2, levelO2;
+  height = pyramid1[level-1].getHeight();
+  width = pyramid1[level-1].getWidth();
+  levelU1.resetDimensions(height,width);
+  levelV1.resetDimensions(height,width);
+  levelO1.resetDimensions(height,width);
+  levelU2.resetDimensions(height,width);
+  levelV2.resetDimensions(height,width);
+  levelO2.resetDimensions(height,width);
+  scale = ldexp(1.0, level);
+  if(!mFlowGlobalMatcher->doMatching(pyramid1[level-1], pyramid2[level-1], floor(minshiftX/scale), ceil(maxshiftX/scale), floor(minshiftY/scale), ceil(maxshiftY/scale), 
+    levelU1, levelV1, levelO1, levelU2, levelV2, levelO2)) return false;
+
+  //finer levels only search around the coarser estimate
+  for(level=level-1; level>=0; level--)
+  {
+    OvImageT<T> & image1 = (level==0) ? i1 : pyramid1[level-1];
+    OvImageT<T> & image2 = (level==0) ? i2 : pyramid2[level-1];
+    height = image1.getHeight();
+    width = image1.getWidth();
+    scale = ldexp(1.0, level);
+    levelMinshiftX = (level==0) ? minshiftX : floor(minshiftX/scale);
+    levelMaxshiftX = (level==0) ? maxshiftX : ceil(maxshiftX/scale);
+    levelMinshiftY = (level==0) ? minshiftY : floor(minshiftY/scale);
+    levelMaxshiftY = (level==0) ? maxshiftY : ceil(maxshiftY/scale);
+
+    //occluded pixels have no estimate of their own: they take the median of the estimated pixels around them,
+    //growing inwards from the visible ones for a few passes (pixels still left search the full range)
+    const int fillPasses = 8;
+    OvImageT<double> estimated = (levelO1==0.0);
+    int unestimated = 0;
+    for(j=0; j<levelU1.getWidth(); j++)
+      for(i=0; i<levelU1.getHeight(); i++)
+      {
+        if(estimated(i,j)!=0) continue;
+        levelU1(i,j) = std::numeric_limits<double>::quiet_NaN();
+        levelV1(i,j) = std::numeric_limits<double>::quiet_NaN();
+        unestimated++;
+      }
+    for(int pass=0; (pass<fillPasses)&&(unestimated>0); pass++)
+    {
+      OvImageT<double> reached = maxFilter2D(estimated,3,3);
+      OvImageT<double> medianU1 = medianFilter2D(levelU1,3,3);
+      OvImageT<double> medianV1 = medianFilter2D(levelV1,3,3);
+      for(j=0; j<levelU1.getWidth(); j++)
+        for(i=0; i<levelU1.getHeight(); i++)
+        {
+          if((estimated(i,j)!=0)||(reached(i,j)==0)) continue;
+          levelU1(i,j) = medianU1(i,j);
+          levelV1(i,j) = medianV1(i,j);
+          unestimated--;
+        }
+      estimated = reached;
+    }
+    levelU1 = medianFilter2D(levelU1,3,3);
+    levelV1 = medianFilter2D(levelV1,3,3);
+    estimated = upsample2D(estimated, height, width);
+
+    //the band covers the coarser flow of the neighbors as well, so that pixels near motion boundaries can take either side
+    //(pixels without any visible pixel around search the full range)
+    OvImageT<double> minshiftsX = upsample2D(minFilter2D(levelU1,3,3), height, width)*2.0 - mPyramidSearchRadius;
+    OvImageT<double> maxshiftsX = upsample2D(maxFilter2D(levelU1,3,3), height, width)*2.0 + mPyramidSearchRadius;
+    OvImageT<double> minshiftsY = upsample2D(minFilter2D(levelV1,3,3), height, width)*2.0 - mPyramidSearchRadius;
+    OvImageT<double> maxshiftsY = upsample2D(maxFilter2D(levelV1,3,3), height, width)*2.0 + mPyramidSearchRadius;
+    for(j=0; j<width; j++)
+      for(i=0; i<height; i++)
+      {
+        bool hasEstimate = (estimated(i,j)!=0);
+        minshiftsX(i,j) = hasEstimate ? std::min(std::max(minshiftsX(i,j), levelMinshiftX), levelMaxshiftX) : levelMinshiftX;
+        maxshiftsX(i,j) = hasEstimate ? std::min(std::max(maxshiftsX(i,j), levelMinshiftX), levelMaxshiftX) : levelMaxshiftX;
+        minshiftsY(i,j) = hasEstimate ? std::min(std::max(minshiftsY(i,j), levelMinshiftY), levelMaxshiftY) : levelMinshiftY;
+        maxshiftsY(i,j) = hasEstimate ? std::min(std::max(maxshiftsY(i,j), levelMinshiftY), levelMaxshiftY) : levelMaxshiftY;
+      }
+
+    if(level==0) return mFlowGlobalMatcher->doMatchingInRanges(i1, i2, minshiftsX, maxshiftsX, minshiftsY, maxshiftsY, u1, v1, o1, u2, v2, o2);
+
+    levelU1.resetDimensions(height,width);
+    levelV1.resetDimensions(height,width);
+    levelO1.resetDimensions(height,width);
+    levelU2.resetDimensions(height,width);
+    levelV2.resetDimensions(height,width);
+    levelO2.resetDimensions(height,width);
+    if(!mFlowGlobalMatcher->doMatchingInRanges(image1, image2, minshiftsX, maxshiftsX, minshiftsY, maxshiftsY, levelU1, levelV1, levelO1, levelU2, levelV2, levelO2)) return false;
+  }
+
+  return true;
+}
+
 #endif //__OVFLOWT_H
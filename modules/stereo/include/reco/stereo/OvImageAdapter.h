@@ -74,6 +74,20 @@ public:
   */
   virtual void   setPixel(double value, int row, int column, int channel) = 0;
 
+  /**
+  * Gives direct access to the pixel buffer of the image, so that whole images can be imported
+  * and exported in one typed pass instead of a getPixel/setPixel call per value (see OvImageT::copyFromAdapter).
+  * The value at a particular row, column and color channel, of the type returned by getDataType, 
+  * starts at data + row*rowStep + column*columnStep + channel*channelStep.
+  * By default, no buffer is exposed.
+  * @param data start of the pixel buffer (the buffer belongs to the adapted image)
+  * @param rowStep distance between rows in bytes
+  * @param columnStep distance between columns in bytes
+  * @param channelStep distance between color channels in bytes
+  * @return true if the image can be accessed through its buffer, false if only through getPixel and setPixel.
+  */
+  virtual bool getDataLayout(unsigned char *& data, long & rowStep, long & columnStep, long & channelStep) const;
+
 protected:
   int  mHeight;			/**< height of the image */
   int  mWidth;			/**< width of the image */
@@ -0,0 +1,404 @@
+/*
+ * OvImageExpr.h
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: Gregory Kramida
+ *   Copyright: 2016 Gregory Kramida
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+#ifndef __OVIMAGEEXPR_H
+#define __OVIMAGEEXPR_H
+
+#include <cmath>
+#include <type_traits>
+
+template<typename T> class OvImageT;
+
+///Base class of per-pixel image expressions.
+/**
+* The arithmetic, comparison and logical operators and the elementwise math functions
+* (e.g., exp, abs, pow) on OvImageT do not compute their result right away. They return a
+* small expression object that refers to its operands, and the whole expression is evaluated
+* in a single pass, without temporary images, when it is assigned to an OvImageT (or used
+* to construct one).
+* <p>e.g.,
+* <pre>
+*    OvImageT<double> i1(100,100,1), i2(100,100,1), i3(100,100,1);
+*    i3 = exp(-0.5*(i1-i2)*(i1-i2)); //one traversal, no allocation since i3 has the right size
+* </pre>
+* Expressions keep references to the images they are built from, so they are meant to be
+* consumed within the statement that builds them.
+*
+* An expression E provides value_type, getHeight(), getWidth(), getNumChannels(), and:
+* <ul>
+* <li> evalAt(index): value at a linear (column-major) pixel index, assuming all operands
+*      have matching dimensions
+* <li> evalCheckedAt(index): same, but falling back to the behavior of the original
+*      operators for operands of different dimensions (the left operand for arithmetic,
+*      false for comparisons and logical operators)
+* <li> sizesMatch(): whether all operands have matching dimensions
+* </ul>
+*/
+template<typename E>
+class OvImageExpr
+{
+public:
+  const E & derived() const { return static_cast<const E &>(*this); }
+};
+
+/**
+* Images are held by reference inside expressions, sub-expressions by value.
+*/
+template<typename E>
+struct OvImageExprOperand
+{
+  typedef const E type;
+};
+
+template<typename T>
+struct OvImageExprOperand<OvImageT<T> >
+{
+  typedef const OvImageT<T> & type;
+};
+
+/**
+* Expression applying a binary operation to each pair of corresponding pixels of two expressions.
+*/
+template<typename Op, typename L, typename R>
+class OvImageBinaryExpr : public OvImageExpr<OvImageBinaryExpr<Op,L,R> >
+{
+public:
+  typedef typename Op::result_type value_type;
+
+  OvImageBinaryExpr(const L & i1, const R & i2) : mLeft(i1), mRight(i2)
+  {
+    static_assert(std::is_same<typename L::value_type, typename R::value_type>::value,
+        "operands of a binary image expression must have the same pixel type");
+  }
+
+  int getHeight() const { return mLeft.getHeight(); }
+  int getWidth() const { return mLeft.getWidth(); }
+  int getNumChannels() const { return mLeft.getNumChannels(); }
+
+  bool sizesMatch() const
+  {
+    return haveEqualOperandDimensions() && mLeft.sizesMatch() && mRight.sizesMatch();
+  }
+
+  value_type evalAt(int i) const
+  {
+    return Op::apply(mLeft.evalAt(i), mRight.evalAt(i));
+  }
+
+  value_type evalCheckedAt(int i) const
+  {
+    if(haveEqualOperandDimensions()) return Op::apply(mLeft.evalCheckedAt(i), mRight.evalCheckedAt(i));
+    return Op::mismatch(mLeft.evalCheckedAt(i));
+  }
+
+private:
+  bool haveEqualOperandDimensions() const
+  {
+    return (mLeft.getHeight()==mRight.getHeight()) && (mLeft.getWidth()==mRight.getWidth())
+      && (mLeft.getNumChannels()==mRight.getNumChannels());
+  }
+
+  typename OvImageExprOperand<L>::type mLeft;
+  typename OvImageExprOperand<R>::type mRight;
+};
+
+/**
+* Expression applying a binary operation to each pixel of an expression and a scalar.
+* ScalarFirst selects the order of the operands, e.g., 5-i1 vs. i1-5.
+*/
+template<typename Op, typename E, typename S, bool ScalarFirst>
+class OvImageScalarExpr : public OvImageExpr<OvImageScalarExpr<Op,E,S,ScalarFirst> >
+{
+public:
+  typedef typename Op::result_type value_type;
+
+  OvImageScalarExpr(const E & i1, S scalar) : mExpr(i1), mScalar(scalar) {}
+
+  int getHeight() const { return mExpr.getHeight(); }
+  int getWidth() const { return mExpr.getWidth(); }
+  int getNumChannels() const { return mExpr.getNumChannels(); }
+  bool sizesMatch() const { return mExpr.sizesMatch(); }
+
+  value_type evalAt(int i) const
+  {
+    return ScalarFirst ? Op::apply(mScalar, mExpr.evalAt(i)) : Op::apply(mExpr.evalAt(i), mScalar);
+  }
+
+  value_type evalCheckedAt(int i) const
+  {
+    return ScalarFirst ? Op::apply(mScalar, mExpr.evalCheckedAt(i)) : Op::apply(mExpr.evalCheckedAt(i), mScalar);
+  }
+
+private:
+  typename OvImageExprOperand<E>::type mExpr;
+  S mScalar;
+};
+
+/**
+* Expression applying a unary operation to each pixel of an expression.
+*/
+template<typename Op, typename E>
+class OvImageUnaryExpr : public OvImageExpr<OvImageUnaryExpr<Op,E> >
+{
+public:
+  typedef typename Op::result_type value_type;
+
+  explicit OvImageUnaryExpr(const E & i1) : mExpr(i1) {}
+
+  int getHeight() const { return mExpr.getHeight(); }
+  int getWidth() const { return mExpr.getWidth(); }
+  int getNumChannels() const { return mExpr.getNumChannels(); }
+  bool sizesMatch() const { return mExpr.sizesMatch(); }
+
+  value_type evalAt(int i) const { return Op::apply(mExpr.evalAt(i)); }
+  value_type evalCheckedAt(int i) const { return Op::apply(mExpr.evalCheckedAt(i)); }
+
+private:
+  typename OvImageExprOperand<E>::type mExpr;
+};
+
+//================================================== PER-PIXEL OPERATIONS ====================//
+
+//arithmetic: scalars are converted to the pixel type, images of different dimensions yield the left operand
+template<typename T> struct OvImagePlusOp
+{
+  typedef T result_type;
+  static T apply(T a, T b) { return a + b; }
+  static T mismatch(T a) { return a; }
+};
+template<typename T> struct OvImageMinusOp
+{
+  typedef T result_type;
+  static T apply(T a, T b) { return a - b; }
+  static T mismatch(T a) { return a; }
+};
+template<typename T> struct OvImageMultipliesOp
+{
+  typedef T result_type;
+  static T apply(T a, T b) { return a * b; }
+  static T mismatch(T a) { return a; }
+};
+template<typename T> struct OvImageDividesOp
+{
+  typedef T result_type;
+  static T apply(T a, T b) { return a / b; }
+  static T mismatch(T a) { return a; }
+};
+
+//comparisons: scalars are compared as doubles, images of different dimensions yield false
+#define OV_IMAGE_COMPARISON_OP(NAME, SYMBOL) \
+template<typename T> struct NAME \
+{ \
+  typedef bool result_type; \
+  template<typename A, typename B> static bool apply(A a, B b) { return a SYMBOL b; } \
+  static bool mismatch(T) { return false; } \
+};
+
+OV_IMAGE_COMPARISON_OP(OvImageLessOp, <)
+OV_IMAGE_COMPARISON_OP(OvImageLessEqualOp, <=)
+OV_IMAGE_COMPARISON_OP(OvImageGreaterOp, >)
+OV_IMAGE_COMPARISON_OP(OvImageGreaterEqualOp, >=)
+OV_IMAGE_COMPARISON_OP(OvImageEqualOp, ==)
+OV_IMAGE_COMPARISON_OP(OvImageLogicalAndOp, &&)
+OV_IMAGE_COMPARISON_OP(OvImageLogicalOrOp, ||)
+
+#undef OV_IMAGE_COMPARISON_OP
+
+template<typename T> struct OvImageNegateOp
+{
+  typedef T result_type;
+  static T apply(T a) { return -a; }
+};
+struct OvImageLogicalNotOp
+{
+  typedef bool result_type;
+  static bool apply(bool a) { return !a; }
+};
+
+//math functions, computed the same way as their standard counterparts on each pixel value
+#define OV_IMAGE_MATH_OP(NAME, EXPRESSION) \
+template<typename T> struct NAME \
+{ \
+  typedef T result_type; \
+  static T apply(T a) { return (T) (EXPRESSION); } \
+};
+
+OV_IMAGE_MATH_OP(OvImageCosOp, cos(a))
+OV_IMAGE_MATH_OP(OvImageSinOp, sin(a))
+OV_IMAGE_MATH_OP(OvImageTanOp, tan(a))
+OV_IMAGE_MATH_OP(OvImageAcosOp, acos(a))
+OV_IMAGE_MATH_OP(OvImageAsinOp, asin(a))
+OV_IMAGE_MATH_OP(OvImageAtanOp, atan(a))
+OV_IMAGE_MATH_OP(OvImageCoshOp, cosh(a))
+OV_IMAGE_MATH_OP(OvImageSinhOp, sinh(a))
+OV_IMAGE_MATH_OP(OvImageTanhOp, tanh(a))
+OV_IMAGE_MATH_OP(OvImageExpOp, exp(a))
+OV_IMAGE_MATH_OP(OvImageLogOp, log(a))
+OV_IMAGE_MATH_OP(OvImageLog10Op, log10(a))
+OV_IMAGE_MATH_OP(OvImageAbsOp, fabs(a))
+OV_IMAGE_MATH_OP(OvImageCeilOp, ceil(a))
+OV_IMAGE_MATH_OP(OvImageFloorOp, floor(a))
+OV_IMAGE_MATH_OP(OvImageSqrtOp, sqrt(a))
+
+#undef OV_IMAGE_MATH_OP
+
+//rounds halves down, i.e., to floor(a) whenever a-floor(a) <= 0.5
+template<typename T> struct OvImageRoundOp
+{
+  typedef T result_type;
+  static T apply(T a)
+  {
+    T tempValue = floor(a);
+    return (T) (((a-tempValue)<=0.5) ? tempValue : ceil(a));
+  }
+};
+
+template<typename T> struct OvImageAtan2Op
+{
+  typedef T result_type;
+  static T apply(T y, T x) { return (T) atan2(y,x); }
+  static T mismatch(T) { return (T) 0; }
+};
+template<typename T> struct OvImageModOp
+{
+  typedef T result_type;
+  static T apply(double a, double d) { return (T) fmod(a,d); }
+};
+template<typename T> struct OvImagePowOp
+{
+  typedef T result_type;
+  static T apply(double a, double p) { return (T) pow(a,p); }
+};
+
+//================================================== OPERATORS AND FUNCTIONS ====================//
+
+//image-image, scalar-image and image-scalar forms of an operator; S is the type scalars are converted to
+#define OV_IMAGE_BINARY_OPERATOR(SYMBOL, OP, S) \
+template<typename L, typename R> \
+inline OvImageBinaryExpr<OP<typename L::value_type>,L,R> operator SYMBOL (const OvImageExpr<L> & i1, const OvImageExpr<R> & i2) \
+{ \
+  return OvImageBinaryExpr<OP<typename L::value_type>,L,R>(i1.derived(), i2.derived()); \
+} \
+template<typename E> \
+inline OvImageScalarExpr<OP<typename E::value_type>,E,S,true> operator SYMBOL (const double i1, const OvImageExpr<E> & i2) \
+{ \
+  return OvImageScalarExpr<OP<typename E::value_type>,E,S,true>(i2.derived(), (S) i1); \
+} \
+template<typename E> \
+inline OvImageScalarExpr<OP<typename E::value_type>,E,S,false> operator SYMBOL (const OvImageExpr<E> & i1, const double i2) \
+{ \
+  return OvImageScalarExpr<OP<typename E::value_type>,E,S,false>(i1.derived(), (S) i2); \
+}
+
+OV_IMAGE_BINARY_OPERATOR(+, OvImagePlusOp, typename E::value_type)			/**< e.g., i1 = i2+i3; i1 = 5.2+i3; i1 = i2+5.2; */
+OV_IMAGE_BINARY_OPERATOR(-, OvImageMinusOp, typename E::value_type)			/**< e.g., i1 = i2-i3; i1 = 5.2-i3; i1 = i2-5.2; */
+OV_IMAGE_BINARY_OPERATOR(*, OvImageMultipliesOp, typename E::value_type)	/**< e.g., i1 = i2*i3; i1 = 10*i3; i1 = i2*10; */
+OV_IMAGE_BINARY_OPERATOR(/, OvImageDividesOp, typename E::value_type)		/**< e.g., i1 = i2/i3; i1 = 1/i3; i1 = i2/5; */
+OV_IMAGE_BINARY_OPERATOR(<, OvImageLessOp, double)							/**< e.g., iresult = i1<i2; iresult = 2<i2; iresult = i1<2; */
+OV_IMAGE_BINARY_OPERATOR(<=, OvImageLessEqualOp, double)					/**< e.g., iresult = i1<=i2; iresult = 2<=i2; iresult = i1<=2; */
+OV_IMAGE_BINARY_OPERATOR(>, OvImageGreaterOp, double)						/**< e.g., iresult = i1>i2; iresult = 2>i2; iresult = i1>2; */
+OV_IMAGE_BINARY_OPERATOR(>=, OvImageGreaterEqualOp, double)					/**< e.g., iresult = i1>=i2; iresult = 2>=i2; iresult = i1>=2; */
+OV_IMAGE_BINARY_OPERATOR(==, OvImageEqualOp, double)						/**< e.g., iresult = i1==i2; iresult = 2==i2; iresult = i1==2; */
+
+#undef OV_IMAGE_BINARY_OPERATOR
+
+//operations defined only on boolean images
+
+template<typename L, typename R>
+inline OvImageBinaryExpr<OvImageLogicalAndOp<bool>,L,R> operator && (const OvImageExpr<L> & i1, const OvImageExpr<R> & i2) /**< e.g., iflag1 = iflag2 && iflag3; */
+{
+  static_assert(std::is_same<typename L::value_type, bool>::value, "&& is defined only on boolean images");
+  return OvImageBinaryExpr<OvImageLogicalAndOp<bool>,L,R>(i1.derived(), i2.derived());
+}
+
+template<typename L, typename R>
+inline OvImageBinaryExpr<OvImageLogicalOrOp<bool>,L,R> operator || (const OvImageExpr<L> & i1, const OvImageExpr<R> & i2) /**< e.g., iflag1 = iflag2 || iflag3; */
+{
+  static_assert(std::is_same<typename L::value_type, bool>::value, "|| is defined only on boolean images");
+  return OvImageBinaryExpr<OvImageLogicalOrOp<bool>,L,R>(i1.derived(), i2.derived());
+}
+
+template<typename E>
+inline OvImageUnaryExpr<OvImageLogicalNotOp,E> operator ! (const OvImageExpr<E> & i1) /**< e.g., iflag1 = !iflag2; */
+{
+  static_assert(std::is_same<typename E::value_type, bool>::value, "! is defined only on boolean images");
+  return OvImageUnaryExpr<OvImageLogicalNotOp,E>(i1.derived());
+}
+
+template<typename E>
+inline OvImageUnaryExpr<OvImageNegateOp<typename E::value_type>,E> operator - (const OvImageExpr<E> & i1) /**< e.g., i1 = -i2; */
+{
+  return OvImageUnaryExpr<OvImageNegateOp<typename E::value_type>,E>(i1.derived());
+}
+
+//math functions
+#define OV_IMAGE_MATH_FUNCTION(NAME, OP) \
+template<typename E> \
+inline OvImageUnaryExpr<OP<typename E::value_type>,E> NAME (const OvImageExpr<E> & i1) \
+{ \
+  return OvImageUnaryExpr<OP<typename E::value_type>,E>(i1.derived()); \
+}
+
+OV_IMAGE_MATH_FUNCTION(cos, OvImageCosOp)		/**< e.g., i2 = cos(i1); */
+OV_IMAGE_MATH_FUNCTION(sin, OvImageSinOp)		/**< e.g., i2 = sin(i1); */
+OV_IMAGE_MATH_FUNCTION(tan, OvImageTanOp)		/**< e.g., i2 = tan(i1); */
+OV_IMAGE_MATH_FUNCTION(acos, OvImageAcosOp)		/**< e.g., i2 = acos(i1); */
+OV_IMAGE_MATH_FUNCTION(asin, OvImageAsinOp)		/**< e.g., i2 = asin(i1); */
+OV_IMAGE_MATH_FUNCTION(atan, OvImageAtanOp)		/**< e.g., i2 = atan(i1); */
+OV_IMAGE_MATH_FUNCTION(cosh, OvImageCoshOp)		/**< e.g., i2 = cosh(i1); */
+OV_IMAGE_MATH_FUNCTION(sinh, OvImageSinhOp)		/**< e.g., i2 = sinh(i1); */
+OV_IMAGE_MATH_FUNCTION(tanh, OvImageTanhOp)		/**< e.g., i2 = tanh(i1); */
+OV_IMAGE_MATH_FUNCTION(exp, OvImageExpOp)		/**< e.g., i2 = exp(i1); */
+OV_IMAGE_MATH_FUNCTION(log, OvImageLogOp)		/**< e.g., i2 = log(i1); */
+OV_IMAGE_MATH_FUNCTION(log10, OvImageLog10Op)	/**< e.g., i2 = log10(i1); */
+OV_IMAGE_MATH_FUNCTION(abs, OvImageAbsOp)		/**< e.g., i2 = abs(i1); */
+OV_IMAGE_MATH_FUNCTION(ceil, OvImageCeilOp)		/**< e.g., i2 = ceil(i1); */
+OV_IMAGE_MATH_FUNCTION(floor, OvImageFloorOp)	/**< e.g., i2 = floor(i1); */
+OV_IMAGE_MATH_FUNCTION(round, OvImageRoundOp)	/**< e.g., i2 = round(i1); */
+OV_IMAGE_MATH_FUNCTION(sqrt, OvImageSqrtOp)		/**< e.g., i2 = sqrt(i1); */
+
+#undef OV_IMAGE_MATH_FUNCTION
+
+template<typename L, typename R>
+inline OvImageBinaryExpr<OvImageAtan2Op<typename L::value_type>,L,R> atan2 (const OvImageExpr<L> & iy, const OvImageExpr<R> & ix) /**< e.g., i2 = atan2(iy,ix); */
+{
+  return OvImageBinaryExpr<OvImageAtan2Op<typename L::value_type>,L,R>(iy.derived(), ix.derived());
+}
+
+template<typename E>
+inline OvImageScalarExpr<OvImageModOp<typename E::value_type>,E,double,false> mod (const OvImageExpr<E> & i1, double d) /**< e.g., i2 = mod(i1,5); */
+{
+  return OvImageScalarExpr<OvImageModOp<typename E::value_type>,E,double,false>(i1.derived(), d);
+}
+
+template<typename E>
+inline OvImageScalarExpr<OvImagePowOp<typename E::value_type>,E,double,false> pow (const OvImageExpr<E> & i1, double p) /**< e.g., i2 = pow(i1,2); */
+{
+  return OvImageScalarExpr<OvImagePowOp<typename E::value_type>,E,double,false>(i1.derived(), p);
+}
+
+template<typename E>
+inline OvImageScalarExpr<OvImagePowOp<typename E::value_type>,E,double,true> pow (double p, const OvImageExpr<E> & i1) /**< e.g., i2 = pow(3,i1); */
+{
+  return OvImageScalarExpr<OvImagePowOp<typename E::value_type>,E,double,true>(i1.derived(), p);
+}
+
+#endif //__OVIMAGEEXPR_H
@@ -2,11 +2,17 @@
 #ifndef __OVIMAGET_H
 #define __OVIMAGET_H
 
+#include <algorithm>
 #include <cmath>
 #include <cstdlib>
 #include <cstdio>
 #include <iostream>
+#include <limits>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include "OvImageAdapter.h"
+#include "OvImageExpr.h"
 
 ///Internal image class with overloaded math operators and utility functions.
 /** 
@@ -20,15 +26,18 @@
 * @author Abhijit Ogale
 */
 template<typename T>
-class OvImageT
+class OvImageT : public OvImageExpr<OvImageT<T> >
 {
 public:
+  typedef T value_type;
 
   //constructors and destructors
   OvImageT(); //create empty image
   OvImageT(int height, int width, int nColorChannels);  //create image of given dimensions
   OvImageT(const OvImageT<T>& srcImage, bool CopyData=true); //create image with same size as input image, with the option of copying data
   template<typename C> OvImageT(const OvImageT<C>& srcImage, bool CopyData=true); //create image with same size as an input image of a different type (i.e., int, float, etc.), with the option of copying data
+  OvImageT(OvImageT<T>&& srcImage); //take over the data of a temporary image
+  template<typename E> OvImageT(const OvImageExpr<E>& expression); //create image holding the evaluated expression (e.g., OvImageT<float> i1 = i2*i3; )
   virtual ~OvImageT();
 
   void getDimensions(int & height, int & width, int & nColorChannels) const; //get image size
@@ -49,9 +58,16 @@ public:
   OvImageT<T>& operator = (const OvImageT<T> & rhsImage); //assignment operator (e.g., i1 = i2; )
   OvImageT<T>& operator = (const T & rhs); //assignment operator with scalar rhs (e.g., i1 = 5.2; )
   template <typename C> OvImageT<T>& operator = (const OvImageT<C> & rhsImage); //convert from one template type to another (e.g., float to int)
+  OvImageT<T>& operator = (OvImageT<T> && rhsImage); //move assignment operator (e.g., i1 = shiftImageXY(i2,1); )
+  template <typename E> OvImageT<T>& operator = (const OvImageExpr<E> & expression); //evaluate expression into image (e.g., i1 = i2+i3; )
+
+  //per-pixel access used by expressions
+  inline T evalAt(int index) const { return mData[index]; }
+  inline T evalCheckedAt(int index) const { return mData[index]; }
+  inline bool sizesMatch() const { return true; }
 
   //special copying methods
-  bool copyFromAdapter(const OvImageAdapter & iadapter); //import values from OvImageAdapter
+  bool copyFromAdapter(const OvImageAdapter & iadapter, bool copyValues = true); //import values (or only dimensions) from OvImageAdapter
   bool copyToAdapter(OvImageAdapter & iadapter); //export values to OvImageAdapter if it has same dimensions
   bool copyMasked(const OvImageT<bool> & mask, const OvImageT<T> & srcImage); //copy values from srcImage only for pixels where mask is set to true
   bool copyMasked(const OvImageT<bool> & mask, const T & value); //set pixels = value only where mask is set to true
@@ -59,7 +75,7 @@ public:
   //bool copyRegion(const T & value, int rowLo=-1, int rowHi=-1, int columnLo=-1, int columnHi=-1, int channelLo=-1, int channelHi=-1);
   //bool copyRegionEx(const T & value, int rowLo=-1, int rowHi=-1, int columnLo=-1, int columnHi=-1, int channelLo=-1, int channelHi=-1);	
 
-  const OvImageT<T> getSubImage(int rowLo=-1, int rowHi=-1, int columnLo=-1, int columnHi=-1, int channelLo=-1, int channelHi=-1); //copy and return rectangular image block
+  OvImageT<T> getSubImage(int rowLo=-1, int rowHi=-1, int columnLo=-1, int columnHi=-1, int channelLo=-1, int channelHi=-1); //copy and return rectangular image block
 
   //arithmetic operators 
   OvImageT<T> & operator += (const OvImageT<T> & rhs);	/**< e.g., i1 += i2;*/
@@ -70,82 +86,30 @@ public:
   OvImageT<T> & operator *= (const T & rhs);				/**< e.g., i1 *= 2;*/
   OvImageT<T> & operator /= (const OvImageT<T> & rhs);	/**< e.g., i1 /= i2;*/
   OvImageT<T> & operator /= (const T & rhs);				/**< e.g., i1 /= 10;*/
+  template<typename E> OvImageT<T> & operator += (const OvImageExpr<E> & rhs);	/**< e.g., i1 += i2*i3;*/
+  template<typename E> OvImageT<T> & operator -= (const OvImageExpr<E> & rhs);	/**< e.g., i1 -= i2*i3;*/
+  template<typename E> OvImageT<T> & operator *= (const OvImageExpr<E> & rhs);	/**< e.g., i1 *= i2+i3;*/
+  template<typename E> OvImageT<T> & operator /= (const OvImageExpr<E> & rhs);	/**< e.g., i1 /= i2+i3;*/
 
   OvImageT<T> & operator ++ (); 							/**< e.g., ++i1;*/
   OvImageT<T> & operator -- ();							/**< e.g., --i1;*/
   const OvImageT<T> operator ++ (int); 					/**< e.g., i1++;*/
   const OvImageT<T> operator -- (int);					/**< e.g., i1--;*/
 
-  const OvImageT<T> operator - (); 						/**< e.g., i1 = -i2;*/
-  const OvImageT<T> operator + ();						/**< e.g., i1 = +i2;*/
-
-  template<typename C> friend const OvImageT<C> operator + (const OvImageT<C> & i1, const OvImageT<C> & i2);  /**< e.g., i1 = i2+i3; */
-  template<typename C> friend const OvImageT<C> operator + (const double i1, const OvImageT<C> & i2);			/**< e.g., i1 = 5.2+i3; */
-  template<typename C> friend const OvImageT<C> operator + (const OvImageT<C> & i1, const double i2);			/**< e.g., i1 = i2+5.2; */
-  template<typename C> friend const OvImageT<C> operator - (const OvImageT<C> & i1, const OvImageT<C> & i2);	/**< e.g., i1 = i2-i3; */
-  template<typename C> friend const OvImageT<C> operator - (const double i1, const OvImageT<C> & i2);			/**< e.g., i1 = 5.2-i3; */
-  template<typename C> friend const OvImageT<C> operator - (const OvImageT<C> & i1, const double i2);			/**< e.g., i1 = i2-5.2; */
-  template<typename C> friend const OvImageT<C> operator * (const OvImageT<C> & i1, const OvImageT<C> & i2);	/**< e.g., i1 = i2*i3; */
-  template<typename C> friend const OvImageT<C> operator * (const double i1, const OvImageT<C> & i2);			/**< e.g., i1 = 10*i3; */
-  template<typename C> friend const OvImageT<C> operator * (const OvImageT<C> & i1, const double i2);			/**< e.g., i1 = i2*10; */
-  template<typename C> friend const OvImageT<C> operator / (const OvImageT<C> & i1, const OvImageT<C> & i2);  /**< e.g., i1 = i2/i3; */
-  template<typename C> friend const OvImageT<C> operator / (const double i1, const OvImageT<C> & i2);			/**< e.g., i1 = 1/i3; */
-  template<typename C> friend const OvImageT<C> operator / (const OvImageT<C> & i1, const double i2);			/**< e.g., i1 = i2/5; */
-
-  //logical operators
-  template<typename C> friend const OvImageT<bool> operator < (const OvImageT<C> & i1, const OvImageT<C> & i2);	/**< e.g., iresult = i1<i2; */
-  template<typename C> friend const OvImageT<bool> operator < (const double i1, const OvImageT<C> & i2);			/**< e.g., iresult = 2<i2; */
-  template<typename C> friend const OvImageT<bool> operator < (const OvImageT<C> & i1, const double i2);			/**< e.g., iresult = i1<2; */
-  template<typename C> friend const OvImageT<bool> operator <= (const OvImageT<C> & i1, const OvImageT<C> & i2);	/**< e.g., iresult = i1<=i2; */
-  template<typename C> friend const OvImageT<bool> operator <= (const double i1, const OvImageT<C> & i2);			/**< e.g., iresult = 2<=i2; */
-  template<typename C> friend const OvImageT<bool> operator <= (const OvImageT<C> & i1, const double i2);			/**< e.g., iresult = i1<=2; */
-  template<typename C> friend const OvImageT<bool> operator > (const OvImageT<C> & i1, const OvImageT<C> & i2);	/**< e.g., iresult = i1>i2; */
-  template<typename C> friend const OvImageT<bool> operator > (const double i1, const OvImageT<C> & i2);			/**< e.g., iresult = 2>i2; */
-  template<typename C> friend const OvImageT<bool> operator > (const OvImageT<C> & i1, const double i2);			/**< e.g., iresult = i1>2; */
-  template<typename C> friend const OvImageT<bool> operator >= (const OvImageT<C> & i1, const OvImageT<C> & i2);	/**< e.g., iresult = i1>=i2; */
-  template<typename C> friend const OvImageT<bool> operator >= (const double i1, const OvImageT<C> & i2);			/**< e.g., iresult = 2>=i2; */
-  template<typename C> friend const OvImageT<bool> operator >= (const OvImageT<C> & i1, const double i2);			/**< e.g., iresult = i1>=2; */
-  template<typename C> friend const OvImageT<bool> operator == (const OvImageT<C> & i1, const OvImageT<C> & i2);	/**< e.g., iresult = i1==i2; */
-  template<typename C> friend const OvImageT<bool> operator == (const double i1, const OvImageT<C> & i2);			/**< e.g., iresult = 2==i2; */
-  template<typename C> friend const OvImageT<bool> operator == (const OvImageT<C> & i1, const double i2);			/**< e.g., iresult = i1==2; */
-
-  //operations defined only on boolean images
-  const OvImageT<bool> operator ! () const; /**< e.g., iflag1 = !iflag2; */
-  friend const OvImageT<bool> operator && (const OvImageT<bool> & i1, const OvImageT<bool> & i2); /**< e.g., iflag1 = iflag2 && iflag3; */
-  friend const OvImageT<bool> operator || (const OvImageT<bool> & i1, const OvImageT<bool> & i2); /**< e.g., iflag1 = iflag2 || iflag3; */
-
-  //math functions
-  template<typename C> friend const OvImageT<C> cos (const OvImageT<C> & i1);	/**< e.g., i2 = cos(i1); */
-  template<typename C> friend const OvImageT<C> sin (const OvImageT<C> & i1);	/**< e.g., i2 = sin(i1); */
-  template<typename C> friend const OvImageT<C> tan (const OvImageT<C> & i1);	/**< e.g., i2 = tan(i1); */
-  template<typename C> friend const OvImageT<C> acos (const OvImageT<C> & i1);	/**< e.g., i2 = acos(i1); */
-  template<typename C> friend const OvImageT<C> asin (const OvImageT<C> & i1);	/**< e.g., i2 = asin(i1); */
-  template<typename C> friend const OvImageT<C> atan (const OvImageT<C> & i1);	/**< e.g., i2 = atan(i1); */
-  template<typename C> friend const OvImageT<C> atan2 (const OvImageT<C> & iy, const OvImageT<C> & ix); /**< e.g., i2 = atan2(iy,ix); */
-  template<typename C> friend const OvImageT<C> cosh (const OvImageT<C> & i1);	/**< e.g., i2 = cosh(i1); */
-  template<typename C> friend const OvImageT<C> sinh (const OvImageT<C> & i1);	/**< e.g., i2 = sinh(i1); */
-  template<typename C> friend const OvImageT<C> tanh (const OvImageT<C> & i1);	/**< e.g., i2 = tang(i1); */
-  template<typename C> friend const OvImageT<C> exp (const OvImageT<C> & i1);		/**< e.g., i2 = exp(i1); */
-  template<typename C> friend const OvImageT<C> log (const OvImageT<C> & i1);		/**< e.g., i2 = log(i1); */
-  template<typename C> friend const OvImageT<C> log10 (const OvImageT<C> & i1);	/**< e.g., i2 = log10(i1); */
-  template<typename C> friend const OvImageT<C> abs (const OvImageT<C> & i1);		/**< e.g., i2 = abs(i1); */
-  template<typename C> friend const OvImageT<C> ceil (const OvImageT<C> & i1);	/**< e.g., i2 = ceil(i1); */
-  template<typename C> friend const OvImageT<C> floor (const OvImageT<C> & i1);	/**< e.g., i2 = floor(i1); */
-  template<typename C> friend const OvImageT<C> round (const OvImageT<C> & i1);	/**< e.g., i2 = round(i1); */
-  template<typename C> friend const OvImageT<C> mod (const OvImageT<C> & i1, double d);	/**< e.g., i2 = mod(i1,5); */
-  template<typename C> friend const OvImageT<C> pow (const OvImageT<C> & i1, double p);	/**< e.g., i2 = pow(i1,2); */
-  template<typename C> friend const OvImageT<C> pow (double p, const OvImageT<C> & i1);	/**< e.g., i2 = pow(3,i1); */
-  template<typename C> friend const OvImageT<C> sqrt (const OvImageT<C> & i1);			/**< e.g., i2 = sqrt(i1); */
+  OvImageT<T> operator + ();						/**< e.g., i1 = +i2;*/
+
+  //per-pixel arithmetic, comparison and logical operators and math functions (e.g., i1 = exp(-i2*i3);)
+  //build expressions that are evaluated in one pass on assignment, see OvImageExpr.h
 
   //filtering, convolution, and other utility functions
-  template<typename C> friend const OvImageT<C> convolve2D (const OvImageT<C> & ikernel, const OvImageT<C> & input);	//2D convolution
-  template<typename C> friend const OvImageT<C> filter2D (const OvImageT<C> & ikernel, const OvImageT<C> & input);	//2D filtering
+  template<typename C> friend OvImageT<C> convolve2D (const OvImageT<C> & ikernel, const OvImageT<C> & input);	//2D convolution
+  template<typename C> friend OvImageT<C> filter2D (const OvImageT<C> & ikernel, const OvImageT<C> & input);	//2D filtering
   //need to implement separable versions for greater speed with separable filters
 
-  template<typename C> friend const OvImageT<C> medianFilter2D (const OvImageT<C> & input, int filterHeight, int filterWidth); //median filter
-  template<typename C> friend const OvImageT<C> minFilter2D (const OvImageT<C> & input, int filterHeight, int filterWidth);	 //minimum filter
-  template<typename C> friend const OvImageT<C> maxFilter2D (const OvImageT<C> & input, int filterHeight, int filterWidth);	 //maximum filter
-  template<typename C> friend const OvImageT<C> meanFilter2D (const OvImageT<C> & input, int filterHeight, int filterWidth);	 //mean filter
+  template<typename C> friend OvImageT<C> medianFilter2D (const OvImageT<C> & input, int filterHeight, int filterWidth); //median filter
+  template<typename C> friend OvImageT<C> minFilter2D (const OvImageT<C> & input, int filterHeight, int filterWidth);	 //minimum filter
+  template<typename C> friend OvImageT<C> maxFilter2D (const OvImageT<C> & input, int filterHeight, int filterWidth);	 //maximum filter
+  template<typename C> friend OvImageT<C> meanFilter2D (const OvImageT<C> & input, int filterHeight, int filterWidth);	 //mean filter
 
 
   //sum pixels in a rectangular image region
@@ -155,37 +119,39 @@ public:
   template<typename C> friend C L1Norm(const OvImageT<C> & input); //sum of absolute values of all pixels
   template<typename C> friend C L2Norm(const OvImageT<C> & input); //sqrt of sum of squared pixel values
 
-  template<typename C> friend const OvImageT<C> transpose(const OvImageT<C> & input); //transpose image (each color channel independently)
-  template<typename C> friend const OvImageT<C> flipLR(const OvImageT<C> & input); //flip image left to right (i.e., about vertical axis)
-  template<typename C> friend const OvImageT<C> flipUD(const OvImageT<C> & input); //flip image upside-down (i.e., about horizontal axis)
+  template<typename C> friend OvImageT<C> transpose(const OvImageT<C> & input); //transpose image (each color channel independently)
+  template<typename C> friend OvImageT<C> flipLR(const OvImageT<C> & input); //flip image left to right (i.e., about vertical axis)
+  template<typename C> friend OvImageT<C> flipUD(const OvImageT<C> & input); //flip image upside-down (i.e., about horizontal axis)
+  template<typename C> friend OvImageT<C> downsample2D(const OvImageT<C> & input); //halve image size by averaging 2x2 blocks
+  template<typename C> friend OvImageT<C> upsample2D(const OvImageT<C> & input, int height, int width); //double image size by pixel replication, to a given size
 
 
   //methods to create specific images and kernels	and their standalone friend versions
   void setToRandom(double lowerbound, double upperbound); //fill caller with random numbers
-  friend const OvImageT<double> random(double lowerbound, double upperbound, int height, int width, int nColorChannels); //create new image filled with random numbers
+  friend OvImageT<double> random(double lowerbound, double upperbound, int height, int width, int nColorChannels); //create new image filled with random numbers
 
   void setToMeshgridX (T x1, T x2, T y1, T y2, T dx = 1, T dy = 1); //set caller to an image of height y2-y1+1 and width x2-x1+1 with each pixel set to its x-coordinate (from x1 to x2)
-  friend const OvImageT<double> meshgridX (double x1, double x2, double y1, double y2, double dx, double dy); //create new image of height y2-y1+1 and width x2-x1+1 with each pixel set to its x-coordinate (from x1 to x2)
+  friend OvImageT<double> meshgridX (double x1, double x2, double y1, double y2, double dx, double dy); //create new image of height y2-y1+1 and width x2-x1+1 with each pixel set to its x-coordinate (from x1 to x2)
 
   void setToMeshgridY (T x1, T x2, T y1, T y2, T dx = 1, T dy = 1); //set caller to an image of height y2-y1+1 and width x2-x1+1 with each pixel set to its y-coordinate (from y1 to y2)
-  friend const OvImageT<double> meshgridY (double x1, double x2, double y1, double y2, double dx, double dy); //create new image of height y2-y1+1 and width x2-x1+1 with each pixel set to its y-coordinate (from y1 to y2)
+  friend OvImageT<double> meshgridY (double x1, double x2, double y1, double y2, double dx, double dy); //create new image of height y2-y1+1 and width x2-x1+1 with each pixel set to its y-coordinate (from y1 to y2)
 
   void setToGaussian(int size, double sigma);	 //set caller to a gaussian
-  friend const OvImageT<double> gaussian(int size, double sigma);	 //create a new gaussian
+  friend OvImageT<double> gaussian(int size, double sigma);	 //create a new gaussian
 
   void setToGaborX(int size, double sigma, double period, double phaseshift=0);	//set caller to a gabor filter oriented horizontally
-  friend const OvImageT<double> gaborX(int size, double sigma, double period, double phaseshift);	//create a gabor filter oriented horizontally
+  friend OvImageT<double> gaborX(int size, double sigma, double period, double phaseshift);	//create a gabor filter oriented horizontally
 
   void setToGaborY(int size, double sigma, double period, double phaseshift=0);	//set caller to a gabor filter oriented vertically
-  friend const OvImageT<double> gaborY(int size, double sigma, double period, double phaseshift);	//create a gabor filter oriented vertically
+  friend OvImageT<double> gaborY(int size, double sigma, double period, double phaseshift);	//create a gabor filter oriented vertically
 
   void setToGaborOriented(int size, double sigma, double period, double angle, double phaseshift=0); //set caller to a gabor filter with a user-specified orientation
-  friend const OvImageT<double> gaborOriented(int size, double sigma, double period, double angle, double phaseshift);	//create a gabor filter with a user-specified orientation
+  friend OvImageT<double> gaborOriented(int size, double sigma, double period, double angle, double phaseshift);	//create a gabor filter with a user-specified orientation
 
   OvImageT<double> getGaborPhaseStack();
 
   void setToGray();	//convert caller to gray image (single channel)
-  template<typename C> friend const OvImageT<C> rgb2gray(const OvImageT<C> & input);	 //convert color image (multiple channels) to gray image (single channel)
+  template<typename C> friend OvImageT<C> rgb2gray(const OvImageT<C> & input);	 //convert color image (multiple channels) to gray image (single channel)
 
   template<typename C> friend bool haveEqualDimensions (const OvImageT<C> & i1, const OvImageT<C> & i2); // Returns true if the two input images have the same height, width and channels
   template<typename C> friend bool haveEqualHeightWidth (const OvImageT<C> & i1, const OvImageT<C> & i2); // Returns true if the two input images have the same height and width, ignores number of channels
@@ -197,6 +163,11 @@ public:
 
 
 protected:
+  template<typename E> void evaluate(const E & expression); //evaluate expression into image, reallocating only if its size differs
+  template<typename Op, typename E> void update(const E & expression); //apply Op in place to the image and an expression of the same dimensions
+  bool copyBuffer(OvImageAdapter::OvDataType dataType, unsigned char * data, long rowStep, long columnStep, long channelStep, bool toBuffer); //bulk import/export through an adapter's pixel buffer
+  template<typename S> void copyBufferT(unsigned char * data, long rowStep, long columnStep, long channelStep, bool toBuffer); //copyBuffer for buffer type S
+
   int  mHeight;			/**<height of the image*/
   int  mWidth;			/**<width of the image*/
   int  mChannels;			/**<number of color channels or dimensions (e.g., 1 for grayscale, 3 for RGB)*/
@@ -212,20 +183,20 @@ protected:
 
 
 //max along a certain dimension (1,2,3 = height, width, or color respectively), e.g., i1 = max(i2,3); returns image with same height and width but 1 color channel
-template<typename C> const OvImageT<C> max(const OvImageT<C> & input, int dimension  = 3);
+template<typename C> OvImageT<C> max(const OvImageT<C> & input, int dimension  = 3);
 //mean along a certain dimension (1,2,3 = height, width, or color respectively), e.g., i1 = mean(i2,3); returns image with same height and width but 1 color channel
-template<typename C> const OvImageT<C> mean(const OvImageT<C> & input, int dimension = 3);
+template<typename C> OvImageT<C> mean(const OvImageT<C> & input, int dimension = 3);
 //min along a certain dimension (1,2,3 = height, width, or color respectively), e.g., i1 = min(i2,3); returns image with same height and width but 1 color channel
-template<typename C> const OvImageT<C> min(const OvImageT<C> & input, int dimension = 3);
+template<typename C> OvImageT<C> min(const OvImageT<C> & input, int dimension = 3);
 
 //tile input image 'height' times vertically, 'width' times horizontally, and 'channels' times along color channels
-template<typename C> const OvImageT<C> repmat (const OvImageT<C> & input, int height=1, int width=1, int channels=1);
+template<typename C> OvImageT<C> repmat (const OvImageT<C> & input, int height=1, int width=1, int channels=1);
 //return copy of input image translated by (rows, columns)
-template<typename C> const OvImageT<C> shiftImageXY (const OvImageT<C> & input, int columns=0, int rows=0);
+template<typename C> OvImageT<C> shiftImageXY (const OvImageT<C> & input, int columns=0, int rows=0);
 //rescale image using nearest neighbor method; use preSmooth to enable resampling
-template<typename C> const OvImageT<C> resizeNearestNbr(const OvImageT<C> & input, double scale, bool preSmooth = false);
+template<typename C> OvImageT<C> resizeNearestNbr(const OvImageT<C> & input, double scale, bool preSmooth = false);
 //rescale image using bilinear interpolation method; use preSmooth to enable resampling
-template<typename C> const OvImageT<C> resizeBilinear(const OvImageT<C> & input, double scale, bool preSmooth = false);
+template<typename C> OvImageT<C> resizeBilinear(const OvImageT<C> & input, double scale, bool preSmooth = false);
 
 //================================================================================================//
 
@@ -233,7 +204,33 @@ template<typename C> const OvImageT<C> resizeBilinear(const OvImageT<C> & input,
  /// @param input
  /// @param dimension 1,2,3 = height, width, or color respectively
  /// @return sum along a certain dimension (1,2,3 = height, width, or color respectively)
-template<typename C> const OvImageT<C> sum(const OvImageT<C> & input, int dimension = 3);
+template<typename C> OvImageT<C> sum(const OvImageT<C> & input, int dimension = 3);
+
+//versions of the above taking per-pixel expressions, which are evaluated first (e.g., i1 = mean(abs(i2-i3),3); )
+template<typename E> OvImageT<typename E::value_type> max(const OvImageExpr<E> & input, int dimension = 3)
+{
+  return max(OvImageT<typename E::value_type>(input), dimension);
+}
+template<typename E> OvImageT<typename E::value_type> mean(const OvImageExpr<E> & input, int dimension = 3)
+{
+  return mean(OvImageT<typename E::value_type>(input), dimension);
+}
+template<typename E> OvImageT<typename E::value_type> min(const OvImageExpr<E> & input, int dimension = 3)
+{
+  return min(OvImageT<typename E::value_type>(input), dimension);
+}
+template<typename E> OvImageT<typename E::value_type> sum(const OvImageExpr<E> & input, int dimension = 3)
+{
+  return sum(OvImageT<typename E::value_type>(input), dimension);
+}
+template<typename E> OvImageT<typename E::value_type> repmat(const OvImageExpr<E> & input, int height=1, int width=1, int channels=1)
+{
+  return repmat(OvImageT<typename E::value_type>(input), height, width, channels);
+}
+template<typename E> OvImageT<typename E::value_type> shiftImageXY(const OvImageExpr<E> & input, int columns=0, int rows=0)
+{
+  return shiftImageXY(OvImageT<typename E::value_type>(input), columns, rows);
+}
 
 /**  Rounds to nearest integer
 * @param value	input value
@@ -244,6 +241,18 @@ inline int ov_round(double value)
   return int(value + 0.5);
 }
 
+/**  Number of threads available to the parallel loops of the library
+* @return the thread count (1 if built without OpenMP)
+*/
+inline int ov_thread_count()
+{
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
 /** 
 * Constructor with no parameters to create empty image.
 * @see OvImageT(int height, int width, int nColorChannels)
@@ -407,6 +416,41 @@ OvImageT<T>::OvImageT(const OvImageT<C>& srcImage, bool copyData)
   }
 }
 
+/** 
+* Move constructor takes over the data of a temporary image (e.g., one returned by a function) without copying it.
+* 
+* @param srcImage source image, left empty
+*/
+template<typename T>
+OvImageT<T>::OvImageT(OvImageT<T>&& srcImage)
+: mHeight(srcImage.mHeight), mWidth(srcImage.mWidth), mChannels(srcImage.mChannels), mHeightTimesWidth(srcImage.mHeightTimesWidth), mSize(srcImage.mSize), mData(srcImage.mData)
+{
+  srcImage.mHeight = 0;
+  srcImage.mWidth = 0;
+  srcImage.mChannels = 0;
+  srcImage.mHeightTimesWidth = 0;
+  srcImage.mSize = 0;
+  srcImage.mData = 0;
+}
+
+/** 
+* Constructor creating an image holding the value of a per-pixel expression, evaluated in one pass.
+* <p>e.g., 
+* <pre>
+*   OvImageT<double> i1(2,3,1), i2(2,3,1);
+*   OvImageT<double> i3 = exp(i1-i2);
+* </pre>
+*
+* @param expression expression built from images, scalars, operators and math functions (see OvImageExpr)
+*/
+template<typename T>
+template<typename E>
+OvImageT<T>::OvImageT(const OvImageExpr<E>& expression)
+: mHeight(0), mWidth(0), mChannels(0), mHeightTimesWidth(0), mSize(0), mData(0)
+{
+  evaluate(expression.derived());
+}
+
 /** 
 * Destructor of OvImageT.
 */
@@ -418,7 +462,10 @@ OvImageT<T>::~OvImageT()
 
 /**
 * Imports image from an OvImageAdapter (external image source).
+* Adapters which expose their pixel buffer (see OvImageAdapter::getDataLayout) are read in one typed pass,
+* others through getPixel.
 * @param iadapter a OvImageAdapter object
+* @param copyValues if false, only the dimensions are taken and the image is filled with zeros (e.g., for an output image)
 * @return true if successful, false if failed
 *
 * <BR> e.g., import and export using OpenCVAdapter, a class derived from OvImageAdapter.
@@ -433,14 +480,24 @@ OvImageT<T>::~OvImageT()
 * @see copyToAdapter(OvImageAdapter & iadapter)
 */
 template<typename T>
-bool OvImageT<T>::copyFromAdapter(const OvImageAdapter & iadapter)
+bool OvImageT<T>::copyFromAdapter(const OvImageAdapter & iadapter, bool copyValues)
 {
   int i,j,k;
   int height, width, ncolors;
+  OvImageAdapter::OvDataType dataType;
+  unsigned char * data;
+  long rowStep, columnStep, channelStep;
   iadapter.getSize(height, width, ncolors);
   resetDimensions(height,width,ncolors);
 
   if((height!=mHeight)||(width!=mWidth)||(ncolors!=mChannels)) return false;
+  if(!copyValues) return true;
+
+  iadapter.getDataType(dataType);
+  if(iadapter.getDataLayout(data, rowStep, columnStep, channelStep))
+  {
+    if(copyBuffer(dataType, data, rowStep, columnStep, channelStep, false)) return true;
+  }
 
   for(k=0; k<mChannels;k++)
     for(j=0; j<mWidth;j++)
@@ -456,6 +513,8 @@ bool OvImageT<T>::copyFromAdapter(const OvImageAdapter & iadapter)
 * Exports image to an OvImageAdapter (external image source).
 * Note: This function will export only if the OvImageAdapter image has the same dimensions as the source image.
 * It does not create or resize the OvImageAdapter.
+* Adapters which expose their pixel buffer (see OvImageAdapter::getDataLayout) are written in one typed pass,
+* others through setPixel.
 * @param iadapter a OvImageAdapter object
 * @return true if successful, false if failed
 *
@@ -475,10 +534,19 @@ bool OvImageT<T>::copyToAdapter(OvImageAdapter & iadapter)
 {
   int i,j,k;
   int height, width, ncolors;
+  OvImageAdapter::OvDataType dataType;
+  unsigned char * data;
+  long rowStep, columnStep, channelStep;
   iadapter.getSize(height, width, ncolors);
 
   if((height!=mHeight)||(width!=mWidth)||(ncolors!=mChannels)) return false;
 
+  iadapter.getDataType(dataType);
+  if(iadapter.getDataLayout(data, rowStep, columnStep, channelStep))
+  {
+    if(copyBuffer(dataType, data, rowStep, columnStep, channelStep, true)) return true;
+  }
+
   for(k=0; k<mChannels;k++) 
     for(j=0; j<mWidth;j++)
       for(i=0; i<mHeight;i++)
@@ -489,6 +557,61 @@ bool OvImageT<T>::copyToAdapter(OvImageAdapter & iadapter)
       return true;
 }
 
+/**
+* Copies the whole image from or to the pixel buffer of an adapter, converting values the way getPixel and setPixel do.
+* @param dataType type of the buffer values
+* @param data start of the buffer
+* @param rowStep distance between rows in bytes
+* @param columnStep distance between columns in bytes
+* @param channelStep distance between color channels in bytes
+* @param toBuffer true to export the image to the buffer, false to import it
+* @return true if successful, false if the data type is unknown
+*/
+template<typename T>
+bool OvImageT<T>::copyBuffer(OvImageAdapter::OvDataType dataType, unsigned char * data, long rowStep, long columnStep, long channelStep, bool toBuffer)
+{
+  switch(dataType)
+  {
+  case OvImageAdapter::OV_DATA_UINT8: copyBufferT<unsigned char>(data, rowStep, columnStep, channelStep, toBuffer); return true;
+  case OvImageAdapter::OV_DATA_INT8: copyBufferT<signed char>(data, rowStep, columnStep, channelStep, toBuffer); return true;
+  case OvImageAdapter::OV_DATA_UINT16: copyBufferT<unsigned short>(data, rowStep, columnStep, channelStep, toBuffer); return true;
+  case OvImageAdapter::OV_DATA_INT16: copyBufferT<short>(data, rowStep, columnStep, channelStep, toBuffer); return true;
+  case OvImageAdapter::OV_DATA_UINT32: copyBufferT<unsigned int>(data, rowStep, columnStep, channelStep, toBuffer); return true;
+  case OvImageAdapter::OV_DATA_INT32: copyBufferT<int>(data, rowStep, columnStep, channelStep, toBuffer); return true;
+  case OvImageAdapter::OV_DATA_UINT64: copyBufferT<unsigned long long>(data, rowStep, columnStep, channelStep, toBuffer); return true;
+  case OvImageAdapter::OV_DATA_INT64: copyBufferT<long long>(data, rowStep, columnStep, channelStep, toBuffer); return true;
+  case OvImageAdapter::OV_DATA_FLOAT32: copyBufferT<float>(data, rowStep, columnStep, channelStep, toBuffer); return true;
+  case OvImageAdapter::OV_DATA_DOUBLE64: copyBufferT<double>(data, rowStep, columnStep, channelStep, toBuffer); return true;
+  default: return false;
+  }
+}
+
+/**
+* Copies the whole image from or to a buffer of values of type S (see copyBuffer).
+* Rows are processed in strips, so that the row-major buffers of the usual image libraries and
+* the column-major image are both accessed a cache line at a time.
+*/
+template<typename T>
+template<typename S>
+void OvImageT<T>::copyBufferT(unsigned char * data, long rowStep, long columnStep, long channelStep, bool toBuffer)
+{
+  const int stripHeight = 16;
+
+#pragma omp parallel for schedule(static)
+  for(int iStrip=0; iStrip<mHeight; iStrip+=stripHeight)
+  {
+    const int iEnd = std::min(iStrip+stripHeight, mHeight);
+    for(int k=0; k<mChannels; k++)
+      for(int j=0; j<mWidth; j++)
+      {
+        unsigned char * buffer = data + j*columnStep + k*channelStep;
+        T * image = mData + k*mHeightTimesWidth + j*mHeight;
+        if(toBuffer) for(int i=iStrip; i<iEnd; i++) *reinterpret_cast<S*>(buffer + i*rowStep) = (S) (double) image[i];
+        else for(int i=iStrip; i<iEnd; i++) image[i] = (T) (double) *reinterpret_cast<const S*>(buffer + i*rowStep);
+      }
+  }
+}
+
 /**
 * Returns the dimensions of the image.
 * @param height returns image height
@@ -748,6 +871,121 @@ OvImageT<T>& OvImageT<T>::operator = (const OvImageT<C> & rhsImage)
   return (*this);
 }
 
+/**
+* Move assignment operator takes over the data of a temporary image without copying it.
+* As with the copy assignment operator, an empty source image leaves the image unchanged.
+* e.g.,
+* <pre>
+*    OvImageT<float> i1(4,4,1), i2;
+*    i2 = shiftImageXY(i1,1,0);
+* </pre>
+*/
+template<typename T>
+OvImageT<T>& OvImageT<T>::operator = (OvImageT<T> && rhsImage)
+{
+  if(this == &rhsImage) return (*this);
+
+  if((rhsImage.mSize>0) && (rhsImage.mData != 0))
+  {
+    T *oldData = mData;
+
+    mHeight = rhsImage.mHeight;
+    mWidth = rhsImage.mWidth;
+    mChannels = rhsImage.mChannels;
+    mHeightTimesWidth = rhsImage.mHeightTimesWidth;
+    mSize = rhsImage.mSize;
+    mData = rhsImage.mData;
+
+    rhsImage.mHeight = 0;
+    rhsImage.mWidth = 0;
+    rhsImage.mChannels = 0;
+    rhsImage.mHeightTimesWidth = 0;
+    rhsImage.mSize = 0;
+    rhsImage.mData = 0;
+
+    if(oldData!=0) delete [] oldData;
+  }
+  return (*this);
+}
+
+/**
+* Assignment operator evaluating a per-pixel expression into the image in one pass.
+* Memory is reused if the image already has the size of the result, and the image
+* may appear in the expression itself.
+* e.g.,
+* <pre>
+*    OvImageT<float> i1(4,4,1), i2(4,4,1), i3(4,4,1);
+*    i3 = (i1+i2)*i3 - 2;
+* </pre>
+*/
+template<typename T>
+template<typename E>
+OvImageT<T>& OvImageT<T>::operator = (const OvImageExpr<E> & expression)
+{
+  evaluate(expression.derived());
+  return (*this);
+}
+
+/**
+* Evaluates an expression into the image. As with the copy assignment operator, an empty
+* result leaves the image unchanged.
+* @param expression the expression
+*/
+template<typename T>
+template<typename E>
+void OvImageT<T>::evaluate(const E & expression)
+{
+  int height = expression.getHeight();
+  int width = expression.getWidth();
+  int nchannels = expression.getNumChannels();
+  int size = height*width*nchannels;
+
+  if(size<=0) return;
+
+  //all operations are per-pixel, so the current buffer can be overwritten even if the expression reads it
+  T *data = (size==mSize) ? mData : new T[size];
+  if(expression.sizesMatch())
+  {
+    for(int i=0; i<size; i++) data[i] = (T) expression.evalAt(i);
+  }
+  else
+  {
+    for(int i=0; i<size; i++) data[i] = (T) expression.evalCheckedAt(i);
+  }
+
+  if(data != mData)
+  {
+    if(mData!=0) delete [] mData;
+    mData = data;
+    mSize = size;
+  }
+  mHeight = height;
+  mWidth = width;
+  mChannels = nchannels;
+  mHeightTimesWidth = height*width;
+}
+
+/**
+* Applies a per-pixel operation in place to the image and an expression, e.g., i1 += i2*i3.
+* As with the image versions of the compound assignment operators, nothing is done if the dimensions differ.
+* @param expression the right-hand side expression
+*/
+template<typename T>
+template<typename Op, typename E>
+void OvImageT<T>::update(const E & expression)
+{
+  if((mHeight!=expression.getHeight())||(mWidth!=expression.getWidth())||(mChannels!=expression.getNumChannels())) return;
+
+  if(expression.sizesMatch())
+  {
+    for(int i=0; i<mSize; i++) mData[i] = Op::apply(mData[i], (T) expression.evalAt(i));
+  }
+  else
+  {
+    for(int i=0; i<mSize; i++) mData[i] = Op::apply(mData[i], (T) expression.evalCheckedAt(i));
+  }
+}
+
 /**
 * Assignment operator to set all values of an image to a given scalar.
 * e.g.,
@@ -851,7 +1089,7 @@ bool OvImageT<T>::copyChannel(OvImageT<T> & input, int inputChannel, int outputC
 * @return the copied subimage
 */
 template<typename T>
-const OvImageT<T> OvImageT<T>::getSubImage(int rowLo, int rowHi, int columnLo, int columnHi, int channelLo, int channelHi)
+OvImageT<T> OvImageT<T>::getSubImage(int rowLo, int rowHi, int columnLo, int columnHi, int channelLo, int channelHi)
 {
   int i,j,k,width,height,nchannels;
   OvImageT<T> result;
@@ -984,6 +1222,38 @@ OvImageT<T> & OvImageT<T>::operator /= (const T & rhs)
   return (*this);
 }
 
+template<typename T>
+template<typename E>
+OvImageT<T> & OvImageT<T>::operator += (const OvImageExpr<E> & rhs)
+{
+  update<OvImagePlusOp<T> >(rhs.derived());
+  return (*this);
+}
+
+template<typename T>
+template<typename E>
+OvImageT<T> & OvImageT<T>::operator -= (const OvImageExpr<E> & rhs)
+{
+  update<OvImageMinusOp<T> >(rhs.derived());
+  return (*this);
+}
+
+template<typename T>
+template<typename E>
+OvImageT<T> & OvImageT<T>::operator *= (const OvImageExpr<E> & rhs)
+{
+  update<OvImageMultipliesOp<T> >(rhs.derived());
+  return (*this);
+}
+
+template<typename T>
+template<typename E>
+OvImageT<T> & OvImageT<T>::operator /= (const OvImageExpr<E> & rhs)
+{
+  update<OvImageDividesOp<T> >(rhs.derived());
+  return (*this);
+}
+
 template<typename T>
 OvImageT<T> & OvImageT<T>::operator ++ ()
 {
@@ -1023,512 +1293,89 @@ const OvImageT<T> OvImageT<T>::operator -- (int)
 }
 
 template<typename T>
-const OvImageT<T> OvImageT<T>::operator - ()
+OvImageT<T> OvImageT<T>::operator + ()
 {
   OvImageT<T> result(*this); 
-
-  for(int i=0; i<mSize; i++)
-    result.mData[i] = -result.mData[i];
-
   return (result); 
 }
 
-template<typename T>
-const OvImageT<T> OvImageT<T>::operator + ()
+
+/** 
+* @relates OvImageT
+* Performs 2D convolution on the input image with a given kernel.
+* <br> e.g., 
+* <pre>
+*   OvImageT<float> ikernel, input, iresult;
+*   input = random(0,100,50,50,1);
+*   ikernel = gaussian(7, 3);
+*   iresult = convolve2D(ikernel, input);
+* </pre>
+* @param kernel a 2D image used as a kernel for convolution
+* @param input the input image
+* @return convolved image
+* @see filter2D(const OvImageT<T> & kernel, const OvImageT<T> & input)
+*/
+template<typename T> 
+OvImageT<T> convolve2D (const OvImageT<T> & kernel, const OvImageT<T> & input)
 {
-  OvImageT<T> result(*this); 
-  return (result); 
-}
+  int iResult,jResult,k,iKernel,jKernel,iInput,jInput,iKernelMidpoint,jKernelMidpoint;
+  T tempValue;
 
+  OvImageT<T> result(input,false); //create same-sized copy without copying contents
 
-template<typename T>
-const OvImageT<T> operator + (const OvImageT<T> & i1, const OvImageT<T> & i2)
-{
-  OvImageT<T> result;
-  result = i1;
-  result += i2;
-  return result;
-}
+  if((kernel.mSize==0)||(input.mSize==0)) return result;
 
-template<typename T>
-const OvImageT<T> operator + (const double i1, const OvImageT<T> & i2)
-{
-  OvImageT<T> result;
-  result = i2;
-  result += (T)i1;
-  return result;
-}
+  iKernelMidpoint = kernel.mHeight/2;
+  jKernelMidpoint = kernel.mWidth/2;
 
-template<typename T>
-const OvImageT<T> operator + (const OvImageT<T> & i1, const double i2)
-{
-  OvImageT<T> result;
-  result = i1;
-  result += (T)i2;
-  return result;
-}
+  for(k=0;k<result.mChannels;k++)
+    for(jResult=0;jResult<result.mWidth;jResult++)
+      for(iResult=0;iResult<result.mHeight;iResult++)
+      {
+        tempValue = 0;
 
-template<typename T>
-const OvImageT<T> operator - (const OvImageT<T> & i1, const OvImageT<T> & i2)
-{
-  OvImageT<T> result;
-  result = i1;
-  result -= i2;
-  return result;
-}
+        for(jKernel=0; jKernel<kernel.mWidth; jKernel++)
+        {
+          jInput = jResult - (jKernel-jKernelMidpoint);
+          if((jInput<0)||(jInput>=input.mWidth)) continue;
 
-template<typename T>
-const OvImageT<T> operator - (const double i1, const OvImageT<T> & i2)
-{
-  OvImageT<T> result;
-  result = i2;
-  result -= (T)i1;
-  return result;
-}
+          for(iKernel=0; iKernel<kernel.mHeight; iKernel++)
+          {
+            iInput = iResult - (iKernel-iKernelMidpoint);
+            if((iInput<0)||(iInput>=input.mHeight)) continue;
+            tempValue += (kernel(iKernel,jKernel)*input(iInput,jInput,k));
+          }
+        }
 
-template<typename T>
-const OvImageT<T> operator - (const OvImageT<T> & i1, const double i2)
-{
-  OvImageT<T> result;
-  result = i1;
-  result -= (T)i2;
-  return result;
-}
+        result(iResult,jResult,k) = tempValue;
+      }
 
-template<typename T>
-const OvImageT<T> operator * (const OvImageT<T> & i1, const OvImageT<T> & i2)
-{
-  OvImageT<T> result;
-  result = i1;
-  result *= i2;
-  return result;
+      return result;
 }
 
-template<typename T>
-const OvImageT<T> operator * (const double i1, const OvImageT<T> & i2)
-{
-  OvImageT<T> result;
-  result = i2;
-  result *= (T)i1;
-  return result;
-}
 
-template<typename T>
-const OvImageT<T> operator * (const OvImageT<T> & i1, const double i2)
+/** 
+* @relates OvImageT
+* Performs 2D filtering on the input image with a given kernel.
+* <br> e.g., 
+* <pre>
+*   OvImageT<float> ikernel, input, iresult;
+*   input = random(0,100,50,50,1);
+*   ikernel = gaussian(7, 3);
+*   iresult = filter2D(ikernel, input);
+* </pre>
+* @param kernel a 2D image used as a kernel for filtering
+* @param input the input image
+* @return filtered image
+* @see convolve2D(const OvImageT<T> & kernel, const OvImageT<T> & input)
+*/
+template<typename T> 
+OvImageT<T> filter2D (const OvImageT<T> & kernel, const OvImageT<T> & input)
 {
-  OvImageT<T> result;
-  result = i1;
-  result *= (T)i2;
-  return result;
-}
+  int iResult,jResult,k,iKernel,jKernel,iInput,jInput,iKernelMidpoint,jKernelMidpoint;
+  T tempValue;
 
-template<typename T>
-const OvImageT<T> operator / (const OvImageT<T> & i1, const OvImageT<T> & i2)
-{
-  OvImageT<T> result;
-  result = i1;
-  result /= i2;
-  return result;
-}
-
-template<typename T>
-const OvImageT<T> operator / (const double i1, const OvImageT<T> & i2)
-{
-  OvImageT<T> result;
-  result = i2;
-  result /= (T)i1;
-  return result;
-}
-
-template<typename T>
-const OvImageT<T> operator / (const OvImageT<T> & i1, const double i2)
-{
-  OvImageT<T> result;
-  result = i1;
-  result /= (T)i2;
-  return result;
-}
-
-template<typename T>
-const OvImageT<bool> operator < (const OvImageT<T> & i1, const OvImageT<T> & i2)
-{
-  OvImageT<bool> result(i1.mHeight,i1.mWidth,i1.mChannels);
-
-  if((i1.mHeight==i2.mHeight) && (i1.mWidth==i2.mWidth) && (i1.mChannels==i2.mChannels))
-  {
-    for(int i=0; i<result.mSize;i++) result.mData[i] = (i1.mData[i] < i2.mData[i]);
-  }
-
-  return result;
-}
-
-template<typename T>
-const OvImageT<bool> operator < (const double i1, const OvImageT<T> & i2)
-{
-  OvImageT<bool> result(i2.mHeight,i2.mWidth,i2.mChannels);
-
-  for(int i=0; i<result.mSize;i++) result.mData[i] = (i1 < i2.mData[i]);
-
-  return result;
-}
-
-template<typename T>
-const OvImageT<bool> operator < (const OvImageT<T> & i1, const double i2)
-{
-  OvImageT<bool> result(i1.mHeight,i1.mWidth,i1.mChannels);
-
-  for(int i=0; i<result.mSize;i++) result.mData[i] = (i1.mData[i] < i2);
-
-  return result;
-}
-
-
-template<typename T>
-const OvImageT<bool> operator <= (const OvImageT<T> & i1, const OvImageT<T> & i2)
-{
-  OvImageT<bool> result(i1.mHeight,i1.mWidth,i1.mChannels);
-
-  if((i1.mHeight==i2.mHeight) && (i1.mWidth==i2.mWidth) && (i1.mChannels==i2.mChannels))
-  {
-    for(int i=0; i<result.mSize;i++) result.mData[i] = (i1.mData[i] <= i2.mData[i]);
-  }
-
-  return result;
-}
-
-template<typename T>
-const OvImageT<bool> operator <= (const double i1, const OvImageT<T> & i2)
-{
-  OvImageT<bool> result(i2.mHeight,i2.mWidth,i2.mChannels);
-
-  for(int i=0; i<result.mSize;i++) result.mData[i] = (i1 <= i2.mData[i]);
-
-  return result;
-}
-
-template<typename T>
-const OvImageT<bool> operator <= (const OvImageT<T> & i1, const double i2)
-{
-  OvImageT<bool> result(i1.mHeight,i1.mWidth,i1.mChannels);
-
-  for(int i=0; i<result.mSize;i++) result.mData[i] = (i1.mData[i] <= i2);
-
-  return result;
-}
-
-
-template<typename T>
-const OvImageT<bool> operator > (const OvImageT<T> & i1, const OvImageT<T> & i2)
-{
-  OvImageT<bool> result(i1.mHeight,i1.mWidth,i1.mChannels);
-
-  if((i1.mHeight==i2.mHeight) && (i1.mWidth==i2.mWidth) && (i1.mChannels==i2.mChannels))
-  {
-    for(int i=0; i<result.mSize;i++) result.mData[i] = (i1.mData[i] > i2.mData[i]);
-  }
-
-  return result;
-}
-
-template<typename T>
-const OvImageT<bool> operator > (const double i1, const OvImageT<T> & i2)
-{
-  OvImageT<bool> result(i2.mHeight,i2.mWidth,i2.mChannels);
-
-  for(int i=0; i<result.mSize;i++) result.mData[i] = (i1 > i2.mData[i]);
-
-  return result;
-}
-
-template<typename T>
-const OvImageT<bool> operator > (const OvImageT<T> & i1, const double i2)
-{
-  OvImageT<bool> result(i1.mHeight,i1.mWidth,i1.mChannels);
-
-  for(int i=0; i<result.mSize;i++) result.mData[i] = (i1.mData[i] > i2);
-
-  return result;
-}
-
-
-template<typename T>
-const OvImageT<bool> operator >= (const OvImageT<T> & i1, const OvImageT<T> & i2)
-{
-  OvImageT<bool> result(i1.mHeight,i1.mWidth,i1.mChannels);
-
-  if((i1.mHeight==i2.mHeight) && (i1.mWidth==i2.mWidth) && (i1.mChannels==i2.mChannels))
-  {
-    for(int i=0; i<result.mSize;i++) result.mData[i] = (i1.mData[i] >= i2.mData[i]);
-  }
-
-  return result;
-}
-
-template<typename T>
-const OvImageT<bool> operator >= (const double i1, const OvImageT<T> & i2)
-{
-  OvImageT<bool> result(i2.mHeight,i2.mWidth,i2.mChannels);
-
-  for(int i=0; i<result.mSize;i++) result.mData[i] = (i1 >= i2.mData[i]);
-
-  return result;
-}
-
-template<typename T>
-const OvImageT<bool> operator >= (const OvImageT<T> & i1, const double i2)
-{
-  OvImageT<bool> result(i1.mHeight,i1.mWidth,i1.mChannels);
-
-  for(int i=0; i<result.mSize;i++) result.mData[i] = (i1.mData[i] >= i2);
-
-  return result;
-}
-
-template<typename T>
-const OvImageT<bool> operator == (const OvImageT<T> & i1, const OvImageT<T> & i2)
-{
-  OvImageT<bool> result(i1.mHeight,i1.mWidth,i1.mChannels);
-
-  if((i1.mHeight==i2.mHeight) && (i1.mWidth==i2.mWidth) && (i1.mChannels==i2.mChannels))
-  {
-    for(int i=0; i<result.mSize;i++) result.mData[i] = (i1.mData[i] == i2.mData[i]);
-  }
-
-  return result;
-}
-
-template<typename T>
-const OvImageT<bool> operator == (const double i1, const OvImageT<T> & i2)
-{
-  OvImageT<bool> result(i2.mHeight,i2.mWidth,i2.mChannels);
-
-  for(int i=0; i<result.mSize;i++) result.mData[i] = (i1 == i2.mData[i]);
-
-  return result;
-}
-
-template<typename T>
-const OvImageT<bool> operator == (const OvImageT<T> & i1, const double i2)
-{
-  OvImageT<bool> result(i1.mHeight,i1.mWidth,i1.mChannels);
-
-  for(int i=0; i<result.mSize;i++) result.mData[i] = (i1.mData[i] == i2);
-
-  return result;
-}
-
-template<typename T> 
-const OvImageT<T> cos (const OvImageT<T> & i1)
-{
-  OvImageT<T> result(i1,false); //create same-sized copy without copying contents
-  for(int i=0; i<result.mSize; i++) result.mData[i] = (T) cos(i1.mData[i]);
-  return result;
-}
-
-template<typename T> 
-const OvImageT<T> sin (const OvImageT<T> & i1)
-{
-  OvImageT<T> result(i1,false); //create same-sized copy without copying contents
-  for(int i=0; i<result.mSize; i++) result.mData[i] = (T) sin(i1.mData[i]);
-  return result;
-}
-
-
-template<typename T> 
-const OvImageT<T> tan (const OvImageT<T> & i1)
-{
-  OvImageT<T> result(i1,false); //create same-sized copy without copying contents
-  for(int i=0; i<result.mSize; i++) result.mData[i] = (T) tan(i1.mData[i]);
-  return result;
-}
-
-
-template<typename T> 
-const OvImageT<T> acos (const OvImageT<T> & i1)
-{
-  OvImageT<T> result(i1,false); //create same-sized copy without copying contents
-  for(int i=0; i<result.mSize; i++) result.mData[i] = (T) acos(i1.mData[i]);
-  return result;
-}
-
-
-template<typename T> 
-const OvImageT<T> asin (const OvImageT<T> & i1)
-{
-  OvImageT<T> result(i1,false); //create same-sized copy without copying contents
-  for(int i=0; i<result.mSize; i++) result.mData[i] = (T) asin(i1.mData[i]);
-  return result;
-}
-
-
-template<typename T> 
-const OvImageT<T> atan (const OvImageT<T> & i1)
-{
-  OvImageT<T> result(i1,false); //create same-sized copy without copying contents
-  for(int i=0; i<result.mSize; i++) result.mData[i] = (T) atan(i1.mData[i]);
-  return result;
-}
-
-
-template<typename T> 
-const OvImageT<T> atan2 (const OvImageT<T> & iy, const OvImageT<T> & ix)
-{
-  OvImageT<T> result(iy,false); //create same-sized copy without copying contents
-  if(iy.mSize != ix.mSize) return result; //unequal sized arrays
-  for(int i=0; i<result.mSize; i++) result.mData[i] = (T) atan2(iy.mData[i],ix.mData[i]);
-  return result;
-}
-
-
-template<typename T> 
-const OvImageT<T> cosh (const OvImageT<T> & i1)
-{
-  OvImageT<T> result(i1,false); //create same-sized copy without copying contents
-  for(int i=0; i<result.mSize; i++) result.mData[i] = (T) cosh(i1.mData[i]);
-  return result;
-}
-
-
-template<typename T> 
-const OvImageT<T> sinh (const OvImageT<T> & i1)
-{
-  OvImageT<T> result(i1,false); //create same-sized copy without copying contents
-  for(int i=0; i<result.mSize; i++) result.mData[i] = (T) sinh(i1.mData[i]);
-  return result;
-}
-
-
-template<typename T> 
-const OvImageT<T> tanh (const OvImageT<T> & i1)
-{
-  OvImageT<T> result(i1,false); //create same-sized copy without copying contents
-  for(int i=0; i<result.mSize; i++) result.mData[i] = (T) tanh(i1.mData[i]);
-  return result;
-}
-
-
-template<typename T> 
-const OvImageT<T> exp (const OvImageT<T> & i1)
-{
-  OvImageT<T> result(i1,false); //create same-sized copy without copying contents
-  for(int i=0; i<result.mSize; i++) result.mData[i] = (T) exp(i1.mData[i]);
-  return result;
-}
-
-
-template<typename T> 
-const OvImageT<T> log (const OvImageT<T> & i1)
-{
-  OvImageT<T> result(i1,false); //create same-sized copy without copying contents
-  for(int i=0; i<result.mSize; i++) result.mData[i] = (T) log(i1.mData[i]);
-  return result;
-}
-
-
-template<typename T> 
-const OvImageT<T> log10 (const OvImageT<T> & i1)
-{
-  OvImageT<T> result(i1,false); //create same-sized copy without copying contents
-  for(int i=0; i<result.mSize; i++) result.mData[i] = (T) log10(i1.mData[i]);
-  return result;
-}
-
-
-template<typename T> 
-const OvImageT<T> abs (const OvImageT<T> & i1)
-{
-  OvImageT<T> result(i1,false); //create same-sized copy without copying contents
-  for(int i=0; i<result.mSize; i++) result.mData[i] = (T) fabs(i1.mData[i]);
-  return result;
-}
-
-
-template<typename T> 
-const OvImageT<T> ceil (const OvImageT<T> & i1)
-{
-  OvImageT<T> result(i1,false); //create same-sized copy without copying contents
-  for(int i=0; i<result.mSize; i++) result.mData[i] = (T) ceil(i1.mData[i]);
-  return result;
-}
-
-
-template<typename T> 
-const OvImageT<T> floor (const OvImageT<T> & i1)
-{
-  OvImageT<T> result(i1,false); //create same-sized copy without copying contents
-  for(int i=0; i<result.mSize; i++) result.mData[i] = (T) floor(i1.mData[i]);
-  return result;
-}
-
-template<typename T> 
-const OvImageT<T> round (const OvImageT<T> & i1)
-{
-  OvImageT<T> result(i1,false); //create same-sized copy without copying contents
-  T tempValue;
-  for(int i=0; i<result.mSize; i++) 
-  {
-    tempValue = floor(i1.mData[i]);
-    result.mData[i] = (T) ((i1.mData[i]-tempValue)<=0.5)?tempValue:ceil(i1.mData[i]);
-  }
-  return result;
-}
-
-template<typename T> 
-const OvImageT<T> mod (const OvImageT<T> & i1, double d)
-{
-  OvImageT<T> result(i1,false); //create same-sized copy without copying contents
-  for(int i=0; i<result.mSize; i++) result.mData[i] = (T) fmod((double)i1.mData[i],(double)d);
-  return result;
-}
-
-
-template<typename T> 
-const OvImageT<T> pow (const OvImageT<T> & i1, double p)
-{
-  OvImageT<T> result(i1,false); //create same-sized copy without copying contents
-  for(int i=0; i<result.mSize; i++) result.mData[i] = (T) pow((double)i1.mData[i],p);
-  return result;
-}
-
-template<typename T> 
-const OvImageT<T> pow (double p, const OvImageT<T> & i1)
-{
-  OvImageT<T> result(i1,false); //create same-sized copy without copying contents
-  for(int i=0; i<result.mSize; i++) result.mData[i] = (T) pow(p,(double)i1.mData[i]);
-  return result;
-}
-
-template<typename T> 
-const OvImageT<T> sqrt (const OvImageT<T> & i1)
-{
-  OvImageT<T> result(i1,false); //create same-sized copy without copying contents
-  for(int i=0; i<result.mSize; i++) result.mData[i] = (T) sqrt(i1.mData[i]);
-  return result;
-}
-
-
-/** 
-* @relates OvImageT
-* Performs 2D convolution on the input image with a given kernel.
-* <br> e.g., 
-* <pre>
-*   OvImageT<float> ikernel, input, iresult;
-*   input = random(0,100,50,50,1);
-*   ikernel = gaussian(7, 3);
-*   iresult = convolve2D(ikernel, input);
-* </pre>
-* @param kernel a 2D image used as a kernel for convolution
-* @param input the input image
-* @return convolved image
-* @see filter2D(const OvImageT<T> & kernel, const OvImageT<T> & input)
-*/
-template<typename T> 
-const OvImageT<T> convolve2D (const OvImageT<T> & kernel, const OvImageT<T> & input)
-{
-  int iResult,jResult,k,iKernel,jKernel,iInput,jInput,iKernelMidpoint,jKernelMidpoint;
-  T tempValue;
-
-  OvImageT<T> result(input,false); //create same-sized copy without copying contents
+  OvImageT<T> result(input,false); //create same-sized copy without copying contents
 
   if((kernel.mSize==0)||(input.mSize==0)) return result;
 
@@ -1543,12 +1390,12 @@ const OvImageT<T> convolve2D (const OvImageT<T> & kernel, const OvImageT<T> & in
 
         for(jKernel=0; jKernel<kernel.mWidth; jKernel++)
         {
-          jInput = jResult - (jKernel-jKernelMidpoint);
+          jInput = jResult + (jKernel-jKernelMidpoint); //only difference from convolve2D is the plus sign
           if((jInput<0)||(jInput>=input.mWidth)) continue;
 
           for(iKernel=0; iKernel<kernel.mHeight; iKernel++)
           {
-            iInput = iResult - (iKernel-iKernelMidpoint);
+            iInput = iResult + (iKernel-iKernelMidpoint); //only difference from convolve2D is the plus sign
             if((iInput<0)||(iInput>=input.mHeight)) continue;
             tempValue += (kernel(iKernel,jKernel)*input(iInput,jInput,k));
           }
@@ -1560,85 +1407,209 @@ const OvImageT<T> convolve2D (const OvImageT<T> & kernel, const OvImageT<T> & in
       return result;
 }
 
+template<typename T> 
+T medianFilter2DHelperFunc_FindMedian(int n, T*elements)
+{
+  if(n==0) return 0; 
 
-/** 
-* @relates OvImageT
-* Performs 2D filtering on the input image with a given kernel.
-* <br> e.g., 
-* <pre>
-*   OvImageT<float> ikernel, input, iresult;
-*   input = random(0,100,50,50,1);
-*   ikernel = gaussian(7, 3);
-*   iresult = filter2D(ikernel, input);
-* </pre>
-* @param kernel a 2D image used as a kernel for filtering
-* @param input the input image
-* @return filtered image
-* @see convolve2D(const OvImageT<T> & kernel, const OvImageT<T> & input)
+  //upper median for even n, as the middle element of the sorted list
+  std::nth_element(elements, elements+n/2, elements+n);
+  return elements[n/2];
+}
+
+/**  Median of the non-NaN values in the filter window around a pixel of one channel plane.
+* @param plane	channel plane (column-major)
+* @param elements	buffer of filterHeight*filterWidth values
 */
 template<typename T> 
-const OvImageT<T> filter2D (const OvImageT<T> & kernel, const OvImageT<T> & input)
+T medianFilter2DHelperFunc_Window(const T * plane, int height, int width, int iResult, int jResult, int filterHeight, int filterWidth, T * elements)
 {
-  int iResult,jResult,k,iKernel,jKernel,iInput,jInput,iKernelMidpoint,jKernelMidpoint;
-  T tempValue;
+  int iLo = std::max(iResult - filterHeight/2, 0);
+  int iHi = std::min(iResult - filterHeight/2 + filterHeight, height);
+  int jLo = std::max(jResult - filterWidth/2, 0);
+  int jHi = std::min(jResult - filterWidth/2 + filterWidth, width);
+  int count = 0;
 
-  OvImageT<T> result(input,false); //create same-sized copy without copying contents
+  for(int jInput=jLo; jInput<jHi; jInput++)
+  {
+    const T * column = plane + jInput*height;
+    for(int iInput=iLo; iInput<iHi; iInput++)
+    {
+      T tempValue = column[iInput];
+      if(tempValue!=tempValue) continue; //check if value is NaN
+      elements[count] = tempValue;
+      count++;
+    }
+  }
 
-  if((kernel.mSize==0)||(input.mSize==0)) return result;
+  return medianFilter2DHelperFunc_FindMedian<T>(count, elements);
+}
 
-  iKernelMidpoint = kernel.mHeight/2;
-  jKernelMidpoint = kernel.mWidth/2;
+/**  Median of three values. */
+template<typename T> 
+inline T medianFilter2DHelperFunc_Median3(T a, T b, T c)
+{
+  return std::max(std::min(a,b), std::min(std::max(a,b),c));
+}
 
-  for(k=0;k<result.mChannels;k++)
-    for(jResult=0;jResult<result.mWidth;jResult++)
-      for(iResult=0;iResult<result.mHeight;iResult++)
+/**  Minimum filter operation: NaNs are replaced by a value that never wins. */
+template<typename T> 
+struct OvImageMinFilterOp
+{
+  static T identity() { return std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max(); }
+  static T load(T a) { return (a!=a) ? identity() : a; }
+  static T apply(T a, T b) { return (b<a) ? b : a; }
+};
+
+/**  Maximum filter operation: NaNs are replaced by a value that never wins. */
+template<typename T> 
+struct OvImageMaxFilterOp
+{
+  static T identity() { return std::numeric_limits<T>::has_infinity ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::lowest(); }
+  static T load(T a) { return (a!=a) ? identity() : a; }
+  static T apply(T a, T b) { return (a<b) ? b : a; }
+};
+
+/**  Running minimum/maximum along a sequence (van Herk/Gil-Werman), at three operations per value whatever the window size.
+* Each element of the sequence is a run of len consecutive values, and output element x combines input elements
+* x-window/2 to x-window/2+window-1 that lie inside the sequence.
+* @param input	first input element
+* @param output	first output element
+* @param n	number of elements
+* @param runLength	number of values per element (len)
+* @param stride	distance between consecutive elements
+* @param window	window size in elements
+* @param forward	buffer of (n+window-1)*len values
+* @param backward	buffer of (n+window-1)*len values
+* @tparam FixedLen	len known at compile time, or 0
+*/
+template<typename T, typename Op, int FixedLen> 
+void extremumFilter2DHelperFunc_Run(const T * input, T * output, int n, int runLength, int stride, int window, T * forward, T * backward)
+{
+  const int len = (FixedLen>0) ? FixedLen : runLength;
+  const int anchor = window/2;
+  const int paddedCount = n + window - 1;
+  const T identity = Op::identity();
+  int p, l;
+
+  if(window<=4)
+  {
+    //scanning the window directly is cheaper for small windows
+    for(int x=0; x<n; x++)
+    {
+      const int xLo = std::max(x-anchor, 0);
+      const int xHi = std::min(x-anchor+window, n);
+      T * out = output + x*stride;
+      for(l=0; l<len; l++) out[l] = Op::load(input[xLo*stride+l]);
+      for(int y=xLo+1; y<xHi; y++)
       {
-        tempValue = 0;
+        const T * in = input + y*stride;
+        for(l=0; l<len; l++) out[l] = Op::apply(out[l], Op::load(in[l]));
+      }
+    }
+    return;
+  }
 
-        for(jKernel=0; jKernel<kernel.mWidth; jKernel++)
-        {
-          jInput = jResult + (jKernel-jKernelMidpoint); //only difference from convolve2D is the plus sign
-          if((jInput<0)||(jInput>=input.mWidth)) continue;
+  //combine within blocks of window elements of the padded sequence, from the block start forward and from the block end backward
+  for(int blockStart=0; blockStart<paddedCount; blockStart+=window)
+  {
+    const int blockEnd = std::min(blockStart+window, paddedCount);
 
-          for(iKernel=0; iKernel<kernel.mHeight; iKernel++)
-          {
-            iInput = iResult + (iKernel-iKernelMidpoint); //only difference from convolve2D is the plus sign
-            if((iInput<0)||(iInput>=input.mHeight)) continue;
-            tempValue += (kernel(iKernel,jKernel)*input(iInput,jInput,k));
-          }
-        }
+    for(p=blockStart; p<blockEnd; p++)
+    {
+      const int x = p - anchor;
+      T * g = forward + p*len;
+      if((x<0)||(x>=n))
+      {
+        if(p==blockStart) for(l=0; l<len; l++) g[l] = identity;
+        else for(l=0; l<len; l++) g[l] = g[l-len];
+        continue;
+      }
+      const T * in = input + x*stride;
+      if(p==blockStart) for(l=0; l<len; l++) g[l] = Op::load(in[l]);
+      else for(l=0; l<len; l++) g[l] = Op::apply(g[l-len], Op::load(in[l]));
+    }
 
-        result(iResult,jResult,k) = tempValue;
+    for(p=blockEnd-1; p>=blockStart; p--)
+    {
+      const int x = p - anchor;
+      T * h = backward + p*len;
+      if((x<0)||(x>=n))
+      {
+        if(p==blockEnd-1) for(l=0; l<len; l++) h[l] = identity;
+        else for(l=0; l<len; l++) h[l] = h[l+len];
+        continue;
       }
+      const T * in = input + x*stride;
+      if(p==blockEnd-1) for(l=0; l<len; l++) h[l] = Op::load(in[l]);
+      else for(l=0; l<len; l++) h[l] = Op::apply(h[l+len], Op::load(in[l]));
+    }
+  }
 
-      return result;
+  //every window spans the end of one block and the start of the next
+  for(int x=0; x<n; x++)
+  {
+    const T * h = backward + x*len;
+    const T * g = forward + (x+window-1)*len;
+    T * out = output + x*stride;
+    for(l=0; l<len; l++) out[l] = Op::apply(h[l], g[l]);
+  }
 }
 
-template<typename T> 
-int medianFilter2DHelperFunc_Compare( const void *arg1, const void *arg2 )
+/**  Separable minimum/maximum filter of all channels: a running extremum down the columns and then across them.
+* NaNs are skipped, and a pixel that is itself NaN stays NaN.
+*/
+template<typename T, typename Op> 
+void extremumFilter2DHelperFunc_Filter(const T * input, T * result, int height, int width, int nChannels, int filterHeight, int filterWidth)
 {
-  if((*(T*)arg1)<(*(T*)arg2)) return -1;
-  else if ((*(T*)arg1)==(*(T*)arg2)) return 0;
-  else return 1;
-}
+  const int planeSize = height*width;
+  const int stripHeight = 64; //rows per horizontal pass task, short enough for its buffers to stay in cache
+  const int stripCount = (height+stripHeight-1)/stripHeight;
+  T * columnResult = new T[planeSize];
 
-template<typename T> 
-T medianFilter2DHelperFunc_FindMedian(int n, T*elements)
-{
-  qsort( (void *) elements, (size_t)n, sizeof(T), medianFilter2DHelperFunc_Compare<T>);
+  for(int k=0; k<nChannels; k++)
+  {
+    const T * inputPlane = input + k*planeSize;
+    T * resultPlane = result + k*planeSize;
 
-  if(n==0) return 0; 
-  else if(n%2) /*odd*/
-    return elements[(n-1)/2];
-  else
-    return elements[n/2];
+#pragma omp parallel
+    {
+      T * forward = new T[height+filterHeight-1];
+      T * backward = new T[height+filterHeight-1];
+#pragma omp for schedule(static)
+      for(int j=0; j<width; j++)
+        extremumFilter2DHelperFunc_Run<T,Op,1>(inputPlane + j*height, columnResult + j*height, height, 1, 1, filterHeight, forward, backward);
+      delete [] forward;
+      delete [] backward;
+    }
+
+    //across the columns a strip of rows at a time, so that the innermost loops run along contiguous memory
+#pragma omp parallel
+    {
+      T * forward = new T[(width+filterWidth-1)*stripHeight];
+      T * backward = new T[(width+filterWidth-1)*stripHeight];
+#pragma omp for schedule(static)
+      for(int strip=0; strip<stripCount; strip++)
+      {
+        int iLo = strip*stripHeight;
+        extremumFilter2DHelperFunc_Run<T,Op,0>(columnResult + iLo, resultPlane + iLo, width, std::min(stripHeight, height-iLo), height, filterWidth, forward, backward);
+      }
+      delete [] forward;
+      delete [] backward;
+    }
+
+    for(int index=0; index<planeSize; index++)
+      if(inputPlane[index]!=inputPlane[index]) resultPlane[index] = inputPlane[index];
+  }
 
+  delete [] columnResult;
 }
 
 
 /** 
 * @relates OvImageT
 * Performs 2D median filtering on the input image, i.e., every output pixel is set to the median value within a rectangular block of pixels around it.
+* NaN values are ignored, and pixels without any other values get 0. 3x3 filters use a sorting network on all complete windows.
 * 
 * <p> e.g., 
 * <pre> 
@@ -1656,56 +1627,101 @@ T medianFilter2DHelperFunc_FindMedian(int n, T*elements)
 * @see convolve2D(const OvImageT<T> & kernel, const OvImageT<T> & input)
 */
 template<typename T> 
-const OvImageT<T> medianFilter2D (const OvImageT<T> & input, int filterHeight, int filterWidth)
+OvImageT<T> medianFilter2D (const OvImageT<T> & input, int filterHeight, int filterWidth)
 {
-  int iResult,jResult,k,iKernel,jKernel,iInput,jInput,iKernelMidpoint,jKernelMidpoint;
-  T*listOfElements, tempValue;
-  int count;
-
   OvImageT<T> result(input,false); //create same-sized copy without copying contents
 
   if(input.mSize==0) return result;
   if((filterHeight<1)||(filterWidth<1)) return result;
 
-  listOfElements = new T[filterHeight*filterWidth];
-  if(listOfElements==0) return result; //no memory
+  const int height = input.mHeight;
+  const int width = input.mWidth;
+  const bool useNetwork = (filterHeight==3)&&(filterWidth==3)&&(height>=3)&&(width>=3);
+  T * sortedLo = 0;
+  T * sortedMid = 0;
+  T * sortedHi = 0;
+  unsigned char * columnHasNaN = 0;
 
-  iKernelMidpoint = filterHeight/2;
-  jKernelMidpoint = filterWidth/2;
+  if(useNetwork)
+  {
+    //sorted vertical triples, shared by the three windows that contain them
+    sortedLo = new T[input.mHeightTimesWidth];
+    sortedMid = new T[input.mHeightTimesWidth];
+    sortedHi = new T[input.mHeightTimesWidth];
+    columnHasNaN = new unsigned char[input.mHeightTimesWidth];
+  }
 
-  for(k=0;k<result.mChannels;k++)
-    for(jResult=0;jResult<result.mWidth;jResult++)
-      for(iResult=0;iResult<result.mHeight;iResult++)
+  for(int k=0;k<result.mChannels;k++)
+  {
+    const T * inputPlane = input.mData + k*input.mHeightTimesWidth;
+    T * resultPlane = result.mData + k*result.mHeightTimesWidth;
+
+    if(useNetwork)
+    {
+#pragma omp parallel for schedule(static)
+      for(int j=0; j<width; j++)
       {
-        count = 0;
-        for(jKernel=0; jKernel<filterWidth; jKernel++)
+        const int offset = j*height;
+        for(int i=1; i<height-1; i++)
         {
-          jInput = jResult + (jKernel-jKernelMidpoint); 
-          if((jInput<0)||(jInput>=input.mWidth)) continue;
-
-          for(iKernel=0; iKernel<filterHeight; iKernel++)
-          {
-            iInput = iResult + (iKernel-iKernelMidpoint); 
-            if((iInput<0)||(iInput>=input.mHeight)) continue;
-
-            tempValue = input(iInput,jInput,k);
-            if(tempValue!=tempValue) continue; //check if value is NaN
-            listOfElements[count] = tempValue;
-            count++;						
-          }
-        }				
+          T a = inputPlane[offset+i-1], b = inputPlane[offset+i], c = inputPlane[offset+i+1];
+          T lo = std::min(a,b), hi = std::max(a,b);
+          sortedLo[offset+i] = std::min(lo,c);
+          sortedMid[offset+i] = std::max(lo, std::min(hi,c));
+          sortedHi[offset+i] = std::max(hi,c);
+          columnHasNaN[offset+i] = (a!=a)|(b!=b)|(c!=c);
+        }
+      }
 
-        result(iResult,jResult,k) = medianFilter2DHelperFunc_FindMedian<T>(count, listOfElements);
+      //median of nine = median of (largest low, median of middles, smallest high) of the sorted columns
+#pragma omp parallel for schedule(static)
+      for(int j=1; j<width-1; j++)
+      {
+        const int offset = j*height;
+        for(int i=1; i<height-1; i++)
+        {
+          const int left = offset-height+i, center = offset+i, right = offset+height+i;
+          T lo = std::max(std::max(sortedLo[left], sortedLo[center]), sortedLo[right]);
+          T mid = medianFilter2DHelperFunc_Median3(sortedMid[left], sortedMid[center], sortedMid[right]);
+          T hi = std::min(std::min(sortedHi[left], sortedHi[center]), sortedHi[right]);
+          resultPlane[center] = medianFilter2DHelperFunc_Median3(lo, mid, hi);
+        }
       }
+    }
 
+    //windows the network does not cover: borders, windows with NaNs, other filter sizes
+#pragma omp parallel
+    {
+      T * listOfElements = new T[filterHeight*filterWidth];
+#pragma omp for schedule(static)
+      for(int j=0; j<width; j++)
+        for(int i=0; i<height; i++)
+        {
+          if(useNetwork && (i>0) && (i<height-1) && (j>0) && (j<width-1))
+          {
+            const int center = j*height+i;
+            if(!(columnHasNaN[center-height]|columnHasNaN[center]|columnHasNaN[center+height])) continue;
+          }
+          resultPlane[j*height+i] = medianFilter2DHelperFunc_Window<T>(inputPlane, height, width, i, j, filterHeight, filterWidth, listOfElements);
+        }
+      delete [] listOfElements;
+    }
+  }
 
-      if(listOfElements!=0) delete [] listOfElements;
-      return result;
+  if(useNetwork)
+  {
+    delete [] sortedLo;
+    delete [] sortedMid;
+    delete [] sortedHi;
+    delete [] columnHasNaN;
+  }
+  return result;
 }
 
 /** 
 * @relates OvImageT
 * Performs 2D minimum filtering on the input image, i.e., every output pixel is set to the minimum value within a rectangular block of pixels around it.
+* NaN values are ignored, except that NaN pixels stay NaN. Costs a constant number of operations per pixel whatever the filter size.
 * 
 * <p> e.g., 
 * <pre> 
@@ -1723,52 +1739,22 @@ const OvImageT<T> medianFilter2D (const OvImageT<T> & input, int filterHeight, i
 * @see convolve2D(const OvImageT<T> & kernel, const OvImageT<T> & input)
 */
 template<typename T> 
-const OvImageT<T> minFilter2D (const OvImageT<T> & input, int filterHeight, int filterWidth)
+OvImageT<T> minFilter2D (const OvImageT<T> & input, int filterHeight, int filterWidth)
 {
-  int iResult,jResult,k,iKernel,jKernel,iInput,jInput,iKernelMidpoint,jKernelMidpoint;
-  T resultValue, tempValue;
-
   OvImageT<T> result(input,false); //create same-sized copy without copying contents
 
   if(input.mSize==0) return result;
   if((filterHeight<1)||(filterWidth<1)) return result;
 
-  iKernelMidpoint = filterHeight/2;
-  jKernelMidpoint = filterWidth/2;
-
-  for(k=0;k<result.mChannels;k++)
-    for(jResult=0;jResult<result.mWidth;jResult++)
-      for(iResult=0;iResult<result.mHeight;iResult++)
-      {
-        resultValue = input(iResult,jResult,k);
-
-        for(jKernel=0; jKernel<filterWidth; jKernel++)
-        {
-          jInput = jResult + (jKernel-jKernelMidpoint); 
-          if((jInput<0)||(jInput>=input.mWidth)) continue;
-
-          for(iKernel=0; iKernel<filterHeight; iKernel++)
-          {
-            iInput = iResult + (iKernel-iKernelMidpoint); 
-            if((iInput<0)||(iInput>=input.mHeight)) continue;
-
-            tempValue = input(iInput,jInput,k);
-            if(tempValue!=tempValue) continue; //check if value is NaN
-
-            if(resultValue>tempValue) resultValue = tempValue;
-          }
-        }				
-
-        result(iResult,jResult,k) = resultValue;
-      }
-
-      return result;
+  extremumFilter2DHelperFunc_Filter<T, OvImageMinFilterOp<T> >(input.mData, result.mData, input.mHeight, input.mWidth, input.mChannels, filterHeight, filterWidth);
+  return result;
 }
 
 
 /** 
 * @relates OvImageT
 * Performs 2D maximum filtering on the input image, i.e., every output pixel is set to the maximum value within a rectangular block of pixels around it.
+* NaN values are ignored, except that NaN pixels stay NaN. Costs a constant number of operations per pixel whatever the filter size.
 * 
 * <p> e.g., 
 * <pre> 
@@ -1786,46 +1772,15 @@ const OvImageT<T> minFilter2D (const OvImageT<T> & input, int filterHeight, int
 * @see convolve2D(const OvImageT<T> & kernel, const OvImageT<T> & input)
 */
 template<typename T> 
-const OvImageT<T> maxFilter2D (const OvImageT<T> & input, int filterHeight, int filterWidth)
+OvImageT<T> maxFilter2D (const OvImageT<T> & input, int filterHeight, int filterWidth)
 {
-  int iResult,jResult,k,iKernel,jKernel,iInput,jInput,iKernelMidpoint,jKernelMidpoint;
-  T resultValue, tempValue;
-
   OvImageT<T> result(input,false); //create same-sized copy without copying contents
 
   if(input.mSize==0) return result;
   if((filterHeight<1)||(filterWidth<1)) return result;
 
-  iKernelMidpoint = filterHeight/2;
-  jKernelMidpoint = filterWidth/2;
-
-  for(k=0;k<result.mChannels;k++)
-    for(jResult=0;jResult<result.mWidth;jResult++)
-      for(iResult=0;iResult<result.mHeight;iResult++)
-      {
-        resultValue = input(iResult,jResult,k);
-
-        for(jKernel=0; jKernel<filterWidth; jKernel++)
-        {
-          jInput = jResult + (jKernel-jKernelMidpoint); 
-          if((jInput<0)||(jInput>=input.mWidth)) continue;
-
-          for(iKernel=0; iKernel<filterHeight; iKernel++)
-          {
-            iInput = iResult + (iKernel-iKernelMidpoint); 
-            if((iInput<0)||(iInput>=input.mHeight)) continue;
-
-            tempValue = input(iInput,jInput,k);
-            if(tempValue!=tempValue) continue; //check if value is NaN
-
-            if(resultValue<tempValue) resultValue = tempValue;
-          }
-        }				
-
-        result(iResult,jResult,k) = resultValue;
-      }
-
-      return result;
+  extremumFilter2DHelperFunc_Filter<T, OvImageMaxFilterOp<T> >(input.mData, result.mData, input.mHeight, input.mWidth, input.mChannels, filterHeight, filterWidth);
+  return result;
 }
 
 /** 
@@ -1848,7 +1803,7 @@ const OvImageT<T> maxFilter2D (const OvImageT<T> & input, int filterHeight, int
 * @see convolve2D(const OvImageT<T> & kernel, const OvImageT<T> & input)
 */
 template<typename T> 
-const OvImageT<T> meanFilter2D (const OvImageT<T> & input, int filterHeight, int filterWidth)
+OvImageT<T> meanFilter2D (const OvImageT<T> & input, int filterHeight, int filterWidth)
 {
   OvImageT<T> result; 
   OvImageT<T> kernel;
@@ -1881,7 +1836,7 @@ const OvImageT<T> meanFilter2D (const OvImageT<T> & input, int filterHeight, int
 * @return image
 */
 template<typename T> 
-const OvImageT<T> mean(const OvImageT<T> & input, int dimension)
+OvImageT<T> mean(const OvImageT<T> & input, int dimension)
 {
   OvImageT<T> result;
   int i,j,k;
@@ -1944,7 +1899,7 @@ const OvImageT<T> mean(const OvImageT<T> & input, int dimension)
 * @return image
 */
 template<typename T> 
-const OvImageT<T> min(const OvImageT<T> & input, int dimension)
+OvImageT<T> min(const OvImageT<T> & input, int dimension)
 {
   OvImageT<T> result;
   int i,j,k;
@@ -2003,7 +1958,7 @@ const OvImageT<T> min(const OvImageT<T> & input, int dimension)
 * @return image
 */
 template<typename T> 
-const OvImageT<T> max(const OvImageT<T> & input, int dimension)
+OvImageT<T> max(const OvImageT<T> & input, int dimension)
 {
   OvImageT<T> result;
   int i,j,k;
@@ -2063,7 +2018,7 @@ const OvImageT<T> max(const OvImageT<T> & input, int dimension)
 * @return summed image
 */
 template<typename T> 
-const OvImageT<T> sum(const OvImageT<T> & input, int dimension)
+OvImageT<T> sum(const OvImageT<T> & input, int dimension)
 {
   OvImageT<T> result;
   int i,j,k;
@@ -2230,7 +2185,7 @@ T L2Norm(const OvImageT<T> & input)
 * @return transposed image
 */
 template<typename T> 
-const OvImageT<T> transpose(const OvImageT<T> & input)
+OvImageT<T> transpose(const OvImageT<T> & input)
 {
   OvImageT<T> result;
   int i,j,k;
@@ -2260,7 +2215,7 @@ const OvImageT<T> transpose(const OvImageT<T> & input)
 * @return flipped image
 */
 template<typename T> 
-const OvImageT<T> flipLR(const OvImageT<T> & input)
+OvImageT<T> flipLR(const OvImageT<T> & input)
 {
   OvImageT<T> result(input,false);
   int i,j,k;
@@ -2287,7 +2242,7 @@ const OvImageT<T> flipLR(const OvImageT<T> & input)
 * @return flipped image
 */
 template<typename T> 
-const OvImageT<T> flipUD(const OvImageT<T> & input)
+OvImageT<T> flipUD(const OvImageT<T> & input)
 {
   OvImageT<T> result(input,false);
   int i,j,k;
@@ -2303,6 +2258,77 @@ const OvImageT<T> flipUD(const OvImageT<T> & input)
       return result;	
 }
 
+/** 
+* @relates OvImageT
+* Halves the image size, every output pixel being the mean of a 2x2 block of input pixels (of fewer pixels along the last row and column if the size is odd).
+* 
+* <p> e.g., 
+* <br> i2 = downsample2D(i1); 
+* </p>
+* @param input the input image
+* @return image of height (height+1)/2 and width (width+1)/2
+* @see upsample2D(const OvImageT<T> & input, int height, int width)
+*/
+template<typename T> 
+OvImageT<T> downsample2D(const OvImageT<T> & input)
+{
+  OvImageT<T> result;
+  int i,j,k,iInput,jInput,count;
+  double sum;
+
+  if(input.mSize==0) return result;
+  result.resetDimensions((input.mHeight+1)/2, (input.mWidth+1)/2, input.mChannels);
+
+  for(k=0; k<result.mChannels;k++)
+    for(j=0; j<result.mWidth;j++)
+      for(i=0; i<result.mHeight;i++)
+      {
+        sum = 0;
+        count = 0;
+        for(jInput=2*j; (jInput<=2*j+1)&&(jInput<input.mWidth); jInput++)
+          for(iInput=2*i; (iInput<=2*i+1)&&(iInput<input.mHeight); iInput++)
+          {
+            sum += input(iInput,jInput,k);
+            count++;
+          }
+        result(i,j,k) = static_cast<T>(sum/count);
+      }
+
+      return result;	
+}
+
+/** 
+* @relates OvImageT
+* Doubles the image size by replicating every pixel into a 2x2 block, e.g., to bring a result computed on a downsample2D image back to the original size.
+* 
+* <p> e.g., 
+* <br> i2 = upsample2D(downsample2D(i1), i1.getHeight(), i1.getWidth()); 
+* </p>
+* @param input the input image
+* @param height height of the result (the last rows are cropped or replicated to reach it)
+* @param width width of the result (the last columns are cropped or replicated to reach it)
+* @return upsampled image
+* @see downsample2D(const OvImageT<T> & input)
+*/
+template<typename T> 
+OvImageT<T> upsample2D(const OvImageT<T> & input, int height, int width)
+{
+  OvImageT<T> result;
+  int i,j,k;
+
+  if((input.mSize==0)||(height<=0)||(width<=0)) return result;
+  result.resetDimensions(height, width, input.mChannels);
+
+  for(k=0; k<result.mChannels;k++)
+    for(j=0; j<result.mWidth;j++)
+      for(i=0; i<result.mHeight;i++)
+      {
+        result(i,j,k) = input(std::min(i/2,input.mHeight-1),std::min(j/2,input.mWidth-1),k);
+      }
+
+      return result;	
+}
+
 /** 
 * @relates OvImageT
 * Converts multi-channel color image to single-channel gray image by averaging channels.
@@ -2313,7 +2339,7 @@ const OvImageT<T> flipUD(const OvImageT<T> & input)
 * @return gray image
 */
 template<typename T> 
-const OvImageT<T> rgb2gray(const OvImageT<T> & input)
+OvImageT<T> rgb2gray(const OvImageT<T> & input)
 {
   OvImageT<T> result(input,false);
 
@@ -2349,7 +2375,7 @@ void OvImageT<T>::setToGray()
 * @return image
 */
 template<typename T> 
-const OvImageT<T> repmat (const OvImageT<T> & input, int height, int width, int channels)
+OvImageT<T> repmat (const OvImageT<T> & input, int height, int width, int channels)
 {
   OvImageT<T> result;
   int i,j,k;
@@ -2384,7 +2410,7 @@ const OvImageT<T> repmat (const OvImageT<T> & input, int height, int width, int
 * @return translated image
 */
 template<typename T> 
-const OvImageT<T> shiftImageXY (const OvImageT<T> & input, int columns, int rows)
+OvImageT<T> shiftImageXY (const OvImageT<T> & input, int columns, int rows)
 {	
   OvImageT<T> result(input,false);
   int i,j,k, iLow, iHigh, jLow, jHigh;
@@ -2424,7 +2450,7 @@ const OvImageT<T> shiftImageXY (const OvImageT<T> & input, int columns, int rows
 * @see resizeBilinear(const OvImageT<T> & input, double scale, bool preSmooth)
 */
 template<typename T> 
-const OvImageT<T> resizeNearestNbr(const OvImageT<T> & input, double scale, bool preSmooth)
+OvImageT<T> resizeNearestNbr(const OvImageT<T> & input, double scale, bool preSmooth)
 {
   int i,j,k;
   OvImageT<T> result, intermediate, kernel;
@@ -2478,7 +2504,7 @@ const OvImageT<T> resizeNearestNbr(const OvImageT<T> & input, double scale, bool
 * @see resizeNearestNbr(const OvImageT<T> & input, double scale, bool preSmooth)
 */
 template<typename T> 
-const OvImageT<T> resizeBilinear(const OvImageT<T> & input, double scale, bool preSmooth)
+OvImageT<T> resizeBilinear(const OvImageT<T> & input, double scale, bool preSmooth)
 {	
   int i,j,k;
   double iInput,jInput;
@@ -2769,7 +2795,7 @@ void OvImageT<T> ::setToGaborY(int size, double sigma, double period, double pha
 * @see OvImageT<T>#setToRandom(double lowerbound, double upperbound)
 */
 
-inline const OvImageT<double> random(double lowerbound, double upperbound, int height, int width, int nColorChannels = 1)
+inline OvImageT<double> random(double lowerbound, double upperbound, int height, int width, int nColorChannels = 1)
 {
   OvImageT<double> result(height,width,nColorChannels);
   result.setToRandom(lowerbound, upperbound);
@@ -2796,7 +2822,7 @@ inline const OvImageT<double> random(double lowerbound, double upperbound, int h
 * @see OvImageT<T>#setToMeshgridX(T x1, T x2, T y1, T y2, T dx, T dy)
 * @see OvImageT<T>#setToMeshgridY(T x1, T x2, T y1, T y2, T dx, T dy)
 */
-inline const OvImageT<double> meshgridX (double x1, double x2, double y1, double y2, double dx = 1, double dy = 1)
+inline OvImageT<double> meshgridX (double x1, double x2, double y1, double y2, double dx = 1, double dy = 1)
 {
   OvImageT<double> result;
   result.setToMeshgridX(x1, x2, y1, y2, dx, dy);
@@ -2823,7 +2849,7 @@ inline const OvImageT<double> meshgridX (double x1, double x2, double y1, double
 * @see OvImageT<T>#setToMeshgridY(T x1, T x2, T y1, T y2, T dx, T dy)
 * @see OvImageT<T>#setToMeshgridX(T x1, T x2, T y1, T y2, T dx, T dy)
 */
-inline const OvImageT<double> meshgridY (double x1, double x2, double y1, double y2, double dx = 1, double dy = 1)
+inline OvImageT<double> meshgridY (double x1, double x2, double y1, double y2, double dx = 1, double dy = 1)
 {
   OvImageT<double> result;
   result.setToMeshgridY(x1, x2, y1, y2, dx, dy);
@@ -2845,7 +2871,7 @@ inline const OvImageT<double> meshgridY (double x1, double x2, double y1, double
 * @see OvImageT<T>#setToGaborX(int size, double sigma, double period, double phaseshift)
 * @see OvImageT<T>#setToGaborY(int size, double sigma, double period, double phaseshift)
 */
-inline const OvImageT<double> gaussian(int size, double sigma)
+inline OvImageT<double> gaussian(int size, double sigma)
 {
   OvImageT<double> result;
   result.setToGaussian(size, sigma);
@@ -2868,7 +2894,7 @@ inline const OvImageT<double> gaussian(int size, double sigma)
 * @see #gaussian(int size, double sigma)
 * @see OvImageT<T>#setToGaussian(int size, double sigma)
 */
-inline const OvImageT<double> gaborX(int size, double sigma, double period, double phaseshift)
+inline OvImageT<double> gaborX(int size, double sigma, double period, double phaseshift)
 {
   OvImageT<double> result;
   result.setToGaborX(size, sigma, period, phaseshift);
@@ -2892,7 +2918,7 @@ inline const OvImageT<double> gaborX(int size, double sigma, double period, doub
 * @see #gaussian(int size, double sigma)
 * @see OvImageT<T>#setToGaussian(int size, double sigma)
 */
-inline const OvImageT<double> gaborY(int size, double sigma, double period, double phaseshift)
+inline OvImageT<double> gaborY(int size, double sigma, double period, double phaseshift)
 {
   OvImageT<double> result;
   result.setToGaborY(size, sigma, period, phaseshift);
@@ -2968,7 +2994,7 @@ void OvImageT<T>::setToGaborOriented(int size, double sigma, double period, doub
 * @see OvImageT<T>#setToGaborX(int size, double sigma, double period, double phaseshift)
 * @see #gaborY(int size, double sigma, double period, double phaseshift)
 */
-inline const OvImageT<double> gaborOriented(int size, double sigma, double period, double angle, double phaseshift=0)
+inline OvImageT<double> gaborOriented(int size, double sigma, double period, double angle, double phaseshift=0)
 {
   OvImageT<double> result;
   result.setToGaborOriented(size, sigma, period, angle, phaseshift);
@@ -3051,10 +3077,6 @@ bool haveEqualHeightWidth(const OvImageT<T> & i1, const OvImageT<T> & i2)
 {
   return ((i1.mWidth==i2.mWidth)&&(i1.mHeight==i2.mHeight));
 }
-template<>
-const OvImageT<bool> OvImageT<bool>::operator ! () const;
-const OvImageT<bool> operator && (const OvImageT<bool> & i1, const OvImageT<bool> & i2);
-const OvImageT<bool> operator || (const OvImageT<bool> & i1, const OvImageT<bool> & i2);
 
 
 #endif //__OVIMAGET_H
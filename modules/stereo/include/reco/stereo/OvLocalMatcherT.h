@@ -37,13 +37,14 @@ public:
 
 	/**
 	* Used to retrieve results of matching the two images with a relative 2D translation. 
-	* Note: Values of the result are between 0 to 1 always.
+	* Note: Values of the result are between 0 to 1 always. The global matchers call this
+	* for several shifts at once from different threads, so it must not modify the matcher.
 	* @param shiftx horizontal relative shift
 	* @param shifty vertical relative shift
 	* @return resulting single channel image if sucessful (values between 0 (no match) and 1 (match)).
 	* @see getRawMatch(int shiftx, int shifty)
 	*/
-	virtual const OvImageT<double> getMatch(int shiftx, int shifty=0) = 0;
+	virtual OvImageT<double> getMatch(int shiftx, int shifty=0) = 0;
 
 	/**
 	* Used to retrieve raw results of matching the two images with a relative 2D translation. 
@@ -53,7 +54,35 @@ public:
 	* @return result image if sucessful, which has same number of channels as the input images.
 	* @see getMatch(int shiftx, int shifty)
 	*/
-	virtual const OvImageT<double> getRawMatch(int shiftx, int shifty=0) = 0;
+	virtual OvImageT<double> getRawMatch(int shiftx, int shifty=0) = 0;
+
+	/**
+	* Used to retrieve results of matching the two images with several relative 2D translations at once,
+	* as getMatch would return them. Matchers can override this to share work between the shifts
+	* (by default, getMatch is called for each one). Like getMatch, this may be called concurrently.
+	* @param count number of shifts
+	* @param shiftsx horizontal relative shifts, count values
+	* @param shiftsy vertical relative shifts, count values
+	* @param results resulting single channel images, count images (reused if they already have the right size)
+	* @see getMatch(int shiftx, int shifty)
+	*/
+	virtual void getMatches(int count, const int * shiftsx, const int * shiftsy, OvImageT<double> * results);
+
+	/**
+	* Used to retrieve results of matching the two images with several relative 2D translations at once,
+	* for a rectangular region of image 1 only (e.g., the pixels whose search range includes the shifts).
+	* By default, the full results of getMatches are cropped. Like getMatch, this may be called concurrently.
+	* @param count number of shifts
+	* @param shiftsx horizontal relative shifts, count values
+	* @param shiftsy vertical relative shifts, count values
+	* @param rowLo first row of the region
+	* @param rowHi last row of the region
+	* @param columnLo first column of the region
+	* @param columnHi last column of the region
+	* @param results resulting single channel images of the size of the region, count images (reused if they already have the right size)
+	* @see getMatches(int count, const int * shiftsx, const int * shiftsy, OvImageT<double> * results)
+	*/
+	virtual void getRegionMatches(int count, const int * shiftsx, const int * shiftsy, int rowLo, int rowHi, int columnLo, int columnHi, OvImageT<double> * results);
 };
 
 template<typename T>
@@ -66,4 +95,21 @@ OvLocalMatcherT<T>::~OvLocalMatcherT()
 {
 }
 
+template<typename T>
+void OvLocalMatcherT<T>::getMatches(int count, const int * shiftsx, const int * shiftsy, OvImageT<double> * results)
+{
+	for(int b=0; b<count; b++) results[b] = getMatch(shiftsx[b], shiftsy[b]);
+}
+
+template<typename T>
+void OvLocalMatcherT<T>::getRegionMatches(int count, const int * shiftsx, const int * shiftsy, int rowLo, int rowHi, int columnLo, int columnHi, OvImageT<double> * results)
+{
+	getMatches(count, shiftsx, shiftsy, results);
+	for(int b=0; b<count; b++)
+	{
+		if((rowLo==0)&&(columnLo==0)&&(rowHi==results[b].getHeight()-1)&&(columnHi==results[b].getWidth()-1)) continue;
+		results[b] = results[b].getSubImage(rowLo, rowHi, columnLo, columnHi);
+	}
+}
+
 #endif //__OVLOCALMATCHERT_H
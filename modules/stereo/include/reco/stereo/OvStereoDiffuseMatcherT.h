@@ -4,6 +4,10 @@
 #include "OvImageT.h"
 #include "OvStereoGlobalMatcherT.h"
 #include "OvLocalMatcherT.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
 
 ///Global stereo matching algorithm based on fast diffusion (see Ogale et al. ICRA April 05, IJCV July 06).
 /**
@@ -37,6 +41,23 @@ public:
   */
   virtual bool doMatching(OvImageT<T> & i1, OvImageT<T> & i2, double minshift, double maxshift, OvImageT<double> & leftDisparityMap, OvImageT<double> & rightDisparityMap, OvImageT<double> & leftOcclusions, OvImageT<double> & rightOcclusions);
 
+  /**
+  * Stereo matching with a separate disparity search range for every pixel of the left image.
+  * Each disparity is only matched over the region of the pixels that search it, and the other pixels
+  * of the region neither take it nor pass on support for it.
+  * Note: This method modifies the input images, so be careful.
+  * @param i1 the first image
+  * @param i2 the second image
+  * @param minshifts each pixel searches for disparities from its minshifts value to its maxshifts value (same height and width as i1)
+  * @param maxshifts each pixel searches for disparities from its minshifts value to its maxshifts value (same height and width as i1)
+  * @param leftDisparityMap the disparity map for the left image. (method sets this).
+  * @param rightDisparityMap the disparity map for the right image. (method sets this).
+  * @param leftOcclusions the occlusion map for the left image. (method sets this).
+  * @param rightOcclusions the occlusion map for the right image. (method sets this).
+  * @return true if successful.
+  */
+  virtual bool doMatchingInRanges(OvImageT<T> & i1, OvImageT<T> & i2, const OvImageT<double> & minshifts, const OvImageT<double> & maxshifts, OvImageT<double> & leftDisparityMap, OvImageT<double> & rightDisparityMap, OvImageT<double> & leftOcclusions, OvImageT<double> & rightOcclusions);
+
   /**
   * Used for specifying any parameters required.
   * @param nparams number of parameters which are being passed
@@ -57,6 +78,18 @@ protected:
   virtual void computeGoodnessHoriz (const OvImageT<double> & iMatch, const OvImageT<double> & iConductivity, OvImageT<double> & iGoodness);
   virtual void computeGoodnessVert  (const OvImageT<double> & iMatch, const OvImageT<double> & iConductivity, OvImageT<double> & iGoodness);
 
+  /**
+  * Finds the bounding box of the pixels that search each shift.
+  * @param firstShifts first shift searched by each pixel
+  * @param lastShifts last shift searched by each pixel
+  * @param firstShift lowest shift searched by any pixel
+  * @param shiftCount number of shifts from firstShift on
+  * @param rowLo first row of each shift (height if no pixel searches it)
+  * @param rowHi last row of each shift (-1 if no pixel searches it)
+  * @param columnLo first column of each shift
+  * @param columnHi last column of each shift
+  */
+  void computeShiftRegions(const OvImageT<int> & firstShifts, const OvImageT<int> & lastShifts, int firstShift, int shiftCount, std::vector<int> & rowLo, std::vector<int> & rowHi, std::vector<int> & columnLo, std::vector<int> & columnHi);
 };
 
 
@@ -72,47 +105,155 @@ OvStereoDiffuseMatcherT<T>::~OvStereoDiffuseMatcherT()
 
 template<typename T>
 bool OvStereoDiffuseMatcherT<T>::doMatching(OvImageT<T> & i1, OvImageT<T> & i2, double minshift, double maxshift, OvImageT<double> & leftDisparityMap, OvImageT<double> & rightDisparityMap, OvImageT<double> & leftOcclusions, OvImageT<double> & rightOcclusions)
+{
+  OvImageT<double> minshifts(i1.getHeight(), i1.getWidth(), 1), maxshifts(i1.getHeight(), i1.getWidth(), 1);
+  minshifts = minshift;
+  maxshifts = maxshift;
+  return doMatchingInRanges(i1, i2, minshifts, maxshifts, leftDisparityMap, rightDisparityMap, leftOcclusions, rightOcclusions);
+}
+
+template<typename T>
+bool OvStereoDiffuseMatcherT<T>::doMatchingInRanges(OvImageT<T> & i1, OvImageT<T> & i2, const OvImageT<double> & minshifts, const OvImageT<double> & maxshifts, OvImageT<double> & leftDisparityMap, OvImageT<double> & rightDisparityMap, OvImageT<double> & leftOcclusions, OvImageT<double> & rightOcclusions)
 {
   int height, width, channels;
-  int i,j,jproj;
+  int i,j,k,jproj;
 
-  OvImageT<double> iMatch, iGoodnessVert, iGoodnessHoriz, iGoodnessL, iGoodnessR, bestprobabL, bestprobabR, bestprobabRshifted;
-  OvImageT<bool> maskL, maskR;
+  OvImageT<double> bestprobabL, bestprobabR;
 
   i1.getDimensions(height,width,channels);
-  iMatch.resetDimensions(height,width);
-  iGoodnessHoriz.resetDimensions(height,width);
-  iGoodnessVert.resetDimensions(height,width);
-  iGoodnessL.resetDimensions(height,width);
-  iGoodnessR.resetDimensions(height,width);
+  if((minshifts.getHeight()!=height)||(minshifts.getWidth()!=width)) return false;
+  if((maxshifts.getHeight()!=height)||(maxshifts.getWidth()!=width)) return false;
   bestprobabL.resetDimensions(height,width);
   bestprobabR.resetDimensions(height,width);
-  bestprobabRshifted.resetDimensions(height,width);
 
   mLocalMatcher->setImagePair(i1, i2);
 
-  leftDisparityMap = minshift;
-  rightDisparityMap = -minshift;
+  for(k=0; k<leftDisparityMap.getNumChannels(); k++)
+    for(j=0; j<width; j++)
+      for(i=0; i<height; i++) leftDisparityMap(i,j,k) = minshifts(i,j);
+  for(k=0; k<rightDisparityMap.getNumChannels(); k++)
+    for(j=0; j<width; j++)
+      for(i=0; i<height; i++) rightDisparityMap(i,j,k) = -minshifts(i,j);
   leftOcclusions = 0;
   rightOcclusions = 0;
 
-  for(int shift=static_cast<int>(minshift); shift<=maxshift; shift++)
+  //integer shifts searched by each pixel: from its truncated minimum up to its maximum
+  OvImageT<int> firstShifts(height,width,1), lastShifts(height,width,1);
+  int firstShift = std::numeric_limits<int>::max(), lastShift = std::numeric_limits<int>::min();
+  for(j=0; j<width; j++)
+    for(i=0; i<height; i++)
+    {
+      firstShifts(i,j) = static_cast<int>(minshifts(i,j));
+      lastShifts(i,j) = static_cast<int>(floor(maxshifts(i,j)));
+      if(firstShifts(i,j)>lastShifts(i,j)) continue;
+      firstShift = std::min(firstShift, firstShifts(i,j));
+      lastShift = std::max(lastShift, lastShifts(i,j));
+    }
+
+  //shifts searched by at least one pixel, and the region of the pixels searching each
+  std::vector<int> shiftRowLo, shiftRowHi, shiftColumnLo, shiftColumnHi, shifts;
+  if(firstShift<=lastShift)
+  {
+    computeShiftRegions(firstShifts, lastShifts, firstShift, lastShift-firstShift+1, shiftRowLo, shiftRowHi, shiftColumnLo, shiftColumnHi);
+    for(int shift=firstShift; shift<=lastShift; shift++)
+      if(shiftRowLo[shift-firstShift]<=shiftRowHi[shift-firstShift]) shifts.push_back(shift);
+  }
+  int shiftCount = static_cast<int>(shifts.size());
+
+  //goodness of a batch of shifts, computed in parallel: each thread takes a block of consecutive shifts,
+  //which the local matcher can match together over the union of their regions
+  const int blockSize = 4;
+  int blockCount = std::max(1, std::min(ov_thread_count(), (shiftCount+blockSize-1)/blockSize));
+  int batchSize = blockCount*blockSize;
+  std::vector<OvImageT<double> > iGoodnessL(batchSize), iGoodnessHoriz(blockCount), iGoodnessVert(blockCount);
+  std::vector<int> shiftsX(batchSize), shiftsY(batchSize);
+  std::vector<int> blockRowLo(blockCount), blockRowHi(blockCount), blockColumnLo(blockCount), blockColumnHi(blockCount);
+
+  for(int batchStart=0; batchStart<shiftCount; batchStart+=batchSize)
   {
-    iMatch = mLocalMatcher->getMatch(shift,0);
-    computeGoodnessHoriz(iMatch, iMatch, iGoodnessHoriz);
-    computeGoodnessVert(iMatch, iMatch, iGoodnessVert);
+    int batchCount = std::min(batchSize, shiftCount-batchStart);
+    for(int b=0; b<batchCount; b++)
+    {
+      shiftsX[b] = shifts[batchStart+b];
+      shiftsY[b] = 0;
+    }
+    for(int block=0; block<blockCount; block++)
+    {
+      blockRowLo[block] = height; blockRowHi[block] = -1;
+      blockColumnLo[block] = width; blockColumnHi[block] = -1;
+      for(int b=block*blockSize; b<std::min((block+1)*blockSize, batchCount); b++)
+      {
+        int index = shiftsX[b]-firstShift;
+        blockRowLo[block] = std::min(blockRowLo[block], shiftRowLo[index]);
+        blockRowHi[block] = std::max(blockRowHi[block], shiftRowHi[index]);
+        blockColumnLo[block] = std::min(blockColumnLo[block], shiftColumnLo[index]);
+        blockColumnHi[block] = std::max(blockColumnHi[block], shiftColumnHi[index]);
+      }
+    }
 
-    iGoodnessL = iGoodnessHoriz*iGoodnessVert;
-    iGoodnessR = shiftImageXY(iGoodnessL, shift, 0);
+#pragma omp parallel for schedule(dynamic,1)
+    for(int block=0; block<blockCount; block++)
+    {
+      int first = block*blockSize;
+      int count = std::min(blockSize, batchCount-first);
+      if(count<=0) continue;
 
-    bestprobabRshifted = shiftImageXY(bestprobabR, -shift, 0);
-    maskL = (iGoodnessL>bestprobabL) && (iGoodnessL>bestprobabRshifted);
-    maskR = shiftImageXY(maskL, shift, 0);
+      int rowLo = blockRowLo[block], columnLo = blockColumnLo[block];
+      int regionHeight = blockRowHi[block]-rowLo+1, regionWidth = blockColumnHi[block]-columnLo+1;
+      if((iGoodnessHoriz[block].getHeight()!=regionHeight)||(iGoodnessHoriz[block].getWidth()!=regionWidth))
+      {
+        iGoodnessHoriz[block].resetDimensions(regionHeight,regionWidth);
+        iGoodnessVert[block].resetDimensions(regionHeight,regionWidth);
+      }
 
-    leftDisparityMap.copyMasked(maskL,shift);
-    bestprobabL.copyMasked(maskL, iGoodnessL);
-    rightDisparityMap.copyMasked(maskR,-shift);
-    bestprobabR.copyMasked(maskR, iGoodnessR);
+      //the match images are replaced by the goodness once diffused
+      mLocalMatcher->getRegionMatches(count, &shiftsX[first], &shiftsY[first], rowLo, blockRowHi[block], columnLo, blockColumnHi[block], &iGoodnessL[first]);
+      for(int b=first; b<first+count; b++)
+      {
+        //pixels that do not search the shift neither match nor conduct
+        OvImageT<double> & iMatch = iGoodnessL[b];
+        for(int column=0; column<regionWidth; column++)
+          for(int row=0; row<regionHeight; row++)
+          {
+            if((shiftsX[b]<firstShifts(row+rowLo,column+columnLo))||(shiftsX[b]>lastShifts(row+rowLo,column+columnLo))) iMatch(row,column) = 0;
+          }
+
+        computeGoodnessHoriz(iMatch, iMatch, iGoodnessHoriz[block]);
+        computeGoodnessVert(iMatch, iMatch, iGoodnessVert[block]);
+        iMatch = iGoodnessHoriz[block]*iGoodnessVert[block];
+      }
+    }
+
+    //winner-take-all, shift by shift in increasing order: a pixel takes a shift if its goodness beats both its own best
+    //so far and the best so far of the right pixel it maps to (earlier shifts win ties). Pixels only compete within
+    //their row, so rows are updated in parallel with the same result as a serial run.
+#pragma omp parallel for schedule(static)
+    for(int row=0; row<height; row++)
+    {
+      for(int b=0; b<batchCount; b++)
+      {
+        int block = b/blockSize;
+        if((row<blockRowLo[block])||(row>blockRowHi[block])) continue;
+        int shift = shiftsX[b];
+        const OvImageT<double> & iGoodness = iGoodnessL[b];
+        for(int column=blockColumnLo[block]; column<=blockColumnHi[block]; column++)
+        {
+          int columnR = column + shift; //matching pixel in the right image
+          bool insideR = (columnR>=0) && (columnR<width);
+          double goodness = iGoodness(row-blockRowLo[block],column-blockColumnLo[block]);
+          if((goodness>bestprobabL(row,column)) && (goodness>(insideR ? bestprobabR(row,columnR) : 0.0)))
+          {
+            leftDisparityMap(row,column) = shift;
+            bestprobabL(row,column) = goodness;
+            if(insideR)
+            {
+              rightDisparityMap(row,columnR) = -shift;
+              bestprobabR(row,columnR) = goodness;
+            }
+          }
+        }
+      }
+    }
   }
 
   leftDisparityMap  = medianFilter2D(leftDisparityMap,3,3);
@@ -228,4 +369,57 @@ void OvStereoDiffuseMatcherT<T>::computeGoodnessVert(const OvImageT<double> & iM
   }
 }
 
+template<typename T>
+void OvStereoDiffuseMatcherT<T>::computeShiftRegions(const OvImageT<int> & firstShifts, const OvImageT<int> & lastShifts, int firstShift, int shiftCount, std::vector<int> & rowLo, std::vector<int> & rowHi, std::vector<int> & columnLo, std::vector<int> & columnHi)
+{
+  int i, j, shift, running, height, width, channels;
+  std::vector<int> coverage(shiftCount+1);
+
+  firstShifts.getDimensions(height, width, channels);
+  rowLo.assign(shiftCount, height);
+  rowHi.assign(shiftCount, -1);
+  columnLo.assign(shiftCount, width);
+  columnHi.assign(shiftCount, -1);
+
+  //the shifts searched in a row are the union of the ranges of its pixels: mark where each range starts and ends
+  for(i=0;i<height;i++)
+  {
+    std::fill(coverage.begin(), coverage.end(), 0);
+    for(j=0;j<width;j++)
+    {
+      if(firstShifts(i,j)>lastShifts(i,j)) continue;
+      coverage[firstShifts(i,j)-firstShift]++;
+      coverage[lastShifts(i,j)-firstShift+1]--;
+    }
+    running = 0;
+    for(shift=0;shift<shiftCount;shift++)
+    {
+      running += coverage[shift];
+      if(running==0) continue;
+      if(rowLo[shift]==height) rowLo[shift] = i;
+      rowHi[shift] = i;
+    }
+  }
+
+  //same for columns
+  for(j=0;j<width;j++)
+  {
+    std::fill(coverage.begin(), coverage.end(), 0);
+    for(i=0;i<height;i++)
+    {
+      if(firstShifts(i,j)>lastShifts(i,j)) continue;
+      coverage[firstShifts(i,j)-firstShift]++;
+      coverage[lastShifts(i,j)-firstShift+1]--;
+    }
+    running = 0;
+    for(shift=0;shift<shiftCount;shift++)
+    {
+      running += coverage[shift];
+      if(running==0) continue;
+      if(columnLo[shift]==width) columnLo[shift] = j;
+      columnHi[shift] = j;
+    }
+  }
+}
+
 #endif //__OVSTEREODIFFUSEMATCHERT_H
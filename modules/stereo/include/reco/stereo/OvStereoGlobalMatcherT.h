@@ -35,6 +35,23 @@ public:
   */
   virtual bool doMatching(OvImageT<T> & i1, OvImageT<T> & i2, double minshift, double maxshift, OvImageT<double> & leftDisparityMap, OvImageT<double> & rightDisparityMap, OvImageT<double> & leftOcclusions, OvImageT<double> & rightOcclusions) = 0;
 
+  /**
+  * Stereo matching with a separate disparity search range for every pixel of the left image, 
+  * e.g., a band around an estimate found at a coarser resolution.
+  * By default, doMatching searches the union of the ranges.
+  * Note: This method modifies the input images, so be careful.
+  * @param i1 the first image
+  * @param i2 the second image
+  * @param minshifts each pixel searches for disparities from its minshifts value to its maxshifts value (same height and width as i1)
+  * @param maxshifts each pixel searches for disparities from its minshifts value to its maxshifts value (same height and width as i1)
+  * @param leftDisparityMap the disparity map for the left image. (method sets this).
+  * @param rightDisparityMap the disparity map for the right image. (method sets this).
+  * @param leftOcclusions the occlusion map for the left image. (method sets this).
+  * @param rightOcclusions the occlusion map for the right image. (method sets this).	
+  * @return true if successful.
+  */
+  virtual bool doMatchingInRanges(OvImageT<T> & i1, OvImageT<T> & i2, const OvImageT<double> & minshifts, const OvImageT<double> & maxshifts, OvImageT<double> & leftDisparityMap, OvImageT<double> & rightDisparityMap, OvImageT<double> & leftOcclusions, OvImageT<double> & rightOcclusions);
+
   /**
   * Used for specifying any parameters required.
   * @param nparams number of parameters which are being passed
@@ -60,4 +77,25 @@ OvStereoGlobalMatcherT<T>::~OvStereoGlobalMatcherT()
 {
 }
 
+template<typename T>
+bool OvStereoGlobalMatcherT<T>::doMatchingInRanges(OvImageT<T> & i1, OvImageT<T> & i2, const OvImageT<double> & minshifts, const OvImageT<double> & maxshifts, OvImageT<double> & leftDisparityMap, OvImageT<double> & rightDisparityMap, OvImageT<double> & leftOcclusions, OvImageT<double> & rightOcclusions)
+{
+  int i, j, height, width, channels;
+  double minshift, maxshift;
+
+  minshifts.getDimensions(height, width, channels);
+  if(height*width==0) return false;
+
+  minshift = minshifts(0,0);
+  maxshift = maxshifts(0,0);
+  for(j=0;j<width;j++)
+    for(i=0;i<height;i++)
+    {
+      if(minshifts(i,j)<minshift) minshift = minshifts(i,j);
+      if(maxshifts(i,j)>maxshift) maxshift = maxshifts(i,j);
+    }
+
+  return doMatching(i1, i2, minshift, maxshift, leftDisparityMap, rightDisparityMap, leftOcclusions, rightOcclusions);
+}
+
 #endif //__OVSTEREOGLOBALMATCHERT_H
@@ -7,6 +7,10 @@
 #include "OvLocalMatcherT.h"
 #include "OvStereoGlobalMatcherT.h"
 #include "OvDisparityPostprocessor.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
 
 
 ///Class for managing the execution of a stereo algorithm.
@@ -83,6 +87,15 @@ public:
   */
   virtual void setDisparityPostprocessorParams(int nparams, double*params);
 
+  /**
+  * Enables coarse-to-fine matching: disparities are first found on downsampled images, and each finer
+  * level only searches a band around the estimate of the coarser one (using the per-pixel ranges of
+  * the global stereo matcher, see OvStereoGlobalMatcherT::doMatchingInRanges).
+  * @param nLevels number of pyramid levels, including the original images (1, the default, disables the pyramid)
+  * @param searchRadius the band extends this many pixels of the finer level beyond the coarser disparities of the pixel and its neighbors
+  */
+  virtual void setPyramidParams(int nLevels, double searchRadius = 2);
+
   /**
   * Main method for executing stereo matching on an image pair.
   * Note: This method modifies the input images, so be careful.
@@ -105,6 +118,13 @@ protected:
   OvLocalMatcherT<T>				*mLocalImageMatcher;		/**< Local image pair matcher */
   OvStereoGlobalMatcherT<T>		*mStereoGlobalMatcher;		/**< Global stereo algorithm */
   OvDisparityPostprocessor		*mDisparityPostprocessor;	/**< Disparity map post processor */
+  int								mPyramidLevels;				/**< Number of coarse-to-fine levels */
+  double							mPyramidSearchRadius;		/**< Search band radius around coarser estimates */
+
+  /**
+  * Coarse-to-fine stereo matching with the global stereo matcher, see setPyramidParams.
+  */
+  virtual bool doPyramidMatching(OvImageT<T> & i1, OvImageT<T> & i2, double minshift, double maxshift, OvImageT<double> & leftDisparityMap, OvImageT<double> & rightDisparityMap, OvImageT<double> & leftOcclusions, OvImageT<double> & rightOcclusions);
 
   // The flags below are for marking whether the above variables are internally allocated.
   // In case they are, we are responsible for releasing them at destruction. 
@@ -117,7 +137,7 @@ protected:
 
 template<typename T>
 OvStereoT<T>::OvStereoT()
-: mImagePairPreprocessor(0), mLocalImageMatcher(0), mStereoGlobalMatcher(0), mDisparityPostprocessor(0), 
+: mImagePairPreprocessor(0), mLocalImageMatcher(0), mStereoGlobalMatcher(0), mDisparityPostprocessor(0), mPyramidLevels(1), mPyramidSearchRadius(2),
 isImagePairPreprocessorInternallyAllocated(false), isLocalImageMatcherInternallyAllocated(false), isStereoGlobalMatcherInternallyAllocated(false), isDisparityPostprocessorInternallyAllocated(false)
 {
 }
@@ -179,6 +199,13 @@ void OvStereoT<T>::setDisparityPostprocessorParams(int nparams, double*params)
   if(mDisparityPostprocessor)mDisparityPostprocessor->setParams(nparams, params);
 }
 
+template<typename T>
+void OvStereoT<T>::setPyramidParams(int nLevels, double searchRadius)
+{
+  mPyramidLevels = std::max(nLevels, 1);
+  mPyramidSearchRadius = std::max(searchRadius, 0.0);
+}
+
 template<typename T>
 bool OvStereoT<T>::doStereoMatching(const OvImageAdapter & i1, const OvImageAdapter & i2, double minshift, double maxshift, OvImageAdapter & leftDisparityMap, OvImageAdapter & rightDisparityMap, OvImageAdapter & leftOcclusions, OvImageAdapter & rightOcclusions)
 {
@@ -187,10 +214,11 @@ bool OvStereoT<T>::doStereoMatching(const OvImageAdapter & i1, const OvImageAdap
 
   mImage1.copyFromAdapter(i1);
   mImage2.copyFromAdapter(i2);
-  mLeftDisparityMap.copyFromAdapter(leftDisparityMap);
-  mRightDisparityMap.copyFromAdapter(rightDisparityMap);
-  mLeftOcclusions.copyFromAdapter(leftOcclusions);
-  mRightOcclusions.copyFromAdapter(rightOcclusions);
+  //the outputs are only sized here: the global matcher sets all their values
+  mLeftDisparityMap.copyFromAdapter(leftDisparityMap, false);
+  mRightDisparityMap.copyFromAdapter(rightDisparityMap, false);
+  mLeftOcclusions.copyFromAdapter(leftOcclusions, false);
+  mRightOcclusions.copyFromAdapter(rightOcclusions, false);
 
   if(!haveEqualDimensions(mImage1, mImage2)) return false; //return if images have different dimensions	
 
@@ -210,7 +238,8 @@ bool OvStereoT<T>::doStereoMatching(const OvImageAdapter & i1, const OvImageAdap
   mStereoGlobalMatcher->setLocalImageMatcher(*mLocalImageMatcher); //tell global matcher about local matcher
 
   if(mImagePairPreprocessor)mImagePairPreprocessor->preProcessImagePair(mImage1, mImage2);
-  mStereoGlobalMatcher->doMatching(mImage1, mImage2, minshift, maxshift, mLeftDisparityMap, mRightDisparityMap, mLeftOcclusions, mRightOcclusions);
+  if(mPyramidLevels>1) doPyramidMatching(mImage1, mImage2, minshift, maxshift, mLeftDisparityMap, mRightDisparityMap, mLeftOcclusions, mRightOcclusions);
+  else mStereoGlobalMatcher->doMatching(mImage1, mImage2, minshift, maxshift, mLeftDisparityMap, mRightDisparityMap, mLeftOcclusions, mRightOcclusions);
   if(mDisparityPostprocessor)mDisparityPostprocessor->postProcessDisparity(mLeftDisparityMap, mRightDisparityMap, mLeftOcclusions, mRightOcclusions);
 
   mLeftDisparityMap.copyToAdapter(leftDisparityMap);
@@ -221,4 +250,99 @@ bool OvStereoT<T>::doStereoMatching(const OvImageAdapter & i1, const OvImageAdap
   return true;
 }
 
+template<typename T>
+bool OvStereoT<T>::doPyramidMatching(OvImageT<T> & i1, OvImageT<T> & i2, double minshift, double maxshift, OvImageT<double> & leftDisparityMap, OvImageT<double> & rightDisparityMap, OvImageT<double> & leftOcclusions, OvImageT<double> & rightOcclusions)
+{
+  const int minimumSize = 16; //levels are not made smaller than this many pixels across
+  int i, j, level, height, width;
+  double scale, levelMinshift, levelMaxshift;
+
+  //levels 1 and up of the image pyramid
+  std::vector<OvImageT<T> > pyramid1, pyramid2;
+  pyramid1.reserve(mPyramidLevels);
+  pyramid2.reserve(mPyramidLevels);
+  const OvImageT<T> * coarsest1 = &i1, * coarsest2 = &i2;
+  while((static_cast<int>(pyramid1.size())+1<mPyramidLevels)&&(std::min(coarsest1->getHeight(), coarsest1->getWidth())>=2*minimumSize))
+  {
+    pyramid1.push_back(downsample2D(*coarsest1));
+    pyramid2.push_back(downsample2D(*coarsest2));
+    coarsest1 = &pyramid1.back();
+    coarsest2 = &pyramid2.back();
+  }
+
+  level = static_cast<int>(pyramid1.size());
+  if(level==0) return mStereoGlobalMatcher->doMatching(i1, i2, minshift, maxshift, leftDisparityMap, rightDisparityMap, leftOcclusions, rightOcclusions);
+
+  //full search at the coarsest level
+  OvImageT<double> left, right, leftOccluded, rightOccluded;
+  height = pyramid1[level-1].getHeight();
+  width = pyramid1[level-1].getWidth();
+  left.resetDimensions(height,width);
+  right.resetDimensions(height,width);
+  leftOccluded.resetDimensions(height,width);
+  rightOccluded.resetDimensions(height,width);
+  scale = ldexp(1.0, level);
+  if(!mStereoGlobalMatcher->doMatching(pyramid1[level-1], pyramid2[level-1], floor(minshift/scale), ceil(maxshift/scale), left, right, leftOccluded, rightOccluded)) return false;
+
+  //finer levels only search around the coarser estimate
+  for(level=level-1; level>=0; level--)
+  {
+    OvImageT<T> & image1 = (level==0) ? i1 : pyramid1[level-1];
+    OvImageT<T> & image2 = (level==0) ? i2 : pyramid2[level-1];
+    height = image1.getHeight();
+    width = image1.getWidth();
+    scale = ldexp(1.0, level);
+    levelMinshift = (level==0) ? minshift : floor(minshift/scale);
+    levelMaxshift = (level==0) ? maxshift : ceil(maxshift/scale);
+
+    //occluded pixels have no estimate of their own: they take the median of the estimated pixels around them,
+    //growing inwards from the visible ones for a few passes (pixels still left search the full range)
+    const int fillPasses = 8;
+    OvImageT<double> estimated = (leftOccluded==0.0);
+    int unestimated = 0;
+    for(j=0; j<left.getWidth(); j++)
+      for(i=0; i<left.getHeight(); i++)
+      {
+        if(estimated(i,j)!=0) continue;
+        left(i,j) = std::numeric_limits<double>::quiet_NaN();
+        unestimated++;
+      }
+    for(int pass=0; (pass<fillPasses)&&(unestimated>0); pass++)
+    {
+      OvImageT<double> reached = maxFilter2D(estimated,3,3);
+      OvImageT<double> medianLeft = medianFilter2D(left,3,3);
+      for(j=0; j<left.getWidth(); j++)
+        for(i=0; i<left.getHeight(); i++)
+        {
+          if((estimated(i,j)!=0)||(reached(i,j)==0)) continue;
+          left(i,j) = medianLeft(i,j);
+          unestimated--;
+        }
+      estimated = reached;
+    }
+    estimated = upsample2D(estimated, height, width);
+
+    //the band covers the coarser disparities of the neighbors as well, so that pixels near depth edges can take either side
+    OvImageT<double> minshifts = upsample2D(minFilter2D(left,3,3), height, width)*2.0 - mPyramidSearchRadius;
+    OvImageT<double> maxshifts = upsample2D(maxFilter2D(left,3,3), height, width)*2.0 + mPyramidSearchRadius;
+    for(j=0; j<width; j++)
+      for(i=0; i<height; i++)
+      {
+        bool hasEstimate = (estimated(i,j)!=0);
+        minshifts(i,j) = hasEstimate ? std::min(std::max(minshifts(i,j), levelMinshift), levelMaxshift) : levelMinshift;
+        maxshifts(i,j) = hasEstimate ? std::min(std::max(maxshifts(i,j), levelMinshift), levelMaxshift) : levelMaxshift;
+      }
+
+    if(level==0) return mStereoGlobalMatcher->doMatchingInRanges(i1, i2, minshifts, maxshifts, leftDisparityMap, rightDisparityMap, leftOcclusions, rightOcclusions);
+
+    left.resetDimensions(height,width);
+    right.resetDimensions(height,width);
+    leftOccluded.resetDimensions(height,width);
+    rightOccluded.resetDimensions(height,width);
+    if(!mStereoGlobalMatcher->doMatchingInRanges(image1, image2, minshifts, maxshifts, left, right, leftOccluded, rightOccluded)) return false;
+  }
+
+  return true;
+}
+
 #endif //__OVSTEREOT_H
@@ -100,6 +100,25 @@ void LegacyOpenCVImageAdapter::setPixel(double value, int row, int column, int c
   (this->*setPixelfptr)(value, row, column, channel);
 }
 
+/**
+* Gives direct access to the pixel buffer of the IplImage (interleaved channels, rows widthStep bytes apart).
+* @param data start of the pixel buffer
+* @param rowStep distance between rows in bytes
+* @param columnStep distance between columns in bytes
+* @param channelStep distance between color channels in bytes
+* @return true unless the IplImage pointer is null or the data type unknown
+*/
+bool LegacyOpenCVImageAdapter::getDataLayout(unsigned char *& data, long & rowStep, long & columnStep, long & channelStep) const
+{
+  if((mIplImage==0)||(mDataType==OV_DATA_UNKNOWN)) return false;
+
+  data = (unsigned char *) mIplImage->imageData;
+  rowStep = mIplImage->widthStep;
+  channelStep = (mIplImage->depth & 255)/8;
+  columnStep = channelStep*mChannels;
+  return true;
+}
+
 /**
 * Internal template function to handle any image datatype. Returns a pixel value at a particular row, column and color channel.
 * @param row row of the image
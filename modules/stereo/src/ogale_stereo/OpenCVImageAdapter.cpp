@@ -99,6 +99,26 @@ void OpenCVImageAdapter::setPixel(double value, int row, int column, int channel
 	(this->*setPixelfptr)(value, row, column, channel);
 }
 
+/**
+ * Gives direct access to the pixel buffer of the matrix (interleaved channels, rows mat.step bytes apart).
+ * @param data start of the pixel buffer
+ * @param rowStep distance between rows in bytes
+ * @param columnStep distance between columns in bytes
+ * @param channelStep distance between color channels in bytes
+ * @return true unless the matrix is empty or of unknown data type
+ */
+bool OpenCVImageAdapter::getDataLayout(unsigned char *& data, long & rowStep, long & columnStep, long & channelStep) const
+		{
+	if (mat.empty() || (mDataType == OV_DATA_UNKNOWN))
+		return false;
+
+	data = mat.data;
+	rowStep = (long) mat.step[0];
+	columnStep = (long) mat.elemSize();
+	channelStep = (long) mat.elemSize1();
+	return true;
+}
+
 /**
  * Internal template function to handle any image datatype. Returns a pixel value at a particular row, column and color channel.
  * @param row row of the image
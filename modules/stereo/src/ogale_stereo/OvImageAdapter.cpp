@@ -21,3 +21,8 @@ void OvImageAdapter::getDataType(OvImageAdapter::OvDataType & dataType) const
   dataType = mDataType;
 }
 
+bool OvImageAdapter::getDataLayout(unsigned char *& data, long & rowStep, long & columnStep, long & channelStep) const
+{
+  return false;
+}
+
@@ -1,57 +0,0 @@
-/*
- * OvImageT.cpp
- *
- *  Created on: Nov 20, 2015
- *      Author: Gregory Kramida
- *   Copyright: 2015 Gregory Kramida
- *
- *   Licensed under the Apache License, Version 2.0 (the "License");
- *   you may not use this file except in compliance with the License.
- *   You may obtain a copy of the License at
- *
- *   http://www.apache.org/licenses/LICENSE-2.0
- *
- *   Unless required by applicable law or agreed to in writing, software
- *   distributed under the License is distributed on an "AS IS" BASIS,
- *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
- *   See the License for the specific language governing permissions and
- *   limitations under the License.
- */
-
-#include <reco/stereo/OvImageT.h>
-
-template<>
-const OvImageT<bool> OvImageT<bool>::operator ! () const
-{
-  OvImageT<bool> result(*this);
-
-  for(int i=0; i<result.mSize; i++)
-    result.mData[i] = !result.mData[i];
-
-  return (result);
-}
-
-const OvImageT<bool> operator && (const OvImageT<bool> & i1, const OvImageT<bool> & i2)
-{
-  OvImageT<bool> result(i1.mHeight,i1.mWidth,i1.mChannels);
-
-  if((i1.mHeight==i2.mHeight) && (i1.mWidth==i2.mWidth) && (i1.mChannels==i2.mChannels))
-  {
-    for(int i=0; i<result.mSize;i++) result.mData[i] = (i1.mData[i] && i2.mData[i]);
-  }
-
-  return result;
-}
-
-
-const OvImageT<bool> operator || (const OvImageT<bool> & i1, const OvImageT<bool> & i2)
-{
-  OvImageT<bool> result(i1.mHeight,i1.mWidth,i1.mChannels);
-
-  if((i1.mHeight==i2.mHeight) && (i1.mWidth==i2.mWidth) && (i1.mChannels==i2.mChannels))
-  {
-    for(int i=0; i<result.mSize;i++) result.mData[i] = (i1.mData[i] || i2.mData[i]);
-  }
-
-  return result;
-}
@@ -0,0 +1,86 @@
+/*
+ * depth_back_projector.h
+ *
+ *     Authors: Gregory Kramida
+ *     License: Apache v. 2
+ *   Copyright: (c) Gregory Kramida 2015
+ */
+
+#ifndef RECO_UTILS_DEPTH_BACK_PROJECTOR_H_
+#define RECO_UTILS_DEPTH_BACK_PROJECTOR_H_
+#pragma once
+
+//standard
+#include <vector>
+#include <cstddef>
+
+namespace reco {
+namespace utils {
+
+/**
+ * Converts depth images of a single (calibrated) depth camera into 3D points in world space.
+ *
+ * The rotated ray through each pixel, R * K^-1 * [col, row, 1]^T, is separable into a per-column and
+ * a per-row term, so both are tabulated once on construction (with the depth scale folded in). The
+ * per-pixel work then reduces to one add and one fused multiply-add per coordinate, which is done
+ * with AVX2 or SSE2 (picked at run time) over structure-of-arrays output buffers. Pixels with
+ * invalid depth (zero, negative or NaN) are skipped.
+ */
+class depth_back_projector {
+public:
+	/**
+	 * @param width depth image width
+	 * @param height depth image height
+	 * @param fx,fy,ox,oy depth camera intrinsics
+	 * @param rotation depth camera rotation, 3x3 row-major
+	 * @param translation depth camera translation, 3 elements
+	 * @param depth_scale factor to convert raw depth values to output units (default: mm to m)
+	 */
+	depth_back_projector(int width, int height, float fx, float fy, float ox, float oy,
+			const float* rotation, const float* translation, float depth_scale = 0.001F);
+	virtual ~depth_back_projector();
+
+	/**
+	 * Back-project the given rows of a depth image. Valid points are written contiguously
+	 * (compacted) into x, y, z, which must each have room for (row_end - row_start) * width floats.
+	 * @param depth pointer to the first element of the depth image
+	 * @param depth_stride distance between the starts of consecutive depth rows, in elements
+	 * @param row_start first row to process
+	 * @param row_end one past the last row to process
+	 * @return number of points written
+	 */
+	size_t back_project(const float* depth, size_t depth_stride, int row_start, int row_end,
+			float* x, float* y, float* z) const;
+
+	/**
+	 * Back-project the whole depth image, see above
+	 * @return number of points written
+	 */
+	size_t back_project(const float* depth, size_t depth_stride, float* x, float* y, float* z) const;
+
+	int get_width() const;
+	int get_height() const;
+
+	/**
+	 * @return name of the instruction set used by the kernel on this machine
+	 */
+	static const char* get_instruction_set();
+
+private:
+	int width;
+	int height;
+	//per-column ray terms (depth scale & first rotation column folded in)
+	std::vector<float> column_ray_x;
+	std::vector<float> column_ray_y;
+	std::vector<float> column_ray_z;
+	//per-row ray terms (depth scale & second, third rotation columns folded in)
+	std::vector<float> row_ray_x;
+	std::vector<float> row_ray_y;
+	std::vector<float> row_ray_z;
+	float translation[3];
+};
+
+} //end namespace utils
+} //end namespace reco
+
+#endif /* RECO_UTILS_DEPTH_BACK_PROJECTOR_H_ */
@@ -94,6 +94,7 @@ public:
 	}
 
 	size_t size(){
+		std::unique_lock<std::mutex> mlock(mutex);
 		return internal_queue.size();
 	}
 
@@ -0,0 +1,360 @@
+/*
+ * ring_buffer.h
+ *
+ *     Authors: Gregory Kramida
+ *     License: Apache v. 2
+ *   Copyright: (c) Gregory Kramida 2015
+ */
+
+#ifndef RECO_UTILS_RING_BUFFER_H_
+#define RECO_UTILS_RING_BUFFER_H_
+#pragma once
+
+//standard
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+//local
+#include <reco/utils/queue.h>
+
+namespace reco {
+namespace utils {
+
+/**
+ * What to do when an item is pushed onto a full bounded buffer
+ */
+enum class overflow_policy {
+	drop_oldest, //!< discard the item at the front of the buffer to make room
+	drop_newest, //!< discard the item being pushed
+	block        //!< wait until the consumer makes room
+};
+
+/**
+ * How to wait when popping from an empty (or pushing onto a full, blocking) buffer
+ */
+enum class wait_strategy {
+	park,          //!< go straight to sleeping on a condition variable
+	spin_then_park //!< spin and yield for a while, then sleep on a condition variable
+};
+
+/**
+ * A bounded, lock-free ring buffer implementing the queue interface.
+ *
+ * Based on the per-slot sequence number scheme (D. Vyukov), which lets the producer act as a
+ * consumer to implement the drop_oldest policy safely. When multi_producer is false, the push
+ * index is advanced without compare-and-swap, which makes the single-producer path cheaper.
+ * Indices are padded to separate cache lines to avoid false sharing between the producer(s) and
+ * the consumer(s). Locks are only ever touched when a thread actually has to go to sleep.
+ **/
+template<typename T, bool multi_producer = false>
+class bounded_ring_buffer:
+		public queue<T> {
+public:
+	bounded_ring_buffer(size_t capacity,
+			overflow_policy policy = overflow_policy::block,
+			wait_strategy waiting = wait_strategy::spin_then_park,
+			unsigned int spin_count = 1024);
+	virtual ~bounded_ring_buffer();
+
+	virtual void push_back(const T& item);
+	virtual T pop_front();
+	virtual void clear();
+
+	bool try_push_back(const T& item);
+	bool try_pop_front(T& item);
+
+	size_t size() const;
+	size_t capacity() const;
+	/**
+	 * @return total number of items discarded due to overflow since construction
+	 */
+	size_t dropped_count() const;
+
+private:
+	static const size_t cache_line_size = 64;
+
+	struct slot {
+		std::atomic<size_t> sequence;
+		T item;
+	};
+
+	template<typename C>
+	struct padded {
+		C value;
+		char padding[cache_line_size - sizeof(C) % cache_line_size];
+	};
+
+	char front_padding[cache_line_size];
+	padded<std::atomic<size_t>> push_pos;
+	padded<std::atomic<size_t>> pop_pos;
+	padded<std::atomic<size_t>> dropped;
+	//number of threads (about to be) asleep
+	padded<std::atomic<int>> parked_consumers;
+	padded<std::atomic<int>> parked_producers;
+
+	const size_t mask;
+	std::unique_ptr<slot[]> slots;
+	const overflow_policy policy;
+	const wait_strategy waiting;
+	const unsigned int spin_count;
+
+	std::mutex park_mutex;
+	std::condition_variable cv_not_empty;
+	std::condition_variable cv_not_full;
+
+	static size_t round_up_to_power_of_two(size_t value);
+	bool try_enqueue(const T& item);
+	bool try_dequeue(T& item);
+	void wake(std::atomic<int>& parked, std::condition_variable& cv);
+};
+
+/**
+ * Single-producer/single-consumer bounded lock-free queue
+ */
+template<typename T>
+using spsc_ring_buffer = bounded_ring_buffer<T, false>;
+
+/**
+ * Multi-producer/multi-consumer bounded lock-free queue
+ */
+template<typename T>
+using mpmc_ring_buffer = bounded_ring_buffer<T, true>;
+
+template<typename T, bool multi_producer>
+size_t bounded_ring_buffer<T, multi_producer>::round_up_to_power_of_two(size_t value) {
+	size_t result = 2;
+	while (result < value) {
+		result <<= 1;
+	}
+	return result;
+}
+
+template<typename T, bool multi_producer>
+bounded_ring_buffer<T, multi_producer>::bounded_ring_buffer(size_t capacity,
+		overflow_policy policy, wait_strategy waiting, unsigned int spin_count) :
+				mask(round_up_to_power_of_two(capacity) - 1),
+				slots(new slot[mask + 1]),
+				policy(policy),
+				waiting(waiting),
+				spin_count(spin_count) {
+	push_pos.value.store(0, std::memory_order_relaxed);
+	pop_pos.value.store(0, std::memory_order_relaxed);
+	dropped.value.store(0, std::memory_order_relaxed);
+	parked_consumers.value.store(0, std::memory_order_relaxed);
+	parked_producers.value.store(0, std::memory_order_relaxed);
+	for (size_t i_slot = 0; i_slot <= mask; i_slot++) {
+		slots[i_slot].sequence.store(i_slot, std::memory_order_relaxed);
+	}
+}
+
+template<typename T, bool multi_producer>
+bounded_ring_buffer<T, multi_producer>::~bounded_ring_buffer() {
+}
+
+/**
+ * Attempt to place the item into the next free slot
+ * @return false if the buffer is full
+ */
+template<typename T, bool multi_producer>
+bool bounded_ring_buffer<T, multi_producer>::try_enqueue(const T& item) {
+	size_t pos = push_pos.value.load(std::memory_order_relaxed);
+	slot* cell;
+	for (;;) {
+		cell = &slots[pos & mask];
+		size_t sequence = cell->sequence.load(std::memory_order_acquire);
+		intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+		if (diff == 0) {
+			if (!multi_producer) {
+				push_pos.value.store(pos + 1, std::memory_order_relaxed);
+				break;
+			} else if (push_pos.value.compare_exchange_weak(pos, pos + 1,
+					std::memory_order_relaxed)) {
+				break;
+			}
+		} else if (diff < 0) {
+			//full
+			return false;
+		} else {
+			pos = push_pos.value.load(std::memory_order_relaxed);
+		}
+	}
+	cell->item = item;
+	cell->sequence.store(pos + 1, std::memory_order_release);
+	return true;
+}
+
+/**
+ * Attempt to take the item out of the front slot
+ * @return false if the buffer is empty
+ */
+template<typename T, bool multi_producer>
+bool bounded_ring_buffer<T, multi_producer>::try_dequeue(T& item) {
+	//consumers always claim slots with compare-and-swap, since under drop_oldest
+	//the producer also consumes
+	size_t pos = pop_pos.value.load(std::memory_order_relaxed);
+	slot* cell;
+	for (;;) {
+		cell = &slots[pos & mask];
+		size_t sequence = cell->sequence.load(std::memory_order_acquire);
+		intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+		if (diff == 0) {
+			if (pop_pos.value.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				break;
+			}
+		} else if (diff < 0) {
+			//empty
+			return false;
+		} else {
+			pos = pop_pos.value.load(std::memory_order_relaxed);
+		}
+	}
+	item = std::move(cell->item);
+	//release whatever resources the item holds right away
+	cell->item = T();
+	cell->sequence.store(pos + mask + 1, std::memory_order_release);
+	return true;
+}
+
+/**
+ * Wake up threads parked on the given condition variable, if there are any
+ */
+template<typename T, bool multi_producer>
+void bounded_ring_buffer<T, multi_producer>::wake(std::atomic<int>& parked,
+		std::condition_variable& cv) {
+	//pairs with the increment of the parked counter before the final re-check in the waiting thread
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (parked.load(std::memory_order_relaxed) > 0) {
+		std::unique_lock<std::mutex> lock(park_mutex);
+		lock.unlock();
+		cv.notify_all();
+	}
+}
+
+/**
+ * Non-blocking push that ignores the overflow policy
+ * @return false if the buffer was full and the item was not pushed
+ */
+template<typename T, bool multi_producer>
+bool bounded_ring_buffer<T, multi_producer>::try_push_back(const T& item) {
+	if (try_enqueue(item)) {
+		wake(parked_consumers.value, cv_not_empty);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * Non-blocking pop
+ * @param item[out] the popped item, untouched if the buffer is empty
+ * @return false if the buffer was empty
+ */
+template<typename T, bool multi_producer>
+bool bounded_ring_buffer<T, multi_producer>::try_pop_front(T& item) {
+	if (try_dequeue(item)) {
+		if (policy == overflow_policy::block) {
+			wake(parked_producers.value, cv_not_full);
+		}
+		return true;
+	}
+	return false;
+}
+
+template<typename T, bool multi_producer>
+void bounded_ring_buffer<T, multi_producer>::push_back(const T& item) {
+	switch (policy) {
+	case overflow_policy::drop_newest:
+		if (!try_push_back(item)) {
+			dropped.value.fetch_add(1, std::memory_order_relaxed);
+		}
+		return;
+	case overflow_policy::drop_oldest: {
+		T discarded;
+		while (!try_push_back(item)) {
+			if (try_dequeue(discarded)) {
+				dropped.value.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+		return;
+	}
+	case overflow_policy::block:
+		break;
+	}
+	if (waiting == wait_strategy::spin_then_park) {
+		for (unsigned int i_spin = 0; i_spin < spin_count; i_spin++) {
+			if (try_push_back(item)) {
+				return;
+			}
+			std::this_thread::yield();
+		}
+	}
+	parked_producers.value.fetch_add(1, std::memory_order_seq_cst);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	{
+		std::unique_lock<std::mutex> lock(park_mutex);
+		cv_not_full.wait(lock, [&] {return try_enqueue(item);});
+	}
+	parked_producers.value.fetch_sub(1, std::memory_order_relaxed);
+	wake(parked_consumers.value, cv_not_empty);
+}
+
+template<typename T, bool multi_producer>
+T bounded_ring_buffer<T, multi_producer>::pop_front() {
+	T item;
+	if (waiting == wait_strategy::spin_then_park) {
+		for (unsigned int i_spin = 0; i_spin < spin_count; i_spin++) {
+			if (try_pop_front(item)) {
+				return item;
+			}
+			std::this_thread::yield();
+		}
+	}
+	parked_consumers.value.fetch_add(1, std::memory_order_seq_cst);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	{
+		std::unique_lock<std::mutex> lock(park_mutex);
+		cv_not_empty.wait(lock, [&] {return try_dequeue(item);});
+	}
+	parked_consumers.value.fetch_sub(1, std::memory_order_relaxed);
+	if (policy == overflow_policy::block) {
+		wake(parked_producers.value, cv_not_full);
+	}
+	return item;
+}
+
+template<typename T, bool multi_producer>
+void bounded_ring_buffer<T, multi_producer>::clear() {
+	T discarded;
+	while (try_dequeue(discarded)) {
+	}
+	wake(parked_producers.value, cv_not_full);
+}
+
+/**
+ * @return approximate number of items currently in the buffer
+ */
+template<typename T, bool multi_producer>
+size_t bounded_ring_buffer<T, multi_producer>::size() const {
+	size_t pushed = push_pos.value.load(std::memory_order_relaxed);
+	size_t popped = pop_pos.value.load(std::memory_order_relaxed);
+	return pushed > popped ? pushed - popped : 0;
+}
+
+template<typename T, bool multi_producer>
+size_t bounded_ring_buffer<T, multi_producer>::capacity() const {
+	return mask + 1;
+}
+
+template<typename T, bool multi_producer>
+size_t bounded_ring_buffer<T, multi_producer>::dropped_count() const {
+	return dropped.value.load(std::memory_order_relaxed);
+}
+
+} //end namespace utils
+} //end namespace reco
+
+#endif /* RECO_UTILS_RING_BUFFER_H_ */
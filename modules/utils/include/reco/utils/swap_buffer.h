@@ -16,6 +16,9 @@
 #include <atomic>
 #include <cstring>
 #include <iostream>
+#include <thread>
+#include <chrono>
+#include <algorithm>
 
 //local
 #include <reco/utils/queue.h>
@@ -28,8 +31,53 @@
 namespace reco {
 namespace utils {
 
+/**
+ * Escalating wait for lock-free retry loops: busy-spins first, then yields the time slice,
+ * then sleeps for increasingly long (capped) intervals.
+ **/
+class adaptive_backoff {
+public:
+	adaptive_backoff(unsigned int spin_limit = 128, unsigned int yield_limit = 64) :
+			spin_limit(spin_limit),
+					yield_limit(yield_limit),
+					iteration(0),
+					sleep_us(1) {
+	}
 
+	/**
+	 * Wait for a little while, the wait becomes longer (and less CPU-hungry) with each call
+	 */
+	void wait() {
+		if (iteration < spin_limit) {
+			iteration++;
+		} else if (iteration < spin_limit + yield_limit) {
+			iteration++;
+			std::this_thread::yield();
+		} else {
+			std::this_thread::sleep_for(std::chrono::microseconds(sleep_us));
+			sleep_us = std::min(sleep_us * 2, (unsigned int) max_sleep_us);
+		}
+	}
+
+	/**
+	 * @return true if spinning and yielding are exhausted, i.e. the caller should go to sleep
+	 */
+	bool exhausted() const {
+		return iteration >= spin_limit + yield_limit;
+	}
 
+	void reset() {
+		iteration = 0;
+		sleep_us = 1;
+	}
+
+private:
+	static const unsigned int max_sleep_us = 1000;
+	const unsigned int spin_limit;
+	const unsigned int yield_limit;
+	unsigned int iteration;
+	unsigned int sleep_us;
+};
 
 /**
  * A thread-safe 1-slot queue with pessimistic locking that uses assignment
@@ -159,7 +207,7 @@ template<typename T> T pessimistic_copy_swap_buffer<T>::pop_front() {
 	return ret;
 }
 /**
- * A thread-safe 1-slot queue with optimistic waiting.
+ * A thread-safe 1-slot queue with optimistic waiting (backs off adaptively instead of busy-spinning).
  **/
 template<typename T> class optimistic_assignment_swap_buffer:
 		public queue<T> {
@@ -194,22 +242,26 @@ template<typename T> void optimistic_assignment_swap_buffer<T>::clear(){
 }
 
 template<typename T> void optimistic_assignment_swap_buffer<T>::push_back(const T& item) {
-	bool exp;
+	bool exp = true;
+	adaptive_backoff backoff;
 	//wait for item to get popped
-	do {
+	while (!allow_push.compare_exchange_weak(exp, false)) { //cork up the bottle as soon as we get through
 		exp = true;
-	} while (!allow_push.compare_exchange_weak(exp, false)); //cork up the bottle as soon as we get through
+		backoff.wait();
+	}
 	this->storage[push_ix] = item;
 	SWAP_INT(push_ix);
 	allow_pop.store(true);
 }
 
 template<typename T> T optimistic_assignment_swap_buffer<T>::pop_front() {
-	bool exp;
+	bool exp = true;
+	adaptive_backoff backoff;
 	//wait for item to get pushed
-	do {
+	while (!allow_pop.compare_exchange_weak(exp, false)) { //cork up the bottle as soon as we get through
 		exp = true;
-	} while (!allow_pop.compare_exchange_weak(exp, false)); //cork up the bottle as soon as we get through
+		backoff.wait();
+	}
 	T ret = this->storage[pop_ix];
 	SWAP_INT(pop_ix);
 	allow_push.store(true);
@@ -232,7 +284,6 @@ public:
 private:
 	std::atomic_bool allow_pop;
 	std::atomic_bool allow_push;
-	std::atomic<T> storage_a;
 	T storage[1];
 };
 
@@ -252,27 +303,165 @@ template<typename T> void optimistic_copy_swap_buffer<T>::clear(){
 }
 
 template<typename T> void optimistic_copy_swap_buffer<T>::push_back(const T& item) {
-	bool exp;
+	bool exp = true;
+	adaptive_backoff backoff;
 	//wait for item to get popped
-	do {
+	while (!allow_push.compare_exchange_weak(exp, false)) { //cork up the bottle as soon as we get through
 		exp = true;
-	} while (!allow_push.compare_exchange_weak(exp, false)); //cork up the bottle as soon as we get through
+		backoff.wait();
+	}
 	memcpy(&storage[0], &item, sizeof(T));
 	allow_pop.store(true);
 }
 
 template<typename T> T optimistic_copy_swap_buffer<T>::pop_front() {
-	bool exp;
+	bool exp = true;
+	adaptive_backoff backoff;
 	//wait for item to get pushed
-	do {
+	while (!allow_pop.compare_exchange_weak(exp, false)) { //cork up the bottle as soon as we get through
 		exp = true;
-	} while (!allow_pop.compare_exchange_weak(exp, false)); //cork up the bottle as soon as we get through
+		backoff.wait();
+	}
 	T ret;
 	memcpy(&ret, &storage[0], sizeof(T));
 	allow_push.store(true);
 	return ret;
 }
 
+/**
+ * A thread-safe "latest item wins" triple buffer for a single producer & a single consumer.
+ *
+ * The producer never blocks: each push publishes the item, replacing the previously-published
+ * one if that has not been consumed yet (which is counted as a dropped item). The consumer always
+ * gets the newest complete item; it spins, then yields, then sleeps on a condition variable while
+ * waiting for one.
+ **/
+template<typename T> class triple_buffer:
+		public queue<T> {
+public:
+	triple_buffer();
+	virtual ~triple_buffer();
+	virtual void push_back(const T& item);
+	virtual T pop_front();
+	/**
+	 * Discard the pending item, if any. Should be called from the consumer side.
+	 */
+	virtual void clear();
+
+	/**
+	 * Non-blocking pop
+	 * @param item[out] the newest item, untouched if there is no new item since the last pop
+	 * @return false if there was no new item
+	 */
+	bool try_pop_front(T& item);
+
+	/**
+	 * @return total number of items pushed
+	 */
+	size_t pushed_count() const;
+	/**
+	 * @return total number of items overwritten before the consumer got to them
+	 */
+	size_t dropped_count() const;
+
+private:
+	static const unsigned int index_mask = 0x3;
+	static const unsigned int fresh_flag = 0x4;
+
+	T storage[3];
+	//index of the published slot & whether it holds a not-yet-consumed item
+	std::atomic<unsigned int> middle;
+	//indices of slots owned exclusively by producer & consumer, respectively
+	unsigned int back;
+	unsigned int front;
+
+	std::atomic<size_t> pushed;
+	std::atomic<size_t> dropped;
+
+	std::atomic<int> parked;
+	std::mutex park_mutex;
+	std::condition_variable cv_pop;
+
+	bool has_fresh() const;
+};
+
+template<typename T> triple_buffer<T>::triple_buffer() :
+		middle(0),
+				back(1),
+				front(2),
+				pushed(0),
+				dropped(0),
+				parked(0) {
+}
+
+template<typename T> triple_buffer<T>::~triple_buffer() {
+
+}
+
+template<typename T> bool triple_buffer<T>::has_fresh() const {
+	return (middle.load(std::memory_order_acquire) & fresh_flag) != 0;
+}
+
+template<typename T> void triple_buffer<T>::push_back(const T& item) {
+	storage[back] = item;
+	unsigned int previous = middle.exchange(back | fresh_flag, std::memory_order_acq_rel);
+	back = previous & index_mask;
+	pushed.fetch_add(1, std::memory_order_relaxed);
+	if (previous & fresh_flag) {
+		dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+	//pairs with the fence after incrementing the parked counter in pop_front
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (parked.load(std::memory_order_relaxed) > 0) {
+		std::unique_lock<std::mutex> lock(park_mutex);
+		lock.unlock();
+		cv_pop.notify_one();
+	}
+}
+
+template<typename T> bool triple_buffer<T>::try_pop_front(T& item) {
+	if (!has_fresh()) {
+		return false;
+	}
+	front = middle.exchange(front, std::memory_order_acq_rel) & index_mask;
+	item = storage[front];
+	return true;
+}
+
+template<typename T> T triple_buffer<T>::pop_front() {
+	T item{};
+	adaptive_backoff backoff;
+	while (!backoff.exhausted()) {
+		if (try_pop_front(item)) {
+			return item;
+		}
+		backoff.wait();
+	}
+	parked.fetch_add(1, std::memory_order_seq_cst);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	{
+		std::unique_lock<std::mutex> lock(park_mutex);
+		cv_pop.wait(lock, [&] {return has_fresh();});
+	}
+	parked.fetch_sub(1, std::memory_order_relaxed);
+	try_pop_front(item);
+	return item;
+}
+
+template<typename T> void triple_buffer<T>::clear() {
+	T discarded{};
+	try_pop_front(discarded);
+	storage[front] = T();
+}
+
+template<typename T> size_t triple_buffer<T>::pushed_count() const {
+	return pushed.load(std::memory_order_relaxed);
+}
+
+template<typename T> size_t triple_buffer<T>::dropped_count() const {
+	return dropped.load(std::memory_order_relaxed);
+}
+
 
 } // end namespace utils
 } // end namespace reco
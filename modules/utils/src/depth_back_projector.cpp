@@ -0,0 +1,263 @@
+/*
+ * depth_back_projector.cpp
+ *
+ *     Authors: Gregory Kramida
+ *     License: Apache v. 2
+ *   Copyright: (c) Gregory Kramida 2015
+ */
+
+#include <reco/utils/depth_back_projector.h>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define RECO_BACK_PROJECTOR_X86
+#include <immintrin.h>
+#endif
+
+namespace reco {
+namespace utils {
+
+namespace {
+
+/**
+ * Everything the kernels need to back-project a single depth row
+ */
+struct row_context {
+	const float* depth;
+	int width;
+	const float* column_ray_x;
+	const float* column_ray_y;
+	const float* column_ray_z;
+	float row_ray_x, row_ray_y, row_ray_z;
+	float tx, ty, tz;
+};
+
+typedef size_t (*row_kernel)(const row_context& ctx, float* x, float* y, float* z);
+
+/**
+ * Back-project depth row pixels starting at col_start, used by itself and for the vector kernel tails
+ */
+inline size_t back_project_span(const row_context& ctx, int col_start, float* x, float* y, float* z) {
+	size_t n_points = 0;
+	for (int col = col_start; col < ctx.width; col++) {
+		const float d = ctx.depth[col];
+		//also rejects NaN
+		if (!(d > 0.0F)) {
+			continue;
+		}
+		x[n_points] = d * (ctx.column_ray_x[col] + ctx.row_ray_x) + ctx.tx;
+		y[n_points] = d * (ctx.column_ray_y[col] + ctx.row_ray_y) + ctx.ty;
+		z[n_points] = d * (ctx.column_ray_z[col] + ctx.row_ray_z) + ctx.tz;
+		n_points++;
+	}
+	return n_points;
+}
+
+size_t back_project_row_scalar(const row_context& ctx, float* x, float* y, float* z) {
+	return back_project_span(ctx, 0, x, y, z);
+}
+
+#ifdef RECO_BACK_PROJECTOR_X86
+
+__attribute__((target("sse2")))
+size_t back_project_row_sse2(const row_context& ctx, float* x, float* y, float* z) {
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 row_x = _mm_set1_ps(ctx.row_ray_x);
+	const __m128 row_y = _mm_set1_ps(ctx.row_ray_y);
+	const __m128 row_z = _mm_set1_ps(ctx.row_ray_z);
+	const __m128 tx = _mm_set1_ps(ctx.tx);
+	const __m128 ty = _mm_set1_ps(ctx.ty);
+	const __m128 tz = _mm_set1_ps(ctx.tz);
+	float lanes_x[4], lanes_y[4], lanes_z[4];
+	size_t n_points = 0;
+	int col = 0;
+	for (; col + 4 <= ctx.width; col += 4) {
+		const __m128 d = _mm_loadu_ps(ctx.depth + col);
+		const int mask = _mm_movemask_ps(_mm_cmpgt_ps(d, zero));
+		if (mask == 0) {
+			continue;
+		}
+		const __m128 px = _mm_add_ps(
+				_mm_mul_ps(d, _mm_add_ps(_mm_loadu_ps(ctx.column_ray_x + col), row_x)), tx);
+		const __m128 py = _mm_add_ps(
+				_mm_mul_ps(d, _mm_add_ps(_mm_loadu_ps(ctx.column_ray_y + col), row_y)), ty);
+		const __m128 pz = _mm_add_ps(
+				_mm_mul_ps(d, _mm_add_ps(_mm_loadu_ps(ctx.column_ray_z + col), row_z)), tz);
+		if (mask == 0xF) {
+			_mm_storeu_ps(x + n_points, px);
+			_mm_storeu_ps(y + n_points, py);
+			_mm_storeu_ps(z + n_points, pz);
+			n_points += 4;
+		} else {
+			//compact the valid lanes
+			_mm_storeu_ps(lanes_x, px);
+			_mm_storeu_ps(lanes_y, py);
+			_mm_storeu_ps(lanes_z, pz);
+			for (int lane = 0; lane < 4; lane++) {
+				if (mask & (1 << lane)) {
+					x[n_points] = lanes_x[lane];
+					y[n_points] = lanes_y[lane];
+					z[n_points] = lanes_z[lane];
+					n_points++;
+				}
+			}
+		}
+	}
+	return n_points + back_project_span(ctx, col, x + n_points, y + n_points, z + n_points);
+}
+
+__attribute__((target("avx2,fma")))
+size_t back_project_row_avx2(const row_context& ctx, float* x, float* y, float* z) {
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 row_x = _mm256_set1_ps(ctx.row_ray_x);
+	const __m256 row_y = _mm256_set1_ps(ctx.row_ray_y);
+	const __m256 row_z = _mm256_set1_ps(ctx.row_ray_z);
+	const __m256 tx = _mm256_set1_ps(ctx.tx);
+	const __m256 ty = _mm256_set1_ps(ctx.ty);
+	const __m256 tz = _mm256_set1_ps(ctx.tz);
+	float lanes_x[8], lanes_y[8], lanes_z[8];
+	size_t n_points = 0;
+	int col = 0;
+	for (; col + 8 <= ctx.width; col += 8) {
+		const __m256 d = _mm256_loadu_ps(ctx.depth + col);
+		const int mask = _mm256_movemask_ps(_mm256_cmp_ps(d, zero, _CMP_GT_OQ));
+		if (mask == 0) {
+			continue;
+		}
+		const __m256 px = _mm256_fmadd_ps(d,
+				_mm256_add_ps(_mm256_loadu_ps(ctx.column_ray_x + col), row_x), tx);
+		const __m256 py = _mm256_fmadd_ps(d,
+				_mm256_add_ps(_mm256_loadu_ps(ctx.column_ray_y + col), row_y), ty);
+		const __m256 pz = _mm256_fmadd_ps(d,
+				_mm256_add_ps(_mm256_loadu_ps(ctx.column_ray_z + col), row_z), tz);
+		if (mask == 0xFF) {
+			_mm256_storeu_ps(x + n_points, px);
+			_mm256_storeu_ps(y + n_points, py);
+			_mm256_storeu_ps(z + n_points, pz);
+			n_points += 8;
+		} else {
+			//compact the valid lanes
+			_mm256_storeu_ps(lanes_x, px);
+			_mm256_storeu_ps(lanes_y, py);
+			_mm256_storeu_ps(lanes_z, pz);
+			for (int lane = 0; lane < 8; lane++) {
+				if (mask & (1 << lane)) {
+					x[n_points] = lanes_x[lane];
+					y[n_points] = lanes_y[lane];
+					z[n_points] = lanes_z[lane];
+					n_points++;
+				}
+			}
+		}
+	}
+	return n_points + back_project_span(ctx, col, x + n_points, y + n_points, z + n_points);
+}
+
+#endif
+
+/**
+ * Pick the widest kernel supported by the CPU (done once)
+ */
+struct kernel_selection {
+	row_kernel kernel;
+	const char* instruction_set;
+
+	kernel_selection() :
+			kernel(back_project_row_scalar),
+					instruction_set("scalar") {
+#ifdef RECO_BACK_PROJECTOR_X86
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+			kernel = back_project_row_avx2;
+			instruction_set = "AVX2";
+		} else if (__builtin_cpu_supports("sse2")) {
+			kernel = back_project_row_sse2;
+			instruction_set = "SSE2";
+		}
+#endif
+	}
+};
+
+const kernel_selection& get_kernel_selection() {
+	static kernel_selection selection;
+	return selection;
+}
+
+} //end anonymous namespace
+
+depth_back_projector::depth_back_projector(int width, int height, float fx, float fy, float ox,
+		float oy, const float* rotation, const float* translation, float depth_scale) :
+		width(width),
+				height(height),
+				column_ray_x(width),
+				column_ray_y(width),
+				column_ray_z(width),
+				row_ray_x(height),
+				row_ray_y(height),
+				row_ray_z(height) {
+	const float inv_fx = 1.0F / fx;
+	const float inv_fy = 1.0F / fy;
+	//R * [(col - ox)/fx, (row - oy)/fy, 1]^T = (col - ox)/fx * R_0 + ((row - oy)/fy * R_1 + R_2),
+	//where R_i are columns of R
+	for (int col = 0; col < width; col++) {
+		const float ray = (col - ox) * inv_fx * depth_scale;
+		column_ray_x[col] = ray * rotation[0];
+		column_ray_y[col] = ray * rotation[3];
+		column_ray_z[col] = ray * rotation[6];
+	}
+	for (int row = 0; row < height; row++) {
+		const float ray = (row - oy) * inv_fy;
+		row_ray_x[row] = (ray * rotation[1] + rotation[2]) * depth_scale;
+		row_ray_y[row] = (ray * rotation[4] + rotation[5]) * depth_scale;
+		row_ray_z[row] = (ray * rotation[7] + rotation[8]) * depth_scale;
+	}
+	this->translation[0] = translation[0];
+	this->translation[1] = translation[1];
+	this->translation[2] = translation[2];
+	//make sure the kernel is selected before any concurrent use
+	get_kernel_selection();
+}
+
+depth_back_projector::~depth_back_projector() {
+}
+
+size_t depth_back_projector::back_project(const float* depth, size_t depth_stride, int row_start,
+		int row_end, float* x, float* y, float* z) const {
+	const row_kernel kernel = get_kernel_selection().kernel;
+	row_context ctx;
+	ctx.width = width;
+	ctx.column_ray_x = column_ray_x.data();
+	ctx.column_ray_y = column_ray_y.data();
+	ctx.column_ray_z = column_ray_z.data();
+	ctx.tx = translation[0];
+	ctx.ty = translation[1];
+	ctx.tz = translation[2];
+	size_t n_points = 0;
+	for (int row = row_start; row < row_end; row++) {
+		ctx.depth = depth + row * depth_stride;
+		ctx.row_ray_x = row_ray_x[row];
+		ctx.row_ray_y = row_ray_y[row];
+		ctx.row_ray_z = row_ray_z[row];
+		n_points += kernel(ctx, x + n_points, y + n_points, z + n_points);
+	}
+	return n_points;
+}
+
+size_t depth_back_projector::back_project(const float* depth, size_t depth_stride, float* x,
+		float* y, float* z) const {
+	return back_project(depth, depth_stride, 0, height, x, y, z);
+}
+
+int depth_back_projector::get_width() const {
+	return width;
+}
+
+int depth_back_projector::get_height() const {
+	return height;
+}
+
+const char* depth_back_projector::get_instruction_set() {
+	return get_kernel_selection().instruction_set;
+}
+
+} //end namespace utils
+} //end namespace reco